@@ -1,23 +1,43 @@
 #include <charconv>
+#include <climits>
+#include <csignal>
+#include <sys/resource.h>
+#include <cstdlib>
 #include <iostream>
 #include <chrono>
 #include <cstring>
+#include <iomanip>
 #include <sstream>
 #include <vector>
 #include <string>
 
 #include "server/include/mplexserver.h"
+#include "srvMgr/include/Config.h"
 #include "srvMgr/include/SrvMgr.h"
 
 using namespace MPlexServer;
 
 //constexpr int   PORT = 6666;
 //constexpr auto SERVER_PASSWORD = "abc";
-constexpr auto SERVER_NAME = "irc.LeMaDa.hn";
+constexpr auto SERVER_NAME = "irc.LeMaDa.hn";     // IRC_SERVER_NAME overrides it, names must be unique per network
+
+// set by SIGUSR2: hand all connections over to a freshly started ircserv binary
+volatile sig_atomic_t upgrade_requested = 0;
+
+void request_upgrade(int) {
+    upgrade_requested = 1;
+}
+
+// set by SIGHUP: read the configuration file again and apply its live settings
+volatile sig_atomic_t reload_requested = 0;
+
+void request_reload(int) {
+    reload_requested = 1;
+}
 
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        std::cout << "command needs to be in this format:\n./ircserv <port> <password>\n";
+    if (argc != 3 && argc != 4) {
+        std::cout << "command needs to be in this format:\n./ircserv <port> <password> [config file]\n";
         return 1;
     }
     int PORT = -1;
@@ -28,15 +48,191 @@ int main(int argc, char* argv[]) {
     }
     std::string SERVER_PASSWORD = argv[2];
 
-    Server  srv(PORT);
+    // optional configuration file, validated before anything starts (see ircserv.conf.example)
+    const std::string   config_path = argc == 4 ? argv[3] : "";
+    Config              config;
+    if (!config_path.empty()) {
+        std::string error;
+        if (!config.load(config_path, error)) {
+            std::cerr << "[ERROR] " << error << std::endl;
+            return 1;
+        }
+    }
+
+    IrcServer   srv(PORT);
     //UserManager um(srv);
-    SrvMgr sm(srv, SERVER_PASSWORD, SERVER_NAME);
+    const char* server_name = getenv("IRC_SERVER_NAME");
+    SrvMgr sm(srv, SERVER_PASSWORD, !config.server_name.empty() ? config.server_name : server_name ? server_name : SERVER_NAME);
     srv.setEventHandler(&sm);
-    srv.setVerbose(2);  // 1: Reduce logging - only important messages 2: Debug info - verbose
+    // log level (1: only important messages, 2: every line), buffer sizes, flood control, timeouts, threads,
+    // latency profile
+    try {
+        config.apply(srv, sm);
+    } catch (std::exception &e) {
+        std::cerr << "[ERROR] " << e.what() << std::endl;
+        return 1;
+    }
     
+    // path of our own binary, re-executed on upgrade (picks up a freshly built ircserv)
+    char binary_path[PATH_MAX];
+    if (realpath(argv[0], binary_path) == nullptr) {
+        strcpy(binary_path, "/proc/self/exe");
+    }
+    signal(SIGUSR2, request_upgrade);
+    signal(SIGHUP, request_reload);
+
+    // every client is an fd: allow as many as the hard limit does
+    rlimit fd_limit{};
+    if (getrlimit(RLIMIT_NOFILE, &fd_limit) == 0 && fd_limit.rlim_cur < fd_limit.rlim_max) {
+        fd_limit.rlim_cur = fd_limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &fd_limit);
+    }
+
+    // channel settings survive crashes in <channel_log>.wal and .snap; refuses to share them with another server
+    if (!sm.enable_channel_log(config.channel_log)) {
+        std::cerr << "[ERROR] Cannot use channel log " << config.channel_log << ".wal" << std::endl;
+        return 1;
+    }
+
+    // optional channel history: IRC_HISTORY_LINES enables it, IRC_HISTORY_BYTES, IRC_HISTORY_AGE (seconds)
+    // and IRC_HISTORY_JOIN (lines replayed on join) refine it
+    if (getenv("IRC_HISTORY_LINES") != nullptr) {
+        HistoryLimits limits;
+        limits.lines = static_cast<size_t>(atol(getenv("IRC_HISTORY_LINES")));
+        if (getenv("IRC_HISTORY_BYTES")) limits.bytes = static_cast<size_t>(atol(getenv("IRC_HISTORY_BYTES")));
+        if (getenv("IRC_HISTORY_AGE")) limits.max_age_ms = static_cast<int64_t>(atol(getenv("IRC_HISTORY_AGE"))) * 1000;
+        if (getenv("IRC_HISTORY_JOIN")) limits.join_replay = static_cast<size_t>(atol(getenv("IRC_HISTORY_JOIN")));
+        sm.enable_history(limits);
+    }
+
+    // optional server links: IRC_LINK_PASSWORD accepts links, IRC_LINKS="ip:port,..." connects out
+    const char* link_password = getenv("IRC_LINK_PASSWORD");
+    if (link_password != nullptr) {
+        std::vector<LinkTarget> targets;
+        std::stringstream       links(getenv("IRC_LINKS") ? getenv("IRC_LINKS") : "");
+        std::string             link;
+        while (std::getline(links, link, ',')) {
+            const size_t colon = link.find(':');
+            if (colon == std::string::npos) {
+                std::cerr << "[ERROR] IRC_LINKS entries must look like <ipv4>:<port>" << std::endl;
+                return 1;
+            }
+            LinkTarget target;
+            target.ipv4 = link.substr(0, colon);
+            target.port = static_cast<uint16_t>(atoi(link.c_str() + colon + 1));
+            targets.push_back(target);
+        }
+        sm.enable_links(link_password, targets);
+    }
+
+    // optional ident lookup of new clients (RFC 1413): IRC_IDENT
+    if (getenv("IRC_IDENT") != nullptr) {
+        sm.enable_ident();
+    }
+
+    // optional reverse DNS of new clients: IRC_RESOLVE, asking IRC_DNS_SERVER (<ipv4>[:port])
+    // or the first nameserver in /etc/resolv.conf
+    if (getenv("IRC_RESOLVE") != nullptr) {
+        sockaddr_in nameserver{};
+        const char* dns_server = getenv("IRC_DNS_SERVER");
+        if (!(dns_server ? Resolver::parse_address(dns_server, nameserver) : Resolver::system_nameserver(nameserver))) {
+            std::cerr << "[ERROR] No usable nameserver, set IRC_DNS_SERVER to <ipv4>[:port]" << std::endl;
+            return 1;
+        }
+        sm.enable_resolver(nameserver);
+    }
+
+    // optional plugins (srvMgr/include/Plugin.h): IRC_PLUGINS="plugins/badwords.so,..."; after an upgrade
+    // the new process loads them again, with fresh state
+    std::vector<std::string>    plugins = config.plugins;
+    if (getenv("IRC_PLUGINS") != nullptr) {
+        std::stringstream   paths(getenv("IRC_PLUGINS"));
+        std::string         path;
+        while (std::getline(paths, path, ',')) {
+            if (!path.empty()) plugins.push_back(path);
+        }
+    }
+    for (const std::string& path : plugins) {
+        if (!sm.load_plugin(path)) {
+            std::cerr << "[ERROR] Cannot start plugin " << path << std::endl;
+            return 1;
+        }
+    }
+
+    // optional extra listeners: IRC_LISTEN="[::]:6667,/run/ircserv.sock?class=bots,tls:[::]:6697?backlog=512"
+    // (format of ListenerConfig::parse), next to the one on <port>
+    // and the config file's listen lines
+    bool                        tls_listeners = false;
+    std::vector<std::string>    listen_specs = config.listen;
+    if (getenv("IRC_LISTEN") != nullptr) {
+        std::stringstream   specs(getenv("IRC_LISTEN"));
+        std::string         spec;
+        while (std::getline(specs, spec, ',')) {
+            if (!spec.empty()) listen_specs.push_back(spec);
+        }
+    }
     try {
-        srv.activate();
-        std::cout << "[SERVER] Started on port " << PORT << std::endl;
+        for (const std::string& spec : listen_specs) {
+            const ListenerConfig listener = ListenerConfig::parse(spec);
+            srv.addListener(listener);
+            tls_listeners = tls_listeners || listener.kind == ListenerKind::TLS;
+            std::cout << "[SERVER] Listener " << listener.describe() << " added" << std::endl;
+        }
+    } catch (std::exception &e) {
+        std::cerr << "[ERROR] Listener: " << e.what() << std::endl;
+        return 1;
+    }
+
+    // optional TLS listener: IRC_TLS_PORT, IRC_TLS_CERT and IRC_TLS_KEY (PEM files, also used by tls: listeners;
+    // tls_cert and tls_key in the config file take precedence)
+    const char* tls_port = getenv("IRC_TLS_PORT");
+    if (tls_port != nullptr || tls_listeners) {
+        const char* cert = !config.tls_cert.empty() ? config.tls_cert.c_str() : getenv("IRC_TLS_CERT");
+        const char* key = !config.tls_key.empty() ? config.tls_key.c_str() : getenv("IRC_TLS_KEY");
+        try {
+            if (tls_port != nullptr) {
+                srv.enableTLS(static_cast<uint16_t>(atoi(tls_port)), cert ? cert : "ircserv.crt", key ? key : "ircserv.key");
+            } else {
+                srv.loadTLSCertificate(cert ? cert : "ircserv.crt", key ? key : "ircserv.key");
+            }
+        } catch (std::exception &e) {
+            std::cerr << "[ERROR] " << e.what() << std::endl;
+            return 1;
+        }
+        if (tls_port != nullptr) std::cout << "[SERVER] TLS enabled on port " << tls_port << std::endl;
+    }
+
+    // optional WebSocket listener for web clients: IRC_WS_PORT
+    const char* ws_port = getenv("IRC_WS_PORT");
+    if (ws_port != nullptr) {
+        try {
+            srv.enableWebSocket(static_cast<uint16_t>(atoi(ws_port)));
+        } catch (std::exception &e) {
+            std::cerr << "[ERROR] " << e.what() << std::endl;
+            return 1;
+        }
+        std::cout << "[SERVER] WebSocket enabled on port " << ws_port << std::endl;
+    }
+
+    // optional traffic capture for tests/replay.cpp: IRC_CAPTURE=<file>; after an upgrade the
+    // new process records to <file>.<pid> so the first part is kept
+    const char* capture_path = getenv("IRC_CAPTURE");
+
+    try {
+        const char* upgrade_fd = getenv(UPGRADE_ENV);
+        if (capture_path != nullptr) {
+            srv.enableCapture(upgrade_fd ? std::string(capture_path) + "." + std::to_string(getpid()) : capture_path);
+        }
+        if (upgrade_fd != nullptr) {
+            const int channel = atoi(upgrade_fd);
+            unsetenv(UPGRADE_ENV);
+            sm.import_state(srv.resume(channel));
+            srv.acknowledgeHandover();
+            std::cout << "[SERVER] Upgraded in place on port " << PORT << std::endl;
+        } else {
+            srv.activate();
+            std::cout << "[SERVER] Started on port " << PORT << std::endl;
+        }
     } catch (std::exception &e) {
         std::cerr << "[ERROR] " << e.what() << std::endl;
         return 1;
@@ -51,12 +247,62 @@ int main(int argc, char* argv[]) {
     
     while (true) {
         srv.poll();
+
+        if (reload_requested) {
+            reload_requested = 0;
+            Config      reloaded;
+            std::string error;
+            if (config_path.empty()) {
+                std::cout << "[CONFIG] No configuration file given, nothing to reload" << std::endl;
+            } else if (!reloaded.load(config_path, error)) {
+                std::cerr << "[CONFIG] Reload failed, keeping the running settings: " << error << std::endl;
+            } else {
+                for (const std::string& key : reloaded.startup_changes(config)) {
+                    std::cout << "[CONFIG] " << key << " changed, takes effect on the next upgrade (SIGUSR2) or restart" << std::endl;
+                }
+                try {
+                    reloaded.apply(srv, sm);
+                    config = reloaded;
+                    std::cout << "[CONFIG] Reloaded " << config_path << std::endl;
+                } catch (std::exception &e) {
+                    // the settings before the failing one are in effect
+                    std::cerr << "[CONFIG] Reload partly applied: " << e.what() << std::endl;
+                }
+            }
+        }
+
+        if (upgrade_requested) {
+            upgrade_requested = 0;
+            std::cout << "[SERVER] Upgrade requested, handing over to " << binary_path << std::endl;
+            // the new process takes the channel log's lock before it imports the state
+            sm.release_channel_log();
+            if (srv.handOver(binary_path, argv, sm.export_state())) {
+                std::cout << "[SERVER] Upgrade complete, exiting" << std::endl;
+                return 0;
+            }
+            if (!sm.enable_channel_log(config.channel_log)) {
+                std::cerr << "[ERROR] Channel log " << config.channel_log << ".wal not reopened, channel settings are not persisted" << std::endl;
+            }
+        }
         
         // Check if 10 seconds have passed for heartbeat
         auto now = std::chrono::steady_clock::now();
         if (now - last_heartbeat >= heartbeat_interval) {
             auto uptime = std::chrono::duration_cast<std::chrono::seconds>(now - server_start).count();
+            const BufferPool::Stats pool = BufferPool::stats();
             std::cout << "[SERVER] Alive - Uptime: " << uptime << "s" << std::endl;
+            std::cout << "[SERVER] Buffer pool (loop thread) - hit rate: " << std::fixed << std::setprecision(1) << BufferPool::hitRate() * 100 << "%"
+                      << ", resident: " << pool.resident_bytes / 1024 << " KiB"
+                      << ", in use: " << pool.in_use_bytes / 1024 << " KiB"
+                      << ", oversized: " << pool.oversized << std::endl;
+            const MemoryStats memory = srv.memoryStats();
+            if (memory.connections > 0) {
+                std::cout << "[SERVER] Memory - " << memory.connections << " connections (" << memory.idle << " idle), per connection: "
+                          << memory.slot_bytes / memory.connections << " B slot, "
+                          << memory.buffer_bytes / memory.connections << " B buffers, "
+                          << sm.users_footprint() / memory.connections << " B user state"
+                          << ", queued output: " << memory.queued_bytes / 1024 << " KiB" << std::endl;
+            }
             last_heartbeat = now;
         }
     }
@@ -0,0 +1,57 @@
+// Example plugin: a channel guard that drops channel messages containing one of the words in
+// IRC_BADWORDS (comma separated, case-insensitive), warns the sender with a NOTICE and
+// disconnects them after IRC_BADWORDS_STRIKES (default 3) dropped messages.
+//
+//     make plugins && IRC_PLUGINS=plugins/badwords.so IRC_BADWORDS=spam,scam ./ircserv 6667 pw
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Plugin.h"
+
+namespace {
+    std::vector<std::string>                words;
+    int                                     max_strikes = 3;
+    std::unordered_map<std::string, int>    strikes;    // by nick
+
+    std::string lowercase(std::string_view text) {
+        std::string out(text);
+        std::transform(out.begin(), out.end(), out.begin(), [](unsigned char c) { return std::tolower(c); });
+        return out;
+    }
+}
+
+extern "C" int ircserv_plugin_init(PluginHost& host, const int api_version) {
+    if (api_version != PLUGIN_API_VERSION) return 1;
+    std::stringstream   list(getenv("IRC_BADWORDS") ? getenv("IRC_BADWORDS") : "");
+    std::string         word;
+    while (std::getline(list, word, ',')) {
+        if (!word.empty()) words.push_back(lowercase(word));
+    }
+    if (getenv("IRC_BADWORDS_STRIKES")) max_strikes = std::max(1, atoi(getenv("IRC_BADWORDS_STRIKES")));
+
+    host.on_register([&host](const User& user) {
+        if (!words.empty()) host.notice(user, "This server filters " + std::to_string(words.size()) + " words in channels");
+    });
+    host.on_channel_message([&host](const User& user, const Channel& channel, const std::string_view text) {
+        const std::string   lower = lowercase(text);
+        for (const std::string& bad : words) {
+            if (lower.find(bad) == std::string::npos) continue;
+            const int   count = ++strikes[user.get_nickname()];
+            host.notice(user, "Message to " + channel.get_channel_name() + " blocked (" + std::to_string(count) + "/"
+                        + std::to_string(max_strikes) + ")");
+            if (count >= max_strikes) host.disconnect_user(user, "Too many blocked messages");
+            return Verdict::DROP;
+        }
+        return Verdict::PASS;
+    });
+    host.on_disconnect([](const User& user) {
+        strikes.erase(user.get_nickname());
+    });
+    return 0;
+}
@@ -0,0 +1,271 @@
+#pragma once
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define POOL_LINE_BLOCK 512
+#define POOL_SEGMENT_BLOCK 4096
+#define POOL_BLOCKS_PER_SLAB 64
+#define OUTQUEUE_INITIAL_CHUNKS (POOL_LINE_BLOCK / 16)     // chunk array of a queue that starts filling: one line block
+
+namespace MPlexServer {
+    /**
+     * @brief Size-class slab pool for line buffers and outbound segments.
+     *
+     * Requests up to POOL_LINE_BLOCK or POOL_SEGMENT_BLOCK bytes are served from
+     * per-thread freelists of fixed-size blocks, carved from slabs of
+     * POOL_BLOCKS_PER_SLAB blocks. Freed blocks go back to the freelist of the
+     * freeing thread instead of the system allocator; slabs are never returned.
+     * Larger requests fall through to operator new.
+     *
+     * Pooled strings and segments belong to the event loop: once a server bound
+     * its poll() thread (bindThread()), they are created, shared and released on
+     * that thread only, and builds without NDEBUG assert it. Segment reference
+     * counts are plain integers, and a block freed elsewhere would land in the
+     * wrong freelist. Other threads hand work over with BasicServer::post().
+     */
+    class BufferPool {
+    public:
+        /**
+         * @brief Counters of the calling thread's pools; only the loop thread uses them.
+         */
+        struct Stats {
+            size_t  allocations = 0;    // requests served by a size class
+            size_t  hits = 0;           // ... of which came from the freelist
+            size_t  oversized = 0;      // requests too large for any size class
+            size_t  resident_bytes = 0; // memory held in slabs
+            size_t  in_use_bytes = 0;   // memory currently handed out from slabs
+        };
+
+        static void*    allocate(size_t bytes);
+        static void     deallocate(void* block, size_t bytes);
+
+        /**
+         * @return Returns the pool statistics of the calling thread.
+         */
+        static Stats    stats();
+        static double   hitRate();
+
+        /**
+         * @brief Makes the calling thread the only one allowed to use the pools; BasicServer calls it on activation.
+         */
+        static void     bindThread();
+    };
+
+    /**
+     * @brief Standard allocator adaptor on top of BufferPool.
+     */
+    template <typename T>
+    struct PoolAllocator {
+        using value_type = T;
+
+        PoolAllocator() noexcept = default;
+        template <typename U>
+        PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+        T* allocate(size_t n) {
+            return static_cast<T*>(BufferPool::allocate(n * sizeof(T)));
+        }
+        void deallocate(T* p, size_t n) noexcept {
+            BufferPool::deallocate(p, n * sizeof(T));
+        }
+
+        template <typename U>
+        bool operator==(const PoolAllocator<U>&) const noexcept { return true; }
+        template <typename U>
+        bool operator!=(const PoolAllocator<U>&) const noexcept { return false; }
+    };
+
+    using pooled_string = std::basic_string<char, std::char_traits<char>, PoolAllocator<char>>;
+
+    /**
+     * @brief Reference counted outbound segment, exactly one POOL_SEGMENT_BLOCK in size.
+     */
+    struct Segment {
+        static constexpr size_t CAPACITY = POOL_SEGMENT_BLOCK - 2 * sizeof(uint32_t);
+
+        uint32_t    refs;
+        uint32_t    used;
+        char        data[CAPACITY];
+
+        static Segment* create();
+        static void     retain(Segment* seg);
+        static void     release(Segment* seg);
+    };
+
+    /**
+     * @brief Bytes [off, off + len) of a segment, e.g. a line kept in a history arena.
+     */
+    struct Slice {
+        Segment*    seg;
+        uint32_t    off;
+        uint32_t    len;
+    };
+
+    /**
+     * @brief Immutable message serialized once into segments, shared by many queues.
+     */
+    class SharedMessage {
+    public:
+        SharedMessage() = default;
+        explicit SharedMessage(std::string_view msg);
+        SharedMessage(const SharedMessage& other);
+        SharedMessage& operator=(const SharedMessage& other);
+        ~SharedMessage();
+
+        [[nodiscard]] const std::vector<Segment*>& segments() const;
+        [[nodiscard]] size_t size() const;
+    private:
+        std::vector<Segment*>   segments_;
+        size_t                  size_ = 0;
+    };
+
+    /**
+     * @brief Outbound byte queue made of (possibly shared) pooled segments.
+     *
+     * A drained queue holds no memory: its chunk array goes back to the pool
+     * and is taken again by the next append, so idle connections cost only
+     * the object itself.
+     */
+    class OutQueue {
+    public:
+        OutQueue() = default;
+        OutQueue(const OutQueue& other) = delete;
+        OutQueue& operator=(const OutQueue& other) = delete;
+        ~OutQueue();
+
+        void    append(std::string_view data);
+        void    append(const SharedMessage& msg);
+        void    append(const Slice& slice);
+        [[nodiscard]] bool   empty() const;
+        [[nodiscard]] size_t size() const;
+
+        /**
+         * @brief Writes as much as possible to fd with a single sendmsg().
+         * @return Result of sendmsg(); consumed bytes are removed from the queue.
+         */
+        ssize_t flush(int fd);
+        void    clear();
+
+        /**
+         * @brief Points up to max_iov entries of iov at the first limit queued bytes.
+         * @return Entries used.
+         */
+        size_t  gather(iovec* iov, size_t max_iov, size_t limit) const;
+
+        /**
+         * @brief Contiguous bytes at the head of the queue, for writers that cannot gather (TLS).
+         */
+        [[nodiscard]] std::string_view front() const;
+
+        /**
+         * @brief Removes n bytes from the head of the queue.
+         */
+        void    consume(size_t n);
+
+        /**
+         * @brief Appends the queued bytes to out without consuming them.
+         */
+        void    copyTo(std::string& out) const;
+
+        /**
+         * @brief Memory held for the chunk array (the segments are accounted by the pool).
+         */
+        [[nodiscard]] size_t heldBytes() const;
+    private:
+        struct Chunk {
+            Segment*    seg;
+            uint32_t    off;
+            uint32_t    len;
+        };
+        std::vector<Chunk, PoolAllocator<Chunk>>    chunks_;    // sent ones before head_
+        size_t                                      head_ = 0;
+        size_t                                      size_ = 0;
+
+        void    push(const Chunk& chunk);
+        void    release();
+    };
+
+    /**
+     * @brief Priority class of outbound data, see SendQueue.
+     */
+    enum class Priority : uint8_t {
+        CONTROL,    // replies to the client itself: numerics, PONG, ERROR, private messages
+        BULK,       // fan-out such as channel traffic, and generated replies; shed first
+    };
+
+    /**
+     * @brief A connection's output in two classes, control before bulk.
+     *
+     * Each class is a FIFO of its own, so nothing is reordered within a class.
+     * A flush serves control output first, but never cuts into a bulk message:
+     * bulk appends are closed with endBulkMessage(), and once part of a bulk
+     * message was sent its remainder goes out ahead of any control output. The
+     * message ends are kept only while bulk output is queued.
+     */
+    class SendQueue {
+    public:
+        SendQueue() = default;
+        SendQueue(const SendQueue& other) = delete;
+        SendQueue& operator=(const SendQueue& other) = delete;
+
+        void    append(std::string_view data, Priority priority = Priority::CONTROL);
+        void    append(const SharedMessage& msg, Priority priority = Priority::CONTROL);
+        void    append(const Slice& slice, Priority priority = Priority::CONTROL);
+
+        /**
+         * @brief The queue of one class, e.g. for WebSocket framing; close bulk messages with endBulkMessage().
+         */
+        [[nodiscard]] OutQueue& queue(Priority priority);
+
+        /**
+         * @brief Marks everything appended to the bulk class so far as whole messages.
+         */
+        void    endBulkMessage();
+
+        [[nodiscard]] bool   empty() const;
+        [[nodiscard]] size_t size() const;
+        [[nodiscard]] size_t size(Priority priority) const;
+
+        /**
+         * @brief Writes with a single sendmsg(): the rest of a half-sent bulk message, then
+         * control output, bulk output only once no control output is left.
+         * @return Result of sendmsg(); consumed bytes are removed from the queues.
+         */
+        ssize_t flush(int fd);
+
+        /**
+         * @brief Contiguous bytes that go out next, for writers that cannot gather (TLS, replay).
+         */
+        [[nodiscard]] std::string_view front() const;
+
+        /**
+         * @brief Removes n <= front().size() bytes, after writing them.
+         */
+        void    consume(size_t n);
+
+        /**
+         * @brief Appends the queued bytes to out, in an order that keeps every message whole.
+         */
+        void    copyTo(std::string& out) const;
+        void    clear();
+        [[nodiscard]] size_t heldBytes() const;
+    private:
+        OutQueue                                    control_;
+        OutQueue                                    bulk_;
+        std::vector<size_t, PoolAllocator<size_t>>  bulk_ends_;     // where bulk messages end, counted like bulk_sent_
+        size_t                                      ends_head_ = 0;
+        size_t                                      bulk_sent_ = 0; // bulk bytes written since the class was last empty
+        size_t                                      bulk_done_ = 0; // end of the last bulk message fully written
+
+        [[nodiscard]] size_t  bulk_remainder() const;
+        [[nodiscard]] bool    serves_bulk() const;
+        void    consume_bulk(size_t n);
+    };
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <netinet/in.h>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "listener.h"
+
+#define CAPTURE_MAGIC "MPXCAP1\n"
+#define CAPTURE_BUFFER (64 * 1024)      // collected bytes that trigger a write to the file
+#define CAPTURE_FLUSH_MS 500            // buffered records are written at least this often
+
+namespace MPlexServer {
+    class Client;
+
+    enum class CaptureEvent : uint8_t {CONNECT = 1, LINE = 2, DISCONNECT = 3, POLL_END = 4};
+
+    /**
+     * @brief One event read back from a capture file.
+     */
+    struct CaptureRecord {
+        CaptureEvent    event = CaptureEvent::POLL_END;
+        uint64_t        at_us = 0;          // since the capture started
+        uint32_t        conn = 0;           // connection id, unique within the capture; 0 for POLL_END
+        SocketAddress   addr{};             // CONNECT
+        std::string     line;               // LINE: as handed to onMessage (CR kept, LF stripped)
+    };
+
+    /**
+     * @brief Records the events a server hands to its handler, see BasicServer::enableCapture().
+     *
+     * File format: CAPTURE_MAGIC, the start time as 8 byte little-endian
+     * microseconds since the Unix epoch, then one record per event: the event
+     * byte, the microseconds since the previous record and the connection id as
+     * LEB128 varints, followed by address and port (6 bytes, network order) for
+     * CONNECT, or the varint length and bytes of the line for LINE. IPv6 clients
+     * connect with event 5 and 18 bytes, unix-domain clients with event 6 and
+     * nothing; the reader reports both as CONNECT. POLL_END
+     * marks the end of a poll() iteration that had events, so a replay flushes
+     * output at the same points.
+     */
+    class CaptureWriter {
+    public:
+        /**
+         * @brief Creates (truncates) the file, readable by the owner only: it holds everything clients sent.
+         */
+        explicit CaptureWriter(const std::string& path);
+        CaptureWriter(const CaptureWriter& other) = delete;
+        CaptureWriter& operator=(const CaptureWriter& other) = delete;
+        ~CaptureWriter();
+
+        uint32_t    nextId();
+        void        connect(uint32_t conn, const SocketAddress& addr);
+        void        line(uint32_t conn, std::string_view line);
+        void        disconnect(uint32_t conn);
+        void        pollEnd();
+        void        flush();
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        int                 fd;
+        std::string         buffer;
+        Clock::time_point   last_record;
+        Clock::time_point   last_flush;
+        uint32_t            last_id = 0;
+        bool                events_since_poll = false;
+
+        void    begin(CaptureEvent event, uint32_t conn);
+    };
+
+    /**
+     * @brief Reads a capture file written by CaptureWriter.
+     */
+    class CaptureReader {
+    public:
+        /**
+         * @brief Loads the file; throws ServerError if it cannot be read or is no capture.
+         */
+        explicit CaptureReader(const std::string& path);
+
+        /**
+         * @return False at the end of the file. Throws ServerError on a truncated or unknown record.
+         */
+        bool        next(CaptureRecord& record);
+
+        [[nodiscard]] uint64_t  startTime() const;
+
+    private:
+        std::string data;
+        size_t      pos = 0;
+        uint64_t    start_us = 0;
+        uint64_t    at_us = 0;
+
+        uint64_t    varint();
+    };
+
+    /**
+     * @brief Receives a replaying server's output instead of the sockets, see BasicServer::activateReplay().
+     */
+    class OutputSink {
+    public:
+        virtual ~OutputSink() = default;
+        virtual void write(const Client& client, std::string_view bytes) = 0;
+    };
+}
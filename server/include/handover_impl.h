@@ -0,0 +1,295 @@
+#pragma once
+
+#include "mplexserver.h"
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include <cstring>
+
+// Wire format on the upgrade socket:
+//   u32 fd count | fds in batches of HANDOVER_FD_BATCH (1 byte + SCM_RIGHTS each) | u64 state length | state
+// The state references fds by their index in the transferred fd list.
+
+#define HANDOVER_FD_BATCH 200
+#define HANDOVER_MAGIC 0x4d504c58u  // "MPLX"
+#define HANDOVER_VERSION 5
+
+namespace MPlexServer::detail {
+    bool write_all(int fd, const char* data, size_t len);
+    bool read_all(int fd, char* data, size_t len);
+    bool send_fds(int channel, const std::vector<int>& fds);
+    bool recv_fds(int channel, size_t total, std::vector<int>& fds);
+}
+
+template <class Handler, class Log, class Buffers>
+bool MPlexServer::BasicServer<Handler, Log, Buffers>::handOver(const std::string& binary, char* const argv[], const std::string& handler_state) {
+    if (!listening()) {
+        log<0>("Upgrade requested on an inactive server.");
+        return false;
+    }
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) == -1) {
+        log<0>("Upgrade failed: could not create socketpair.");
+        return false;
+    }
+
+    const pid_t pid = fork();
+    if (pid == -1) {
+        close(pair[0]);
+        close(pair[1]);
+        log<0>("Upgrade failed: fork failed.");
+        return false;
+    }
+    if (pid == 0) {
+        // keep stdio, move the channel to fd 3 and drop everything else we inherited
+        if (pair[1] == 3) {
+            fcntl(3, F_SETFD, 0);
+        } else if (dup2(pair[1], 3) == -1) {
+            _exit(127);
+        }
+        close_range(4, ~0U, 0);
+        setenv(UPGRADE_ENV, "3", 1);
+        execv(binary.c_str(), argv);
+        _exit(127);
+    }
+    close(pair[1]);
+    const int channel = pair[0];
+
+    std::vector<int> fds;
+    StateWriter state;
+    state.u32(HANDOVER_MAGIC);
+    state.u32(HANDOVER_VERSION);
+    // listeners are matched by description in the new process, it may have a different list
+    state.u32(static_cast<uint32_t>(listeners.size()));
+    for (size_t i = 0; i < listeners.size(); ++i) {
+        state.str(listeners[i].config.describe());
+        state.u32(static_cast<uint32_t>(fds.size()));
+        fds.push_back(listeners[i].fd);
+    }
+    // TLS sessions live in this process's OpenSSL state and cannot be moved;
+    // WebSocket clients still in the HTTP upgrade are unknown to the handler
+    const auto transferable_conn = [](const Connection& conn) {
+        return conn.active && conn.tls == nullptr && !conn.connecting && conn.ws_mode != WsMode::HANDSHAKE;
+    };
+    uint32_t transferable = 0;
+    for (Connection& conn : connections) {
+        if (transferable_conn(conn)) transferable++;
+    }
+    state.u32(transferable);
+    for (Connection& conn : connections) {
+        if (!transferable_conn(conn)) continue;
+        state.u32(static_cast<uint32_t>(fds.size()));
+        fds.push_back(conn.fd);
+        state.u32(static_cast<uint32_t>(conn.fd));
+        state.u32(conn.generation);
+        state.u8(conn.disconnecting);
+        const SocketAddress& addr = conn.client.getAddress();
+        state.str(std::string_view(reinterpret_cast<const char*>(&addr), sizeof(addr)));
+        state.u32(conn.client.getListener());
+        state.f64(conn.flood.tokens);
+        state.u8(conn.flood.exempt);
+        state.u8(conn.flood.throttled);
+        state.u64(conn.sendq_limit);
+        state.str(std::string_view(conn.recv_buffer.data(), conn.recv_buffer.size()));
+        std::string pending;
+        conn.send_queue.copyTo(pending);
+        state.str(pending);
+        state.u8(conn.ws != nullptr);
+        if (conn.ws != nullptr) {
+            conn.ws->serialize(state);
+        }
+        if (!conn.generators.empty()) {
+            log<1>("Unfinished reply of fd ", conn.fd, " is not handed over.");
+        }
+    }
+    state.str(handler_state);
+
+    const uint32_t fd_count = static_cast<uint32_t>(fds.size());
+    const uint64_t state_len = state.data().size();
+    bool ok = detail::write_all(channel, reinterpret_cast<const char*>(&fd_count), sizeof(fd_count))
+        && detail::send_fds(channel, fds)
+        && detail::write_all(channel, reinterpret_cast<const char*>(&state_len), sizeof(state_len))
+        && detail::write_all(channel, state.data().data(), state.data().size());
+
+    char ack = 0;
+    if (ok) {
+        pollfd pfd{channel, POLLIN, 0};
+        ok = ::poll(&pfd, 1, UPGRADE_TIMEOUT_MS) == 1 && read(channel, &ack, 1) == 1 && ack == 'K';
+    }
+    close(channel);
+    if (!ok) {
+        log<0>("Upgrade failed: new process did not take over, continuing.");
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        return false;
+    }
+    log<1>("Upgrade: handed ", transferable, " clients over to pid ", pid, ".");
+    if (transferable != static_cast<uint32_t>(clientCount)) {
+        log<1>("Upgrade: closing ", clientCount - transferable, " clients that cannot be handed over.");
+    }
+
+    if (scheduler.spawned() > 0) {
+        log<1>("Upgrade: ", scheduler.spawned(), " unfinished tasks are not handed over.");
+    }
+    scheduler.shutdown();
+
+    // The sockets live on in the new process; only drop our references.
+    for (Connection& conn : connections) {
+        if (!conn.active) continue;
+        release_tls(conn);
+        close(conn.fd);
+        if (user_data_deleter != nullptr && conn.user_data != nullptr) {
+            user_data_deleter(conn.user_data);
+        }
+    }
+    connections.clear();
+    throttled_clients.clear();
+    overflowed_clients.clear();
+    disconnect_queue.clear();
+    flush_queue.clear();
+    clientCount = 0;
+    close_listeners(false);     // the files of unix sockets stay, the new process listens on them
+    close(epollfd);
+    epollfd = -1;
+    return true;
+}
+
+template <class Handler, class Log, class Buffers>
+std::string MPlexServer::BasicServer<Handler, Log, Buffers>::resume(const int channel) {
+    uint32_t fd_count = 0;
+    uint64_t state_len = 0;
+    std::vector<int> fds;
+    if (!detail::read_all(channel, reinterpret_cast<char*>(&fd_count), sizeof(fd_count))
+        || !detail::recv_fds(channel, fd_count, fds)
+        || !detail::read_all(channel, reinterpret_cast<char*>(&state_len), sizeof(state_len))) {
+        throw ServerError("Upgrade: failed to receive sockets from the old process");
+    }
+    std::string raw(state_len, '\0');
+    if (!detail::read_all(channel, raw.data(), raw.size())) {
+        throw ServerError("Upgrade: failed to receive state from the old process");
+    }
+    handover_channel = channel;
+
+    StateReader state(raw);
+    if (state.u32() != HANDOVER_MAGIC || state.u32() != HANDOVER_VERSION) {
+        throw ServerError("Upgrade: incompatible state format");
+    }
+    const auto fd_at = [&fds](const uint32_t index) {
+        if (index >= fds.size()) throw ServerError("Upgrade: state references unknown fd");
+        return fds[index];
+    };
+
+    const int epoll_fd = epoll_create1(0);
+    if (epoll_fd < 0) {
+        throw ServerError("Failed to create epoll instance");
+    }
+    this->epollfd = epoll_fd;
+    scheduler.attach(epollfd);
+    posted.attach(epollfd);
+    BufferPool::bindThread();
+    // sockets of listeners we still have are taken over, the others closed; new ones are opened
+    std::vector<uint16_t> listener_index(state.u32(), NO_LISTENER);    // old index -> ours
+    for (uint16_t& index : listener_index) {
+        const std::string name = state.str();
+        const int fd = fd_at(state.u32());
+        for (size_t i = 0; i < listeners.size(); ++i) {
+            if (listeners[i].fd == -1 && listeners[i].config.describe() == name) {
+                listeners[i].fd = fd;
+                index = static_cast<uint16_t>(i);
+                break;
+            }
+        }
+        if (index == NO_LISTENER) {
+            log<0>("Upgrade: ", name, " is not configured anymore, closing it.");
+            Listener dropped{ListenerConfig::parse(name), fd};
+            dropped.close(true);
+        }
+    }
+    for (size_t i = 0; i < listeners.size(); ++i) {
+        listen_on(i);
+    }
+
+    const uint32_t conn_count = state.u32();
+    for (uint32_t i = 0; i < conn_count; ++i) {
+        const int fd = fd_at(state.u32());
+        const int old_fd = static_cast<int>(state.u32());
+        Connection& conn = connections.slot(fd);
+        conn.fd = fd;
+        conn.generation = state.u32();
+        const bool disconnecting = state.u8();
+        SocketAddress addr{};
+        const std::string addr_bytes = state.str();
+        std::memcpy(&addr, addr_bytes.data(), std::min(sizeof(addr), addr_bytes.size()));
+        const uint32_t listener = state.u32();
+        conn.client = Client(fd, addr, conn.generation, listener < listener_index.size() ? listener_index[listener] : NO_LISTENER);
+        conn.flood = FloodState{};
+        conn.flood.tokens = state.f64();
+        conn.flood.exempt = state.u8();
+        conn.flood.throttled = state.u8();
+        conn.sendq_limit = static_cast<size_t>(state.u64());
+        const std::string recv_bytes = state.str();
+        conn.recv_buffer.assign(recv_bytes.data(), recv_bytes.size());
+        conn.send_queue.append(state.str());
+        if (state.u8()) {
+            // an open WebSocket stays one even if the new binary has no WebSocket listener
+            conn.ws = std::make_unique<WebSocket>();
+            conn.ws->deserialize(state);
+            conn.ws_mode = WsMode::OPEN;
+        }
+        conn.active = true;
+        conn.disconnecting = false;
+        clientCount++;
+        imported_fds[old_fd] = fd;
+
+        uint32_t events = EPOLLRDHUP;
+        if (!conn.flood.throttled) events |= EPOLLIN;
+        add_to_epoll(fd, &conn, events);
+        conn.epoll_events = events;
+        if (!conn.send_queue.empty()) {
+            mark_for_flush(conn);
+        }
+        if (conn.flood.throttled) {
+            throttled_clients.emplace_back(&conn, conn.generation);
+        }
+        if (disconnecting) {
+            // the old process already ran onDisconnect for it
+            conn.disconnecting = true;
+            disconnect_queue.push_back(&conn);
+        }
+    }
+    std::string handler_state = state.str();
+    log<1>("Upgrade: took over ", clientCount, " clients.");
+    return handler_state;
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::acknowledgeHandover() {
+    imported_fds.clear();
+    if (handover_channel == -1) return;
+    const char ack = 'K';
+    if (write(handover_channel, &ack, 1) != 1) {
+        log<0>("Upgrade: could not acknowledge takeover.");
+    }
+    close(handover_channel);
+    handover_channel = -1;
+}
+
+template <class Handler, class Log, class Buffers>
+MPlexServer::Client MPlexServer::BasicServer<Handler, Log, Buffers>::importedClient(const int old_fd) const {
+    const auto it = imported_fds.find(old_fd);
+    if (it == imported_fds.end()) return Client();
+    const Connection* conn = lookup(it->second);
+    return conn == nullptr ? Client() : conn->client;
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::add_to_epoll(const int fd, void* ptr, const uint32_t events) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.ptr = ptr;
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        throw ServerError("Failed to add fd to epoll instance");
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#define NO_LISTENER 0xffff      // Client::getListener() of outgoing and replayed connections
+
+namespace MPlexServer {
+    /**
+     * @brief Address of a peer: IPv4, IPv6, or just AF_UNIX for unix-domain clients (they are unnamed).
+     *
+     * Sized for sockaddr_in6 rather than sockaddr_storage, which keeps a Client
+     * small; that is all an accepted TCP socket can have.
+     */
+    union SocketAddress {
+        sockaddr        any;
+        sockaddr_in     v4;
+        sockaddr_in6    v6;
+
+        [[nodiscard]] int family() const;
+        /**
+         * @return The length to pass to connect()/bind(), 0 for AF_UNIX.
+         */
+        [[nodiscard]] socklen_t length() const;
+    };
+
+    enum class ListenerKind : uint8_t {PLAIN, TLS, WEBSOCKET};
+
+    /**
+     * @brief Options set on accepted sockets; 0 / false keeps the kernel's default.
+     */
+    struct SocketOptions {
+        bool    nodelay = false;        // TCP_NODELAY: short replies leave at once instead of waiting for an ACK
+        int     send_buffer = 0;        // SO_SNDBUF bytes
+        int     notsent_lowat = 0;      // TCP_NOTSENT_LOWAT: writable only while fewer bytes are unsent, keeps the queue in user space
+        int     keepalive_idle = 0;     // SO_KEEPALIVE after this many idle seconds, 3 probes idle / 3 apart
+        int     busy_poll_us = 0;       // SO_BUSY_POLL: reads spin on the device queue this long
+
+        /**
+         * @return These options, with the ones left at the default taken from fallback.
+         */
+        [[nodiscard]] SocketOptions merged(const SocketOptions& fallback) const;
+
+        /**
+         * @brief Sets the options on fd; tcp false skips the TCP-only ones (unix sockets).
+         * @return False if the kernel refused one (SO_BUSY_POLL above net.core.busy_read needs CAP_NET_ADMIN).
+         */
+        bool    apply(int fd, bool tcp) const;
+    };
+
+    /**
+     * @brief Settings of one listening socket, see BasicServer::addListener().
+     */
+    struct ListenerConfig {
+        std::string     address;                // IPv4, IPv6 or a unix socket path (starts with '/'); empty: every IPv4 interface
+        uint16_t        port = 0;               // unused for unix sockets
+        ListenerKind    kind = ListenerKind::PLAIN;
+        int             backlog = SOMAXCONN;
+        bool            reuse_port = false;     // SO_REUSEPORT: other processes may bind the same port
+        int             defer_accept = 0;       // TCP_DEFER_ACCEPT seconds: wake up only once the client sent something
+        std::string     client_class;           // free label for the handler, see BasicServer::getListener()
+        SocketOptions   sockets;                // for accepted sockets, on top of BasicServer::setLatencyProfile()
+
+        [[nodiscard]] bool isUnix() const;
+
+        /**
+         * @return "[tls:|ws:]address", e.g. "tls:[::]:6697" or "/run/ircd.sock"; identifies the socket across an upgrade.
+         */
+        [[nodiscard]] std::string describe() const;
+
+        /**
+         * @brief Parses "[tls:|ws:]<address>[?option&...]".
+         *
+         * Addresses: "6667" or ":6667" (every IPv4 interface), "127.0.0.1:6667",
+         * "[::]:6667", "[::1]:6667", "/path/to.sock". Options: backlog=N,
+         * reuseport, defer=SECONDS, class=NAME, and for accepted sockets nodelay,
+         * sndbuf=BYTES, lowat=BYTES, keepalive=SECONDS, busypoll=MICROSECONDS.
+         * Throws ServerSettingsError.
+         */
+        static ListenerConfig parse(std::string_view spec);
+    };
+
+    /**
+     * @brief A configured listener and its socket (-1 while closed).
+     */
+    struct Listener {
+        ListenerConfig  config;
+        int             fd = -1;
+
+        /**
+         * @brief Creates, binds and listens; throws ServerError. A stale unix socket file nobody accepts on is replaced.
+         */
+        void open();
+
+        /**
+         * @brief Closes the socket; unlink also removes the file of a unix socket.
+         */
+        void close(bool unlink);
+    };
+
+    /**
+     * @brief Writes the numeric form of addr into out (INET6_ADDRSTRLEN bytes); "localhost" for unix-domain peers.
+     */
+    void formatAddress(const SocketAddress& addr, char* out);
+}
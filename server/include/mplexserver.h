@@ -18,18 +18,43 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <fcntl.h>
+#include <sched.h>
 #include <unistd.h>
 
 #include <chrono>
+#include <deque>
 #include <functional>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <unordered_map>
 #include <vector>
 
+#include "bufferpool.h"
+#include "capture.h"
+#include "listener.h"
+#include "post.h"
+#include "serial.h"
+#include "task.h"
+#include "websocket.h"
+
 #define VERBOSITY_MAX 2
-#define MAX_EPOLL_EVENTS 10
+#define MAX_EPOLL_EVENTS 10     // default of setEventBatch()
 #define MAX_MSG_LEN 512
+#define MAX_TAG_BYTES 4096      // IRCv3 client tag section, '@' and the closing space included
+#define FLOOD_DEFAULT_RATE 1.0
+#define FLOOD_DEFAULT_BURST 10.0
+#define FLOOD_DEFAULT_RECVQ 8192
+#define SENDQ_DEFAULT_MAX (1024 * 1024)     // queued output beyond which bulk messages are dropped, setSendQLimit()
+#define SENDQ_HARD_FACTOR 2                 // queued output of any class beyond this times the limit: disconnect
+#define UPGRADE_ENV "MPLEX_UPGRADE_FD"
+#define UPGRADE_TIMEOUT_MS 10000
+#define GENERATOR_CHUNK (16 * 1024)     // bytes produced per generator step, also the low-water mark of the send queue
+#define CONNECTION_CHUNK 64             // connection slots allocated together, see ConnectionTable
+
+// OpenSSL handles, only tls_impl.h includes the OpenSSL headers
+struct ssl_st;
+struct ssl_ctx_st;
 
 namespace MPlexServer {
     /**
@@ -62,20 +87,40 @@ namespace MPlexServer {
         Client(const Client& other);
         Client& operator=(const Client& other);
 
-        explicit Client(int fd, sockaddr_in addr);
+        explicit Client(int fd, const SocketAddress& addr, uint32_t generation = 0, uint16_t listener = NO_LISTENER);
 
         [[nodiscard]] int getFd() const;
-        [[nodiscard]] std::string getIpv4() const;
+        /**
+         * @return Generation of the connection slot; distinguishes this client from later ones reusing the same fd.
+         */
+        [[nodiscard]] uint32_t getGeneration() const;
+        /**
+         * @return Numeric IPv4 or IPv6 address of the peer, "localhost" for unix-domain clients. Formatted once on accept.
+         */
+        [[nodiscard]] const char* getPeer() const;
         [[nodiscard]] int getPort() const;
+        [[nodiscard]] const SocketAddress& getAddress() const;
+        /**
+         * @return Index of the listener the client connected to, NO_LISTENER for outgoing connections.
+         */
+        [[nodiscard]] uint16_t getListener() const;
 
         ~Client();
     private:
         int fd;
-        sockaddr_in client_addr{};
+        uint32_t generation;
+        uint16_t listener;
+        SocketAddress client_addr{};
+        char peer[INET6_ADDRSTRLEN]{};
     };
 
     /**
      * @brief Message class.
+     *
+     * A line starting with '@' carries IRCv3 message tags. The tag section is
+     * split off when the message is framed: getTags() and getBody() are views
+     * into the line, and a section without its closing space within
+     * MAX_TAG_BYTES is flagged instead of being searched any further.
      */
     class Message final {
     public:
@@ -86,44 +131,313 @@ namespace MPlexServer {
 
         [[nodiscard]] const Client& getClient() const;
         [[nodiscard]] std::string getMessage() const;
+
+        /**
+         * @return The raw tags between '@' and the space ("a=b;+c"), empty for an untagged line.
+         */
+        [[nodiscard]] std::string_view getTags() const;
+
+        /**
+         * @return The line without its tag section.
+         */
+        [[nodiscard]] std::string_view getBody() const;
+
+        /**
+         * @return True if the tag section exceeds MAX_TAG_BYTES; the line should be rejected (ERR_INPUTTOOLONG).
+         */
+        [[nodiscard]] bool tagsTooLong() const;
     private:
         std::string message;
         Client client;
+        size_t tag_len = 0;             // "@tags " prefix, 0 without tags
+        bool tags_too_long = false;
     };
 
+    /**
+     * @brief Interface of the handler used by Server; every event is a virtual call.
+     */
     class EventHandler {
     public:
         virtual void onConnect(Client client) = 0;
         virtual void onDisconnect(Client client) = 0;
         virtual void onMessage(Message msg) = 0;
+
+        /**
+         * @brief Called once at the end of every poll() iteration, after all events were dispatched.
+         */
+        virtual void onPollEnd() {}
     };
 
     enum class EventType {CONNECTED, DISCONNECTED, MESSAGE};
 
+    /**
+     * @brief Producer of a long reply (e.g. LIST) that is written out piece by piece.
+     *
+     * The server asks for the next part only once the client's send queue ran
+     * below GENERATOR_CHUNK, at most once per poll() iteration, so a large
+     * reply never piles up in memory and never stalls the loop.
+     */
+    class OutputGenerator {
+    public:
+        virtual ~OutputGenerator() = default;
+
+        /**
+         * @brief Appends the next complete lines of the reply.
+         * @param out Buffer to append to.
+         * @param budget Amount of bytes wanted; may be exceeded by the last line.
+         * @return False once the reply is complete (out may still hold its last part).
+         */
+        virtual bool generate(std::string& out, size_t budget) = 0;
+    };
+
+    /**
+     * @brief Per-connection input throttling state (token bucket).
+     *
+     * Every dispatched line costs tokens according to its command penalty.
+     * Tokens refill over time up to the burst size; while a client is out of
+     * tokens its remaining lines stay queued in the receive buffer and reading
+     * from its socket is paused.
+     */
+    struct FloodState {
+        double                                  tokens = FLOOD_DEFAULT_BURST;
+        std::chrono::steady_clock::time_point   last_refill = std::chrono::steady_clock::now();
+        bool                                    exempt = false;
+        bool                                    throttled = false;
+    };
+
+    /**
+     * @brief Encryption of a connection.
+     *
+     * KTLS: handshake done in OpenSSL, records are encrypted by the kernel, so
+     * output is written with plain sendmsg(). USERSPACE: the kernel (or OpenSSL
+     * build) has no TLS offload, every write goes through SSL_write().
+     */
+    enum class TlsMode : uint8_t {PLAIN, HANDSHAKE, KTLS, USERSPACE};
+
+    /**
+     * @brief Everything the server keeps per connection, stored in one slot.
+     *
+     * Slots live in a ConnectionTable indexed by fd and are never freed, only reset,
+     * so a slot pointer stays valid and is stored directly in epoll_event.data.ptr.
+     * The generation is bumped every time the slot is handed to a new client.
+     * An idle connection holds no buffers: input and output storage is given
+     * back to the pool once drained, see memoryStats().
+     */
+    struct Connection {
+        int             fd = -1;
+        uint32_t        generation = 0;
+        Client          client;
+        pooled_string   recv_buffer;
+        SendQueue       send_queue;             // control output before bulk, see Priority
+        FloodState      flood;
+        void*           user_data = nullptr;
+        ssl_st*         tls = nullptr;
+        std::unique_ptr<WebSocket> ws;          // only on connections from the WebSocket listener
+        std::vector<std::unique_ptr<OutputGenerator>> generators;   // replies still to produce, in order
+        uint32_t        epoll_events = 0;       // interest mask currently registered with epoll
+        uint32_t        capture_id = 0;         // id in the running capture, 0: not recorded yet
+        TlsMode         tls_mode = TlsMode::PLAIN;
+        WsMode          ws_mode = WsMode::NONE;
+        bool            active = false;
+        bool            disconnecting = false;
+        bool            flush_pending = false;  // queued in the end-of-iteration flush phase
+        bool            write_blocked = false;  // last send hit EAGAIN, waiting for EPOLLOUT
+        bool            connecting = false;     // outgoing connect() still in progress
+        bool            generating = false;     // listed in the server's generator queue
+        bool            shedding = false;       // bulk output is being dropped at the SendQ limit
+        bool            sendq_exceeded = false; // past the hard limit, dropped at the end of the iteration
+        size_t          sendq_limit = 0;        // own SendQ limit (e.g. a server link), 0: the server's
+
+        /**
+         * @return True once the handler has seen onConnect for this connection.
+         */
+        [[nodiscard]] bool established() const {
+            return !connecting && tls_mode != TlsMode::HANDSHAKE && ws_mode != WsMode::HANDSHAKE;
+        }
+    };
+
+    /**
+     * @brief Connection slots indexed by fd, stored inline in chunks of CONNECTION_CHUNK.
+     *
+     * Neighbouring fds share a chunk, and a lookup is one index into the short
+     * chunk array instead of a pointer per slot. Chunks are allocated on demand
+     * and never moved or freed until clear(), so every slot keeps its address.
+     * Iteration visits all allocated slots, inactive ones included.
+     */
+    class ConnectionTable {
+    public:
+        class iterator {
+        public:
+            iterator(const std::unique_ptr<Connection[]>* chunk, size_t index) : chunk(chunk), index(index) {}
+            Connection& operator*() const { return chunk[index / CONNECTION_CHUNK][index % CONNECTION_CHUNK]; }
+            iterator& operator++() { ++index; return *this; }
+            bool operator!=(const iterator& other) const { return index != other.index; }
+        private:
+            const std::unique_ptr<Connection[]>*    chunk;
+            size_t                                  index;
+        };
+
+        /**
+         * @return The slot of fd, nullptr if its chunk was never allocated.
+         */
+        [[nodiscard]] Connection* find(const int fd) const {
+            if (fd < 0 || static_cast<size_t>(fd) >= size()) return nullptr;
+            return &chunks[fd / CONNECTION_CHUNK][fd % CONNECTION_CHUNK];
+        }
+
+        /**
+         * @brief The slot of fd, allocating its chunk first if needed.
+         */
+        Connection& slot(int fd);
+
+        /**
+         * @return Number of allocated slots.
+         */
+        [[nodiscard]] size_t size() const { return chunks.size() * CONNECTION_CHUNK; }
+
+        /**
+         * @return Bytes held by the table itself.
+         */
+        [[nodiscard]] size_t heldBytes() const;
+
+        /**
+         * @brief Frees all chunks; slot pointers become invalid.
+         */
+        void clear() { chunks.clear(); }
+
+        [[nodiscard]] iterator begin() const { return {chunks.data(), 0}; }
+        [[nodiscard]] iterator end() const { return {chunks.data(), size()}; }
+
+    private:
+        std::vector<std::unique_ptr<Connection[]>>  chunks;
+    };
+
+    /**
+     * @brief Memory the server keeps for its connections, see BasicServer::memoryStats().
+     *
+     * Kernel socket buffers and pooled output segments (BufferPool::stats())
+     * are not included.
+     */
+    struct MemoryStats {
+        size_t  connections = 0;    // open connections
+        size_t  idle = 0;           // ... of which hold no input, output or generator memory
+        size_t  slot_bytes = 0;     // connection table and slots, including free ones
+        size_t  buffer_bytes = 0;   // input buffers, output chunk arrays and generators held
+        size_t  queued_bytes = 0;   // output waiting to be sent
+    };
+
+    /**
+     * @brief Log policy: messages up to MaxLevel are compiled in and filtered by the runtime verbosity.
+     *
+     * Calls above MaxLevel are not instantiated at all, their arguments are never evaluated.
+     */
+    template <int MaxLevel>
+    struct LevelLog {
+        static constexpr int max_level = MaxLevel;
+
+        static bool enabled(const int level, const int verbose) {
+            return level <= verbose;
+        }
+    };
+
+    using RuntimeLog = LevelLog<VERBOSITY_MAX>;    // everything, as selected with setVerbose()
+    using NoLog = LevelLog<-1>;                     // no logging code at all
+
+    /**
+     * @brief Latency versus CPU trade-off of the event loop, see BasicServer::setLatencyProfile().
+     */
+    struct LatencyProfile {
+        int             cpu = -1;       // pin the poll() thread to this CPU; -1: wherever the scheduler puts it
+        int             spin_us = 0;    // poll() checks for events without sleeping this long before it blocks
+        SocketOptions   sockets;        // for every accepted socket; a listener's own options take precedence
+
+        /**
+         * @brief "default": nothing tuned. "latency": TCP_NODELAY, TCP_NOTSENT_LOWAT 16 KiB,
+         * SO_BUSY_POLL 50 us and 100 us of spinning per poll(). Throws ServerSettingsError.
+         */
+        static LatencyProfile named(std::string_view name);
+    };
+
+    /**
+     * @brief Buffer policy: sizes of the per-read stack buffer.
+     */
+    struct DefaultBuffers {
+        static constexpr size_t read_size = MAX_MSG_LEN;   // bytes taken from a socket per readiness event, see setReadSize()
+    };
+
     /**
      * @brief Multiplexer Server class
+     *
+     * Handler receives the events through plain member calls: onConnect(Client),
+     * onDisconnect(Client), onMessage(Message) and onPollEnd(). With EventHandler
+     * these are virtual; a final handler class is called directly and can be
+     * inlined into the event loop. Log is a LevelLog, Buffers like DefaultBuffers.
      */
-    class Server final {
+    template <class Handler = EventHandler, class Log = RuntimeLog, class Buffers = DefaultBuffers>
+    class BasicServer final {
     public:
-        Server() = delete;
-        Server(const Server& other) = delete;
-        Server& operator=(const Server& other) = delete;
+        BasicServer() = delete;
+        BasicServer(const BasicServer& other) = delete;
+        BasicServer& operator=(const BasicServer& other) = delete;
 
         /**
          * @brief Creates an MPlexServer class.
-         * @param port Specifies the port for the server (port cannot be changed once set).
+         * @param port Specifies the port of the first, plain listener (port cannot be changed once set).
          * @param ipv4 Specifies the ipv4 address the server should bind to. (Default value binds to all available network interfaces)
-         * @param password Specifies the server password. (Default: "DaLeMa26")
+         *
+         * More listeners (IPv6, unix sockets, TLS, WebSocket) are added with addListener().
          */
-        explicit Server(uint16_t port = 6667, std::string ipv4 = "");
+        explicit BasicServer(uint16_t port = 6667, std::string ipv4 = "");
 
-        ~Server();
+        ~BasicServer();
 
         /**
          * @brief Activates the server.
          */
         void activate();
 
+        /**
+         * @brief Adds a listener; must be called before activate() or resume().
+         *
+         * Listeners are IPv4, IPv6 or unix-domain sockets of any ListenerKind, each
+         * with its own backlog, SO_REUSEPORT, TCP_DEFER_ACCEPT and client class.
+         * A TLS listener needs loadTLSCertificate(). Throws ServerSettingsError.
+         */
+        void addListener(const ListenerConfig& config);
+
+        /**
+         * @return The settings of the listener c connected to, nullptr for outgoing and replayed connections.
+         */
+        [[nodiscard]] const ListenerConfig* getListener(const Client& c) const;
+
+        /**
+         * @brief Loads the certificate for TLS listeners; must be called before activate() or resume().
+         * @param cert_file PEM certificate (chain) presented to clients.
+         * @param key_file PEM private key of the certificate.
+         *
+         * Handshakes run non-blocking inside poll(); onConnect fires once the
+         * handshake completed. Afterwards record encryption is moved to kernel
+         * TLS where available and stays in OpenSSL otherwise.
+         */
+        void loadTLSCertificate(const std::string& cert_file, const std::string& key_file);
+
+        /**
+         * @brief Loads the certificate and adds a TLS listener on every IPv4 interface.
+         * @param tls_port Port of the TLS listener (0: 6697).
+         */
+        void enableTLS(uint16_t tls_port, const std::string& cert_file, const std::string& key_file);
+
+        /**
+         * @brief Adds a WebSocket listener on every IPv4 interface; must be called before activate() or resume().
+         * @param ws_port Port of the WebSocket listener (plain HTTP, no TLS).
+         *
+         * onConnect fires once the HTTP upgrade completed. From then on the
+         * client is handled like any other: its messages arrive as lines, and
+         * everything sent to it is framed, one line per frame. Fan-outs link the
+         * same line segments as for TCP clients and only add the frame headers.
+         */
+        void enableWebSocket(uint16_t ws_port);
+
         /**
          * @brief Deactivates the server.
          *
@@ -136,6 +450,11 @@ namespace MPlexServer {
          */
         [[nodiscard]] int getConnectedClientsCount() const;
 
+        /**
+         * @brief Walks the connection table; meant for occasional reporting, not per event.
+         */
+        [[nodiscard]] MemoryStats memoryStats() const;
+
         /**
          * @brief Sets the level of verbosity.
          * @param level Level of verbosity.
@@ -159,34 +478,111 @@ namespace MPlexServer {
         /**
          * @brief Set the active eventhandler instance for the server.
          */
-        void setEventHandler(EventHandler* handler);
+        void setEventHandler(Handler* handler);
 
         /**
          * @brief Transmits a text message to client c.
          * @param c Client to send to.
          * @param msg Message to send.
          */
-        void sendTo(const Client& c, std::string msg);
+        void sendTo(const Client& c, std::string_view msg);
+
+        /**
+         * @brief Transmits one line to client c; the CRLF terminator is appended by the server.
+         * @param c Client to send to.
+         * @param line Line to send, without CRLF.
+         */
+        void sendLine(const Client& c, std::string_view line);
 
         /**
          * @brief Write message to all connected clients.
          * @param message Message to send.
+         * @param priority Class of the message; bulk output is sent after control output and shed at the SendQ limit.
          */
-        void broadcast(std::string message);
+        void broadcast(std::string_view message, Priority priority = Priority::BULK);
 
         /**
          * @brief Write message to all connected clients except one.
          * @param except Client to exclude from broadcast.
          * @param message Message to send.
+         * @param priority See broadcast().
          */
-        void broadcastExcept(const Client& except, std::string message);
+        void broadcastExcept(const Client& except, std::string_view message, Priority priority = Priority::BULK);
 
         /**
          * @brief Sends a message to all clients in vector clients.
+         *
+         * The message is copied once into shared segments which are linked into
+         * every recipient's send queue.
          * @param clients Clients to send a message to.
          * @param message Message to send.
+         * @param priority See broadcast().
+         */
+        void multisend(const std::vector<Client>& clients, std::string_view message, Priority priority = Priority::BULK);
+
+        /**
+         * @brief Queues bytes that already live in segments (e.g. a history arena) without copying them.
+         * @param c Client to send to.
+         * @param slices Ranges to send, in order; the queue holds a reference on their segments.
          */
-        void multisend(const std::vector<Client>& clients, std::string message);
+        void sendSlices(const Client& c, const std::vector<Slice>& slices);
+
+        /**
+         * @brief Queues a reply that is produced lazily while the client's socket is writable.
+         *
+         * Output sent to the client afterwards may arrive between two parts of the
+         * reply, but always at line boundaries. Pending generators are dropped when
+         * the client disconnects or the server is handed over.
+         * @param c Client to send to.
+         * @param generator Producer of the reply; runs after earlier generators of c finished.
+         */
+        void attachGenerator(const Client& c, std::unique_ptr<OutputGenerator> generator);
+
+        /**
+         * @brief Starts a coroutine on the server's loop and keeps it until it finishes.
+         *
+         * The task runs right away up to its first suspension; it is resumed from
+         * poll() when what it awaits is ready. An exception ending it is logged.
+         * Tasks still suspended are destroyed by deactivate() and are not handed over.
+         */
+        void spawn(Task<> task);
+
+        /**
+         * @brief Awaitable: suspends until fd is readable (or hung up), at most timeout_ms (-1: no limit).
+         *
+         * The fd must not be registered with the server otherwise (e.g. a resolver or ident socket),
+         * and only one task may wait for it at a time. co_await yields the epoll events, 0 on timeout.
+         */
+        FdAwaiter readable(int fd, int timeout_ms = -1);
+
+        /**
+         * @brief Awaitable: like readable(), waiting until fd is writable (e.g. a non-blocking connect finished).
+         */
+        FdAwaiter writable(int fd, int timeout_ms = -1);
+
+        /**
+         * @brief Awaitable: resumes the task once duration has passed (checked once per poll()).
+         */
+        SleepAwaiter sleep(std::chrono::milliseconds duration);
+
+        /**
+         * @brief Awaitable: runs fn on a worker thread and resumes the task with its result.
+         *
+         * fn must not touch the server or handler state; the awaiting task continues on the loop.
+         */
+        template <class F>
+        OffloadAwaiter<F> offload(F fn) {
+            return OffloadAwaiter<F>(scheduler, std::move(fn));
+        }
+
+        /**
+         * @brief Opens an outgoing connection, e.g. to link with another server.
+         * @param remote_address IPv4 or IPv6 address to connect to.
+         * @param remote_port Port to connect to.
+         * @return The new client; onConnect fires once the connection is established,
+         * onDisconnect if it fails. Returns an invalid Client (fd -1) if connect() fails right away.
+         */
+        Client connectTo(const std::string& remote_address, uint16_t remote_port);
 
         /**
          * @brief Disconnects a client and deletes him from the server.
@@ -195,26 +591,269 @@ namespace MPlexServer {
         void disconnectClient(const Client& c);
         void disconnectClient(int fd);
 
+        /**
+         * @brief The one call that is safe from any thread: hands a task to the poll() thread.
+         *
+         * Lets workers, admin tools, bridges and timers on other threads send, broadcast,
+         * disconnect or run code on the loop (Posted::send/broadcast/disconnect/closure).
+         * Tasks run in posting order at the end of the next poll(), before output is
+         * flushed; a task for a client that has left is dropped. Tasks posted while the
+         * server is inactive run once it polls again.
+         * @return False if POST_QUEUE_CAPACITY tasks are pending; task is then left untouched, to retry or drop.
+         */
+        bool post(Posted&& task);
+
+        /**
+         * @brief Configures inbound flood control for all connections.
+         * @param tokens_per_second Refill rate of each client's token bucket.
+         * @param burst Maximum amount of tokens a client can save up.
+         * @param max_recvq Queued but not yet processed input (in bytes) after which a client is disconnected (Excess Flood).
+         */
+        void setFloodControl(double tokens_per_second, double burst, size_t max_recvq);
+
+        /**
+         * @brief Forgets all command penalties, every command costs 1 token again.
+         */
+        void clearCommandPenalties();
+
+        /**
+         * @brief Sets the penalty (token cost) of a command. Commands without an entry cost 1 token.
+         * @param command Command name as sent by the client (e.g. "PRIVMSG").
+         * @param penalty Amount of tokens the command costs. A penalty above the burst costs the whole burst.
+         */
+        void setCommandPenalty(const std::string& command, double penalty);
+
+        /**
+         * @brief Sets how many epoll events one poll() call takes at most (default MAX_EPOLL_EVENTS).
+         *
+         * Larger batches mean fewer epoll_wait() calls under load. May be changed between poll() calls.
+         */
+        void setEventBatch(size_t events);
+
+        /**
+         * @brief Sets how many bytes are read from a socket per readiness event (default Buffers::read_size).
+         *
+         * May be changed between poll() calls; takes effect for all connections.
+         */
+        void setReadSize(size_t bytes);
+
+        /**
+         * @brief Sets the number of threads offload() may use (default TASK_WORKER_THREADS).
+         *
+         * Threads are started on demand; lowering the number does not stop running ones.
+         */
+        void setWorkerThreads(size_t threads);
+
+        /**
+         * @brief Selects how poll() waits and how accepted sockets are tuned (LatencyProfile::named()).
+         *
+         * Call from the thread that runs poll(): a cpu >= 0 pins that thread, -1 undoes an
+         * earlier pinning. Offload workers keep the CPUs the process had before. Socket options
+         * apply to connections accepted from now on. Throws ServerError if pinning fails.
+         */
+        void setLatencyProfile(const LatencyProfile& profile);
+
+        /**
+         * @brief Exempts a client from flood control (e.g. operators).
+         * @param c Client to exempt.
+         * @param exempt True to disable throttling for this client.
+         */
+        void setFloodExempt(const Client& c, bool exempt);
+
+        /**
+         * @brief Output a client may have queued before bulk messages to it are dropped (default SENDQ_DEFAULT_MAX).
+         *
+         * Control output (sendTo(), sendLine(), sendSlices()) is not dropped, and
+         * generated replies wait for room instead. A client with more than
+         * SENDQ_HARD_FACTOR times the limit queued, of any class, is disconnected
+         * (SendQ exceeded) at the end of the poll() iteration. Throws ServerSettingsError below 4096.
+         */
+        void setSendQLimit(size_t max_bytes);
+
+        /**
+         * @brief Gives one client its own SendQ limit, e.g. a server link that must take a whole burst.
+         * @param c Client the limit applies to, until it disconnects.
+         * @param max_bytes Limit in place of setSendQLimit()'s, with the same rules; 0 goes back to that one.
+         *
+         * Throws ServerSettingsError below 4096 bytes (other than 0).
+         */
+        void setSendQLimit(const Client& c, size_t max_bytes);
+
+        /**
+         * @brief Attaches opaque per-connection data (e.g. the handler's user object) to a client.
+         * @param c Client the data belongs to.
+         * @param data Pointer stored in the connection slot.
+         */
+        void setUserData(const Client& c, void* data);
+
+        /**
+         * @return Returns the data attached with setUserData(), or nullptr if the client is gone.
+         */
+        [[nodiscard]] void* getUserData(const Client& c) const;
+        [[nodiscard]] void* getUserData(int fd) const;
+
+        /**
+         * @brief Sets a function that releases a connection's user data once its slot is freed.
+         */
+        void setUserDataDeleter(void (*deleter)(void*));
+
+        /**
+         * @return Returns all currently connected clients.
+         */
+        [[nodiscard]] std::vector<Client> getClients() const;
+
+        /**
+         * @brief Hands the listening socket and all client sockets over to a freshly exec'd binary.
+         *
+         * The new process is started with the UPGRADE_ENV environment variable pointing at
+         * a unix socket over which the fds (SCM_RIGHTS), the connection buffers and the
+         * opaque handler state are transferred. It has to call resume() instead of activate().
+         * @param binary Path of the executable to start.
+         * @param argv Arguments for the new process.
+         * @param handler_state Opaque state of the event handler, returned by resume() in the new process.
+         * @return True once the new process acknowledged the takeover; the caller must then exit
+         *         without sending anything. False if the upgrade failed and this process keeps serving.
+         */
+        bool handOver(const std::string& binary, char* const argv[], const std::string& handler_state);
+
+        /**
+         * @brief Takes over the sockets of a process that called handOver(). Replaces activate().
+         * @param channel Unix socket given in the UPGRADE_ENV environment variable.
+         * @return Returns the handler state passed to handOver().
+         */
+        std::string resume(int channel);
+
+        /**
+         * @brief Tells the old process that the handler restored its state, so it can exit.
+         */
+        void acknowledgeHandover();
+
+        /**
+         * @return Returns the client that had fd old_fd in the old process (fd -1 if unknown). Valid until acknowledgeHandover().
+         */
+        [[nodiscard]] Client importedClient(int old_fd) const;
+
+        /**
+         * @brief Records every connect, disconnect and dispatched line to path (format in capture.h).
+         *
+         * Connections that are already open are recorded from their next event on.
+         * Starting a new capture ends the previous one. Throws ServerError if path cannot be created.
+         */
+        void enableCapture(const std::string& path);
+
+        /**
+         * @brief Ends the capture and writes what is still buffered.
+         */
+        void disableCapture();
+
+        /**
+         * @brief Activates the server for an in-process replay instead of activate(): no listening socket.
+         *
+         * Connections are opened with replayConnect() and their output goes to sink
+         * instead of a socket. Spawned tasks and timers work as usual.
+         * @param sink Receives every client's output; must outlive the server's activation.
+         */
+        void activateReplay(OutputSink& sink);
+
+        /**
+         * @brief Opens a socket-free connection on a replaying server and calls onConnect.
+         */
+        Client replayConnect(const SocketAddress& addr);
+
+        /**
+         * @brief Hands line to onMessage as if c had sent it (no flood control, like a captured line).
+         */
+        void replayLine(const Client& c, std::string line);
+
+        /**
+         * @brief The client hung up: calls onDisconnect, the connection is closed by the next replayPollEnd().
+         */
+        void replayDisconnect(const Client& c);
+
+        /**
+         * @brief Ends a replayed poll() iteration: timers, onPollEnd, generators (run to the end) and output.
+         */
+        void replayPollEnd();
+
     private:
-        int server_fd;
-        const int port;
-        const std::string ipv4;
+        std::vector<Listener> listeners;    // [0]: the constructor's; in epoll as (index << 2) | 2
         int verbose;
         int epollfd;
         int clientCount;
-        std::unordered_map<int, Client> client_map;
-        std::unordered_map<int, std::string> send_buffer;
-        std::unordered_map<int, std::string> recv_buffer;
-        std::vector<int> disconnect_queue;
-        EventHandler* handler;
-
-        void log(std::string message, int required_level) const;
-        void deleteClient(const int fd);
-        void callHandler(EventType event, Client client, Message msg=Message()) const;
-        void modifyEpollFlags(int fd, int flags);
-        void recv_from_fd(int fd);
-        void send_to_fd(int fd);
-        void accept_client();
+        ConnectionTable connections;
+        std::unordered_map<std::string, double> command_penalty;
+        std::vector<std::pair<Connection*, uint32_t>> throttled_clients;
+        std::vector<std::pair<Connection*, uint32_t>> overflowed_clients;
+        std::vector<Connection*> disconnect_queue;
+        std::vector<Connection*> flush_queue;
+        std::vector<Connection*> generator_queue;
+        ssl_ctx_st* tls_ctx;
+        Handler* handler;
+        void (*user_data_deleter)(void*);
+        int handover_channel;
+        std::unordered_map<int, int> imported_fds;
+        double flood_rate;
+        double flood_burst;
+        size_t flood_max_recvq;
+        size_t max_sendq;
+        mutable int replying_fd;                    // client whose message onMessage is handling, -1 outside
+        std::vector<epoll_event> epoll_events;      // poll() batch
+        std::vector<char> read_buffer;              // recv()/SSL_read() target, setReadSize()
+        LatencyProfile latency;
+        bool pinned;
+        cpu_set_t unpinned_cpus;                    // affinity before setLatencyProfile() pinned the loop
+        TaskScheduler scheduler;
+        PostQueue posted;
+        std::unique_ptr<CaptureWriter> capture;
+        OutputSink* output_sink;
+
+        template <int Level, class... Parts>
+        void log(const Parts&... parts) const;
+        void enqueue(Connection& conn, const SharedMessage& msg, WebSocketFrames& frames, Priority priority);
+        void append_output(Connection& conn, std::string_view data, Priority priority = Priority::CONTROL);
+        Connection* lookup(const Client& c) const;
+        Connection* lookup(int fd) const;
+        void deleteClient(Connection& conn);
+        void callHandler(EventType event, const Client& client, const Message& msg=Message()) const;
+        void capture_event(EventType event, const Client& client, const Message& msg) const;
+        void end_iteration();
+        void run_posted(Posted& task);
+        void modifyEpollFlags(Connection& conn, int flags);
+        void recv_from_fd(Connection& conn);
+        void dispatch_lines(Connection& conn);
+        void resume_throttled();
+        void refill_tokens(FloodState& state) const;
+        double penalty_of(std::string_view line) const;
+        void update_epoll_interest(Connection& conn);
+        void mark_for_flush(Connection& conn);
+        size_t sendq_limit(const Connection& conn) const;
+        void drop_overflowed();
+        void flush_all();
+        void run_generators();
+        void send_to_fd(Connection& conn);
+        void accept_client(size_t index);
+        Connection* register_connection(int fd, const SocketAddress& addr, uint32_t events, uint16_t listener = NO_LISTENER);
+        void finish_connect(Connection& conn);
+        bool listening() const;
+        void listen_on(size_t index);
+        void close_listeners(bool unlink);
+        bool start_tls(Connection& conn);
+        void continue_handshake(Connection& conn);
+        void tls_recv(Connection& conn);
+        ssize_t tls_write(Connection& conn);
+        void release_tls(Connection& conn);
+        void ws_recv(Connection& conn, std::string_view data);
+        void free_tls_context();
+        void discard_client(Connection& conn);
+        void add_to_epoll(int fd, void* ptr, uint32_t events);
+        Task<> guard(Task<> task);
     };
+
+    /**
+     * @brief The server with a virtual EventHandler and runtime verbosity, built into libserver.a.
+     */
+    using Server = BasicServer<>;
+
+    extern template class BasicServer<EventHandler, RuntimeLog, DefaultBuffers>;
 }
 
@@ -0,0 +1,1215 @@
+#pragma once
+
+// Member definitions of BasicServer. Only translation units that instantiate
+// a server (see mplexserver.cpp) include this; everyone else uses mplexserver.h.
+
+#include "mplexserver.h"
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+template <class Handler, class Log, class Buffers>
+MPlexServer::BasicServer<Handler, Log, Buffers>::BasicServer(uint16_t port, const std::string ipv4) {
+    ListenerConfig config;
+    config.address = ipv4;
+    config.port = port == 0 ? 6667 : port;
+    this->listeners.push_back(Listener{config});
+    this->verbose = 0;
+    this->epollfd = -1;
+    this->clientCount = 0;
+    this->handler = nullptr;
+    this->user_data_deleter = nullptr;
+    this->handover_channel = -1;
+    this->flood_rate = FLOOD_DEFAULT_RATE;
+    this->flood_burst = FLOOD_DEFAULT_BURST;
+    this->flood_max_recvq = FLOOD_DEFAULT_RECVQ;
+    this->max_sendq = SENDQ_DEFAULT_MAX;
+    this->replying_fd = -1;
+    this->epoll_events.resize(MAX_EPOLL_EVENTS);
+    this->read_buffer.resize(Buffers::read_size);
+    this->pinned = false;
+    CPU_ZERO(&this->unpinned_cpus);
+    this->tls_ctx = nullptr;
+    this->output_sink = nullptr;
+}
+
+template <class Handler, class Log, class Buffers>
+MPlexServer::BasicServer<Handler, Log, Buffers>::~BasicServer() {
+    deactivate();
+    free_tls_context();
+}
+
+template <class Handler, class Log, class Buffers>
+MPlexServer::Connection* MPlexServer::BasicServer<Handler, Log, Buffers>::lookup(const Client& c) const {
+    Connection* conn = lookup(c.getFd());
+    if (conn == nullptr || conn->generation != c.getGeneration()) return nullptr;
+    return conn;
+}
+
+template <class Handler, class Log, class Buffers>
+MPlexServer::Connection* MPlexServer::BasicServer<Handler, Log, Buffers>::lookup(const int fd) const {
+    Connection* conn = connections.find(fd);
+    if (conn == nullptr || !conn->active) return nullptr;
+    return conn;
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::sendTo(const Client &c, std::string_view msg) {
+    log<2>("Queueing ", msg.size(), " bytes for fd ", c.getFd(), ": [", msg.substr(0, 50), "...");
+    Connection* conn = lookup(c);
+    if (conn == nullptr) {
+        log<2>("Dropping message for stale client fd ", c.getFd());
+        return;
+    }
+    append_output(*conn, msg);
+    mark_for_flush(*conn);
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::sendLine(const Client &c, std::string_view line) {
+    Connection* conn = lookup(c);
+    if (conn == nullptr) return;
+    log<2>("Queueing line for fd ", c.getFd(), ": [", line.substr(0, 50), "...");
+    if (conn->ws_mode == WsMode::OPEN) {
+        conn->ws->frame(conn->send_queue.queue(Priority::CONTROL), line);
+    } else {
+        conn->send_queue.append(line);
+        conn->send_queue.append("\r\n");
+    }
+    mark_for_flush(*conn);
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::enqueue(Connection& conn, const SharedMessage& msg, WebSocketFrames& frames,
+                                                              Priority priority) {
+    if (conn.fd == replying_fd) {
+        // the sender's own copy of a channel event is a reply too, and must not fall behind the numerics that follow it
+        priority = Priority::CONTROL;
+    }
+    if (priority == Priority::BULK) {
+        // a client that cannot keep up loses channel traffic, not the replies it is waiting for
+        if (conn.send_queue.size() + msg.size() > sendq_limit(conn)) {
+            if (!conn.shedding) {
+                log<1>("SendQ of fd ", conn.fd, " full (", conn.send_queue.size(), " bytes), dropping bulk messages.");
+                conn.shedding = true;
+            }
+            return;
+        }
+        conn.shedding = false;
+    }
+    if (conn.ws_mode == WsMode::OPEN) {
+        for (const Slice& slice : frames.slices(conn.ws->binary())) {
+            conn.send_queue.append(slice, priority);
+        }
+    } else {
+        conn.send_queue.append(msg, priority);
+    }
+    if (priority == Priority::BULK) {
+        conn.send_queue.endBulkMessage();
+    }
+    mark_for_flush(conn);
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::append_output(Connection& conn, const std::string_view data,
+                                                                    const Priority priority) {
+    if (conn.ws_mode == WsMode::OPEN) {
+        conn.ws->frame(conn.send_queue.queue(priority), data);
+    } else {
+        conn.send_queue.append(data, priority);
+    }
+    if (priority == Priority::BULK) {
+        conn.send_queue.endBulkMessage();
+    }
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::mark_for_flush(Connection& conn) {
+    if (!conn.sendq_exceeded && conn.send_queue.size() > SENDQ_HARD_FACTOR * sendq_limit(conn)) {
+        // not disconnected from here: a handler may be in the middle of a fan-out
+        conn.sendq_exceeded = true;
+        overflowed_clients.emplace_back(&conn, conn.generation);
+    }
+    if (conn.flush_pending || conn.write_blocked) return;
+    conn.flush_pending = true;
+    flush_queue.push_back(&conn);
+}
+
+template <class Handler, class Log, class Buffers>
+size_t MPlexServer::BasicServer<Handler, Log, Buffers>::sendq_limit(const Connection& conn) const {
+    return conn.sendq_limit != 0 ? conn.sendq_limit : max_sendq;
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::addListener(const ListenerConfig& config) {
+    if (epollfd != -1) {
+        throw ServerSettingsError("Listeners must be added before the server is activated");
+    }
+    if (listeners.size() >= NO_LISTENER) {
+        throw ServerSettingsError("Too many listeners");
+    }
+    for (const Listener& listener : listeners) {
+        if (listener.config.describe() == config.describe()) {
+            throw ServerSettingsError("Duplicate listener " + config.describe());
+        }
+    }
+    listeners.push_back(Listener{config});
+}
+
+template <class Handler, class Log, class Buffers>
+const MPlexServer::ListenerConfig* MPlexServer::BasicServer<Handler, Log, Buffers>::getListener(const Client& c) const {
+    if (c.getListener() >= listeners.size()) return nullptr;
+    return &listeners[c.getListener()].config;
+}
+
+template <class Handler, class Log, class Buffers>
+bool MPlexServer::BasicServer<Handler, Log, Buffers>::listening() const {
+    return std::any_of(listeners.begin(), listeners.end(), [](const Listener& l) { return l.fd != -1; });
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::listen_on(const size_t index) {
+    Listener& listener = listeners[index];
+    if (listener.config.kind == ListenerKind::TLS && tls_ctx == nullptr) {
+        throw ServerSettingsError("TLS listener " + listener.config.describe() + " has no certificate");
+    }
+    if (listener.fd == -1) {
+        listener.open();        // otherwise taken over from the previous binary
+    }
+    // tagged like the scheduler's fd waiters, but with bit 1: no Connection lives at such an address
+    add_to_epoll(listener.fd, reinterpret_cast<void*>((static_cast<uintptr_t>(index) << 2) | 2), EPOLLIN);
+    log<1>("Listening on ", listener.config.describe());
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::close_listeners(const bool unlink) {
+    for (Listener& listener : listeners) {
+        listener.close(unlink);
+    }
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::activate() {
+    const int epoll_fd = epoll_create1(0);
+    if (epoll_fd < 0) {
+        throw ServerError("Failed to create epoll instance");
+    }
+    this->epollfd = epoll_fd;
+    try {
+        for (size_t i = 0; i < listeners.size(); ++i) {
+            listen_on(i);
+        }
+    } catch (std::exception&) {
+        close_listeners(true);
+        close(epollfd);
+        epollfd = -1;
+        throw;
+    }
+    scheduler.attach(epollfd);
+    posted.attach(epollfd);
+    BufferPool::bindThread();
+
+    log<1>("Server successfully activated");
+}
+
+template <class Handler, class Log, class Buffers>
+template <int Level, class... Parts>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::log(const Parts&... parts) const {
+    // levels above the policy's maximum are not even instantiated
+    if constexpr (Level <= Log::max_level) {
+        if (Log::enabled(Level, this->verbose)) {
+            auto now = std::chrono::system_clock::now();
+            std::time_t now_time = std::chrono::system_clock::to_time_t(now);
+            std::tm local_tm = *std::localtime(&now_time);
+            std::cout << "[MPlexServer][" << std::put_time(&local_tm, "%Y-%m-%d@%H:%M:%S") << "] ";
+            (std::cout << ... << parts) << std::endl;
+        }
+    }
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::deactivate() {
+    scheduler.shutdown();
+    if (capture != nullptr) capture->flush();
+    output_sink = nullptr;
+    for (Connection& conn : connections) {
+        if (!conn.active) continue;
+        if (epoll_ctl(epollfd,EPOLL_CTL_DEL,conn.fd,nullptr) == -1) {
+            log<0>("Critical error could not delete fd from epoll.");
+        }
+        release_tls(conn);
+        close(conn.fd);
+        if (user_data_deleter != nullptr && conn.user_data != nullptr) {
+            user_data_deleter(conn.user_data);
+        }
+    }
+    this->clientCount = 0;
+    this->connections.clear();
+    this->throttled_clients.clear();
+    this->overflowed_clients.clear();
+    this->disconnect_queue.clear();
+    this->flush_queue.clear();
+    this->generator_queue.clear();
+    close_listeners(true);
+    if (epollfd != -1) close(epollfd);
+    epollfd = -1;
+    log<1>("Server has been deactivated.");
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::setVerbose(const int level) {
+    if (level <= VERBOSITY_MAX && level >= 0) {
+        this->verbose = level;
+    } else {
+        throw ServerSettingsError("Verbosity level does not exist");
+    }
+}
+
+template <class Handler, class Log, class Buffers>
+int MPlexServer::BasicServer<Handler, Log, Buffers>::getVerbose() const {
+    return this->verbose;
+}
+
+template <class Handler, class Log, class Buffers>
+int MPlexServer::BasicServer<Handler, Log, Buffers>::getConnectedClientsCount() const {
+    return this->clientCount;
+}
+
+template <class Handler, class Log, class Buffers>
+MPlexServer::MemoryStats MPlexServer::BasicServer<Handler, Log, Buffers>::memoryStats() const {
+    MemoryStats stats;
+    stats.slot_bytes = connections.heldBytes();
+    for (const Connection& conn : connections) {
+        if (!conn.active) continue;
+        const size_t held = (conn.recv_buffer.capacity() > pooled_string().capacity() ? conn.recv_buffer.capacity() : 0)
+                            + conn.send_queue.heldBytes()
+                            + conn.generators.capacity() * sizeof(conn.generators[0])
+                            + (conn.ws != nullptr ? sizeof(WebSocket) + conn.ws->heldBytes() : 0);
+        stats.connections++;
+        stats.idle += held == 0 && conn.generators.empty();
+        stats.buffer_bytes += held;
+        stats.queued_bytes += conn.send_queue.size();
+    }
+    return stats;
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::recv_from_fd(Connection& conn) {
+    if (conn.tls != nullptr) {
+        tls_recv(conn);
+        return;
+    }
+    char* const buffer = read_buffer.data();
+    const ssize_t n = recv(conn.fd, buffer, read_buffer.size(), 0);
+    if (n == 0) {
+        log<1>("Client disconnected (EOF)");
+        disconnectClient(conn.fd);
+        return;
+    }
+    if (n < 0) {
+        switch (errno) {
+            case EAGAIN:
+                break;
+            case ECONNRESET:
+                log<1>("Connection of client has been reset");
+                disconnectClient(conn.fd);
+                break;
+            case ETIMEDOUT:
+                log<1>("Client has timed out");
+                disconnectClient(conn.fd);
+                break;
+            default:
+                log<1>("Unkown error occured while reading from client");
+                disconnectClient(conn.fd);
+                break;
+
+        }
+        return;
+    }
+    log<2>(std::string_view(buffer, n));
+    if (conn.ws != nullptr) {
+        ws_recv(conn, std::string_view(buffer, n));
+        return;
+    }
+    conn.recv_buffer.append(buffer, n);
+    dispatch_lines(conn);
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::refill_tokens(FloodState& state) const {
+    const auto now = std::chrono::steady_clock::now();
+    const std::chrono::duration<double> elapsed = now - state.last_refill;
+    state.tokens = std::min(flood_burst, state.tokens + elapsed.count() * flood_rate);
+    state.last_refill = now;
+}
+
+template <class Handler, class Log, class Buffers>
+double MPlexServer::BasicServer<Handler, Log, Buffers>::penalty_of(std::string_view line) const {
+    // the command follows the "@tags " section as in Message::getBody(), and an optional prefix
+    if (!line.empty() && line[0] == '@') {
+        const size_t space = line.substr(0, MAX_TAG_BYTES).find(' ');
+        if (space != std::string_view::npos) line.remove_prefix(space + 1);
+    }
+    size_t start = 0;
+    if (!line.empty() && line[0] == ':') {
+        start = line.find(' ');
+        if (start == std::string_view::npos) return 1;
+        ++start;
+    }
+    const size_t end = line.find_first_of(" \r", start);
+    const auto it = command_penalty.find(std::string(line.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start)));
+    // a full bucket always pays for one line, or a client could never get past it
+    return it == command_penalty.end() ? std::min(1.0, flood_burst) : std::min(it->second, flood_burst);
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::dispatch_lines(Connection& conn) {
+    pooled_string& r_buffer = conn.recv_buffer;
+    FloodState& state = conn.flood;
+    const bool was_throttled = state.throttled;
+    refill_tokens(state);
+    state.throttled = false;
+    size_t start = 0;
+    size_t pos;
+    while ((pos = r_buffer.find("\r\n", start)) != std::string::npos) {
+        if (conn.disconnecting) break;
+        std::string msg(r_buffer.data() + start, pos+1 - start);
+        if (!state.exempt) {
+            const double penalty = penalty_of(msg);
+            if (state.tokens < penalty) {
+                state.throttled = true;
+                break;
+            }
+            state.tokens -= penalty;
+        }
+        start = pos+2;
+        callHandler(EventType::MESSAGE,conn.client,Message(std::move(msg),conn.client));
+    }
+    // dispatched lines leave the buffer at once instead of shifting it for every line
+    r_buffer.erase(0,start);
+    if (r_buffer.empty()) {
+        pooled_string().swap(r_buffer);     // idle clients keep no input block
+    }
+    if (conn.disconnecting) return;
+    // What is left is a line without CRLF yet, or the lines behind a throttle. While
+    // throttled, reading stays paused until the bucket refilled, so the kernel buffer
+    // holds the rest. Once that plus our queue exceeds the limit: Excess Flood.
+    size_t queued = r_buffer.size();
+    if (state.throttled) {
+        int pending = 0;
+        if (ioctl(conn.fd, FIONREAD, &pending) == -1) pending = 0;
+        queued += static_cast<size_t>(pending);
+    }
+    if (queued > flood_max_recvq) {
+        log<1>("Client fd ", conn.fd, " disconnected: Excess Flood");
+        disconnectClient(conn.fd);
+        return;
+    }
+    if (state.throttled && !was_throttled) {
+        log<2>("Throttling client fd ", conn.fd);
+        throttled_clients.emplace_back(&conn, conn.generation);
+    }
+    if (state.throttled != was_throttled) {
+        update_epoll_interest(conn);
+    }
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::resume_throttled() {
+    if (throttled_clients.empty()) return;
+    std::vector<std::pair<Connection*, uint32_t>> pending;
+    pending.swap(throttled_clients);
+    for (const auto& [conn, generation] : pending) {
+        if (!conn->active || conn->generation != generation || !conn->flood.throttled) continue;
+        refill_tokens(conn->flood);
+        // resume only once the line we stopped at can be paid for
+        const pooled_string& input = conn->recv_buffer;
+        const size_t end = input.find("\r\n");
+        if (end == std::string::npos || conn->flood.tokens >= penalty_of(std::string_view(input.data(), end + 1))) {
+            dispatch_lines(*conn);
+        }
+        if (conn->active && conn->flood.throttled) {
+            throttled_clients.emplace_back(conn, generation);
+        }
+    }
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::setFloodControl(const double tokens_per_second, const double burst, const size_t max_recvq) {
+    if (tokens_per_second <= 0 || burst < 1) {
+        throw ServerSettingsError("Invalid flood control settings");
+    }
+    this->flood_rate = tokens_per_second;
+    this->flood_burst = burst;
+    this->flood_max_recvq = max_recvq;
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::clearCommandPenalties() {
+    command_penalty.clear();
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::setEventBatch(const size_t events) {
+    if (events == 0 || events > INT_MAX) {
+        throw ServerSettingsError("Invalid epoll batch size");
+    }
+    epoll_events.resize(events);
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::setReadSize(const size_t bytes) {
+    if (bytes < 64 || bytes > INT_MAX) {
+        throw ServerSettingsError("Invalid read size");
+    }
+    read_buffer.resize(bytes);
+    read_buffer.shrink_to_fit();
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::setWorkerThreads(const size_t threads) {
+    scheduler.set_max_workers(threads);
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::setLatencyProfile(const LatencyProfile& profile) {
+    if (profile.spin_us < 0) {
+        throw ServerSettingsError("Invalid spin budget");
+    }
+    if (profile.cpu >= 0) {
+        if (profile.cpu >= CPU_SETSIZE) {
+            throw ServerSettingsError("Invalid CPU " + std::to_string(profile.cpu));
+        }
+        if (!pinned && sched_getaffinity(0, sizeof(unpinned_cpus), &unpinned_cpus) == -1) {
+            throw ServerError(std::string("Failed to read the CPU affinity: ") + std::strerror(errno));
+        }
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(profile.cpu, &cpus);
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) == -1) {
+            throw ServerError("Failed to pin the loop to CPU " + std::to_string(profile.cpu) + ": " + std::strerror(errno));
+        }
+        // workers started from here on would inherit the loop's CPU
+        scheduler.set_worker_cpus(unpinned_cpus);
+        pinned = true;
+        log<1>("Event loop pinned to CPU ", profile.cpu);
+    } else if (pinned) {
+        sched_setaffinity(0, sizeof(unpinned_cpus), &unpinned_cpus);
+        pinned = false;
+    }
+    latency = profile;
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::setSendQLimit(const size_t max_bytes) {
+    if (max_bytes < 4096) {
+        throw ServerSettingsError("SendQ limit below 4096 bytes");
+    }
+    max_sendq = max_bytes;
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::setSendQLimit(const Client& c, const size_t max_bytes) {
+    if (max_bytes != 0 && max_bytes < 4096) {
+        throw ServerSettingsError("SendQ limit below 4096 bytes");
+    }
+    Connection* conn = lookup(c);
+    if (conn == nullptr) return;
+    conn->sendq_limit = max_bytes;
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::setCommandPenalty(const std::string& command, const double penalty) {
+    if (penalty < 0) {
+        throw ServerSettingsError("Negative penalty for " + command);
+    }
+    command_penalty[command] = penalty;
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::setFloodExempt(const Client& c, const bool exempt) {
+    Connection* conn = lookup(c);
+    if (conn == nullptr) return;
+    conn->flood.exempt = exempt;
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::setUserData(const Client& c, void* data) {
+    Connection* conn = lookup(c);
+    if (conn == nullptr) return;
+    conn->user_data = data;
+}
+
+template <class Handler, class Log, class Buffers>
+void* MPlexServer::BasicServer<Handler, Log, Buffers>::getUserData(const Client& c) const {
+    const Connection* conn = lookup(c);
+    return conn == nullptr ? nullptr : conn->user_data;
+}
+
+template <class Handler, class Log, class Buffers>
+void* MPlexServer::BasicServer<Handler, Log, Buffers>::getUserData(const int fd) const {
+    const Connection* conn = lookup(fd);
+    return conn == nullptr ? nullptr : conn->user_data;
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::setUserDataDeleter(void (*deleter)(void*)) {
+    this->user_data_deleter = deleter;
+}
+
+template <class Handler, class Log, class Buffers>
+std::vector<MPlexServer::Client> MPlexServer::BasicServer<Handler, Log, Buffers>::getClients() const {
+    std::vector<Client> clients;
+    clients.reserve(clientCount);
+    for (const Connection& conn : connections) {
+        if (conn.active && !conn.disconnecting && conn.established()) {
+            clients.push_back(conn.client);
+        }
+    }
+    return clients;
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::update_epoll_interest(Connection& conn) {
+    uint32_t flags = EPOLLRDHUP;
+    if (!conn.flood.throttled && !conn.connecting) flags |= EPOLLIN;
+    if (conn.write_blocked || conn.connecting) flags |= EPOLLOUT;
+    if (flags == conn.epoll_events) return;
+    modifyEpollFlags(conn, flags);
+    conn.epoll_events = flags;
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::flush_all() {
+    // a failing send disconnects, and onDisconnect may queue output for others
+    while (!flush_queue.empty()) {
+        std::vector<Connection*> pending;
+        pending.swap(flush_queue);
+        for (Connection* conn : pending) {
+            conn->flush_pending = false;
+            if (!conn->active || conn->write_blocked) continue;
+            send_to_fd(*conn);
+        }
+    }
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::attachGenerator(const Client& c, std::unique_ptr<OutputGenerator> generator) {
+    Connection* conn = lookup(c);
+    if (conn == nullptr || generator == nullptr) return;
+    conn->generators.push_back(std::move(generator));
+    if (!conn->generating) {
+        conn->generating = true;
+        generator_queue.push_back(conn);
+    }
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::spawn(Task<> task) {
+    scheduler.spawn(guard(std::move(task)));
+}
+
+template <class Handler, class Log, class Buffers>
+MPlexServer::Task<> MPlexServer::BasicServer<Handler, Log, Buffers>::guard(Task<> task) {
+    try {
+        co_await task;
+    } catch (const std::exception& e) {
+        log<0>("Task failed: ", e.what());
+    }
+}
+
+template <class Handler, class Log, class Buffers>
+MPlexServer::FdAwaiter MPlexServer::BasicServer<Handler, Log, Buffers>::readable(const int fd, const int timeout_ms) {
+    return FdAwaiter(scheduler, fd, EPOLLIN | EPOLLRDHUP, timeout_ms);
+}
+
+template <class Handler, class Log, class Buffers>
+MPlexServer::FdAwaiter MPlexServer::BasicServer<Handler, Log, Buffers>::writable(const int fd, const int timeout_ms) {
+    return FdAwaiter(scheduler, fd, EPOLLOUT, timeout_ms);
+}
+
+template <class Handler, class Log, class Buffers>
+MPlexServer::SleepAwaiter MPlexServer::BasicServer<Handler, Log, Buffers>::sleep(const std::chrono::milliseconds duration) {
+    return SleepAwaiter(scheduler, std::chrono::steady_clock::now() + duration);
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::run_generators() {
+    for (size_t i = 0; i < generator_queue.size();) {
+        Connection* conn = generator_queue[i];
+        if (!conn->active || conn->generators.empty()) {
+            conn->generating = false;
+            generator_queue[i] = generator_queue.back();
+            generator_queue.pop_back();
+            continue;
+        }
+        ++i;
+        // refill only once the previous part has (almost) left; EPOLLOUT clears write_blocked
+        if (conn->disconnecting || conn->write_blocked || conn->send_queue.size(Priority::BULK) >= GENERATOR_CHUNK) continue;
+        std::string part;
+        if (!conn->generators.front()->generate(part, GENERATOR_CHUNK)) {
+            conn->generators.erase(conn->generators.begin());
+            if (conn->generators.empty()) conn->generators.shrink_to_fit();
+        }
+        if (!part.empty()) {
+            // bulk, so answers to PING and other commands overtake a long reply
+            append_output(*conn, part, Priority::BULK);
+            mark_for_flush(*conn);
+        }
+    }
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::send_to_fd(Connection& conn) {
+    if (!conn.established()) return;    // flushed once connect or handshake completed
+    SendQueue& queue = conn.send_queue;
+    if (output_sink != nullptr) {
+        // replay: the connection has no socket, everything leaves at once
+        while (!queue.empty()) {
+            const std::string_view head = queue.front();
+            output_sink->write(conn.client, head);
+            queue.consume(head.size());
+        }
+        conn.write_blocked = false;
+        return;
+    }
+    while (!queue.empty()) {
+        const size_t queued = queue.size();
+        const ssize_t sent = conn.tls_mode == TlsMode::USERSPACE ? tls_write(conn) : queue.flush(conn.fd);
+
+        if (sent > 0) {
+            log<2>("Sent ", sent, " bytes of ", queued);
+        }
+        else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            log<2>("Send would block (EAGAIN)");
+            break;
+        }
+        else if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        else if (sent == 0) {
+            log<1>("Send returned 0, connection closed");
+            disconnectClient(conn.fd);
+            return;
+        }
+        else {
+            log<0>("Unknown error occurred while sending to client, errno: ", errno);
+            disconnectClient(conn.fd);
+            return;
+        }
+    }
+    // only a socket that is actually full waits for EPOLLOUT
+    conn.write_blocked = !queue.empty();
+    update_epoll_interest(conn);
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::accept_client(const size_t index) {
+    const Listener& listener = listeners[index];
+    SocketAddress client_addr{};
+    socklen_t len = sizeof(client_addr);
+    const int clientFd = accept(listener.fd, &client_addr.any, &len);
+    if (clientFd < 0) {
+        log<1>("Failed to accept client.");
+        return;
+    }
+    try {
+        setNonBlocking(clientFd);
+    } catch (std::runtime_error &e) {
+        log<0>(e.what());
+        close(clientFd);
+        return;
+    }
+
+    if (listener.config.isUnix()) {
+        client_addr.any.sa_family = AF_UNIX;    // unnamed peers may come back without any address
+    }
+    if (!listener.config.sockets.merged(latency.sockets).apply(clientFd, !listener.config.isUnix())) {
+        log<1>("Some socket options were refused on ", listener.config.describe(), ": ", std::strerror(errno));
+    }
+
+    Connection* slot = register_connection(clientFd, client_addr, EPOLLIN | EPOLLRDHUP, static_cast<uint16_t>(index));
+    if (slot == nullptr) return;
+    Connection& conn = *slot;
+    clientCount++;
+    if (listener.config.kind == ListenerKind::WEBSOCKET) {
+        // like TLS, the handler only learns about the client once the upgrade is done
+        log<1>("New WebSocket client accepted, waiting for the upgrade request.");
+        conn.ws = std::make_unique<WebSocket>();
+        conn.ws_mode = WsMode::HANDSHAKE;
+        return;
+    }
+    if (listener.config.kind == ListenerKind::TLS) {
+        // the handler only learns about the client once the handshake is done
+        log<1>("New TLS client accepted, starting handshake.");
+        if (!start_tls(conn)) {
+            discard_client(conn);
+        }
+        return;
+    }
+    log<1>("New client accepted.");
+    callHandler(EventType::CONNECTED,conn.client);
+}
+
+template <class Handler, class Log, class Buffers>
+MPlexServer::Connection* MPlexServer::BasicServer<Handler, Log, Buffers>::register_connection(const int fd, const SocketAddress& addr, const uint32_t events, const uint16_t listener) {
+    Connection& conn = connections.slot(fd);
+
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.ptr = &conn;
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        close(fd);
+        log<0>("Failed to add client to epoll.");
+        return nullptr;
+    }
+    conn.epoll_events = ev.events;
+    conn.fd = fd;
+    conn.generation++;
+    conn.active = true;
+    conn.disconnecting = false;
+    conn.client = Client(fd, addr, conn.generation, listener);
+    conn.flood = FloodState{flood_burst};
+    return &conn;
+}
+
+template <class Handler, class Log, class Buffers>
+MPlexServer::Client MPlexServer::BasicServer<Handler, Log, Buffers>::connectTo(const std::string& remote_address, const uint16_t remote_port) {
+    if (epollfd == -1) {
+        throw ServerError("Cannot connect from an inactive server");
+    }
+    SocketAddress addr{};
+    if (inet_pton(AF_INET, remote_address.c_str(), &addr.v4.sin_addr.s_addr) == 1) {
+        addr.v4.sin_family = AF_INET;
+        addr.v4.sin_port = htons(remote_port);
+    } else if (inet_pton(AF_INET6, remote_address.c_str(), &addr.v6.sin6_addr) == 1) {
+        addr.v6.sin6_family = AF_INET6;
+        addr.v6.sin6_port = htons(remote_port);
+    } else {
+        throw ServerSettingsError("Invalid IP address");
+    }
+    const int fd = socket(addr.family(), SOCK_STREAM, 0);
+    if (fd < 0) {
+        log<0>("Failed to open socket for outgoing connection.");
+        return Client();
+    }
+    try {
+        setNonBlocking(fd);
+    } catch (std::runtime_error &e) {
+        log<0>(e.what());
+        close(fd);
+        return Client();
+    }
+    if (connect(fd, &addr.any, addr.length()) == -1 && errno != EINPROGRESS) {
+        log<1>("Connecting to ", remote_address, ":", remote_port, " failed.");
+        close(fd);
+        return Client();
+    }
+    Connection* conn = register_connection(fd, addr, EPOLLOUT | EPOLLRDHUP);
+    if (conn == nullptr) return Client();
+    conn->connecting = true;
+    clientCount++;
+    log<1>("Connecting to ", remote_address, ":", remote_port, ".");
+    return conn->client;
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::finish_connect(Connection& conn) {
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1 || error != 0) {
+        log<1>("Outgoing connection on fd ", conn.fd, " failed: ", std::strerror(error));
+        conn.connecting = false;
+        disconnectClient(conn.fd);
+        return;
+    }
+    conn.connecting = false;
+    update_epoll_interest(conn);
+    log<1>("Outgoing connection on fd ", conn.fd, " established.");
+    callHandler(EventType::CONNECTED,conn.client);
+    if (!conn.send_queue.empty()) {
+        mark_for_flush(conn);
+    }
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::discard_client(Connection& conn) {
+    if (conn.disconnecting) return;
+    conn.disconnecting = true;
+    disconnect_queue.push_back(&conn);
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::poll() {
+    epoll_event* const events = epoll_events.data();
+    int numEvents = 0;
+    const int batch = static_cast<int>(epoll_events.size());
+    while (true) {
+        // don't sleep while a generator could produce more output right away
+        const bool generator_ready = std::any_of(generator_queue.begin(), generator_queue.end(),
+                                                 [](const Connection* c) { return !c->write_blocked; });
+        numEvents = 0;
+        if (latency.spin_us > 0 && !generator_ready) {
+            // busy-poll: whatever arrives within the budget is handled without waiting for a wakeup
+            const auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(latency.spin_us);
+            do {
+                numEvents = epoll_wait(epollfd, events, batch, 0);
+            } while (numEvents == 0 && std::chrono::steady_clock::now() < until);
+        }
+        if (numEvents == 0) {
+            numEvents = epoll_wait(epollfd, events, batch, generator_ready ? 0 : 1); // timeout (in ms) of 0 return immediately (potentially negating the use of poll?)
+        }
+        if (numEvents == EAGAIN) {
+            continue;
+        }
+        if (numEvents == -1) {
+            log<0>("Failed to poll events.");
+            return;
+        }
+        break;
+    }
+
+    for (int i = 0; i < numEvents; ++i) {
+        const uintptr_t tag = reinterpret_cast<uintptr_t>(events[i].data.ptr);
+        if ((tag & 3) == 2) {
+            if (events[i].events & EPOLLIN) accept_client(tag >> 2);
+            continue;
+        }
+        if (scheduler.handle_event(events[i]) || posted.handle_event(events[i])) continue;
+        Connection* conn = static_cast<Connection*>(events[i].data.ptr);
+        if (!conn->active || conn->disconnecting) continue;
+        if (conn->connecting) {
+            finish_connect(*conn);
+            continue;
+        }
+        if (conn->tls_mode == TlsMode::HANDSHAKE) {
+            if (events[i].events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)) {
+                log<1>("TLS client left during handshake.");
+                discard_client(*conn);
+            } else {
+                continue_handshake(*conn);
+            }
+            continue;
+        }
+        if (events[i].events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)) {
+            log<1>("Client disconnected.");
+            disconnectClient(conn->fd);
+            continue;
+        }
+        if (events[i].events & EPOLLIN) {
+            recv_from_fd(*conn);
+        }
+        if (events[i].events & EPOLLOUT && !conn->disconnecting) {
+            send_to_fd(*conn);
+        }
+    }
+    end_iteration();
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::end_iteration() {
+    posted.drain([this](Posted& task) { run_posted(task); });
+    resume_throttled();
+    scheduler.run_timers();
+    if (capture != nullptr) {
+        capture->pollEnd();
+    }
+    if (handler != nullptr) {
+        handler->onPollEnd();
+    }
+    run_generators();
+    drop_overflowed();
+    // Output was only queued so far. One direct send per connection with data,
+    // this also gives clients being dropped a last chance to get their ERROR line.
+    flush_all();
+    for (Connection* conn : disconnect_queue) {
+        deleteClient(*conn);
+    }
+    disconnect_queue.clear();
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::drop_overflowed() {
+    // onDisconnect may push other clients over the limit in turn
+    while (!overflowed_clients.empty()) {
+        std::vector<std::pair<Connection*, uint32_t>> pending;
+        pending.swap(overflowed_clients);
+        for (const auto& [conn, generation] : pending) {
+            if (!conn->active || conn->generation != generation || conn->disconnecting) continue;
+            log<1>("Client fd ", conn->fd, " disconnected: SendQ exceeded (", conn->send_queue.size(), " bytes)");
+            conn->send_queue.clear();
+            disconnectClient(conn->fd);
+        }
+    }
+}
+
+template <class Handler, class Log, class Buffers>
+bool MPlexServer::BasicServer<Handler, Log, Buffers>::post(Posted&& task) {
+    return posted.push(task);
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::run_posted(Posted& task) {
+    if (task.kind == Posted::Kind::BROADCAST) {
+        broadcast(task.text);
+        return;
+    }
+    if (task.kind == Posted::Kind::CALL) {
+        try {
+            task.fn();
+        } catch (std::exception& e) {
+            log<0>("Posted task failed: ", e.what());
+        }
+        return;
+    }
+    Connection* conn = lookup(task.fd);
+    if (conn == nullptr || conn->generation != task.generation) {
+        log<2>("Dropping posted task for stale client fd ", task.fd);
+        return;
+    }
+    if (task.kind == Posted::Kind::SEND) {
+        sendTo(conn->client, task.text);
+    } else {
+        disconnectClient(conn->client);
+    }
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::modifyEpollFlags(Connection& conn, const int flags) {
+    epoll_event ev{};
+    ev.data.ptr = &conn;
+    ev.events = flags;
+    if (epoll_ctl(epollfd, EPOLL_CTL_MOD,conn.fd,&ev) == -1) {
+        log<0>("Failed to mod epoll.");
+    }
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::disconnectClient(const Client& c) {
+    Connection* conn = lookup(c);
+    if (conn == nullptr || conn->disconnecting)
+        return;
+    conn->disconnecting = true;
+    callHandler(EventType::DISCONNECTED,conn->client);
+    disconnect_queue.push_back(conn);
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::disconnectClient(const int fd) {
+    Connection* conn = lookup(fd);
+    if (conn == nullptr || conn->disconnecting)
+        return;
+    conn->disconnecting = true;
+    callHandler(EventType::DISCONNECTED,conn->client);
+    disconnect_queue.push_back(conn);
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::deleteClient(Connection& conn) {
+    clientCount--;
+    if (epoll_ctl(epollfd,EPOLL_CTL_DEL,conn.fd,nullptr) == -1) {
+        log<0>("Critical error could not delete fd from epoll.");
+    }
+    log<2>("Closing client file descriptor.");
+    release_tls(conn);
+    close(conn.fd);
+    if (user_data_deleter != nullptr && conn.user_data != nullptr) {
+        user_data_deleter(conn.user_data);
+    }
+    conn.active = false;
+    conn.disconnecting = false;
+    conn.user_data = nullptr;
+    conn.client = Client();
+    pooled_string().swap(conn.recv_buffer);
+    conn.send_queue.clear();
+    conn.shedding = false;
+    conn.sendq_exceeded = false;
+    conn.sendq_limit = 0;
+    conn.flood = FloodState{};
+    conn.epoll_events = 0;
+    conn.flush_pending = false;
+    conn.write_blocked = false;
+    conn.connecting = false;
+    conn.capture_id = 0;
+    conn.ws.reset();
+    conn.ws_mode = WsMode::NONE;
+    decltype(conn.generators)().swap(conn.generators);  // the slot leaves generator_queue on the next run_generators()
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::setEventHandler(Handler *handler) {
+    this->handler = handler;
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::callHandler(EventType event, const Client& client, const Message& msg) const {
+    if (handler == nullptr)
+        return;
+    if (capture != nullptr) {
+        capture_event(event, client, msg);
+    }
+    switch (event) {
+        case EventType::CONNECTED:
+            handler->onConnect(client);
+            break;
+        case EventType::DISCONNECTED:
+            handler->onDisconnect(client);
+            break;
+        case EventType::MESSAGE:
+            replying_fd = client.getFd();
+            handler->onMessage(msg);
+            replying_fd = -1;
+    }
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::capture_event(const EventType event, const Client& client, const Message& msg) const {
+    Connection* conn = lookup(client);
+    if (conn == nullptr) return;
+    if (conn->capture_id == 0) {
+        // connected before the capture started (or imported on upgrade): announce it now
+        conn->capture_id = capture->nextId();
+        capture->connect(conn->capture_id, client.getAddress());
+        if (event == EventType::CONNECTED) return;
+    }
+    switch (event) {
+        case EventType::CONNECTED:
+            break;
+        case EventType::DISCONNECTED:
+            capture->disconnect(conn->capture_id);
+            break;
+        case EventType::MESSAGE:
+            capture->line(conn->capture_id, msg.getMessage());
+    }
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::enableCapture(const std::string& path) {
+    capture = std::make_unique<CaptureWriter>(path);
+    for (Connection& conn : connections) {
+        conn.capture_id = 0;
+    }
+    log<1>("Capturing traffic to ", path);
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::disableCapture() {
+    capture.reset();
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::activateReplay(OutputSink& sink) {
+    const int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        throw ServerError("Failed to create epoll instance");
+    }
+    this->epollfd = epoll_fd;
+    this->output_sink = &sink;
+    scheduler.attach(epollfd);
+    posted.attach(epollfd);
+    BufferPool::bindThread();
+    log<1>("Server activated for replay");
+}
+
+template <class Handler, class Log, class Buffers>
+MPlexServer::Client MPlexServer::BasicServer<Handler, Log, Buffers>::replayConnect(const SocketAddress& addr) {
+    if (output_sink == nullptr) {
+        throw ServerError("Server is not activated for replay");
+    }
+    // never readable: it only reserves an fd, and with it a connection slot, for the client
+    const int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) {
+        throw ServerError("Failed to create replay connection");
+    }
+    Connection* conn = register_connection(fd, addr, EPOLLIN | EPOLLRDHUP);
+    if (conn == nullptr) {
+        throw ServerError("Failed to register replay connection");
+    }
+    clientCount++;
+    callHandler(EventType::CONNECTED, conn->client);
+    return conn->client;
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::replayLine(const Client& c, std::string line) {
+    Connection* conn = lookup(c);
+    if (conn == nullptr || conn->disconnecting) return;
+    callHandler(EventType::MESSAGE, c, Message(std::move(line), c));
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::replayDisconnect(const Client& c) {
+    disconnectClient(c);
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::replayPollEnd() {
+    end_iteration();
+    // without sockets nothing ever blocks, so long replies are produced right here
+    while (!generator_queue.empty()) {
+        run_generators();
+        flush_all();
+    }
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::broadcast(std::string_view message, const Priority priority) {
+    const SharedMessage shared(message);
+    WebSocketFrames frames(shared);
+    for (Connection& conn : connections) {
+        if (conn.active && conn.established()) {
+            enqueue(conn, shared, frames, priority);
+        }
+    }
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::broadcastExcept(const Client& except, std::string_view message, const Priority priority) {
+    const SharedMessage shared(message);
+    WebSocketFrames frames(shared);
+    for (Connection& conn : connections) {
+        if (conn.active && conn.established() && conn.fd != except.getFd()) {
+            enqueue(conn, shared, frames, priority);
+        }
+    }
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::multisend(const std::vector<Client> &clients, std::string_view message, const Priority priority) {
+    log<2>("Queueing ", message.size(), " bytes for ", clients.size(), " clients: [", message.substr(0, 50), "...");
+    const SharedMessage shared(message);
+    WebSocketFrames frames(shared);
+    for (const auto&c : clients) {
+        Connection* conn = lookup(c);
+        if (conn != nullptr) {
+            enqueue(*conn, shared, frames, priority);
+        }
+    }
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::sendSlices(const Client& c, const std::vector<Slice>& slices) {
+    Connection* conn = lookup(c);
+    if (conn == nullptr) return;
+    if (conn->ws_mode == WsMode::OPEN) {
+        // a line may be made of several slices; for the one recipient they are copied into frames
+        std::string data;
+        for (const Slice& slice : slices) {
+            data.append(slice.seg->data + slice.off, slice.len);
+        }
+        conn->ws->frame(conn->send_queue.queue(Priority::CONTROL), data);
+    } else {
+        for (const Slice& slice : slices) {
+            conn->send_queue.append(slice);
+        }
+    }
+    mark_for_flush(*conn);
+}
+
+#include "handover_impl.h"
+#include "tls_impl.h"
+#include "websocket_impl.h"
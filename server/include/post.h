@@ -0,0 +1,119 @@
+#pragma once
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#define POST_QUEUE_CAPACITY 4096    // tasks other threads can have pending; post() fails beyond that
+
+namespace MPlexServer {
+    class Client;
+
+    /**
+     * @brief Work handed to the poll() thread by BasicServer::post(), built with the factories.
+     *
+     * Clients are kept as fd and slot generation, so a task for a client that left
+     * in the meantime is dropped instead of reaching whoever got the fd next.
+     */
+    struct Posted {
+        enum class Kind : uint8_t {SEND, BROADCAST, DISCONNECT, CALL};
+
+        Kind                    kind = Kind::CALL;
+        int                     fd = -1;
+        uint32_t                generation = 0;
+        std::string             text;
+        std::function<void()>   fn;
+
+        static Posted send(const Client& c, std::string message);
+        static Posted broadcast(std::string message);
+        static Posted disconnect(const Client& c);
+        /**
+         * @brief fn runs on the poll() thread and may use the whole server API.
+         */
+        static Posted closure(std::function<void()> fn);
+    };
+
+    /**
+     * @brief Bounded lock-free multi-producer, single-consumer queue of Posted tasks.
+     *
+     * A ring of slots with sequence numbers: a producer claims a slot with one CAS on
+     * the tail and fills it without touching any other producer's slot, the loop
+     * takes slots in order once their sequence says they are complete. A full queue
+     * fails instead of waiting. The eventfd wakes a sleeping epoll_wait() once per
+     * batch: only the push that finds no wakeup pending writes it, and the loop
+     * clears that flag when it starts draining.
+     */
+    class PostQueue {
+    public:
+        explicit PostQueue(size_t capacity = POST_QUEUE_CAPACITY);
+        PostQueue(const PostQueue& other) = delete;
+        PostQueue& operator=(const PostQueue& other) = delete;
+        ~PostQueue();
+
+        /**
+         * @brief Registers the eventfd with epoll_fd; called whenever the server gets a new epoll instance.
+         */
+        void    attach(int epoll_fd);
+
+        /**
+         * @brief Any thread. @return False if the queue is full; the task is then left untouched.
+         */
+        bool    push(Posted& task);
+
+        /**
+         * @brief Consumes the wakeup if event belongs to the queue.
+         * @return False for events of other fds.
+         */
+        bool    handle_event(const epoll_event& event);
+
+        /**
+         * @brief Loop thread: hands at most one queue's worth of tasks to run, oldest first.
+         * @return Number of tasks run.
+         */
+        template <class F>
+        size_t  drain(F&& run);
+
+    private:
+        struct Slot {
+            std::atomic<size_t>     sequence;
+            Posted                  task;
+        };
+
+        std::unique_ptr<Slot[]>     slots;
+        size_t                      mask;
+        int                         wake_fd = -1;                   // eventfd, also the epoll tag of its own event
+        alignas(64) std::atomic<size_t> tail{0};                    // next slot to claim, shared by producers
+        alignas(64) std::atomic<bool>   wake_pending{false};        // eventfd written since the last drain
+        alignas(64) size_t          head = 0;                       // next slot to take, loop thread only
+
+        bool    pop(Posted& out);
+    };
+
+    template <class F>
+    size_t PostQueue::drain(F&& run) {
+        if (!wake_pending.load(std::memory_order_relaxed) || !wake_pending.exchange(false, std::memory_order_seq_cst)) {
+            return 0;
+        }
+        // pairs with the fence in push(): a producer that still saw the flag set has its task visible below
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        size_t  count = 0;
+        Posted  task;
+        while (count <= mask && pop(task)) {
+            run(task);
+            ++count;
+        }
+        if (count > mask) {
+            // producers kept up with us: leave the rest for the next iteration, without sleeping
+            wake_pending.store(true, std::memory_order_seq_cst);
+            const uint64_t one = 1;
+            if (write(wake_fd, &one, sizeof(one)) == -1) {}
+        }
+        return count;
+    }
+}
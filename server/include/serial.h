@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace MPlexServer {
+    /**
+     * @brief Thrown when serialized state is truncated or malformed.
+     */
+    class SerialError final : public std::runtime_error {
+    public:
+        explicit SerialError(const std::string& what_arg) : std::runtime_error(what_arg) {}
+    };
+
+    /**
+     * @brief Appends fixed-width little-endian integers and length-prefixed strings to a byte string.
+     */
+    class StateWriter {
+    public:
+        void    u8(uint8_t v);
+        void    u32(uint32_t v);
+        void    u64(uint64_t v);
+        void    f64(double v);
+        void    str(std::string_view v);
+
+        [[nodiscard]] const std::string& data() const;
+        std::string&                     data();
+    private:
+        std::string buf_;
+    };
+
+    /**
+     * @brief Reads back what a StateWriter produced; throws SerialError on truncation.
+     */
+    class StateReader {
+    public:
+        explicit StateReader(std::string_view data);
+
+        uint8_t     u8();
+        uint32_t    u32();
+        uint64_t    u64();
+        double      f64();
+        std::string str();
+
+        [[nodiscard]] bool   done() const;
+        [[nodiscard]] size_t offset() const;
+    private:
+        std::string_view data_;
+        size_t           pos_ = 0;
+
+        const char* take(size_t n);
+    };
+}
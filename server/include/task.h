@@ -0,0 +1,322 @@
+#pragma once
+
+#include <sched.h>
+#include <sys/epoll.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "bufferpool.h"
+
+#define TASK_WORKER_THREADS 4       // default number of threads running offload()ed work, started on first use
+
+namespace MPlexServer {
+    template <class T = void>
+    class Task;
+
+    namespace detail {
+        /**
+         * @brief Shared part of every Task promise; frames come from the BufferPool size classes.
+         */
+        struct PromiseBase {
+            std::coroutine_handle<>     continuation;           // coroutine awaiting this one
+            std::exception_ptr          error;
+            std::unordered_set<void*>*  roots = nullptr;        // set for spawned tasks, which free themselves
+
+            static void* operator new(const size_t size) {
+                return BufferPool::allocate(size);
+            }
+            static void operator delete(void* frame, const size_t size) {
+                BufferPool::deallocate(frame, size);
+            }
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            void unhandled_exception() noexcept { error = std::current_exception(); }
+        };
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+
+            template <class Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> coro) noexcept {
+                PromiseBase& promise = coro.promise();
+                if (promise.continuation) return promise.continuation;
+                if (promise.roots != nullptr) {
+                    promise.roots->erase(coro.address());
+                    coro.destroy();
+                }
+                return std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        template <class T>
+        struct Result {
+            std::optional<T> value;
+
+            template <class U>
+            void return_value(U&& result) { value.emplace(std::forward<U>(result)); }
+            T take() { return std::move(*value); }
+        };
+
+        template <>
+        struct Result<void> {
+            void return_void() {}
+            void take() {}
+        };
+    }
+
+    /**
+     * @brief Lazily started coroutine returning T.
+     *
+     * A Task runs once it is co_awaited (the awaiting coroutine continues when it
+     * finished, exceptions included) or handed to BasicServer::spawn(). Owning a
+     * Task owns its frame: destroying an unfinished one destroys the coroutine.
+     */
+    template <class T>
+    class [[nodiscard]] Task {
+    public:
+        struct promise_type : detail::PromiseBase, detail::Result<T> {
+            Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            detail::FinalAwaiter final_suspend() noexcept { return {}; }
+        };
+
+        Task(Task&& other) noexcept : coro(std::exchange(other.coro, {})) {}
+        Task& operator=(Task&& other) noexcept {
+            if (this != &other) {
+                if (coro) coro.destroy();
+                coro = std::exchange(other.coro, {});
+            }
+            return *this;
+        }
+        Task(const Task& other) = delete;
+        Task& operator=(const Task& other) = delete;
+        ~Task() {
+            if (coro) coro.destroy();
+        }
+
+        bool await_ready() const noexcept { return false; }
+
+        std::coroutine_handle<> await_suspend(const std::coroutine_handle<> awaiting) noexcept {
+            coro.promise().continuation = awaiting;
+            return coro;
+        }
+
+        T await_resume() {
+            if (coro.promise().error) std::rethrow_exception(coro.promise().error);
+            return coro.promise().take();
+        }
+
+        /**
+         * @brief Starts the task without an owner; its frame is freed when it finishes.
+         * @param roots Registry of unowned frames, so unfinished ones can be destroyed on shutdown.
+         */
+        void detach(std::unordered_set<void*>& roots) {
+            const std::coroutine_handle<promise_type> started = std::exchange(coro, {});
+            started.promise().roots = &roots;
+            roots.insert(started.address());
+            started.resume();
+        }
+
+    private:
+        explicit Task(const std::coroutine_handle<promise_type> coro) : coro(coro) {}
+
+        std::coroutine_handle<promise_type> coro;
+    };
+
+    /**
+     * @brief A suspended coroutine waiting for fd readiness and/or a deadline.
+     */
+    struct Waiter {
+        using Clock = std::chrono::steady_clock;
+        using Deadlines = std::multimap<Clock::time_point, Waiter*, std::less<>,
+                                        PoolAllocator<std::pair<const Clock::time_point, Waiter*>>>;
+
+        std::coroutine_handle<> handle;
+        int                     fd = -1;            // -1: only waiting for the deadline
+        uint32_t                events = 0;         // epoll events it was woken with, 0: deadline passed
+        bool                    timed = false;
+        Deadlines::iterator     deadline;
+    };
+
+    /**
+     * @brief Work run on a worker thread; the awaiting coroutine is resumed by the loop afterwards.
+     */
+    struct Completion {
+        virtual ~Completion() = default;
+        virtual void run() = 0;
+
+        std::coroutine_handle<> handle;
+    };
+
+    /**
+     * @brief Resumes coroutines of a server from its poll() loop.
+     *
+     * Readiness waits register the fd with the server's epoll instance, tagged
+     * so poll() hands the event here; deadlines are kept in one ordered map and
+     * checked once per iteration. Offloaded work runs on up to TASK_WORKER_THREADS
+     * threads (set_max_workers()), which report back through an eventfd. Nothing here allocates per
+     * suspension except from the buffer pool.
+     */
+    class TaskScheduler {
+    public:
+        TaskScheduler() = default;
+        TaskScheduler(const TaskScheduler& other) = delete;
+        TaskScheduler& operator=(const TaskScheduler& other) = delete;
+        ~TaskScheduler();
+
+        /**
+         * @brief Starts using epoll_fd; called when the server is activated.
+         */
+        void    attach(int epoll_fd);
+
+        /**
+         * @brief Stops the workers and destroys all unfinished spawned tasks.
+         */
+        void    shutdown();
+
+        /**
+         * @brief Handles an epoll event if it belongs to the scheduler.
+         * @return False for events of other fds.
+         */
+        bool    handle_event(const epoll_event& event);
+
+        /**
+         * @brief Resumes every coroutine whose deadline has passed.
+         */
+        void    run_timers();
+
+        void    wait_fd(Waiter& waiter, uint32_t events, int timeout_ms);
+        void    wait_until(Waiter& waiter, Waiter::Clock::time_point deadline);
+        void    submit(Completion& job);
+        void    spawn(Task<> task);
+
+        /**
+         * @brief Limits the worker threads; raising it takes effect with the next submit(), lowering
+         * it only stops new threads from being started.
+         */
+        void    set_max_workers(size_t count);
+
+        /**
+         * @brief CPUs for workers started from now on, e.g. the ones the process had before the loop was pinned.
+         */
+        void    set_worker_cpus(const cpu_set_t& cpus);
+
+        [[nodiscard]] size_t  spawned() const;
+
+    private:
+        int                         epollfd = -1;
+        int                         wake_fd = -1;       // eventfd, also the epoll tag of its own event
+        std::vector<Waiter*>        fd_waiters;         // by fd
+        Waiter::Deadlines           deadlines;
+        std::vector<Waiter*>        due;                // run_timers() scratch
+        std::unordered_set<void*>   roots;              // frames of spawned, unfinished tasks
+
+        std::vector<std::thread>    workers;
+        size_t                      max_workers = TASK_WORKER_THREADS;
+        bool                        worker_cpus_set = false;
+        cpu_set_t                   worker_cpus{};
+        std::mutex                  lock;               // guards everything below
+        std::condition_variable     work_ready;
+        std::deque<Completion*>     jobs;
+        std::vector<Completion*>    done;
+        std::vector<Completion*>    finished;           // loop thread only, swapped with done
+        bool                        stopping = false;
+
+        void    worker_loop();
+        void    resume_done();
+        void    release_fd(Waiter& waiter);
+    };
+
+    /**
+     * @brief co_await result: epoll events the fd became ready with, 0 if the timeout passed first.
+     */
+    class FdAwaiter : private Waiter {
+    public:
+        FdAwaiter(TaskScheduler& scheduler, const int fd, const uint32_t interest, const int timeout_ms)
+            : scheduler(scheduler), interest(interest), timeout_ms(timeout_ms) {
+            this->fd = fd;
+        }
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(const std::coroutine_handle<> coro) {
+            handle = coro;
+            scheduler.wait_fd(*this, interest, timeout_ms);
+        }
+        uint32_t await_resume() const noexcept { return events; }
+
+    private:
+        TaskScheduler&  scheduler;
+        uint32_t        interest;
+        int             timeout_ms;
+    };
+
+    class SleepAwaiter : private Waiter {
+    public:
+        SleepAwaiter(TaskScheduler& scheduler, const Clock::time_point until) : scheduler(scheduler), until(until) {}
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(const std::coroutine_handle<> coro) {
+            handle = coro;
+            scheduler.wait_until(*this, until);
+        }
+        void await_resume() const noexcept {}
+
+    private:
+        TaskScheduler&      scheduler;
+        Clock::time_point   until;
+    };
+
+    /**
+     * @brief co_await result: the return value of fn, run on a worker thread (exceptions are rethrown).
+     */
+    template <class F>
+    class OffloadAwaiter : private Completion {
+    public:
+        using Result = std::invoke_result_t<F&>;
+
+        OffloadAwaiter(TaskScheduler& scheduler, F fn) : scheduler(scheduler), fn(std::move(fn)) {}
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(const std::coroutine_handle<> coro) {
+            handle = coro;
+            scheduler.submit(*this);
+        }
+        Result await_resume() {
+            if (error) std::rethrow_exception(error);
+            if constexpr (!std::is_void_v<Result>) return std::move(*result);
+        }
+
+    private:
+        using Storage = std::conditional_t<std::is_void_v<Result>, bool, std::optional<Result>>;
+
+        TaskScheduler&      scheduler;
+        F                   fn;
+        Storage             result{};
+        std::exception_ptr  error;
+
+        void run() override {
+            try {
+                if constexpr (std::is_void_v<Result>) {
+                    fn();
+                } else {
+                    result.emplace(fn());
+                }
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+    };
+}
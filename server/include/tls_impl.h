@@ -0,0 +1,157 @@
+#pragma once
+
+#include "mplexserver.h"
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+namespace MPlexServer::detail {
+    /**
+     * @return Description of the oldest queued OpenSSL error, which is removed from the queue.
+     */
+    std::string tls_error();
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::enableTLS(const uint16_t tls_port, const std::string& cert_file, const std::string& key_file) {
+    loadTLSCertificate(cert_file, key_file);
+    ListenerConfig config;
+    config.port = tls_port == 0 ? 6697 : tls_port;
+    config.kind = ListenerKind::TLS;
+    addListener(config);
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::loadTLSCertificate(const std::string& cert_file, const std::string& key_file) {
+    if (epollfd != -1) {
+        throw ServerSettingsError("TLS must be enabled before the server is activated");
+    }
+    SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+    if (ctx == nullptr) {
+        throw ServerError("Failed to create TLS context: " + detail::tls_error());
+    }
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    // OpenSSL installs the "tls" ULP (setsockopt TCP_ULP) itself after the handshake if it can
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    // no session resumption: nothing to do after the handshake that would not fit kTLS
+    SSL_CTX_set_num_tickets(ctx, 0);
+    if (SSL_CTX_use_certificate_chain_file(ctx, cert_file.c_str()) != 1
+        || SSL_CTX_use_PrivateKey_file(ctx, key_file.c_str(), SSL_FILETYPE_PEM) != 1
+        || SSL_CTX_check_private_key(ctx) != 1) {
+        const std::string reason = detail::tls_error();
+        SSL_CTX_free(ctx);
+        throw ServerSettingsError("Invalid TLS certificate or key: " + reason);
+    }
+    free_tls_context();
+    this->tls_ctx = ctx;
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::free_tls_context() {
+    if (tls_ctx == nullptr) return;
+    SSL_CTX_free(tls_ctx);
+    tls_ctx = nullptr;
+}
+
+template <class Handler, class Log, class Buffers>
+bool MPlexServer::BasicServer<Handler, Log, Buffers>::start_tls(Connection& conn) {
+    conn.tls = SSL_new(tls_ctx);
+    if (conn.tls == nullptr || SSL_set_fd(conn.tls, conn.fd) != 1) {
+        log<0>("TLS setup failed: ", detail::tls_error());
+        return false;
+    }
+    SSL_set_accept_state(conn.tls);
+    conn.tls_mode = TlsMode::HANDSHAKE;
+    continue_handshake(conn);
+    return true;
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::continue_handshake(Connection& conn) {
+    ERR_clear_error();
+    const int ret = SSL_do_handshake(conn.tls);
+    if (ret != 1) {
+        switch (SSL_get_error(conn.tls, ret)) {
+            case SSL_ERROR_WANT_READ:
+                conn.write_blocked = false;
+                break;
+            case SSL_ERROR_WANT_WRITE:
+                conn.write_blocked = true;
+                break;
+            default:
+                log<1>("TLS handshake with fd ", conn.fd, " failed: ", detail::tls_error());
+                discard_client(conn);
+                return;
+        }
+        update_epoll_interest(conn);
+        return;
+    }
+
+    const bool ktls = BIO_get_ktls_send(SSL_get_wbio(conn.tls));
+    conn.tls_mode = ktls ? TlsMode::KTLS : TlsMode::USERSPACE;
+    conn.write_blocked = false;
+    update_epoll_interest(conn);
+    log<1>("TLS handshake with fd ", conn.fd, " done (", SSL_get_version(conn.tls), ", ",
+           ktls ? "kernel TLS" : "user space encryption", ").");
+
+    callHandler(EventType::CONNECTED, conn.client);
+    if (!conn.send_queue.empty()) {
+        mark_for_flush(conn);
+    }
+    // the client may have sent its first lines together with the Finished message
+    if (conn.active && !conn.disconnecting && SSL_has_pending(conn.tls)) {
+        tls_recv(conn);
+    }
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::tls_recv(Connection& conn) {
+    // OpenSSL may hold decrypted bytes the socket no longer signals, so read until it wants more,
+    // even when throttled: the lines then wait in recv_buffer like for plain clients
+    char* const buffer = read_buffer.data();
+    while (!conn.disconnecting) {
+        ERR_clear_error();
+        const int n = SSL_read(conn.tls, buffer, static_cast<int>(read_buffer.size()));
+        if (n <= 0) {
+            const int err = SSL_get_error(conn.tls, n);
+            if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) break;
+            if (err == SSL_ERROR_ZERO_RETURN) {
+                log<1>("TLS client closed the connection");
+            } else {
+                log<1>("TLS read from fd ", conn.fd, " failed: ", detail::tls_error());
+            }
+            disconnectClient(conn.fd);
+            return;
+        }
+        conn.recv_buffer.append(buffer, n);
+        log<2>(std::string_view(buffer, n));
+        dispatch_lines(conn);
+    }
+}
+
+template <class Handler, class Log, class Buffers>
+ssize_t MPlexServer::BasicServer<Handler, Log, Buffers>::tls_write(Connection& conn) {
+    const std::string_view chunk = conn.send_queue.front();
+    ERR_clear_error();
+    const int n = SSL_write(conn.tls, chunk.data(), static_cast<int>(chunk.size()));
+    if (n > 0) {
+        conn.send_queue.consume(n);
+        return n;
+    }
+    const int err = SSL_get_error(conn.tls, n);
+    errno = (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ) ? EAGAIN : EPIPE;
+    return -1;
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::release_tls(Connection& conn) {
+    if (conn.tls == nullptr) return;
+    if (conn.tls_mode == TlsMode::KTLS || conn.tls_mode == TlsMode::USERSPACE) {
+        SSL_shutdown(conn.tls);     // best effort close_notify, the socket is closed right after
+    }
+    SSL_free(conn.tls);
+    ERR_clear_error();
+    conn.tls = nullptr;
+    conn.tls_mode = TlsMode::PLAIN;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bufferpool.h"
+#include "serial.h"
+
+#define WS_MAX_HANDSHAKE 8192       // bytes of HTTP upgrade request accepted before the client is dropped
+#define WS_MAX_MESSAGE 8192         // largest message a client may send, all fragments together
+#define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+namespace MPlexServer {
+    /**
+     * @brief Framing of a connection: plain TCP, or WebSocket before/after the HTTP upgrade.
+     */
+    enum class WsMode : uint8_t {NONE, HANDSHAKE, OPEN};
+
+    /**
+     * @brief RFC 6455 codec of one connection accepted on the WebSocket listener.
+     *
+     * IRC over WebSocket as in the IRCv3 WebSocket specification: every message
+     * carries one IRC line without CRLF, in text frames ("text.ircv3.net" or no
+     * subprotocol) or binary frames ("binary.ircv3.net"). Incoming messages are
+     * turned back into CRLF-terminated lines for the normal line framer; every
+     * line the server sends becomes one unmasked frame.
+     */
+    class WebSocket {
+    public:
+        enum class Handshake {PENDING, UPGRADED, REJECTED};
+
+        /**
+         * @brief Consumes the HTTP upgrade request.
+         * @param data Bytes received.
+         * @param response Receives the HTTP response once the request is complete, also for a rejected one.
+         * @return UPGRADED once switched to frames; bytes after the request are kept for decode().
+         */
+        Handshake handshake(std::string_view data, std::string& response);
+
+        /**
+         * @brief Decodes complete frames; messages are appended to lines, each terminated with CRLF.
+         * @param data Bytes received (may be empty to decode what handshake() left over).
+         * @param control Receives the frames to send back: pongs, and the close frame.
+         * @return False once the connection must be closed (close frame or protocol error).
+         */
+        bool decode(std::string_view data, pooled_string& lines, std::string& control);
+
+        /**
+         * @brief Queues data as one frame per line (CRLF dropped); a trailing partial line is a frame of its own.
+         */
+        void frame(OutQueue& queue, std::string_view data) const;
+
+        [[nodiscard]] bool binary() const;
+
+        /**
+         * @brief Memory held for partial input.
+         */
+        [[nodiscard]] size_t heldBytes() const;
+
+        void serialize(StateWriter& out) const;
+        void deserialize(StateReader& in);
+
+        /**
+         * @return The frame header of a payload of len bytes.
+         */
+        static std::string header(size_t len, bool binary);
+
+    private:
+        pooled_string   input;                  // incomplete request or frame
+        pooled_string   message;                // payload of a fragmented message so far
+        bool            binary_ = false;        // binary.ircv3.net negotiated
+        bool            fragmented = false;     // a message is continued in the next frame
+
+        void deliver(std::string_view payload, pooled_string& lines) const;
+    };
+
+    /**
+     * @brief The WebSocket form of a message fanned out to many clients.
+     *
+     * Built on first use and kept for the rest of the fan-out: the frame headers
+     * are serialized once into their own segment, the lines are referenced in
+     * the message's segments. Every WebSocket recipient then only links these
+     * slices into its queue, like TCP recipients link the message itself.
+     */
+    class WebSocketFrames {
+    public:
+        explicit WebSocketFrames(const SharedMessage& msg);
+
+        /**
+         * @return Header and payload slices of every line, for text or binary frames.
+         */
+        const std::vector<Slice>& slices(bool binary);
+
+    private:
+        const SharedMessage&    msg;
+        SharedMessage           headers[2];
+        std::vector<Slice>      frames[2];
+        bool                    built[2] = {};
+    };
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "mplexserver.h"
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::enableWebSocket(const uint16_t ws_port) {
+    if (ws_port == 0) {
+        throw ServerSettingsError("Invalid WebSocket port");
+    }
+    ListenerConfig config;
+    config.port = ws_port;
+    config.kind = ListenerKind::WEBSOCKET;
+    addListener(config);
+}
+
+template <class Handler, class Log, class Buffers>
+void MPlexServer::BasicServer<Handler, Log, Buffers>::ws_recv(Connection& conn, std::string_view data) {
+    if (conn.ws_mode == WsMode::HANDSHAKE) {
+        std::string response;
+        switch (conn.ws->handshake(data, response)) {
+            case WebSocket::Handshake::PENDING:
+                return;
+            case WebSocket::Handshake::REJECTED:
+                log<1>("WebSocket upgrade of fd ", conn.fd, " rejected.");
+                // best effort: the connection never got established, so its queue is not flushed
+                send(conn.fd, response.data(), response.size(), MSG_NOSIGNAL);
+                discard_client(conn);
+                return;
+            case WebSocket::Handshake::UPGRADED:
+                break;
+        }
+        conn.send_queue.append(response);      // unframed, ahead of everything the handler sends
+        conn.ws_mode = WsMode::OPEN;
+        mark_for_flush(conn);
+        log<1>("WebSocket upgrade of fd ", conn.fd, " done", conn.ws->binary() ? " (binary frames)." : ".");
+        callHandler(EventType::CONNECTED, conn.client);
+        if (!conn.active || conn.disconnecting) return;
+        data = {};      // frames sent along with the request were kept by the codec
+    }
+    std::string control;
+    const bool open = conn.ws->decode(data, conn.recv_buffer, control);
+    if (!control.empty()) {
+        conn.send_queue.append(control);
+        mark_for_flush(conn);
+    }
+    if (!open) {
+        log<1>("WebSocket client on fd ", conn.fd, " closed the connection.");
+        disconnectClient(conn.fd);
+        return;
+    }
+    dispatch_lines(conn);
+}
@@ -0,0 +1,411 @@
+#include "../include/bufferpool.h"
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <climits>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <thread>
+
+namespace {
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    struct SizeClass {
+        size_t      block_size;
+        FreeBlock*  free_list;
+    };
+
+    struct ThreadPools {
+        SizeClass                       classes[2] = {{POOL_LINE_BLOCK, nullptr}, {POOL_SEGMENT_BLOCK, nullptr}};
+        MPlexServer::BufferPool::Stats  stats;
+    };
+
+    thread_local ThreadPools pools;
+
+    // the loop thread once a server bound it, none before
+    std::atomic<std::thread::id>    bound_thread{};
+
+    [[maybe_unused]] bool on_bound_thread() {
+        const std::thread::id bound = bound_thread.load(std::memory_order_relaxed);
+        return bound == std::thread::id() || bound == std::this_thread::get_id();
+    }
+
+    // Slabs outlive the thread that carved them (its blocks may sit in other
+    // threads' freelists), so they are only registered here and never freed.
+    std::mutex          slab_registry_lock;
+    std::vector<void*>  slab_registry;
+
+    SizeClass* size_class_for(const size_t bytes) {
+        for (SizeClass& sc : pools.classes) {
+            if (bytes <= sc.block_size) return &sc;
+        }
+        return nullptr;
+    }
+
+    void carve_slab(SizeClass& sc) {
+        const size_t slab_size = sc.block_size * POOL_BLOCKS_PER_SLAB;
+        char* slab = static_cast<char*>(::operator new(slab_size));
+        {
+            std::lock_guard<std::mutex> guard(slab_registry_lock);
+            slab_registry.push_back(slab);
+        }
+        for (size_t i = POOL_BLOCKS_PER_SLAB; i-- > 0;) {
+            auto* block = reinterpret_cast<FreeBlock*>(slab + i * sc.block_size);
+            block->next = sc.free_list;
+            sc.free_list = block;
+        }
+        pools.stats.resident_bytes += slab_size;
+    }
+}
+
+void* MPlexServer::BufferPool::allocate(const size_t bytes) {
+    assert(on_bound_thread() && "pooled buffer allocated outside the loop thread");
+    SizeClass* sc = size_class_for(bytes);
+    if (sc == nullptr) {
+        pools.stats.oversized++;
+        return ::operator new(bytes);
+    }
+    pools.stats.allocations++;
+    if (sc->free_list != nullptr) {
+        pools.stats.hits++;
+    } else {
+        carve_slab(*sc);
+    }
+    FreeBlock* block = sc->free_list;
+    sc->free_list = block->next;
+    pools.stats.in_use_bytes += sc->block_size;
+    return block;
+}
+
+void MPlexServer::BufferPool::deallocate(void* block, const size_t bytes) {
+    if (block == nullptr) return;
+    assert(on_bound_thread() && "pooled buffer released outside the loop thread");
+    SizeClass* sc = size_class_for(bytes);
+    if (sc == nullptr) {
+        ::operator delete(block);
+        return;
+    }
+    auto* free_block = static_cast<FreeBlock*>(block);
+    free_block->next = sc->free_list;
+    sc->free_list = free_block;
+    pools.stats.in_use_bytes -= std::min(pools.stats.in_use_bytes, sc->block_size);
+}
+
+MPlexServer::BufferPool::Stats MPlexServer::BufferPool::stats() {
+    return pools.stats;
+}
+
+double MPlexServer::BufferPool::hitRate() {
+    if (pools.stats.allocations == 0) return 0;
+    return static_cast<double>(pools.stats.hits) / static_cast<double>(pools.stats.allocations);
+}
+
+void MPlexServer::BufferPool::bindThread() {
+    bound_thread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+}
+
+MPlexServer::Segment* MPlexServer::Segment::create() {
+    auto* seg = static_cast<Segment*>(BufferPool::allocate(sizeof(Segment)));
+    seg->refs = 1;
+    seg->used = 0;
+    return seg;
+}
+
+void MPlexServer::Segment::retain(Segment* seg) {
+    assert(on_bound_thread() && "segment shared outside the loop thread");
+    seg->refs++;
+}
+
+void MPlexServer::Segment::release(Segment* seg) {
+    assert(on_bound_thread() && "segment released outside the loop thread");
+    if (--seg->refs == 0) {
+        BufferPool::deallocate(seg, sizeof(Segment));
+    }
+}
+
+MPlexServer::SharedMessage::SharedMessage(std::string_view msg) : size_(msg.size()) {
+    while (!msg.empty()) {
+        Segment* seg = Segment::create();
+        const size_t n = std::min(msg.size(), Segment::CAPACITY);
+        std::memcpy(seg->data, msg.data(), n);
+        seg->used = static_cast<uint32_t>(n);
+        segments_.push_back(seg);
+        msg.remove_prefix(n);
+    }
+}
+
+MPlexServer::SharedMessage::SharedMessage(const SharedMessage& other) : segments_(other.segments_), size_(other.size_) {
+    for (Segment* seg : segments_) Segment::retain(seg);
+}
+
+MPlexServer::SharedMessage& MPlexServer::SharedMessage::operator=(const SharedMessage& other) {
+    if (this == &other) return *this;
+    for (Segment* seg : other.segments_) Segment::retain(seg);
+    for (Segment* seg : segments_) Segment::release(seg);
+    segments_ = other.segments_;
+    size_ = other.size_;
+    return *this;
+}
+
+MPlexServer::SharedMessage::~SharedMessage() {
+    for (Segment* seg : segments_) Segment::release(seg);
+}
+
+const std::vector<MPlexServer::Segment*>& MPlexServer::SharedMessage::segments() const {
+    return segments_;
+}
+
+size_t MPlexServer::SharedMessage::size() const {
+    return size_;
+}
+
+MPlexServer::OutQueue::~OutQueue() {
+    clear();
+}
+
+void MPlexServer::OutQueue::append(std::string_view data) {
+    size_ += data.size();
+    while (!data.empty()) {
+        // the tail segment can only be written to if nobody else references it
+        // and our chunk ends where its data ends
+        if (chunks_.empty() || chunks_.back().seg->refs != 1
+            || chunks_.back().off + chunks_.back().len != chunks_.back().seg->used
+            || chunks_.back().seg->used == Segment::CAPACITY) {
+            push({Segment::create(), 0, 0});
+        }
+        Chunk& tail = chunks_.back();
+        const size_t n = std::min(data.size(), Segment::CAPACITY - tail.seg->used);
+        std::memcpy(tail.seg->data + tail.seg->used, data.data(), n);
+        tail.seg->used += n;
+        tail.len += n;
+        data.remove_prefix(n);
+    }
+}
+
+void MPlexServer::OutQueue::append(const SharedMessage& msg) {
+    for (Segment* seg : msg.segments()) {
+        Segment::retain(seg);
+        push({seg, 0, seg->used});
+    }
+    size_ += msg.size();
+}
+
+void MPlexServer::OutQueue::append(const Slice& slice) {
+    if (slice.len == 0) return;
+    Segment::retain(slice.seg);
+    push({slice.seg, slice.off, slice.len});
+    size_ += slice.len;
+}
+
+bool MPlexServer::OutQueue::empty() const {
+    return size_ == 0;
+}
+
+size_t MPlexServer::OutQueue::size() const {
+    return size_;
+}
+
+ssize_t MPlexServer::OutQueue::flush(const int fd) {
+    iovec iov[64];
+    msghdr msg{};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = gather(iov, 64, SIZE_MAX);
+    const ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    if (sent <= 0) return sent;
+    consume(static_cast<size_t>(sent));
+    return sent;
+}
+
+size_t MPlexServer::OutQueue::gather(iovec* iov, const size_t max_iov, size_t limit) const {
+    size_t used = 0;
+    for (size_t i = head_; i < chunks_.size() && used < max_iov && limit > 0; ++i) {
+        const size_t len = std::min<size_t>(chunks_[i].len, limit);
+        iov[used].iov_base = chunks_[i].seg->data + chunks_[i].off;
+        iov[used].iov_len = len;
+        limit -= len;
+        ++used;
+    }
+    return used;
+}
+
+std::string_view MPlexServer::OutQueue::front() const {
+    if (head_ == chunks_.size()) return {};
+    const Chunk& head = chunks_[head_];
+    return {head.seg->data + head.off, head.len};
+}
+
+void MPlexServer::OutQueue::consume(size_t n) {
+    n = std::min(n, size_);
+    size_ -= n;
+    while (n > 0) {
+        Chunk& head = chunks_[head_];
+        if (n < head.len) {
+            head.off += n;
+            head.len -= n;
+            break;
+        }
+        n -= head.len;
+        Segment::release(head.seg);
+        ++head_;
+    }
+    if (head_ == chunks_.size()) release();
+}
+
+void MPlexServer::OutQueue::copyTo(std::string& out) const {
+    out.reserve(out.size() + size_);
+    for (size_t i = head_; i < chunks_.size(); ++i) {
+        out.append(chunks_[i].seg->data + chunks_[i].off, chunks_[i].len);
+    }
+}
+
+void MPlexServer::OutQueue::clear() {
+    for (size_t i = head_; i < chunks_.size(); ++i) Segment::release(chunks_[i].seg);
+    release();
+    size_ = 0;
+}
+
+size_t MPlexServer::OutQueue::heldBytes() const {
+    return chunks_.capacity() * sizeof(Chunk);
+}
+
+void MPlexServer::OutQueue::push(const Chunk& chunk) {
+    if (chunks_.size() == chunks_.capacity()) {
+        if (head_ > 0) {
+            // reuse the room of sent chunks before growing
+            chunks_.erase(chunks_.begin(), chunks_.begin() + static_cast<ptrdiff_t>(head_));
+            head_ = 0;
+        } else if (chunks_.empty()) {
+            chunks_.reserve(OUTQUEUE_INITIAL_CHUNKS);
+        }
+    }
+    chunks_.push_back(chunk);
+}
+
+void MPlexServer::OutQueue::release() {
+    std::vector<Chunk, PoolAllocator<Chunk>>().swap(chunks_);
+    head_ = 0;
+}
+
+void MPlexServer::SendQueue::append(const std::string_view data, const Priority priority) {
+    queue(priority).append(data);
+}
+
+void MPlexServer::SendQueue::append(const SharedMessage& msg, const Priority priority) {
+    queue(priority).append(msg);
+}
+
+void MPlexServer::SendQueue::append(const Slice& slice, const Priority priority) {
+    queue(priority).append(slice);
+}
+
+MPlexServer::OutQueue& MPlexServer::SendQueue::queue(const Priority priority) {
+    return priority == Priority::BULK ? bulk_ : control_;
+}
+
+void MPlexServer::SendQueue::endBulkMessage() {
+    const size_t end = bulk_sent_ + bulk_.size();
+    if (end == (ends_head_ < bulk_ends_.size() ? bulk_ends_.back() : bulk_done_)) return;     // nothing new
+    if (bulk_ends_.size() == bulk_ends_.capacity() && ends_head_ > 0) {
+        bulk_ends_.erase(bulk_ends_.begin(), bulk_ends_.begin() + static_cast<ptrdiff_t>(ends_head_));
+        ends_head_ = 0;
+    }
+    bulk_ends_.push_back(end);
+}
+
+bool MPlexServer::SendQueue::empty() const {
+    return control_.empty() && bulk_.empty();
+}
+
+size_t MPlexServer::SendQueue::size() const {
+    return control_.size() + bulk_.size();
+}
+
+size_t MPlexServer::SendQueue::size(const Priority priority) const {
+    return priority == Priority::BULK ? bulk_.size() : control_.size();
+}
+
+ssize_t MPlexServer::SendQueue::flush(const int fd) {
+    // bulk bytes that have to go out ahead of control output
+    const size_t lead = control_.empty() ? bulk_.size() : bulk_remainder();
+    iovec iov[64];
+    size_t used = lead > 0 ? bulk_.gather(iov, 64, lead) : 0;
+    used += control_.gather(iov + used, 64 - used, SIZE_MAX);
+    msghdr msg{};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = used;
+    const ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    if (sent <= 0) return sent;
+    const size_t from_bulk = std::min(static_cast<size_t>(sent), lead);
+    consume_bulk(from_bulk);
+    control_.consume(static_cast<size_t>(sent) - from_bulk);
+    return sent;
+}
+
+std::string_view MPlexServer::SendQueue::front() const {
+    if (!serves_bulk()) return control_.front();
+    const size_t remainder = bulk_remainder();
+    const std::string_view head = bulk_.front();
+    return remainder > 0 ? head.substr(0, remainder) : head;
+}
+
+void MPlexServer::SendQueue::consume(const size_t n) {
+    if (serves_bulk()) {
+        consume_bulk(n);
+    } else {
+        control_.consume(n);
+    }
+}
+
+void MPlexServer::SendQueue::copyTo(std::string& out) const {
+    if (bulk_remainder() > 0) {
+        bulk_.copyTo(out);
+        control_.copyTo(out);
+    } else {
+        control_.copyTo(out);
+        bulk_.copyTo(out);
+    }
+}
+
+void MPlexServer::SendQueue::clear() {
+    control_.clear();
+    bulk_.clear();
+    std::vector<size_t, PoolAllocator<size_t>>().swap(bulk_ends_);
+    ends_head_ = 0;
+    bulk_sent_ = 0;
+    bulk_done_ = 0;
+}
+
+size_t MPlexServer::SendQueue::heldBytes() const {
+    return control_.heldBytes() + bulk_.heldBytes() + bulk_ends_.capacity() * sizeof(size_t);
+}
+
+size_t MPlexServer::SendQueue::bulk_remainder() const {
+    if (bulk_sent_ == bulk_done_) return 0;
+    // a message that was never closed counts as one up to the end of the queue
+    return ends_head_ < bulk_ends_.size() ? bulk_ends_[ends_head_] - bulk_sent_ : bulk_.size();
+}
+
+bool MPlexServer::SendQueue::serves_bulk() const {
+    return control_.empty() || bulk_remainder() > 0;
+}
+
+void MPlexServer::SendQueue::consume_bulk(const size_t n) {
+    bulk_.consume(n);
+    bulk_sent_ += n;
+    while (ends_head_ < bulk_ends_.size() && bulk_ends_[ends_head_] <= bulk_sent_) {
+        bulk_done_ = bulk_ends_[ends_head_++];
+    }
+    if (bulk_.empty()) {
+        std::vector<size_t, PoolAllocator<size_t>>().swap(bulk_ends_);
+        ends_head_ = 0;
+        bulk_sent_ = 0;
+        bulk_done_ = 0;
+    }
+}
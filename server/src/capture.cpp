@@ -0,0 +1,182 @@
+#include "../include/capture.h"
+#include "../include/mplexserver.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace {
+    // connects of other address families, read back as CaptureEvent::CONNECT
+    constexpr uint8_t CONNECT_V6 = 5;
+    constexpr uint8_t CONNECT_LOCAL = 6;
+
+    void put_varint(std::string& out, uint64_t value) {
+        while (value >= 0x80) {
+            out += static_cast<char>((value & 0x7f) | 0x80);
+            value >>= 7;
+        }
+        out += static_cast<char>(value);
+    }
+}
+
+MPlexServer::CaptureWriter::CaptureWriter(const std::string& path) {
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        throw ServerError("Failed to open capture file " + path + ": " + std::strerror(errno));
+    }
+    const uint64_t start = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    buffer = CAPTURE_MAGIC;
+    for (int shift = 0; shift < 64; shift += 8) {
+        buffer += static_cast<char>((start >> shift) & 0xff);
+    }
+    last_record = Clock::now();
+    last_flush = last_record;
+}
+
+MPlexServer::CaptureWriter::~CaptureWriter() {
+    flush();
+    close(fd);
+}
+
+uint32_t MPlexServer::CaptureWriter::nextId() {
+    return ++last_id;
+}
+
+void MPlexServer::CaptureWriter::begin(const CaptureEvent event, const uint32_t conn) {
+    const Clock::time_point now = Clock::now();
+    buffer += static_cast<char>(event);
+    put_varint(buffer, std::chrono::duration_cast<std::chrono::microseconds>(now - last_record).count());
+    put_varint(buffer, conn);
+    last_record = now;
+    events_since_poll = event != CaptureEvent::POLL_END;
+}
+
+void MPlexServer::CaptureWriter::connect(const uint32_t conn, const SocketAddress& addr) {
+    switch (addr.family()) {
+        case AF_INET:
+            begin(CaptureEvent::CONNECT, conn);
+            buffer.append(reinterpret_cast<const char*>(&addr.v4.sin_addr.s_addr), 4);
+            buffer.append(reinterpret_cast<const char*>(&addr.v4.sin_port), 2);
+            break;
+        case AF_INET6:
+            begin(static_cast<CaptureEvent>(CONNECT_V6), conn);
+            buffer.append(reinterpret_cast<const char*>(&addr.v6.sin6_addr), 16);
+            buffer.append(reinterpret_cast<const char*>(&addr.v6.sin6_port), 2);
+            break;
+        default:
+            begin(static_cast<CaptureEvent>(CONNECT_LOCAL), conn);
+    }
+}
+
+void MPlexServer::CaptureWriter::line(const uint32_t conn, const std::string_view line) {
+    begin(CaptureEvent::LINE, conn);
+    put_varint(buffer, line.size());
+    buffer.append(line);
+}
+
+void MPlexServer::CaptureWriter::disconnect(const uint32_t conn) {
+    begin(CaptureEvent::DISCONNECT, conn);
+}
+
+void MPlexServer::CaptureWriter::pollEnd() {
+    if (events_since_poll) {
+        begin(CaptureEvent::POLL_END, 0);
+    }
+    if (buffer.size() >= CAPTURE_BUFFER || Clock::now() - last_flush >= std::chrono::milliseconds(CAPTURE_FLUSH_MS)) {
+        flush();
+    }
+}
+
+void MPlexServer::CaptureWriter::flush() {
+    last_flush = Clock::now();
+    size_t written = 0;
+    while (written < buffer.size()) {
+        const ssize_t n = write(fd, buffer.data() + written, buffer.size() - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;      // disk full: the capture ends here, the server keeps going
+        written += n;
+    }
+    buffer.clear();
+}
+
+MPlexServer::CaptureReader::CaptureReader(const std::string& path) {
+    std::ifstream       file(path, std::ios::binary);
+    std::stringstream   contents;
+    if (!file || !(contents << file.rdbuf())) {
+        throw ServerError("Failed to read capture file " + path);
+    }
+    data = contents.str();
+    const std::string magic = CAPTURE_MAGIC;
+    if (data.compare(0, magic.size(), magic) != 0 || data.size() < magic.size() + 8) {
+        throw ServerError(path + " is no capture file");
+    }
+    pos = magic.size();
+    for (int shift = 0; shift < 64; shift += 8) {
+        start_us |= static_cast<uint64_t>(static_cast<uint8_t>(data[pos++])) << shift;
+    }
+}
+
+uint64_t MPlexServer::CaptureReader::varint() {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos >= data.size()) throw ServerError("Truncated capture record");
+        const uint8_t byte = static_cast<uint8_t>(data[pos++]);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) return value;
+    }
+    throw ServerError("Malformed capture record");
+}
+
+bool MPlexServer::CaptureReader::next(CaptureRecord& record) {
+    if (pos >= data.size()) return false;
+    const uint8_t event = static_cast<uint8_t>(data[pos++]);
+    at_us += varint();
+    record.event = static_cast<CaptureEvent>(event);
+    record.at_us = at_us;
+    record.conn = static_cast<uint32_t>(varint());
+    if (event == CONNECT_V6) {
+        if (pos + 18 > data.size()) throw ServerError("Truncated capture record");
+        record.event = CaptureEvent::CONNECT;
+        record.addr = SocketAddress();
+        record.addr.v6.sin6_family = AF_INET6;
+        std::memcpy(&record.addr.v6.sin6_addr, data.data() + pos, 16);
+        std::memcpy(&record.addr.v6.sin6_port, data.data() + pos + 16, 2);
+        pos += 18;
+        return true;
+    }
+    if (event == CONNECT_LOCAL) {
+        record.event = CaptureEvent::CONNECT;
+        record.addr = SocketAddress();
+        record.addr.any.sa_family = AF_UNIX;
+        return true;
+    }
+    switch (record.event) {
+        case CaptureEvent::CONNECT:
+            if (pos + 6 > data.size()) throw ServerError("Truncated capture record");
+            record.addr = SocketAddress();
+            record.addr.v4.sin_family = AF_INET;
+            std::memcpy(&record.addr.v4.sin_addr.s_addr, data.data() + pos, 4);
+            std::memcpy(&record.addr.v4.sin_port, data.data() + pos + 4, 2);
+            pos += 6;
+            break;
+        case CaptureEvent::LINE: {
+            const uint64_t len = varint();
+            if (len > data.size() - pos) throw ServerError("Truncated capture record");
+            record.line.assign(data, pos, len);
+            pos += len;
+            break;
+        }
+        case CaptureEvent::DISCONNECT:
+        case CaptureEvent::POLL_END:
+            break;
+        default:
+            throw ServerError("Unknown capture record type " + std::to_string(event));
+    }
+    return true;
+}
+
+uint64_t MPlexServer::CaptureReader::startTime() const {
+    return start_us;
+}
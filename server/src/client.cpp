@@ -1,22 +1,32 @@
 #include "../include/mplexserver.h"
 
+#include <cstring>
+
 MPlexServer::Client::Client() {
     this->fd = -1;
+    this->generation = 0;
+    this->listener = NO_LISTENER;
     // this->nickname = "";
 }
 
-MPlexServer::Client::Client(const int fd, const sockaddr_in addr) : fd(fd), client_addr(addr) {
+MPlexServer::Client::Client(const int fd, const SocketAddress& addr, const uint32_t generation, const uint16_t listener)
+    : fd(fd), generation(generation), listener(listener), client_addr(addr) {
+    formatAddress(client_addr, peer);
 }
 
 MPlexServer::Client::~Client() {
 }
 
-MPlexServer::Client::Client(const Client &other) : fd(other.fd), client_addr(other.client_addr) {
+MPlexServer::Client::Client(const Client &other) : fd(other.fd), generation(other.generation), listener(other.listener), client_addr(other.client_addr) {
+    std::memcpy(peer, other.peer, sizeof(peer));
 }
 
 MPlexServer::Client & MPlexServer::Client::operator=(const Client &other) {
     this->fd = other.fd;
+    this->generation = other.generation;
+    this->listener = other.listener;
     this->client_addr = other.client_addr;
+    std::memcpy(this->peer, other.peer, sizeof(peer));
     return *this;
 }
 
@@ -24,12 +34,26 @@ int MPlexServer::Client::getFd() const {
     return this->fd;
 }
 
-std::string MPlexServer::Client::getIpv4() const {
-    char ip[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &client_addr.sin_addr, ip, INET_ADDRSTRLEN);
-    return std::string(ip);
+uint32_t MPlexServer::Client::getGeneration() const {
+    return this->generation;
+}
+
+const char* MPlexServer::Client::getPeer() const {
+    return this->peer;
 }
 
 int MPlexServer::Client::getPort() const {
-    return ntohs(client_addr.sin_port);
+    switch (client_addr.family()) {
+        case AF_INET: return ntohs(client_addr.v4.sin_port);
+        case AF_INET6: return ntohs(client_addr.v6.sin6_port);
+        default: return 0;
+    }
+}
+
+const MPlexServer::SocketAddress& MPlexServer::Client::getAddress() const {
+    return client_addr;
+}
+
+uint16_t MPlexServer::Client::getListener() const {
+    return this->listener;
 }
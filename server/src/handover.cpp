@@ -0,0 +1,68 @@
+#include "../include/handover_impl.h"
+
+namespace MPlexServer::detail {
+    bool write_all(const int fd, const char* data, size_t len) {
+        while (len > 0) {
+            const ssize_t n = write(fd, data, len);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    bool read_all(const int fd, char* data, size_t len) {
+        while (len > 0) {
+            const ssize_t n = read(fd, data, len);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    bool send_fds(const int channel, const std::vector<int>& fds) {
+        for (size_t first = 0; first < fds.size(); first += HANDOVER_FD_BATCH) {
+            const size_t count = std::min<size_t>(HANDOVER_FD_BATCH, fds.size() - first);
+            std::vector<char> control(CMSG_SPACE(count * sizeof(int)));
+            char marker = 'F';
+            iovec iov{&marker, 1};
+            msghdr msg{};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control.data();
+            msg.msg_controllen = control.size();
+            cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(count * sizeof(int));
+            std::memcpy(CMSG_DATA(cmsg), fds.data() + first, count * sizeof(int));
+            if (sendmsg(channel, &msg, 0) != 1) return false;
+        }
+        return true;
+    }
+
+    bool recv_fds(const int channel, const size_t total, std::vector<int>& fds) {
+        while (fds.size() < total) {
+            const size_t count = std::min<size_t>(HANDOVER_FD_BATCH, total - fds.size());
+            std::vector<char> control(CMSG_SPACE(count * sizeof(int)));
+            char marker;
+            iovec iov{&marker, 1};
+            msghdr msg{};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control.data();
+            msg.msg_controllen = control.size();
+            if (recvmsg(channel, &msg, MSG_CMSG_CLOEXEC) != 1) return false;
+            cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+            if (cmsg == nullptr || cmsg->cmsg_type != SCM_RIGHTS) return false;
+            const size_t received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const size_t old_size = fds.size();
+            fds.resize(old_size + received);
+            std::memcpy(fds.data() + old_size, CMSG_DATA(cmsg), received * sizeof(int));
+        }
+        return true;
+    }
+}
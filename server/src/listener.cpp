@@ -0,0 +1,256 @@
+#include "../include/listener.h"
+#include "../include/mplexserver.h"
+
+#include <netinet/tcp.h>
+
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+
+namespace {
+    int parse_number(const std::string_view text, const int min, const int max, const std::string_view what) {
+        int value = 0;
+        const auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (text.empty() || result.ec != std::errc() || result.ptr != text.data() + text.size() || value < min || value > max) {
+            throw MPlexServer::ServerSettingsError("Invalid " + std::string(what) + " '" + std::string(text) + "'");
+        }
+        return value;
+    }
+
+    bool is_ipv6(const std::string& address) {
+        return address.find(':') != std::string::npos;
+    }
+
+    [[noreturn]] void fail(const int fd, const std::string& what) {
+        const std::string reason = std::strerror(errno);
+        close(fd);
+        throw MPlexServer::ServerError(what + ": " + reason);
+    }
+}
+
+int MPlexServer::SocketAddress::family() const {
+    return any.sa_family;
+}
+
+socklen_t MPlexServer::SocketAddress::length() const {
+    switch (any.sa_family) {
+        case AF_INET: return sizeof(v4);
+        case AF_INET6: return sizeof(v6);
+        default: return 0;
+    }
+}
+
+MPlexServer::SocketOptions MPlexServer::SocketOptions::merged(const SocketOptions& fallback) const {
+    SocketOptions out = *this;
+    out.nodelay = nodelay || fallback.nodelay;
+    if (send_buffer == 0) out.send_buffer = fallback.send_buffer;
+    if (notsent_lowat == 0) out.notsent_lowat = fallback.notsent_lowat;
+    if (keepalive_idle == 0) out.keepalive_idle = fallback.keepalive_idle;
+    if (busy_poll_us == 0) out.busy_poll_us = fallback.busy_poll_us;
+    return out;
+}
+
+bool MPlexServer::SocketOptions::apply(const int fd, const bool tcp) const {
+    const int on = 1;
+    bool ok = true;
+    if (send_buffer > 0) {
+        ok &= setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &send_buffer, sizeof(send_buffer)) == 0;
+    }
+    if (busy_poll_us > 0) {
+        ok &= setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll_us, sizeof(busy_poll_us)) == 0;
+    }
+    if (!tcp) return ok;
+    if (nodelay) {
+        ok &= setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) == 0;
+    }
+    if (notsent_lowat > 0) {
+        ok &= setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &notsent_lowat, sizeof(notsent_lowat)) == 0;
+    }
+    if (keepalive_idle > 0) {
+        const int interval = keepalive_idle / 3;
+        const int probes = 3;
+        ok &= setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on)) == 0
+            && setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &keepalive_idle, sizeof(keepalive_idle)) == 0
+            && setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval)) == 0
+            && setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes)) == 0;
+    }
+    return ok;
+}
+
+bool MPlexServer::ListenerConfig::isUnix() const {
+    return !address.empty() && address[0] == '/';
+}
+
+std::string MPlexServer::ListenerConfig::describe() const {
+    std::string out = kind == ListenerKind::TLS ? "tls:" : kind == ListenerKind::WEBSOCKET ? "ws:" : "";
+    if (isUnix()) return out + address;
+    if (address.empty()) return out + "0.0.0.0:" + std::to_string(port);
+    if (is_ipv6(address)) return out + "[" + address + "]:" + std::to_string(port);
+    return out + address + ":" + std::to_string(port);
+}
+
+MPlexServer::ListenerConfig MPlexServer::ListenerConfig::parse(std::string_view spec) {
+    ListenerConfig config;
+    if (spec.starts_with("tls:")) {
+        config.kind = ListenerKind::TLS;
+        spec.remove_prefix(4);
+    } else if (spec.starts_with("ws:")) {
+        config.kind = ListenerKind::WEBSOCKET;
+        spec.remove_prefix(3);
+    }
+    const size_t question = spec.find('?');
+    std::string_view options = question == std::string_view::npos ? "" : spec.substr(question + 1);
+    const std::string_view where = spec.substr(0, question);
+
+    if (where.starts_with("/")) {
+        if (where.size() >= sizeof(sockaddr_un::sun_path)) {
+            throw ServerSettingsError("Unix socket path too long: " + std::string(where));
+        }
+        config.address = where;
+    } else {
+        std::string_view port = where;
+        if (where.starts_with("[")) {
+            const size_t close = where.find("]:");
+            if (close == std::string_view::npos) {
+                throw ServerSettingsError("Expected [ipv6]:port in '" + std::string(where) + "'");
+            }
+            config.address = where.substr(1, close - 1);
+            port = where.substr(close + 2);
+        } else if (const size_t colon = where.rfind(':'); colon != std::string_view::npos) {
+            config.address = where.substr(0, colon);
+            port = where.substr(colon + 1);
+        }
+        config.port = static_cast<uint16_t>(parse_number(port, 1, 65535, "port"));
+        in6_addr probe{};
+        if (!config.address.empty()
+            && inet_pton(is_ipv6(config.address) ? AF_INET6 : AF_INET, config.address.c_str(), &probe) != 1) {
+            throw ServerSettingsError("Invalid listen address '" + config.address + "'");
+        }
+    }
+
+    while (!options.empty()) {
+        const size_t amp = options.find('&');
+        const std::string_view option = options.substr(0, amp);
+        options = amp == std::string_view::npos ? "" : options.substr(amp + 1);
+        const size_t equals = option.find('=');
+        const std::string_view name = option.substr(0, equals);
+        const std::string_view value = equals == std::string_view::npos ? "" : option.substr(equals + 1);
+        if (name == "backlog") {
+            config.backlog = parse_number(value, 1, 65535, "backlog");
+        } else if (name == "reuseport") {
+            config.reuse_port = true;
+        } else if (name == "defer") {
+            config.defer_accept = parse_number(value, 0, 3600, "defer");
+        } else if (name == "class") {
+            config.client_class = value;
+        } else if (name == "nodelay") {
+            config.sockets.nodelay = true;
+        } else if (name == "sndbuf") {
+            config.sockets.send_buffer = parse_number(value, 4096, 64 << 20, "sndbuf");
+        } else if (name == "lowat") {
+            config.sockets.notsent_lowat = parse_number(value, 1, 64 << 20, "lowat");
+        } else if (name == "keepalive") {
+            config.sockets.keepalive_idle = parse_number(value, 3, 86400, "keepalive");
+        } else if (name == "busypoll") {
+            config.sockets.busy_poll_us = parse_number(value, 1, 1000000, "busypoll");
+        } else {
+            throw ServerSettingsError("Unknown listener option '" + std::string(name) + "'");
+        }
+    }
+    return config;
+}
+
+void MPlexServer::Listener::open() {
+    if (config.isUnix()) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, config.address.c_str(), sizeof(addr.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            throw ServerError("Failed to open socket");
+        }
+        if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == -1) {
+            if (errno != EADDRINUSE) fail(fd, "Failed to bind " + config.address);
+            // left over from a server that is gone? then nobody accepts on it
+            const int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+            const bool stale = probe != -1 && connect(probe, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == -1
+                && errno == ECONNREFUSED;
+            if (probe != -1) ::close(probe);
+            if (!stale) {
+                errno = EADDRINUSE;
+                fail(fd, "Failed to bind " + config.address);
+            }
+            unlink(config.address.c_str());
+            if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == -1) {
+                fail(fd, "Failed to bind " + config.address);
+            }
+        }
+    } else {
+        SocketAddress addr{};
+        const bool v6 = is_ipv6(config.address);
+        if (v6) {
+            addr.v6.sin6_family = AF_INET6;
+            addr.v6.sin6_port = htons(config.port);
+            inet_pton(AF_INET6, config.address.c_str(), &addr.v6.sin6_addr);
+        } else {
+            addr.v4.sin_family = AF_INET;
+            addr.v4.sin_port = htons(config.port);
+            addr.v4.sin_addr.s_addr = INADDR_ANY;
+            if (!config.address.empty() && inet_pton(AF_INET, config.address.c_str(), &addr.v4.sin_addr.s_addr) <= 0) {
+                throw ServerSettingsError("Invalid IPv4 address");
+            }
+        }
+        fd = socket(addr.family(), SOCK_STREAM, 0);
+        if (fd < 0) {
+            throw ServerError("Failed to open socket");
+        }
+        int opt = 1;
+        if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == -1) {
+            fail(fd, "Failed to set SO_REUSEADDR");
+        }
+        if (config.reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) == -1) {
+            fail(fd, "Failed to set SO_REUSEPORT");
+        }
+        // IPv4 has a listener of its own, so "[::]" may share the port with "0.0.0.0"
+        if (v6 && setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &opt, sizeof(opt)) == -1) {
+            fail(fd, "Failed to set IPV6_V6ONLY");
+        }
+        if (config.defer_accept > 0
+            && setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &config.defer_accept, sizeof(config.defer_accept)) == -1) {
+            fail(fd, "Failed to set TCP_DEFER_ACCEPT");
+        }
+        if (bind(fd, &addr.any, addr.length()) == -1) {
+            fail(fd, "Failed to bind " + config.describe());
+        }
+    }
+    if (listen(fd, config.backlog) == -1) {
+        fail(fd, "Failed to listen on " + config.describe());
+    }
+    try {
+        setNonBlocking(fd);
+    } catch (std::runtime_error&) {
+        fail(fd, "Failed to make " + config.describe() + " non-blocking");
+    }
+}
+
+void MPlexServer::Listener::close(const bool unlink) {
+    if (fd == -1) return;
+    ::close(fd);
+    fd = -1;
+    if (unlink && config.isUnix()) {
+        ::unlink(config.address.c_str());
+    }
+}
+
+void MPlexServer::formatAddress(const SocketAddress& addr, char* out) {
+    switch (addr.family()) {
+        case AF_INET:
+            inet_ntop(AF_INET, &addr.v4.sin_addr, out, INET6_ADDRSTRLEN);
+            break;
+        case AF_INET6:
+            inet_ntop(AF_INET6, &addr.v6.sin6_addr, out, INET6_ADDRSTRLEN);
+            break;
+        default:
+            std::strcpy(out, "localhost");
+    }
+}
@@ -1,15 +1,29 @@
 #include "../include/mplexserver.h"
 
+#include <algorithm>
+#include <cstring>
+
 MPlexServer::Message::Message() {}
 
 MPlexServer::Message::Message(std::string msg, Client client) {
-    this->message = msg;
+    this->message = std::move(msg);
     this->client = client;
+    // the tag section is only located here, one bounded scan; its content is the handler's business
+    if (!this->message.empty() && this->message[0] == '@') {
+        const void* space = std::memchr(this->message.data(), ' ', std::min(this->message.size(), static_cast<size_t>(MAX_TAG_BYTES)));
+        if (space == nullptr) {
+            this->tags_too_long = true;
+        } else {
+            this->tag_len = static_cast<const char*>(space) - this->message.data() + 1;
+        }
+    }
 }
 
 MPlexServer::Message::Message(const Message &other) {
     this->message = other.message;
     this->client = other.client;
+    this->tag_len = other.tag_len;
+    this->tags_too_long = other.tags_too_long;
 }
 
 const MPlexServer::Client & MPlexServer::Message::getClient() const {
@@ -20,8 +34,23 @@ std::string MPlexServer::Message::getMessage() const {
     return this->message;
 }
 
+std::string_view MPlexServer::Message::getTags() const {
+    if (this->tag_len == 0) return {};
+    return std::string_view(this->message).substr(1, this->tag_len - 2);
+}
+
+std::string_view MPlexServer::Message::getBody() const {
+    return std::string_view(this->message).substr(this->tag_len);
+}
+
+bool MPlexServer::Message::tagsTooLong() const {
+    return this->tags_too_long;
+}
+
 MPlexServer::Message & MPlexServer::Message::operator=(const Message &other) {
     this->message = other.message;
     this->client = other.client;
+    this->tag_len = other.tag_len;
+    this->tags_too_long = other.tags_too_long;
     return *this;
-}
\ No newline at end of file
+}
@@ -5,4 +5,28 @@ void MPlexServer::setNonBlocking(const int fd) {
     if (flags == -1) throw std::runtime_error("fcntl F_GETFL failed");
     if (fcntl(fd,F_SETFL,flags|O_NONBLOCK) == -1)
         throw std::runtime_error("fcntl F_SETFL failed");
-}
\ No newline at end of file
+}
+
+MPlexServer::Connection& MPlexServer::ConnectionTable::slot(const int fd) {
+    while (static_cast<size_t>(fd) >= size()) {
+        chunks.push_back(std::make_unique<Connection[]>(CONNECTION_CHUNK));
+    }
+    return chunks[fd / CONNECTION_CHUNK][fd % CONNECTION_CHUNK];
+}
+
+size_t MPlexServer::ConnectionTable::heldBytes() const {
+    return chunks.capacity() * sizeof(chunks[0]) + size() * sizeof(Connection);
+}
+
+MPlexServer::LatencyProfile MPlexServer::LatencyProfile::named(const std::string_view name) {
+    LatencyProfile profile;
+    if (name == "latency") {
+        profile.spin_us = 100;
+        profile.sockets.nodelay = true;
+        profile.sockets.notsent_lowat = 16 * 1024;
+        profile.sockets.busy_poll_us = 50;
+    } else if (name != "default") {
+        throw ServerSettingsError("Unknown latency profile '" + std::string(name) + "'");
+    }
+    return profile;
+}
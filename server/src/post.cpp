@@ -0,0 +1,109 @@
+#include "../include/post.h"
+#include "../include/mplexserver.h"
+
+#include <sys/eventfd.h>
+
+MPlexServer::Posted MPlexServer::Posted::send(const Client& c, std::string message) {
+    Posted task;
+    task.kind = Kind::SEND;
+    task.fd = c.getFd();
+    task.generation = c.getGeneration();
+    task.text = std::move(message);
+    return task;
+}
+
+MPlexServer::Posted MPlexServer::Posted::broadcast(std::string message) {
+    Posted task;
+    task.kind = Kind::BROADCAST;
+    task.text = std::move(message);
+    return task;
+}
+
+MPlexServer::Posted MPlexServer::Posted::disconnect(const Client& c) {
+    Posted task;
+    task.kind = Kind::DISCONNECT;
+    task.fd = c.getFd();
+    task.generation = c.getGeneration();
+    return task;
+}
+
+MPlexServer::Posted MPlexServer::Posted::closure(std::function<void()> fn) {
+    Posted task;
+    task.kind = Kind::CALL;
+    task.fn = std::move(fn);
+    return task;
+}
+
+MPlexServer::PostQueue::PostQueue(const size_t capacity) {
+    if (capacity < 2 || (capacity & (capacity - 1)) != 0) {
+        throw ServerSettingsError("Post queue capacity must be a power of two");
+    }
+    slots = std::make_unique<Slot[]>(capacity);
+    mask = capacity - 1;
+    for (size_t i = 0; i < capacity; ++i) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    // created up front, so push() never sees it change while the server is (re)activated
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd == -1) {
+        throw ServerError("Failed to create eventfd for posted tasks");
+    }
+}
+
+MPlexServer::PostQueue::~PostQueue() {
+    close(wake_fd);
+}
+
+void MPlexServer::PostQueue::attach(const int epoll_fd) {
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = &wake_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev) == -1) {
+        throw ServerError("Failed to add eventfd to epoll instance");
+    }
+}
+
+bool MPlexServer::PostQueue::push(Posted& task) {
+    size_t  position = tail.load(std::memory_order_relaxed);
+    Slot*   slot;
+    while (true) {
+        slot = &slots[position & mask];
+        const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        if (sequence == position) {
+            // free slot: claim it, or learn the new tail from whoever was faster
+            if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+        } else if (sequence < position) {
+            return false;       // the loop has not taken this slot's previous task yet: full
+        } else {
+            position = tail.load(std::memory_order_relaxed);
+        }
+    }
+    slot->task = std::move(task);
+    slot->sequence.store(position + 1, std::memory_order_release);
+
+    // one wakeup per batch; the fence pairs with the exchange in drain(), so either the
+    // loop sees this task or we see the flag cleared and write the eventfd
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!wake_pending.load(std::memory_order_relaxed) && !wake_pending.exchange(true, std::memory_order_seq_cst)) {
+        const uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) == -1) {}   // counter cannot overflow here
+    }
+    return true;
+}
+
+bool MPlexServer::PostQueue::pop(Posted& out) {
+    Slot& slot = slots[head & mask];
+    if (slot.sequence.load(std::memory_order_acquire) != head + 1) return false;
+    out = std::move(slot.task);
+    slot.task = Posted();
+    slot.sequence.store(head + mask + 1, std::memory_order_release);
+    ++head;
+    return true;
+}
+
+bool MPlexServer::PostQueue::handle_event(const epoll_event& event) {
+    if (event.data.ptr != &wake_fd) return false;
+    uint64_t count;
+    if (read(wake_fd, &count, sizeof(count)) == -1) {}      // EAGAIN: already drained
+    return true;
+}
@@ -0,0 +1,82 @@
+#include "../include/serial.h"
+
+#include <cstring>
+
+void MPlexServer::StateWriter::u8(const uint8_t v) {
+    buf_.push_back(static_cast<char>(v));
+}
+
+void MPlexServer::StateWriter::u32(const uint32_t v) {
+    for (int i = 0; i < 4; ++i) buf_.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+void MPlexServer::StateWriter::u64(const uint64_t v) {
+    for (int i = 0; i < 8; ++i) buf_.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+void MPlexServer::StateWriter::f64(const double v) {
+    uint64_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    u64(bits);
+}
+
+void MPlexServer::StateWriter::str(std::string_view v) {
+    u32(static_cast<uint32_t>(v.size()));
+    buf_.append(v);
+}
+
+const std::string& MPlexServer::StateWriter::data() const {
+    return buf_;
+}
+
+std::string& MPlexServer::StateWriter::data() {
+    return buf_;
+}
+
+MPlexServer::StateReader::StateReader(std::string_view data) : data_(data) {
+}
+
+const char* MPlexServer::StateReader::take(const size_t n) {
+    if (data_.size() - pos_ < n) throw SerialError("Serialized state is truncated");
+    const char* p = data_.data() + pos_;
+    pos_ += n;
+    return p;
+}
+
+uint8_t MPlexServer::StateReader::u8() {
+    return static_cast<uint8_t>(*take(1));
+}
+
+uint32_t MPlexServer::StateReader::u32() {
+    const auto* p = reinterpret_cast<const unsigned char*>(take(4));
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) v |= static_cast<uint32_t>(p[i]) << (8 * i);
+    return v;
+}
+
+uint64_t MPlexServer::StateReader::u64() {
+    const auto* p = reinterpret_cast<const unsigned char*>(take(8));
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v |= static_cast<uint64_t>(p[i]) << (8 * i);
+    return v;
+}
+
+double MPlexServer::StateReader::f64() {
+    const uint64_t bits = u64();
+    double v;
+    std::memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+std::string MPlexServer::StateReader::str() {
+    const uint32_t n = u32();
+    return std::string(take(n), n);
+}
+
+bool MPlexServer::StateReader::done() const {
+    return pos_ == data_.size();
+}
+
+size_t MPlexServer::StateReader::offset() const {
+    return pos_;
+}
@@ -0,0 +1,205 @@
+#include "../include/task.h"
+#include "../include/mplexserver.h"
+
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+// fd waits are tagged in epoll_event.data with the fd shifted left and the low bit set;
+// real pointers (connection slots, listener markers, wake_fd) are aligned, so their low bit is 0
+namespace {
+    void* fd_tag(const int fd) {
+        return reinterpret_cast<void*>((static_cast<uintptr_t>(fd) << 1) | 1);
+    }
+}
+
+MPlexServer::TaskScheduler::~TaskScheduler() {
+    shutdown();
+}
+
+void MPlexServer::TaskScheduler::attach(const int epoll_fd) {
+    epollfd = epoll_fd;
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd == -1) {
+        throw ServerError("Failed to create eventfd for task completions");
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = &wake_fd;
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, wake_fd, &ev) == -1) {
+        throw ServerError("Failed to add eventfd to epoll instance");
+    }
+}
+
+void MPlexServer::TaskScheduler::shutdown() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+    jobs.clear();
+    done.clear();
+    finished.clear();
+    stopping = false;
+    // the frames of awaited tasks belong to their awaiting frame, so destroying the roots frees everything
+    const std::vector<void*> unfinished(roots.begin(), roots.end());
+    roots.clear();
+    for (void* frame : unfinished) {
+        std::coroutine_handle<>::from_address(frame).destroy();
+    }
+    fd_waiters.clear();
+    deadlines.clear();
+    due.clear();
+    if (wake_fd != -1) close(wake_fd);
+    wake_fd = -1;
+    epollfd = -1;
+}
+
+bool MPlexServer::TaskScheduler::handle_event(const epoll_event& event) {
+    if (event.data.ptr == &wake_fd) {
+        resume_done();
+        return true;
+    }
+    const uintptr_t tag = reinterpret_cast<uintptr_t>(event.data.ptr);
+    if ((tag & 1) == 0) return false;
+    const int fd = static_cast<int>(tag >> 1);
+    if (static_cast<size_t>(fd) >= fd_waiters.size() || fd_waiters[fd] == nullptr) return true;
+    Waiter& waiter = *fd_waiters[fd];
+    release_fd(waiter);
+    if (waiter.timed) {
+        deadlines.erase(waiter.deadline);
+        waiter.timed = false;
+    }
+    waiter.events = event.events;
+    waiter.handle.resume();
+    return true;
+}
+
+void MPlexServer::TaskScheduler::run_timers() {
+    if (deadlines.empty()) return;
+    const Waiter::Clock::time_point now = Waiter::Clock::now();
+    while (!deadlines.empty() && deadlines.begin()->first <= now) {
+        Waiter* waiter = deadlines.begin()->second;
+        deadlines.erase(deadlines.begin());
+        waiter->timed = false;
+        if (waiter->fd != -1) release_fd(*waiter);
+        waiter->events = 0;
+        due.push_back(waiter);
+    }
+    // resumed coroutines may wait again, possibly with an already passed deadline: that is for the next iteration
+    for (Waiter* waiter : due) {
+        waiter->handle.resume();
+    }
+    due.clear();
+}
+
+void MPlexServer::TaskScheduler::wait_fd(Waiter& waiter, const uint32_t events, const int timeout_ms) {
+    if (epollfd == -1) {
+        throw ServerError("Cannot wait for an fd on an inactive server");
+    }
+    const int fd = waiter.fd;
+    if (fd < 0) {
+        throw ServerError("Cannot wait for an invalid fd");
+    }
+    if (static_cast<size_t>(fd) >= fd_waiters.size()) {
+        fd_waiters.resize(fd + 1, nullptr);
+    }
+    if (fd_waiters[fd] != nullptr) {
+        throw ServerError("Another task is already waiting for this fd");
+    }
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.ptr = fd_tag(fd);
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        throw ServerError("Failed to add fd to epoll instance");
+    }
+    fd_waiters[fd] = &waiter;
+    waiter.events = 0;
+    if (timeout_ms >= 0) {
+        wait_until(waiter, Waiter::Clock::now() + std::chrono::milliseconds(timeout_ms));
+    }
+}
+
+void MPlexServer::TaskScheduler::wait_until(Waiter& waiter, const Waiter::Clock::time_point deadline) {
+    waiter.deadline = deadlines.emplace(deadline, &waiter);
+    waiter.timed = true;
+}
+
+void MPlexServer::TaskScheduler::release_fd(Waiter& waiter) {
+    epoll_ctl(epollfd, EPOLL_CTL_DEL, waiter.fd, nullptr);
+    fd_waiters[waiter.fd] = nullptr;
+}
+
+void MPlexServer::TaskScheduler::submit(Completion& job) {
+    if (wake_fd == -1) {
+        throw ServerError("Cannot offload work on an inactive server");
+    }
+    size_t queued;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        jobs.push_back(&job);
+        queued = jobs.size();
+    }
+    work_ready.notify_one();
+    if (workers.size() < max_workers && workers.size() < queued) {
+        workers.emplace_back(&TaskScheduler::worker_loop, this);
+        if (worker_cpus_set) {
+            pthread_setaffinity_np(workers.back().native_handle(), sizeof(worker_cpus), &worker_cpus);
+        }
+    }
+}
+
+void MPlexServer::TaskScheduler::set_max_workers(const size_t count) {
+    if (count == 0) {
+        throw ServerSettingsError("At least one worker thread is needed");
+    }
+    max_workers = count;
+}
+
+void MPlexServer::TaskScheduler::set_worker_cpus(const cpu_set_t& cpus) {
+    worker_cpus = cpus;
+    worker_cpus_set = true;
+}
+
+void MPlexServer::TaskScheduler::worker_loop() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        work_ready.wait(guard, [this] { return stopping || !jobs.empty(); });
+        if (stopping) return;
+        Completion* job = jobs.front();
+        jobs.pop_front();
+        guard.unlock();
+        job->run();
+        guard.lock();
+        done.push_back(job);
+        // one wakeup per batch: the loop drains everything that finished until it reads the eventfd
+        if (done.size() == 1) {
+            const uint64_t one = 1;
+            if (write(wake_fd, &one, sizeof(one)) == -1) {}   // counter cannot overflow here
+        }
+    }
+}
+
+void MPlexServer::TaskScheduler::resume_done() {
+    uint64_t count;
+    if (read(wake_fd, &count, sizeof(count)) == -1) {}      // EAGAIN: already drained
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        finished.swap(done);
+    }
+    for (Completion* job : finished) {
+        job->handle.resume();
+    }
+    finished.clear();   // both vectors keep their capacity
+}
+
+void MPlexServer::TaskScheduler::spawn(Task<> task) {
+    task.detach(roots);
+}
+
+size_t MPlexServer::TaskScheduler::spawned() const {
+    return roots.size();
+}
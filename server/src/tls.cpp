@@ -0,0 +1,12 @@
+#include "../include/tls_impl.h"
+
+namespace MPlexServer::detail {
+    std::string tls_error() {
+        const unsigned long code = ERR_get_error();
+        if (code == 0) return "unknown error";
+        char buf[256];
+        ERR_error_string_n(code, buf, sizeof(buf));
+        ERR_clear_error();
+        return buf;
+    }
+}
@@ -0,0 +1,324 @@
+#include "../include/websocket.h"
+
+#include <openssl/evp.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace {
+    constexpr uint8_t OP_CONTINUATION = 0x0;
+    constexpr uint8_t OP_TEXT = 0x1;
+    constexpr uint8_t OP_BINARY = 0x2;
+    constexpr uint8_t OP_CLOSE = 0x8;
+    constexpr uint8_t OP_PING = 0x9;
+    constexpr uint8_t OP_PONG = 0xa;
+
+    constexpr uint16_t CLOSE_NORMAL = 1000;
+    constexpr uint16_t CLOSE_PROTOCOL_ERROR = 1002;
+    constexpr uint16_t CLOSE_TOO_BIG = 1009;
+
+    std::string frame_header(const uint8_t opcode, const size_t len) {
+        std::string out;
+        out += static_cast<char>(0x80 | opcode);
+        if (len < 126) {
+            out += static_cast<char>(len);
+        } else if (len <= 0xffff) {
+            out += static_cast<char>(126);
+            out += static_cast<char>(len >> 8);
+            out += static_cast<char>(len & 0xff);
+        } else {
+            out += static_cast<char>(127);
+            for (int shift = 56; shift >= 0; shift -= 8) {
+                out += static_cast<char>((static_cast<uint64_t>(len) >> shift) & 0xff);
+            }
+        }
+        return out;
+    }
+
+    std::string close_frame(const uint16_t code) {
+        std::string out = frame_header(OP_CLOSE, 2);
+        out += static_cast<char>(code >> 8);
+        out += static_cast<char>(code & 0xff);
+        return out;
+    }
+
+    bool iequals(const std::string_view a, const std::string_view b) {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const char x, const char y) {
+            return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+        });
+    }
+
+    std::string_view trim(std::string_view s) {
+        while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+        while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+        return s;
+    }
+
+    // true if the comma separated header value lists token (case-insensitive)
+    bool has_token(std::string_view list, const std::string_view token) {
+        while (!list.empty()) {
+            const size_t comma = list.find(',');
+            if (iequals(trim(list.substr(0, comma)), token)) return true;
+            if (comma == std::string_view::npos) break;
+            list.remove_prefix(comma + 1);
+        }
+        return false;
+    }
+
+    std::string accept_key(const std::string_view key) {
+        const std::string       input = std::string(key) + WS_GUID;
+        unsigned char           digest[EVP_MAX_MD_SIZE];
+        unsigned int            digest_len = 0;
+        EVP_Digest(input.data(), input.size(), digest, &digest_len, EVP_sha1(), nullptr);
+        unsigned char           encoded[64];
+        const int               n = EVP_EncodeBlock(encoded, digest, static_cast<int>(digest_len));
+        return std::string(reinterpret_cast<const char*>(encoded), n);
+    }
+
+    // [from, to) of every line in data, CR and LF excluded, empty lines skipped
+    template <class CharAt>
+    void split_lines(const size_t size, const CharAt& char_at, std::vector<std::pair<size_t, size_t>>& lines) {
+        size_t start = 0;
+        for (size_t pos = 0; pos <= size; ++pos) {
+            if (pos < size && char_at(pos) != '\n') continue;
+            size_t end = pos;
+            if (end > start && char_at(end - 1) == '\r') --end;
+            if (end > start) lines.emplace_back(start, end);
+            start = pos + 1;
+        }
+    }
+
+    // segments of a SharedMessage are full except the last, so a position maps straight to one
+    void add_range(std::vector<MPlexServer::Slice>& out, const std::vector<MPlexServer::Segment*>& segments, size_t from, const size_t to) {
+        using MPlexServer::Segment;
+        while (from < to) {
+            const size_t off = from % Segment::CAPACITY;
+            const size_t len = std::min(to - from, Segment::CAPACITY - off);
+            out.push_back(MPlexServer::Slice{segments[from / Segment::CAPACITY], static_cast<uint32_t>(off), static_cast<uint32_t>(len)});
+            from += len;
+        }
+    }
+}
+
+MPlexServer::WebSocket::Handshake MPlexServer::WebSocket::handshake(const std::string_view data, std::string& response) {
+    static const std::string bad_request = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+
+    input.append(data);
+    const size_t end = input.find("\r\n\r\n");
+    if (end == pooled_string::npos) {
+        if (input.size() <= WS_MAX_HANDSHAKE) return Handshake::PENDING;
+        response = bad_request;
+        return Handshake::REJECTED;
+    }
+    std::string_view    request(input.data(), end + 2);
+    const size_t        first_line = request.find("\r\n");
+    if (request.substr(0, 4) != "GET ") {
+        response = bad_request;
+        return Handshake::REJECTED;
+    }
+    request.remove_prefix(first_line + 2);
+
+    bool                upgrade = false;
+    bool                connection = false;
+    std::string_view    key;
+    std::string_view    version;
+    std::string_view    protocols;
+    while (!request.empty()) {
+        const size_t            eol = request.find("\r\n");
+        const std::string_view  header = request.substr(0, eol);
+        request.remove_prefix(eol + 2);
+        const size_t            colon = header.find(':');
+        if (colon == std::string_view::npos) continue;
+        const std::string_view  name = trim(header.substr(0, colon));
+        const std::string_view  value = trim(header.substr(colon + 1));
+        if (iequals(name, "Upgrade")) upgrade = has_token(value, "websocket");
+        else if (iequals(name, "Connection")) connection = has_token(value, "upgrade");
+        else if (iequals(name, "Sec-WebSocket-Key")) key = value;
+        else if (iequals(name, "Sec-WebSocket-Version")) version = value;
+        else if (iequals(name, "Sec-WebSocket-Protocol")) protocols = value;
+    }
+    if (!upgrade || !connection || key.empty()) {
+        response = bad_request;
+        return Handshake::REJECTED;
+    }
+    if (version != "13") {
+        response = "HTTP/1.1 426 Upgrade Required\r\nSec-WebSocket-Version: 13\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+        return Handshake::REJECTED;
+    }
+
+    response = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: "
+               + accept_key(key) + "\r\n";
+    // text is preferred; without a subprotocol the client gets text frames too
+    if (has_token(protocols, "text.ircv3.net")) {
+        response += "Sec-WebSocket-Protocol: text.ircv3.net\r\n";
+    } else if (has_token(protocols, "binary.ircv3.net")) {
+        response += "Sec-WebSocket-Protocol: binary.ircv3.net\r\n";
+        binary_ = true;
+    }
+    response += "\r\n";
+    input.erase(0, end + 4);
+    return Handshake::UPGRADED;
+}
+
+bool MPlexServer::WebSocket::decode(const std::string_view data, pooled_string& lines, std::string& control) {
+    input.append(data);
+    size_t pos = 0;
+    bool open = true;
+    while (open && input.size() - pos >= 2) {
+        const uint8_t   b0 = static_cast<uint8_t>(input[pos]);
+        const uint8_t   b1 = static_cast<uint8_t>(input[pos + 1]);
+        const bool      fin = b0 & 0x80;
+        const uint8_t   opcode = b0 & 0x0f;
+        size_t          header_len = 2;
+        uint64_t        len = b1 & 0x7f;
+        if (len == 126 || len == 127) {
+            header_len += len == 126 ? 2 : 8;
+            if (input.size() - pos < header_len) break;
+            len = 0;
+            for (size_t i = pos + 2; i < pos + header_len; ++i) {
+                len = (len << 8) | static_cast<uint8_t>(input[i]);
+            }
+        }
+        // client frames must be masked, reserved bits unused, control frames short and unfragmented
+        if (!(b1 & 0x80) || (b0 & 0x70) || (opcode >= OP_CLOSE && (!fin || len > 125))) {
+            control += close_frame(CLOSE_PROTOCOL_ERROR);
+            open = false;
+            break;
+        }
+        if (len > WS_MAX_MESSAGE || message.size() + len > WS_MAX_MESSAGE) {
+            control += close_frame(CLOSE_TOO_BIG);
+            open = false;
+            break;
+        }
+        if (input.size() - pos < header_len + 4 + len) break;
+
+        const char*     mask = input.data() + pos + header_len;
+        std::string     payload(input.data() + pos + header_len + 4, len);
+        for (size_t i = 0; i < payload.size(); ++i) {
+            payload[i] ^= mask[i % 4];
+        }
+        pos += header_len + 4 + len;
+
+        switch (opcode) {
+            case OP_TEXT:
+            case OP_BINARY:
+            case OP_CONTINUATION:
+                if (fragmented == (opcode != OP_CONTINUATION)) {
+                    control += close_frame(CLOSE_PROTOCOL_ERROR);
+                    open = false;
+                    break;
+                }
+                if (fin && !fragmented) {
+                    deliver(payload, lines);
+                    break;
+                }
+                message.append(payload);
+                fragmented = !fin;
+                if (fin) {
+                    deliver(std::string_view(message.data(), message.size()), lines);
+                    pooled_string().swap(message);
+                }
+                break;
+            case OP_PING:
+                control += frame_header(OP_PONG, payload.size()) + payload;
+                break;
+            case OP_PONG:
+                break;
+            case OP_CLOSE: {
+                // echo the status code, as the close handshake asks for
+                const uint16_t code = payload.size() >= 2
+                    ? static_cast<uint16_t>(static_cast<uint8_t>(payload[0]) << 8 | static_cast<uint8_t>(payload[1])) : CLOSE_NORMAL;
+                control += close_frame(code);
+                open = false;
+                break;
+            }
+            default:
+                control += close_frame(CLOSE_PROTOCOL_ERROR);
+                open = false;
+        }
+    }
+    input.erase(0, pos);
+    if (input.empty()) {
+        pooled_string().swap(input);
+    }
+    return open;
+}
+
+void MPlexServer::WebSocket::deliver(std::string_view payload, pooled_string& lines) const {
+    while (!payload.empty() && (payload.back() == '\r' || payload.back() == '\n')) {
+        payload.remove_suffix(1);
+    }
+    if (payload.empty()) return;
+    lines.append(payload);
+    lines.append("\r\n");
+}
+
+void MPlexServer::WebSocket::frame(OutQueue& queue, const std::string_view data) const {
+    std::vector<std::pair<size_t, size_t>> lines;
+    split_lines(data.size(), [&data](const size_t pos) { return data[pos]; }, lines);
+    for (const auto& [from, to] : lines) {
+        queue.append(header(to - from, binary_));
+        queue.append(data.substr(from, to - from));
+    }
+}
+
+bool MPlexServer::WebSocket::binary() const {
+    return binary_;
+}
+
+size_t MPlexServer::WebSocket::heldBytes() const {
+    const size_t inline_capacity = pooled_string().capacity();
+    return (input.capacity() > inline_capacity ? input.capacity() : 0)
+           + (message.capacity() > inline_capacity ? message.capacity() : 0);
+}
+
+void MPlexServer::WebSocket::serialize(StateWriter& out) const {
+    out.u8(binary_);
+    out.u8(fragmented);
+    out.str(std::string_view(input.data(), input.size()));
+    out.str(std::string_view(message.data(), message.size()));
+}
+
+void MPlexServer::WebSocket::deserialize(StateReader& in) {
+    binary_ = in.u8();
+    fragmented = in.u8();
+    const std::string pending_input = in.str();
+    const std::string pending_message = in.str();
+    input.assign(pending_input.data(), pending_input.size());
+    message.assign(pending_message.data(), pending_message.size());
+}
+
+std::string MPlexServer::WebSocket::header(const size_t len, const bool binary) {
+    return frame_header(binary ? OP_BINARY : OP_TEXT, len);
+}
+
+MPlexServer::WebSocketFrames::WebSocketFrames(const SharedMessage& msg) : msg(msg) {}
+
+const std::vector<MPlexServer::Slice>& MPlexServer::WebSocketFrames::slices(const bool binary) {
+    std::vector<Slice>& out = frames[binary];
+    if (built[binary]) return out;
+    built[binary] = true;
+
+    const std::vector<Segment*>& segments = msg.segments();
+    std::vector<std::pair<size_t, size_t>> lines;
+    split_lines(msg.size(), [&segments](const size_t pos) {
+        return segments[pos / Segment::CAPACITY]->data[pos % Segment::CAPACITY];
+    }, lines);
+
+    std::string             all_headers;
+    std::vector<size_t>     header_ends;
+    for (const auto& [from, to] : lines) {
+        all_headers += WebSocket::header(to - from, binary);
+        header_ends.push_back(all_headers.size());
+    }
+    headers[binary] = SharedMessage(all_headers);
+    out.reserve(lines.size() * 2);
+    size_t header_start = 0;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        add_range(out, headers[binary].segments(), header_start, header_ends[i]);
+        add_range(out, segments, lines[i].first, lines[i].second);
+        header_start = header_ends[i];
+    }
+    return out;
+}
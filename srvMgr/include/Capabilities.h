@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// capabilities a client enabled with CAP REQ, one bit each in User::get_caps()
+enum Capability : uint32_t {
+    CAP_MESSAGE_TAGS    = 1u << 0,
+    CAP_SERVER_TIME     = 1u << 1,
+    CAP_ECHO_MESSAGE    = 1u << 2,      // PRIVMSG/TAGMSG are sent back to the sender too
+    CAP_EXTENDED_JOIN   = 1u << 3,      // JOIN carries account ("*", we have none) and realname
+    CAP_MULTI_PREFIX    = 1u << 4,      // all prefixes in NAMES; with '@' as the only one, replies are unchanged
+    CAP_BATCH           = 1u << 5,      // history replays come wrapped in a chathistory BATCH
+};
+
+#define CAP_ALL_MASK    0x3fu
+
+// the capabilities that change which tags a client gets
+#define CAP_TAG_MASK    (CAP_MESSAGE_TAGS | CAP_SERVER_TIME)
+
+// the bit of a capability name, 0 if the server does not offer it
+uint32_t        capability_bit(std::string_view name);
+// space-separated names of the bits in caps; all offered capabilities for CAP_ALL_MASK
+std::string     capability_names(uint32_t caps);
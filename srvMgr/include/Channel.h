@@ -4,34 +4,51 @@
 
 #pragma once
 
+#include <cstdint>
 #include <ctime>
+#include <functional>
+#include <memory>
+#include <vector>
 
+#include "MaskMatcher.h"
 #include "User.h"
 
+#define CHANNEL_MAX_MASKS 100       // entries per +b/+e/+I list
+
+// one entry of a +b/+e/+I list
+struct MaskEntry {
+    std::string     mask;           // nick!user@host, wildcards allowed
+    std::string     setter;
+    std::time_t     set_time;
+};
+
 class Channel
 {
 public:
     Channel() = default;
     Channel(std::string  chan_name, std::string chan_creator);
+    Channel(std::string chan_name, std::time_t creation_time);     // empty channel learned from a linked server
     Channel(const Channel& other) = default;
     ~Channel() = default;
 
     Channel&    operator=(const Channel& other) = default;
 
-    std::string                     get_channel_name();
-    std::string                     get_channel_topic();
+    std::string                     get_channel_name() const;
+    std::string                     get_channel_topic() const;
     void                            set_channel_topic(std::string&);
-    std::string                     get_user_nicks_str();
+    std::string                     get_user_nicks_str() const;
     std::unordered_set<std::string> get_chan_nicks() const;
+    std::unordered_set<std::string> get_chan_ops() const;
     void                            add_operator(std::string);
     int                             remove_operator(std::string);
     void                            add_nick(std::string);
     int                             remove_nick(std::string);
-    bool                            has_chan_member(const std::string &nick);
-    bool                            has_chan_op(const std::string &nick);
+    bool                            has_chan_member(const std::string &nick) const;
+    bool                            has_chan_op(const std::string &nick) const;
 
     std::string                     get_modes() const;
 
+    std::string                     get_key() const;
     void                            set_key(const std::string &key);
     bool                            does_key_fit(const std::string &key);
     int                             get_member_count() const;
@@ -42,10 +59,35 @@ public:
     bool                            needs_invite() const;
     void                            set_needs_invite(bool needs_invite);
     std::string                     get_creation_time() const;
+    std::time_t                     get_creation_ts() const;
+    void                            set_creation_ts(std::time_t creation_time);
     std::string                     get_topic_setter() const;
     void                            set_topic_setter(std::string setter_nick);
     std::string                     get_topic_set_time() const;
     void                            set_topic_set_time();
+    std::time_t                     get_topic_set_ts() const;
+    void                            set_topic_set_time(std::time_t set_time);
+
+    // +b/+e/+I lists, selected by their mode letter
+    bool                            add_mask(char list, const MaskEntry& entry);
+    bool                            remove_mask(char list, const std::string& mask);
+    const std::vector<MaskEntry>&   get_masks(char list) const;
+    bool                            has_masks() const;
+    bool                            masks_match(char list, const std::string& signature);
+    uint64_t                        get_masks_version() const;
+
+    void                            serialize(MPlexServer::StateWriter& out) const;
+    void                            deserialize(MPlexServer::StateReader& in);
+
+    // persistent settings only (no members or invites), used by ChannelLog; operators are
+    // saved as nick!user@host so that a nick alone does not win them back after a restart
+    using SignatureOf = std::function<std::string(const std::string& nick)>;
+    void                            serialize_settings(MPlexServer::StateWriter& out, const SignatureOf& signature_of) const;
+    void                            deserialize_settings(MPlexServer::StateReader& in);
+    bool                            has_operators() const;
+    bool                            has_saved_ops() const;
+    bool                            is_saved_op(const std::string& signature) const;
+    void                            clear_saved_ops();
 
 private:
     std::string                     chan_name_;
@@ -62,4 +104,15 @@ private:
     std::unordered_set<std::string> chan_nicks_;
     std::unordered_set<std::string> chan_ops_;
     std::unordered_set<std::string> invites_;
+    std::unordered_set<std::string> saved_ops_;             // nick!user@host of operators read from the log
+
+    std::vector<MaskEntry>          masks_[3];              // b, e, I
+    std::shared_ptr<MaskMatcher>    matchers_[3];           // compiled on first use after a change
+    uint64_t                        masks_version_ = next_masks_version();
+
+    static int                      list_index(char list);
+    static uint64_t                 next_masks_version();   // unique across channels, cached ban checks compare it
+    void                            masks_changed();
+    void                            serialize_masks(MPlexServer::StateWriter& out) const;
+    void                            deserialize_masks(MPlexServer::StateReader& in);
 };
\ No newline at end of file
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "mplexserver.h"
+
+#define HISTORY_DEFAULT_LINES 100
+#define HISTORY_DEFAULT_BYTES (32 * 1024)
+#define HISTORY_DEFAULT_AGE (24 * 3600)         // seconds
+#define CHATHISTORY_MAX_LIMIT 100               // lines per CHATHISTORY request
+
+/**
+ * @brief Caps of every channel's history; a line is dropped once any of them is exceeded.
+ *
+ * Lines past max_age_ms are dropped by SrvMgr's periodic sweep as well, not
+ * only when the channel is active. The byte cap counts the lines, not the
+ * memory they keep: every line holds a reference on its whole arena segment
+ * (Segment::CAPACITY bytes), so a few old lines can pin segments otherwise
+ * filled with evicted ones, up to about one segment per channel with history.
+ */
+struct HistoryLimits {
+    size_t  lines = HISTORY_DEFAULT_LINES;
+    size_t  bytes = HISTORY_DEFAULT_BYTES;
+    int64_t max_age_ms = static_cast<int64_t>(HISTORY_DEFAULT_AGE) * 1000;
+    size_t  join_replay = 0;                    // lines sent to every joining user, 0: only on CHATHISTORY
+};
+
+/**
+ * @brief Append-only store for history lines, shared by all channels.
+ *
+ * Lines are packed back to back into the server's pooled outbound segments,
+ * so replay links them into a send queue without copying. Every stored line
+ * holds a reference on its segment; a segment goes back to the pool once the
+ * arena moved on and the last line in it was evicted (and sent).
+ * Sender prefixes (":nick!user@host ") are interned: each is stored once and
+ * shared by all lines of that sender, in every channel.
+ */
+class HistoryArena {
+public:
+    HistoryArena() = default;
+    HistoryArena(const HistoryArena& other) = delete;
+    HistoryArena& operator=(const HistoryArena& other) = delete;
+    ~HistoryArena();
+
+    /**
+     * @brief Copies bytes into the arena.
+     * @return The stored range, holding one segment reference for the caller; an empty slice if bytes do not fit a segment.
+     */
+    MPlexServer::Slice  store(std::string_view bytes);
+
+    /**
+     * @return Id of the interned prefix, with one more reference on it.
+     */
+    uint32_t            intern(std::string_view prefix);
+    void                release(uint32_t prefix_id);
+    MPlexServer::Slice  prefix(uint32_t prefix_id) const;
+
+private:
+    struct Prefix {
+        MPlexServer::Slice  slice;
+        uint32_t            refs;
+    };
+
+    MPlexServer::Segment*                           tail_ = nullptr;
+    std::vector<Prefix>                             prefixes_;
+    std::vector<uint32_t>                           free_ids_;
+    std::unordered_map<std::string_view, uint32_t>  index_;     // views into the arena
+};
+
+/**
+ * @brief One stored line as returned by a query; the views and slices point
+ * into the arena and stay valid until the history is changed or trimmed.
+ */
+struct HistoryLine {
+    int64_t             time_ms;        // when the server relayed it, the @time it went out with
+    std::string_view    tags;           // "msgid=...[;+client=tags]" as message-tags clients got it
+    MPlexServer::Slice  prefix;         // ":nick!user@host "
+    MPlexServer::Slice  body;           // "PRIVMSG #chan :text\r\n"
+};
+
+/**
+ * @brief Bounded ring of a channel's recent messages, stored in a HistoryArena.
+ *
+ * A line's tags are stored in front of its body in one arena range, so
+ * they cost no allocation of their own; they count towards the byte cap.
+ */
+class ChannelHistory {
+public:
+    ChannelHistory(HistoryArena& arena, const HistoryLimits& limits);
+    ChannelHistory(const ChannelHistory& other) = delete;
+    ChannelHistory& operator=(const ChannelHistory& other) = delete;
+    ~ChannelHistory();
+
+    /**
+     * @brief Stores one line, sent as prefix + body ("PRIVMSG #chan :text\r\n") at time_ms with tags.
+     */
+    void    add(int64_t time_ms, std::string_view tags, std::string_view prefix, std::string_view body);
+
+    // lines in chronological order; trims by age against now_ms first
+    std::vector<HistoryLine>    latest(int64_t now_ms, size_t limit, int64_t after_ms = -1);
+    std::vector<HistoryLine>    before(int64_t now_ms, int64_t before_ms, size_t limit);
+    std::vector<HistoryLine>    after(int64_t now_ms, int64_t after_ms, size_t limit);
+
+    size_t  size() const;
+    // time of the oldest line; only valid if size() > 0
+    int64_t oldest_ms() const;
+
+    /**
+     * @brief Drops the lines beyond any cap, the oldest first.
+     */
+    void    trim(int64_t now_ms);
+
+    /**
+     * @brief Parses an IRCv3 "timestamp=YYYY-MM-DDThh:mm:ss.sssZ" reference.
+     */
+    static bool parse_timestamp(const std::string& reference, int64_t& ms);
+    static int64_t  now_ms();
+
+private:
+    struct Entry {
+        int64_t             time_ms;
+        uint32_t            prefix;
+        uint32_t            tags_len;
+        MPlexServer::Slice  stored;         // tags, then the body
+    };
+
+    HistoryArena&           arena_;
+    const HistoryLimits&    limits_;
+    std::deque<Entry>       entries_;
+    size_t                  bytes_ = 0;
+
+    void    evict_oldest();
+    std::vector<HistoryLine>    lines(size_t first, size_t last) const;
+};
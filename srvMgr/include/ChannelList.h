@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Channel.h"
+#include "mplexserver.h"
+
+#define LIST_SCAN_STEP 256      // buckets of the channel table inspected per generator step
+
+/**
+ * @brief Conditions of a LIST request: "LIST [<mask>|>n|<n>[,...]]".
+ */
+struct ListFilter {
+    std::vector<std::string>    masks;          // '*' and '?' wildcards, none: every channel
+    int                         min_users = -1; // ">n": more than n users
+    int                         max_users = -1; // "<n": less than n users
+
+    bool                matches(const std::string& chan_name, const Channel& channel) const;
+    static ListFilter   parse(std::string args);
+};
+
+/**
+ * @brief Produces a LIST reply lazily, resuming from a bucket of the channel table.
+ *
+ * Between two steps only the cursor is kept, never a copy of the channel set.
+ * Channels created or dropped while the reply is under way may be missed, or
+ * listed twice if the table was rehashed meanwhile.
+ */
+class ChannelList : public MPlexServer::OutputGenerator {
+public:
+    ChannelList(std::unordered_map<std::string, Channel>& channels, const std::string& server_name, const std::string& nick, ListFilter filter);
+
+    bool    generate(std::string& out, size_t budget) override;
+
+private:
+    std::unordered_map<std::string, Channel>&   channels_;
+    const std::string                           server_name_;
+    const std::string                           nick_;
+    const ListFilter                            filter_;
+    bool                                        literal_;       // plain channel names only: looked up instead of scanned
+    size_t                                      cursor_ = 0;    // next bucket, or next mask if literal_
+
+    void    append_entry(std::string& out, const std::string& chan_name, Channel& channel) const;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Channel.h"
+
+#define CHANLOG_INITIAL_SIZE (64 * 1024)
+#define CHANLOG_SNAPSHOT_BYTES (256 * 1024)
+
+/**
+ * @brief Write-ahead log and snapshot of the persistent channel settings.
+ *
+ * Every record is the full settings of one channel (topic, key, limit, +i/+t,
+ * operators as nick!user@host) or a deletion, so replay is "last record
+ * wins". Records are collected during a poll iteration and copied into the
+ * memory-mapped log in one batch by commit(); nothing waits for the disk. Once the log outgrows
+ * CHANLOG_SNAPSHOT_BYTES the whole state is written to a snapshot file and
+ * the log starts over.
+ *
+ * Files: <prefix>.wal and <prefix>.snap; the open log holds an exclusive
+ * flock() on the .wal so that only one server uses them.
+ * Record: u32 length | u32 crc32 | u8 type | payload
+ */
+class ChannelLog {
+public:
+    ChannelLog() = default;
+    ChannelLog(const ChannelLog& other) = delete;
+    ChannelLog& operator=(const ChannelLog& other) = delete;
+    ~ChannelLog();
+
+    /**
+     * @brief Locks the log, replays snapshot and log into recovered and opens the log for appending.
+     * @return False if the files cannot be opened or another process holds the lock; logging stays disabled.
+     */
+    bool    open(const std::string& path_prefix, std::unordered_map<std::string, Channel>& recovered);
+    bool    is_open() const;
+
+    /**
+     * @brief Unmaps the log and releases its lock; records not yet committed are lost.
+     */
+    void    close();
+
+    void    record_settings(const Channel& channel, const Channel::SignatureOf& signature_of);
+    void    record_removal(const std::string& chan_name);
+
+    /**
+     * @brief Copies the records of this iteration into the mapped log.
+     * @return True if the log grew past CHANLOG_SNAPSHOT_BYTES and wants a snapshot.
+     */
+    bool    commit();
+
+    /**
+     * @brief Writes all channel settings to the snapshot file and empties the log.
+     */
+    void    snapshot(const std::vector<const Channel*>& channels, const Channel::SignatureOf& signature_of);
+
+private:
+    enum RecordType : uint8_t { SETTINGS = 1, REMOVAL = 2 };
+
+    std::string path_prefix_;
+    int         fd_ = -1;
+    char*       map_ = nullptr;
+    size_t      map_size_ = 0;
+    size_t      end_ = 0;
+    std::string pending_;
+
+    void    append_record(RecordType type, const std::string& payload);
+    bool    map_file(size_t size);
+    void    replay_snapshot(std::unordered_map<std::string, Channel>& recovered) const;
+    void    replay_log(std::unordered_map<std::string, Channel>& recovered);
+    void    reset_log();
+};
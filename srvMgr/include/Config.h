@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "SrvMgr.h"
+
+/**
+ * @brief Settings from the configuration file, the optional third argument of ircserv.
+ *
+ * One "key = value" per line, '#' starts a comment; see ircserv.conf.example for
+ * every key. Values left out keep the built-in defaults, so a reload with a line
+ * removed goes back to the default. The file is checked as a whole: a reload
+ * with any error changes nothing.
+ *
+ * Live settings are re-applied on SIGHUP without touching connections. The
+ * startup settings only take effect on a restart or on a binary upgrade
+ * (SIGUSR2), whose new process reads the file again and keeps the connections.
+ */
+struct Config {
+    // startup settings
+    std::string                 server_name;        // empty: IRC_SERVER_NAME or the built-in name
+    std::vector<std::string>    listen;             // ListenerConfig::parse() specs, next to <port> and IRC_LISTEN
+    std::string                 tls_cert;           // empty: IRC_TLS_CERT or ircserv.crt
+    std::string                 tls_key;
+    std::vector<std::string>    plugins;            // next to IRC_PLUGINS
+    std::string                 channel_log = "ircserv";  // crash recovery files <prefix>.wal and <prefix>.snap
+
+    // live settings
+    int                         log_level = VERBOSITY_MAX;
+    size_t                      read_size = MAX_MSG_LEN;
+    size_t                      epoll_events = MAX_EPOLL_EVENTS;
+    double                      flood_rate = FLOOD_DEFAULT_RATE;
+    double                      flood_burst = FLOOD_DEFAULT_BURST;
+    size_t                      recvq_max = FLOOD_DEFAULT_RECVQ;
+    size_t                      sendq_max = SENDQ_DEFAULT_MAX;
+    std::unordered_map<std::string, double> penalties;     // "penalty.<COMMAND>" lines
+    int                         ident_timeout_ms = IDENT_TIMEOUT_MS;
+    int                         dns_timeout_ms = DNS_TIMEOUT_MS;
+    size_t                      worker_threads = TASK_WORKER_THREADS;
+    std::string                 profile = "default";  // LatencyProfile::named()
+    int                         loop_cpu = -1;        // overrides of the profile
+    int                         spin_us = -1;
+
+    /**
+     * @brief Reads and validates path.
+     * @return False with "<path>:<line>: <problem>" in error; this object is then unchanged.
+     */
+    bool    load(const std::string& path, std::string& error);
+
+    /**
+     * @brief Applies the live settings to the server and SrvMgr; call from the loop's thread.
+     *
+     * Throws ServerError if the loop cannot be pinned to loop_cpu.
+     */
+    void    apply(IrcServer& srv, SrvMgr& srv_mgr) const;
+
+    /**
+     * @return Keys of startup settings that differ from running, which a reload cannot apply.
+     */
+    std::vector<std::string>    startup_changes(const Config& running) const;
+};
@@ -5,6 +5,8 @@
 #define RPL_CREATED "003"
 #define RPL_MYINFO "004"
 
+#define RPL_LIST "322"
+#define RPL_LISTEND "323"
 #define RPL_CHANNELMODEIS "324"
 
 #define RPL_CREATIONTIME "329"
@@ -12,15 +14,24 @@
 #define RPL_TOPIC "332"
 #define RPL_TOPICWHOTIME "333"
 #define RPL_INVITING "341"
+#define RPL_INVITELIST "346"
+#define RPL_ENDOFINVITELIST "347"
+#define RPL_EXCEPTLIST "348"
+#define RPL_ENDOFEXCEPTLIST "349"
 #define RPL_NAMREPLY "353"
 #define RPL_ENDOFNAMES "366"
+#define RPL_BANLIST "367"
+#define RPL_ENDOFBANLIST "368"
 
 #define ERR_UNKNOWNERROR "400"
 #define ERR_NOSUCHNICK "401"
 #define ERR_NOSUCHCHANNEL "403"
 #define ERR_CANNOTSENDTOCHAN "404"
 
+#define ERR_INVALIDCAPCMD "410"
+
 #define ERR_NOTEXTTOSEND "412"
+#define ERR_INPUTTOOLONG "417"
 
 #define ERR_NONICKNAMEGIVEN "431"
 #define ERR_ERRONEUSNICKNAME "432"
@@ -38,8 +49,10 @@
 
 #define ERR_CHANNELISFULL "471"
 #define ERR_INVITEONLYCHAN " 473"
+#define ERR_BANNEDFROMCHAN "474"
 #define ERR_BADCHANMASK "476"
 #define ERR_BADCHANNELKEY "475"
+#define ERR_BANLISTFULL "478"
 #define ERR_CHANOPRIVSNEEDED "482"
 
 #define ERR_UMODEUNKNOWNFLAG "501"
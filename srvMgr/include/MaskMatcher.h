@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define MASK_DFA_MAX_STATES 512         // cached DFA states per matcher before the cache is started over
+
+/**
+ * @brief A set of nick!user@host wildcard masks compiled into one automaton.
+ *
+ * The masks are merged into a trie of literal, '?' and '*' steps, so masks
+ * with a common prefix share states. Matching runs that trie as an NFA whose
+ * state sets become DFA states the first time they are reached; afterwards a
+ * subject costs one table lookup per character, however many masks there are.
+ * Characters that appear in no mask share one input class, which keeps the
+ * transition tables small. Matching is case-insensitive (ASCII).
+ */
+class MaskMatcher {
+public:
+    explicit MaskMatcher(const std::vector<std::string>& masks);
+
+    /**
+     * @return True if any mask matches the whole subject.
+     */
+    bool    matches(std::string_view subject);
+
+    /**
+     * @brief Completes a short mask ("nick", "user@host", "nick!user") to nick!user@host form.
+     */
+    static std::string  normalize(const std::string& mask);
+
+    // DFA states built so far, at most MASK_DFA_MAX_STATES (tests/mask_check.cpp)
+    size_t  dfa_states() const;
+
+private:
+    struct Node {
+        std::map<uint8_t, int32_t>  literal;        // by input class
+        int32_t                     any = -1;       // '?'
+        int32_t                     star = -1;      // '*'
+        bool                        is_star = false;
+        bool                        accept = false;
+    };
+    struct DfaState {
+        std::vector<int32_t>    nodes;              // sorted set of trie nodes
+        std::vector<int32_t>    next;               // by input class, -1: not built yet
+        bool                    accept = false;
+    };
+
+    std::array<uint8_t, 256>                    classes_{};     // byte -> input class, 0: no literal
+    uint8_t                                     class_count_ = 1;
+    std::vector<Node>                           nodes_;
+    std::vector<DfaState>                       dfa_;
+    std::map<std::vector<int32_t>, int32_t>     dfa_index_;
+    int32_t                                     dead_ = -1;     // DFA state without any trie node
+
+    void        add_mask(const std::string& mask);
+    void        close_over(std::vector<int32_t>& set) const;
+    int32_t     intern(std::vector<int32_t> set);
+    int32_t     build(int32_t from, uint8_t input_class);
+    void        reset_dfa();
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Capabilities.h"
+
+#define CLIENT_TAGS_MAX_LEN 4094    // client-only tags relayed per message, like the client limit of the spec
+
+struct MessageTag {
+    std::string key;            // "+" prefix: client-only tag
+    std::string value;          // unescaped
+};
+
+// splits "a=b;+c=d\sx" into tags with unescaped values; false if the section is malformed
+bool            parse_tags(std::string_view section, std::vector<MessageTag>& out);
+std::string     escape_tag_value(std::string_view value);
+
+/**
+ * @brief The server-time of the current loop iteration as "YYYY-MM-DDThh:mm:ss.sssZ".
+ *
+ * The clock is read at most once per iteration, and the string rebuilt only
+ * if the millisecond changed since, so every message of an iteration shares
+ * one timestamp.
+ */
+class ServerTime {
+public:
+    const std::string&  now();
+    // the same instant in milliseconds since the epoch
+    int64_t             now_ms();
+    // called once per loop iteration (SrvMgr::onPollEnd)
+    void                next_iteration();
+
+    static std::string  format(int64_t ms);
+
+private:
+    std::string     iso_;
+    int64_t         ms_ = -1;
+    bool            fresh_ = false;
+};
+
+/**
+ * @brief Unique msgid values: a random per-process prefix and a counter.
+ *
+ * The counter is a relaxed atomic, so ids can be taken from any thread
+ * without a lock.
+ */
+class MsgIdGenerator {
+public:
+    MsgIdGenerator();
+    std::string     next();
+
+private:
+    std::string             prefix_;
+    std::atomic<uint64_t>   counter_{0};
+};
+
+/**
+ * @brief Tags of one outbound event, rendered once per capability variant.
+ *
+ * A fan-out asks for the tag prefix of each recipient's capabilities; every
+ * variant ("@time=...;msgid=... ", "@time=... ", "") is built on first use and
+ * then shared by everyone in it. The msgid is only generated if a recipient
+ * takes message-tags.
+ */
+class OutboundTags {
+public:
+    OutboundTags(ServerTime& time, MsgIdGenerator& ids, std::string client_tags = "");
+
+    // "@...;... " for clients with caps, empty if they get no tags
+    const std::string&  prefix(uint32_t caps);
+    // what a message-tags client gets besides the time ("msgid=...[;+client=tags]"), e.g. to store in history
+    std::string         message_tags();
+
+private:
+    ServerTime&         time_;
+    MsgIdGenerator&     ids_;
+    std::string         client_tags_;       // rendered client-only tags without '@'
+    std::string         msgid_;
+    std::string         variants_[CAP_TAG_MASK + 1];
+    bool                rendered_[CAP_TAG_MASK + 1] = {};
+};
+
+// the client-only tags of an incoming message, rendered for relaying ("+a=b;+c"); empty if none or too long
+std::string     relayed_client_tags(const std::vector<MessageTag>& tags);
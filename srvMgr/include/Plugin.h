@@ -0,0 +1,64 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include "Channel.h"
+#include "User.h"
+
+// The interface between ircserv and its plugins: shared objects loaded with dlopen at startup
+// (IRC_PLUGINS), running inside the server loop instead of as clients on a socket of their own.
+// A plugin exports
+//
+//     extern "C" int ircserv_plugin_init(PluginHost& host, int api_version);
+//
+// which checks api_version against the PLUGIN_API_VERSION it was built with, registers its hooks
+// on host and returns 0 (anything else aborts the startup). Build it from the same headers as the
+// server, e.g. g++ -std=c++20 -fPIC -shared -Iserver/include -IsrvMgr/include, see plugins/.
+
+#define PLUGIN_API_VERSION  1
+#define PLUGIN_INIT_SYMBOL  "ircserv_plugin_init"
+
+// what a message hook decides: let the server go on, or drop the message silently
+enum class Verdict {
+    PASS,
+    DROP
+};
+
+/**
+ * @brief What the server offers a plugin, valid until the plugin is unloaded.
+ *
+ * Hooks run on the server thread in the middle of processing; the User and Channel
+ * references they get are only valid during the call, keep nicks and channel names
+ * instead. Every registered hook costs one call at its hook point, hook points nobody
+ * registered for cost one branch.
+ */
+class PluginHost {
+public:
+    virtual ~PluginHost() = default;
+
+    virtual const std::string&  server_name() const = 0;
+    // local users and channels, nullptr if there is none by that name
+    virtual const User*         find_user(const std::string& nick) const = 0;
+    virtual const Channel*      find_channel(const std::string& chan_name) const = 0;
+
+    // a raw line to a local user, no "\r\n" needed
+    virtual void                send_to_user(const User& user, const std::string& line) = 0;
+    // ":<server> NOTICE <nick> :<text>"
+    virtual void                notice(const User& user, const std::string& text) = 0;
+    // ERROR and disconnect, once the current poll iteration is done
+    virtual void                disconnect_user(const User& user, const std::string& reason) = 0;
+
+    // the user completed registration, after the welcome numerics
+    virtual void    on_register(std::function<void(const User&)> hook) = 0;
+    // every command of a client before it is dispatched (also PASS/NICK/USER before registration);
+    // command as sent, args the rest of the line
+    virtual void    on_command(std::function<Verdict(const User&, const std::string& command, const std::string& args)> hook) = 0;
+    // a PRIVMSG from a local user to a channel they may speak in, before anyone receives it
+    virtual void    on_channel_message(std::function<Verdict(const User&, const Channel&, std::string_view text)> hook) = 0;
+    // a local user's connection is gone, before they leave their channels
+    virtual void    on_disconnect(std::function<void(const User&)> hook) = 0;
+};
+
+using PluginInit = int (*)(PluginHost& host, int api_version);
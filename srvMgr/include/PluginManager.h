@@ -0,0 +1,77 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Plugin.h"
+
+class SrvMgr;
+
+/**
+ * @brief The loaded plugins, their hooks and SrvMgr's side of PluginHost.
+ *
+ * SrvMgr calls the hook points below unconditionally; each is inline and only
+ * leaves its fast path (one test of an empty vector) when a plugin registered
+ * for it. Hooks are destroyed before the plugins' code is unloaded.
+ */
+class PluginManager final : public PluginHost {
+public:
+    explicit PluginManager(SrvMgr& srv_mgr);
+    PluginManager(const PluginManager& other) = delete;
+    PluginManager& operator=(const PluginManager& other) = delete;
+    ~PluginManager() override;
+
+    /**
+     * @brief dlopens path and runs its ircserv_plugin_init().
+     * @return False if it cannot be loaded, lacks the entry point or refuses to start.
+     */
+    bool    load(const std::string& path);
+    size_t  loaded() const;
+
+    // hook points
+    void    registered(const User& user) const {
+        if (!register_hooks_.empty()) [[unlikely]] run_register(user);
+    }
+    Verdict command(const User& user, const std::string& command, const std::string& args) const {
+        return command_hooks_.empty() ? Verdict::PASS : run_command(user, command, args);
+    }
+    Verdict channel_message(const User& user, const Channel& channel, const std::string_view text) const {
+        return channel_message_hooks_.empty() ? Verdict::PASS : run_channel_message(user, channel, text);
+    }
+    void    disconnected(const User& user) const {
+        if (!disconnect_hooks_.empty()) [[unlikely]] run_disconnect(user);
+    }
+
+    // disconnect_user() requests of this poll iteration, called from SrvMgr::onPollEnd()
+    void    flush_disconnects();
+
+    // PluginHost
+    const std::string&  server_name() const override;
+    const User*         find_user(const std::string& nick) const override;
+    const Channel*      find_channel(const std::string& chan_name) const override;
+    void                send_to_user(const User& user, const std::string& line) override;
+    void                notice(const User& user, const std::string& text) override;
+    void                disconnect_user(const User& user, const std::string& reason) override;
+
+    void    on_register(std::function<void(const User&)> hook) override;
+    void    on_command(std::function<Verdict(const User&, const std::string&, const std::string&)> hook) override;
+    void    on_channel_message(std::function<Verdict(const User&, const Channel&, std::string_view)> hook) override;
+    void    on_disconnect(std::function<void(const User&)> hook) override;
+
+private:
+    SrvMgr&                 srv_mgr_;
+    std::vector<void*>      handles_;       // dlopen handles, in load order
+
+    std::vector<std::function<void(const User&)>>                                                register_hooks_;
+    std::vector<std::function<Verdict(const User&, const std::string&, const std::string&)>>     command_hooks_;
+    std::vector<std::function<Verdict(const User&, const Channel&, std::string_view)>>         channel_message_hooks_;
+    std::vector<std::function<void(const User&)>>                                                disconnect_hooks_;
+
+    std::vector<std::pair<MPlexServer::Client, std::string>>    pending_disconnects_;
+
+    void    run_register(const User& user) const;
+    Verdict run_command(const User& user, const std::string& command, const std::string& args) const;
+    Verdict run_channel_message(const User& user, const Channel& channel, std::string_view text) const;
+    void    run_disconnect(const User& user) const;
+};
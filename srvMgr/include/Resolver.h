@@ -0,0 +1,132 @@
+#pragma once
+
+#include <netinet/in.h>
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define DNS_PORT            53
+#define DNS_TIMEOUT_MS      4000        // registration waits at most this long for the PTR and A lookups together
+#define DNS_RETRY_MS        1000        // a query still unanswered after this long is sent again
+#define DNS_MAX_PACKET      512         // plain UDP DNS, no EDNS
+#define DNS_CACHE_MAX       4096        // cached addresses; the entry that expires first makes room
+#define DNS_NEGATIVE_TTL    60          // seconds an address without confirmed name stays cached
+#define DNS_MAX_TTL         86400       // longer record TTLs are cut to this
+#define HOST_MAX_LEN        63          // longer names are not used, like HOSTLEN on other servers
+
+/**
+ * @brief Bookkeeping of the reverse DNS lookups of client addresses.
+ *
+ * The queries themselves are coroutines of SrvMgr (SrvMgrLookup.cpp) on the
+ * server loop; this class holds what they share: the nameserver, the DNS wire
+ * format, a bounded cache of results with their TTL, and the lookups in
+ * flight, so concurrent clients from one address cause one set of queries.
+ * Addresses are IPv4 in network byte order, an empty host means "no confirmed
+ * name".
+ */
+class Resolver {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Type : uint16_t {
+        A = 1,
+        CNAME = 5,
+        PTR = 12
+    };
+
+    struct Answer {
+        std::vector<std::string>    names;          // PTR targets
+        std::vector<uint32_t>       addresses;      // A records, network byte order
+        uint32_t                    ttl = DNS_MAX_TTL;  // smallest TTL of the records above
+    };
+
+    /**
+     * @brief co_await result: the host the lookup in flight for an address ended with.
+     */
+    class Join {
+    public:
+        Join(Resolver& resolver, uint32_t addr) : resolver_(resolver), addr_(addr) {}
+        Join(const Join& other) = delete;
+        Join& operator=(const Join& other) = delete;
+        ~Join();
+
+        bool        await_ready() const noexcept { return false; }
+        bool        await_suspend(std::coroutine_handle<> handle);
+        std::string await_resume() { return std::move(host_); }
+
+    private:
+        friend class Resolver;
+
+        Resolver&               resolver_;
+        uint32_t                addr_;
+        std::coroutine_handle<> handle_;
+        std::string             host_;
+        bool                    waiting_ = false;
+    };
+
+    /**
+     * @brief A lookup in flight; others for the same address join it until finish().
+     *
+     * Dropped unfinished (its coroutine was destroyed) it only forgets the lookup.
+     */
+    class Flight {
+    public:
+        Flight(Resolver& resolver, uint32_t addr) : resolver_(&resolver), addr_(addr) {}
+        Flight(const Flight& other) = delete;
+        Flight& operator=(const Flight& other) = delete;
+        ~Flight();
+
+        // caches host for ttl seconds and resumes everyone who joined
+        void    finish(const std::string& host, uint32_t ttl);
+
+    private:
+        Resolver*   resolver_;
+        uint32_t    addr_;
+    };
+
+    Resolver() = default;
+    Resolver(const Resolver& other) = delete;
+    Resolver& operator=(const Resolver& other) = delete;
+
+    void                set_nameserver(const sockaddr_in& nameserver);
+    const sockaddr_in&  get_nameserver() const;
+
+    // cached host (possibly empty) for addr, nullptr if unknown or expired
+    const std::string*  cached(uint32_t addr);
+    bool                in_flight(uint32_t addr) const;
+    Flight              begin(uint32_t addr);
+    Join                join(uint32_t addr);
+    uint16_t            next_id();
+
+    static std::string  ptr_name(uint32_t addr);
+    static std::string  build_query(uint16_t id, const std::string& name, Type type);
+    // true if reply answers exactly this query (any response code); records of type are collected in answer
+    static bool         parse_reply(const std::string& reply, uint16_t id, const std::string& name, Type type, Answer& answer);
+    static bool         valid_hostname(const std::string& host);
+
+    // "ipv4" or "ipv4:port"
+    static bool         parse_address(const std::string& spec, sockaddr_in& out);
+    // first IPv4 nameserver of /etc/resolv.conf
+    static bool         system_nameserver(sockaddr_in& out);
+
+private:
+    struct CacheEntry {
+        std::string                                         host;
+        std::multimap<Clock::time_point, uint32_t>::iterator  expiry;
+    };
+
+    sockaddr_in                                     nameserver_{};
+    std::unordered_map<uint32_t, CacheEntry>        cache_;
+    std::multimap<Clock::time_point, uint32_t>      expiries_;     // cache_ keys by expiry
+    std::unordered_map<uint32_t, std::vector<Join*>>    flights_;  // lookups in flight and who joined them
+    std::mt19937                                    ids_{std::random_device{}()};
+
+    void    store(uint32_t addr, const std::string& host, uint32_t ttl);
+    void    erase(uint32_t addr);
+};
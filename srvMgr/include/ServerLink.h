@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "mplexserver.h"
+
+// max members per SJOIN line, keeps burst lines well below 512 bytes
+#define LINK_SJOIN_CHUNK 20
+// seconds between attempts to (re)connect to a configured link
+#define LINK_RETRY_INTERVAL 5
+// SendQ limit of a link: a burst of the whole network must fit, twice this disconnects the link
+#define LINK_SENDQ_MAX (64 * 1024 * 1024)
+
+/**
+ * @brief A user connected to another server of the network.
+ */
+struct RemoteUser {
+    std::string             username;
+    std::string             hostname;
+    std::string             server;         // server the user is connected to
+    MPlexServer::Client     link;           // our direct link towards that server
+};
+
+/**
+ * @brief Another server of the network; together all links form a spanning tree.
+ */
+struct LinkedServer {
+    std::string             uplink;         // server that introduced it, our own name for direct links
+    MPlexServer::Client     link;           // our direct link towards it
+};
+
+/**
+ * @brief A server we connect out to (IRC_LINKS), retried until the link is up.
+ */
+struct LinkTarget {
+    std::string                             ipv4;
+    uint16_t                                port = 0;
+    MPlexServer::Client                     client{};
+    std::chrono::steady_clock::time_point   next_attempt{};
+};
@@ -1,25 +1,45 @@
 #pragma once
 
+#include <functional>
+#include <queue>
 #include <string>
 #include <unordered_set>
 #include <unordered_map>
+#include <vector>
 
 #include "Channel.h"
+#include "ChannelHistory.h"
+#include "ChannelList.h"
+#include "ChannelLog.h"
+#include "MessageTags.h"
+#include "PluginManager.h"
+#include "Resolver.h"
+#include "ServerLink.h"
 #include "User.h"
 #include "mplexserver.h"
 
+#define IDENT_PORT          113
+#define IDENT_TIMEOUT_MS    3000        // default: registration waits at most this long for the client's identd
+#define IDENT_MAX_LEN       10          // longer ident replies are cut, like USERLEN on other servers
+
+class SrvMgr;
+
+// the server calls SrvMgr directly instead of through the virtual EventHandler
+using IrcServer = MPlexServer::BasicServer<SrvMgr>;
+
 /**
  * @brief Class to manage channels, users and their capabilities
 */
-class SrvMgr : public MPlexServer::EventHandler {
+class SrvMgr final {
 public:
     SrvMgr() = delete;
-    SrvMgr(MPlexServer::Server&, const std::string& server_password, const std::string& server_name);
+    SrvMgr(IrcServer&, const std::string& server_password, const std::string& server_name);
     ~SrvMgr() = default;
 
-    void    onConnect(MPlexServer::Client client) override;
-    void    onDisconnect(MPlexServer::Client client) override;
-    void    onMessage(MPlexServer::Message msg) override;
+    void    onConnect(MPlexServer::Client client);
+    void    onDisconnect(MPlexServer::Client client);
+    void    onMessage(MPlexServer::Message msg);
+    void    onPollEnd();
 
     void    process_password(const std::string&, const MPlexServer::Client&, User&) const;
     void    process_cap(const std::string&, const MPlexServer::Client&, User&) const;
@@ -34,12 +54,50 @@ public:
     void    process_kick(std::string, const MPlexServer::Client&, User&);
     void    process_quit(std::string, const MPlexServer::Client&, User&);
     void    pong(const std::string &, const MPlexServer::Client &, const User&);
+    void    process_chathistory(std::string, const MPlexServer::Client&, User&);
+    void    process_list(std::string, const MPlexServer::Client&, User&);
+    void    process_tagmsg(std::string, const MPlexServer::Client&, User&);
+
+    // binary upgrade: state handed to / received from IrcServer::handOver()
+    std::string export_state() const;
+    void        import_state(const std::string& state);
+
+    // crash recovery: replays <path_prefix>.snap/.wal and logs channel settings from now on
+    bool        enable_channel_log(const std::string& path_prefix);
+    // writes out pending records and unlocks the log for the process taking over on upgrade
+    void        release_channel_log();
+
+    // server-to-server linking, see SrvMgrLink.cpp; targets are connected to and retried from onPollEnd
+    void        enable_links(const std::string& link_password, const std::vector<LinkTarget>& targets);
+
+    // per-channel message history, replayed by CHATHISTORY and optionally on join
+    void        enable_history(const HistoryLimits& limits);
+
+    // RFC 1413 ident lookup of every new client, registration waits for it (SrvMgrLookup.cpp)
+    void        enable_ident();
+    // reverse DNS of every new client, confirmed by a forward lookup; registration waits for it (SrvMgrLookup.cpp)
+    void        enable_resolver(const sockaddr_in& nameserver);
+    // how long registration waits for each lookup; applies to lookups started from now on
+    void        set_lookup_timeouts(int ident_timeout_ms, int dns_timeout_ms);
+
+    // built-in flood penalties with overrides (e.g. from the config file) on top, replacing the current ones
+    void        set_command_penalties(const std::unordered_map<std::string, double>& overrides);
+    // 2 logs every received line, like the server's verbosity level
+    void        set_log_level(int level);
+
+    // in-process plugin (Plugin.h), loaded at startup and again by the new process after an upgrade
+    bool        load_plugin(const std::string& path);
+
+    // memory of all local users (User objects and the nick table), for the heartbeat report
+    size_t      users_footprint() const;
 
 private:
+    friend class PluginManager;     // PluginHost reads users and channels, sends and disconnects
+
     void    try_to_log_in(User& user, const MPlexServer::Client& client) const;
 
     void    change_nick(const std::string &new_nick, const std::string& old_nick, User& user);
-    void    change_nick_in_channel(const std::string &new_nick, const std::string& old_nick, Channel &channel);
+    void    change_nick_in_channel(const std::string &new_nick, const std::string& old_nick, const std::string& old_signature, Channel &channel);
 
     void    remove_user_from_channel(Channel& channel, std::string& nick);
     void    remove_op_from_channel(Channel& channel, std::string& op);
@@ -50,8 +108,65 @@ private:
     void    mode_k(char plusminus, std::string& mode_arguments, Channel &channel, User& user);
     void    mode_o(char plusminus, std::string& mode_arguments, Channel &channel, User& user);
     void    mode_l(char plusminus, std::string& mode_arguments, Channel &channel, User& user);
+    void    mode_list(char list, char plusminus, std::string& mode_arguments, Channel &channel, User& user);
+
+    // +b/+e/+I result for a local user, cached in the User until the lists or the user's mask change
+    BanCheck    check_masks(const std::string& chan_name, Channel& channel, User& user);
 
     void    join_channel(std::string& chan_name, std::string& key, User& user);
+    // the channel user may send PRIVMSG/TAGMSG to; nullptr after sending the error
+    Channel*    channel_to_speak_in(const std::string& target, User& user);
+    void    mark_channel_dirty(const std::string& chan_name);
+    // records the settings of this iteration's dirty channels and snapshots when the log asks for it
+    void    flush_channel_log();
+    void    record_history(const std::string& chan_name, const std::string& line, OutboundTags& tags);
+    // drops history lines past the age cap in channels nobody talks in, from onPollEnd
+    void    expire_history();
+    // history lines with the tags user's capabilities ask for, in a chathistory BATCH with batch
+    void    send_history(const User& user, const std::string& chan_name, const std::vector<HistoryLine>& lines, bool empty_batch);
+
+    User*   find_user(int fd) const;
+    // nick!user@host of a local or remote nick, empty if unknown
+    std::string signature_of(const std::string& nick) const;
+
+    // registration lookups (SrvMgrLookup.cpp), coroutines resumed by the server loop
+    MPlexServer::Task<>             ident_lookup(MPlexServer::Client client);
+    MPlexServer::Task<std::string>  query_ident(MPlexServer::Client client);
+    MPlexServer::Task<>             host_lookup(MPlexServer::Client client);
+    MPlexServer::Task<std::string>  resolve_host(uint32_t addr);
+    MPlexServer::Task<bool>         query_dns(std::string name, Resolver::Type type, Resolver::Clock::time_point deadline,
+                                              Resolver::Answer& answer);
+    void    lookup_done(const MPlexServer::Client& client, User& user);
+
+    // server links (SrvMgrLink.cpp)
+    void    maintain_links();
+    bool    start_link(const MPlexServer::Client& client, User& user);
+    void    process_server(std::string, const MPlexServer::Client&, User&);
+    void    process_link_message(const std::string& line, const MPlexServer::Client& client, User& user);
+    void    process_remote_command(const std::string& prefix, std::string command, std::string args, const std::string& line);
+    void    send_burst(const MPlexServer::Client& link);
+    std::vector<std::string>    sjoin_lines(Channel& channel) const;
+    std::vector<std::string>    smask_lines(const std::string& chan_name, const Channel& channel) const;
+
+    void    remote_server(const std::string& uplink, const std::string& args, const std::string& line);
+    void    remote_unick(const std::string& server, std::string args, const std::string& line);
+    void    remote_sjoin(std::string args, const std::string& line);
+    void    remote_stopic(const std::string& server, std::string args, const std::string& line);
+    void    remote_smask(const std::string& server, std::string args, const std::string& line);
+    void    remote_squit(std::string args, const std::string& line);
+    void    remote_kill(std::string args, const std::string& line);
+    void    remote_join(const std::string& nick, const std::string& signature, std::string chan_name);
+    void    remote_nick(const std::string& old_nick, const std::string& old_signature, std::string new_nick, const std::string& line);
+
+    void    link_closed(const MPlexServer::Client& client, const User& user);
+    void    drop_servers(const std::unordered_set<std::string>& names, const std::string& reason);
+    void    remove_remote_user(const std::string& nick, const std::string& reason);
+    void    kill_nick(const std::string& nick, const std::string& reason);
+
+    void    propagate(const std::string& line, bool include_origin = false) const;
+    void    route_to_channel(const Channel& channel, const std::string& line) const;
+    void    send_to_remote(const std::string& nick, const std::string& line) const;
+    void    send_to_chan_and_links(const Channel& channel, const std::string& msg) const;
 
     bool    nick_exists(std::string& nick);
     bool    chan_exists(std::string& chan_name);
@@ -61,21 +176,62 @@ private:
     void    send_to_one(const User& user, const std::string& msg);
     void    send_to_chan_all_but_one(const Channel& channel, const std::string& msg, const std::string& origin_nick) const;
     void    send_to_chan_all_but_one(const std::string& chan_name, const std::string& msg, const std::string& origin_nick) const;
+    // channel traffic is bulk: it queues behind replies and is dropped for members over their SendQ
     void    send_to_chan_all(const Channel& channel, const std::string& msg) const;
+    // tags as each recipient's capabilities ask for; tag_clients_only: skip clients without message-tags
+    void    send_to_one(const std::string& nick, const std::string& msg, OutboundTags& tags, bool tag_clients_only = false);
+    void    send_tagged(const std::unordered_set<std::string>& nicks, const std::string& origin_nick, const std::string& msg,
+                        OutboundTags& tags, bool tag_clients_only = false) const;
+    // local members of nicks but origin_nick, grouped by caps & variant_caps: render(caps) builds each group's
+    // line (no "\r\n", empty to skip the group) once, and the group shares one buffer
+    void    send_grouped(const std::unordered_set<std::string>& nicks, const std::string& origin_nick, uint32_t variant_caps,
+                         const std::function<std::string(uint32_t caps)>& render) const;
+    // the JOIN of a member to channel, with account and realname for extended-join clients
+    void    send_join(const Channel& channel, const std::string& nick, const std::string& signature, const std::string& realname) const;
 
     void    send_channel_command_ack(Channel&, const User&);
     void    send_channel_greetings(Channel&, const User&);
 
-    std::vector<MPlexServer::Client>    create_client_vector(const std::unordered_set<std::string>& set_of_nicks) const;
-
-    MPlexServer::Server&                        srv_instance_;
+    IrcServer&                                  srv_instance_;
     const std::string                           server_password_;
     const std::string                           server_name_;
-    std::unordered_map<int, User>               server_users_;
     std::unordered_map<std::string, int>        server_nicks_;
     std::unordered_map<std::string, Channel>    server_channels_;
+
+    ChannelLog                                  channel_log_;
+    std::unordered_map<std::string, Channel>    recovered_channels_;   // restored from the log, nobody joined yet
+    std::unordered_set<std::string>             dirty_channels_;       // settings changed in this poll iteration
+
+    std::string                                 link_password_;        // empty: linking disabled
+    std::vector<LinkTarget>                     link_targets_;
+    std::unordered_map<std::string, LinkedServer>   servers_;
+    std::unordered_map<std::string, RemoteUser>     remote_users_;
+    MPlexServer::Client                         link_origin_;          // link the message being processed came from
+
+    std::vector<MessageTag>                     current_tags_;         // tags of the message being processed
+    mutable ServerTime                          server_time_;          // caches, advanced by the const senders too
+    mutable MsgIdGenerator                      msgids_;
+
+    bool                                        history_enabled_ = false;
+    HistoryLimits                               history_limits_;
+    HistoryArena                                history_arena_;        // must outlive channel_history_
+    std::unordered_map<std::string, ChannelHistory> channel_history_;
+    // (expiry of the oldest line, channel), earliest first; entries may be stale, the sweep re-checks them
+    std::priority_queue<std::pair<int64_t, std::string>, std::vector<std::pair<int64_t, std::string>>,
+                        std::greater<>>     history_expiry_;
+
+    int                                         log_level_ = 2;
+    bool                                        ident_enabled_ = false;
+    bool                                        resolver_enabled_ = false;
+    int                                         ident_timeout_ms_ = IDENT_TIMEOUT_MS;
+    int                                         dns_timeout_ms_ = DNS_TIMEOUT_MS;
+    Resolver                                    resolver_;
+
+    PluginManager                               plugins_;              // last: hooks go before anything they look at
 };
 
+extern template class MPlexServer::BasicServer<SrvMgr>;     // instantiated at the end of SrvMgr.cpp
+
 
 enum    cmdType {
     PASS,
@@ -91,5 +247,8 @@ enum    cmdType {
     KICK,
     QUIT,
     PING,
+    CHATHISTORY,
+    LIST,
+    TAGMSG,
     NO_TYPE_FOUND
 };
\ No newline at end of file
@@ -1,26 +1,55 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "mplexserver.h"
 
+// connections from other ircserv instances are Users too, see SrvMgrLink.cpp
+enum class LinkState : uint8_t {
+    NONE,               // a regular client
+    HANDSHAKE_SENT,     // we connected out and sent SERVER, waiting for the answer
+    ESTABLISHED
+};
+
+#define BAN_CACHE_MAX 256           // cached channel checks per user before the cache starts over
+
+// outcome of matching a user against a channel's +b/+e/+I lists
+struct BanCheck {
+    uint64_t    masks_version;      // Channel::get_masks_version() the result belongs to
+    bool        banned;             // matches +b and no +e
+    bool        invite_exempt;      // matches +I
+};
+
+/**
+ * @brief A connection's IRC state, stored as the server's user data.
+ *
+ * Most users are idle and only ever set nick, user, host and realname, which
+ * usually fit the strings' inline storage. Everything else (invites, QUIT message, link name,
+ * ident reply, ban cache) lives in a separately allocated part that is only
+ * created when first needed.
+ */
 class User
 {
 public:
     User() = default;
-    User(const User& other) = default;
+    User(const User& other) = delete;
     User(MPlexServer::Client&);
     ~User() = default;
 
-    User& operator=(const User& other) = default;
+    User& operator=(const User& other) = delete;
 
     MPlexServer::Client     get_client() const;
     void                    set_nickname(std::string);
     std::string             get_nickname() const;
     void                    set_username(std::string);
-    std::string             get_username();
+    std::string             get_username() const;
     void                    set_hostname(std::string);
-    std::string             get_hostname();
+    std::string             get_hostname() const;
+    void                    set_realname(const std::string& realname);
+    const std::string&      get_realname() const;
     std::string             get_signature() const;
 
     std::string             get_farewell_message() const;
@@ -33,12 +62,47 @@ public:
     void                    set_cap_negotiation_ended(bool cap_negotiation_ended);
     bool                    cap_negotiation_started() const;
     void                    set_cap_negotiation_started(bool cap_negotiation_started);
+    // capability bits (Capabilities.h) the client enabled with CAP REQ
+    uint32_t                get_caps() const;
+    void                    set_caps(uint32_t caps);
     void                    add_invitation(std::string& chan_name);
     void                    remove_invitation(std::string& chan_name);
     bool                    has_invitation(std::string& chan_name);
+    LinkState               get_link_state() const;
+    void                    set_link_state(LinkState link_state);
+    std::string             get_link_name() const;
+    void                    set_link_name(const std::string& link_name);
+
+    // lookups started at connect (ident) hold registration until each one finished or timed out
+    void                    begin_lookup();
+    void                    end_lookup();
+    bool                    lookups_pending() const;
+    std::string             get_ident() const;
+    void                    set_ident(const std::string& ident);
+
+    // nick, user and host changes drop every cached result
+    const BanCheck*         cached_ban_check(const std::string& chan_name, uint64_t masks_version) const;
+    void                    cache_ban_check(const std::string& chan_name, const BanCheck& check);
+
+    void                    serialize(MPlexServer::StateWriter& out) const;
+    void                    deserialize(MPlexServer::StateReader& in);
+
+    // this object and what it allocated, for the memory report
+    size_t                  footprint() const;
 
 private:
+    struct Extras {
+        std::unordered_set<std::string>             channel_invites;
+        std::string                                 farewell_message;
+        std::string                                 link_name;
+        std::string                                 ident;          // user name confirmed by the client's identd
+        std::unordered_map<std::string, BanCheck>   ban_checks;
+    };
+
     MPlexServer::Client             client_{};
+    LinkState                       link_state_ = LinkState::NONE;
+    int                             pending_lookups_ = 0;
+    uint32_t                        caps_ = 0;
     bool                            is_logged_in_ = false;
     bool                            password_provided_ = false;
     bool                            cap_negotiation_started_ = false;
@@ -46,6 +110,8 @@ private:
     std::string                     nickname_{};
     std::string                     username_{};
     std::string                     hostname_{};
-    std::unordered_set<std::string> channel_invites_{};
-    std::string                     farewell_message_{};
+    std::string                     realname_{};
+    std::unique_ptr<Extras>         extras_{};
+
+    Extras&                 extras();
 };
\ No newline at end of file
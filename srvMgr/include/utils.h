@@ -1,9 +1,12 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 std::vector<std::string>    process_message(std::string);
 void                        strip_trailing_rn(std::string& s);
 std::string                 split_off_before_del(std::string& s, char del);
-int                         get_msg_type(std::string& s);
\ No newline at end of file
+int                         get_msg_type(std::string& s);
+// IRC style wildcard match ('*' any run, '?' one character), case-insensitive
+bool                        mask_match(std::string_view mask, std::string_view s);
@@ -0,0 +1,35 @@
+#include "Capabilities.h"
+
+namespace {
+    struct CapabilityName {
+        const char* name;
+        Capability  bit;
+    };
+
+    // in the order CAP LS lists them
+    constexpr CapabilityName    capabilities[] = {
+        {"batch", CAP_BATCH},
+        {"echo-message", CAP_ECHO_MESSAGE},
+        {"extended-join", CAP_EXTENDED_JOIN},
+        {"message-tags", CAP_MESSAGE_TAGS},
+        {"multi-prefix", CAP_MULTI_PREFIX},
+        {"server-time", CAP_SERVER_TIME},
+    };
+}
+
+uint32_t    capability_bit(const std::string_view name) {
+    for (const CapabilityName& capability : capabilities) {
+        if (name == capability.name) return capability.bit;
+    }
+    return 0;
+}
+
+std::string capability_names(const uint32_t caps) {
+    std::string out;
+    for (const CapabilityName& capability : capabilities) {
+        if (!(caps & capability.bit)) continue;
+        if (!out.empty()) out += ' ';
+        out += capability.name;
+    }
+    return out;
+}
@@ -6,22 +6,29 @@
 Channel::Channel(std::string  chan_name, std::string chan_creator) : chan_name_(std::move(chan_name)) {
     chan_nicks_.insert(chan_creator);
     chan_ops_.insert(chan_creator);
+    member_count_ = 1;
     creation_time_ = std::time(nullptr);
 }
 
-std::string Channel::get_channel_name() {
+Channel::Channel(std::string chan_name, std::time_t creation_time) : chan_name_(std::move(chan_name)), creation_time_(creation_time) {
+}
+
+std::string Channel::get_channel_name() const {
     return chan_name_;
 }
-std::string Channel::get_channel_topic() {
+std::string Channel::get_channel_topic() const {
     return topic_;
 }
 void    Channel::set_channel_topic(std::string& topic) {
     topic_ = topic;
 }
-std::string Channel::get_user_nicks_str() {
+std::string Channel::get_user_nicks_str() const {
     std::string all_nicks;
-    for (const auto& op : chan_ops_) {
-        all_nicks += "@" + op + " ";
+    // operators restored from the channel log may not have rejoined yet
+    for (const auto& nick : chan_nicks_) {
+        if (chan_ops_.find(nick) != chan_ops_.end()) {
+            all_nicks += "@" + nick + " ";
+        }
     }
     for (const auto& nick : chan_nicks_) {
         if (chan_ops_.find(nick) == chan_ops_.end()) {
@@ -45,9 +52,9 @@ int    Channel::remove_operator(std::string op) {
 }
 
 void    Channel::add_nick(std::string nick) {
-    chan_nicks_.insert(nick);
-    member_count_++;
-
+    if (chan_nicks_.insert(nick).second) {
+        member_count_++;
+    }
 }
 
 int Channel::remove_nick(std::string nick) {
@@ -58,7 +65,7 @@ int Channel::remove_nick(std::string nick) {
     return 0;
 }
 
-bool Channel::has_chan_member(const std::string &nick) {
+bool Channel::has_chan_member(const std::string &nick) const {
     for (const std::string& member : chan_nicks_) {
         if (member == nick) {
             return true;
@@ -67,7 +74,7 @@ bool Channel::has_chan_member(const std::string &nick) {
     return false;
 }
 
-bool Channel::has_chan_op(const std::string &op) {
+bool Channel::has_chan_op(const std::string &op) const {
     for (const std::string& member : chan_ops_) {
         if (member == op) {
             return true;
@@ -76,6 +83,14 @@ bool Channel::has_chan_op(const std::string &op) {
     return false;
 }
 
+std::unordered_set<std::string> Channel::get_chan_ops() const {
+    return chan_ops_;
+}
+
+std::string Channel::get_key() const {
+    return key_;
+}
+
 void Channel::set_key(const std::string &key) {
     key_ = key;
 }
@@ -117,6 +132,14 @@ std::string Channel::get_creation_time() const {
     return time.str();
 }
 
+std::time_t Channel::get_creation_ts() const {
+    return creation_time_;
+}
+
+void Channel::set_creation_ts(std::time_t creation_time) {
+    creation_time_ = creation_time;
+}
+
 std::string Channel::get_topic_setter() const {
     return topic_setter_;
 }
@@ -135,6 +158,78 @@ void Channel::set_topic_set_time() {
     topic_set_time_ = std::time(nullptr);
 }
 
+std::time_t Channel::get_topic_set_ts() const {
+    return topic_set_time_;
+}
+
+void Channel::set_topic_set_time(std::time_t set_time) {
+    topic_set_time_ = set_time;
+}
+
+int Channel::list_index(char list) {
+    return list == 'b' ? 0 : list == 'e' ? 1 : 2;
+}
+
+uint64_t Channel::next_masks_version() {
+    static uint64_t version = 0;
+    return ++version;
+}
+
+void Channel::masks_changed() {
+    for (auto& matcher : matchers_) {
+        matcher.reset();
+    }
+    masks_version_ = next_masks_version();
+}
+
+bool Channel::add_mask(char list, const MaskEntry& entry) {
+    std::vector<MaskEntry>& masks = masks_[list_index(list)];
+    if (masks.size() >= CHANNEL_MAX_MASKS) return false;
+    for (const MaskEntry& listed : masks) {
+        if (listed.mask == entry.mask) return false;
+    }
+    masks.push_back(entry);
+    masks_changed();
+    return true;
+}
+
+bool Channel::remove_mask(char list, const std::string& mask) {
+    std::vector<MaskEntry>& masks = masks_[list_index(list)];
+    for (auto it = masks.begin(); it != masks.end(); ++it) {
+        if (it->mask == mask) {
+            masks.erase(it);
+            masks_changed();
+            return true;
+        }
+    }
+    return false;
+}
+
+const std::vector<MaskEntry>& Channel::get_masks(char list) const {
+    return masks_[list_index(list)];
+}
+
+bool Channel::has_masks() const {
+    return !masks_[0].empty() || !masks_[1].empty() || !masks_[2].empty();
+}
+
+bool Channel::masks_match(char list, const std::string& signature) {
+    const int   index = list_index(list);
+    if (masks_[index].empty()) return false;
+    if (matchers_[index] == nullptr) {
+        std::vector<std::string>    masks;
+        for (const MaskEntry& entry : masks_[index]) {
+            masks.push_back(entry.mask);
+        }
+        matchers_[index] = std::make_shared<MaskMatcher>(masks);
+    }
+    return matchers_[index]->matches(signature);
+}
+
+uint64_t Channel::get_masks_version() const {
+    return masks_version_;
+}
+
 std::string Channel::get_modes() const {
     std::string modes = "+";
     if (needs_invite_) modes += "i";
@@ -146,3 +241,127 @@ std::string Channel::get_modes() const {
 
     return modes;
 }
+
+void Channel::serialize(MPlexServer::StateWriter& out) const {
+    out.str(chan_name_);
+    out.u64(static_cast<uint64_t>(creation_time_));
+    out.str(key_);
+    out.str(topic_);
+    out.str(topic_setter_);
+    out.u64(static_cast<uint64_t>(topic_set_time_));
+    out.u32(static_cast<uint32_t>(member_limit_));
+    out.u8(topic_protected_);
+    out.u8(needs_invite_);
+    for (const auto* set : {&chan_nicks_, &chan_ops_, &invites_}) {
+        out.u32(static_cast<uint32_t>(set->size()));
+        for (const std::string& nick : *set) {
+            out.str(nick);
+        }
+    }
+    serialize_masks(out);
+}
+
+void Channel::deserialize(MPlexServer::StateReader& in) {
+    chan_name_ = in.str();
+    creation_time_ = static_cast<std::time_t>(in.u64());
+    key_ = in.str();
+    topic_ = in.str();
+    topic_setter_ = in.str();
+    topic_set_time_ = static_cast<std::time_t>(in.u64());
+    member_limit_ = static_cast<int>(in.u32());
+    topic_protected_ = in.u8();
+    needs_invite_ = in.u8();
+    for (auto* set : {&chan_nicks_, &chan_ops_, &invites_}) {
+        set->clear();
+        for (uint32_t n = in.u32(); n > 0; --n) {
+            set->insert(in.str());
+        }
+    }
+    member_count_ = static_cast<int>(chan_nicks_.size());
+    deserialize_masks(in);
+}
+
+void Channel::serialize_settings(MPlexServer::StateWriter& out, const SignatureOf& signature_of) const {
+    out.str(chan_name_);
+    out.u64(static_cast<uint64_t>(creation_time_));
+    out.str(key_);
+    out.str(topic_);
+    out.str(topic_setter_);
+    out.u64(static_cast<uint64_t>(topic_set_time_));
+    out.u32(static_cast<uint32_t>(member_limit_));
+    out.u8(topic_protected_);
+    out.u8(needs_invite_);
+    // a channel still waiting in the log has no live operators, only the saved ones
+    std::vector<std::string> ops(saved_ops_.begin(), saved_ops_.end());
+    for (const std::string& op : chan_ops_) {
+        std::string signature = signature_of(op);
+        if (!signature.empty()) ops.push_back(std::move(signature));
+    }
+    out.u32(static_cast<uint32_t>(ops.size()));
+    for (const std::string& op : ops) {
+        out.str(op);
+    }
+    serialize_masks(out);
+}
+
+void Channel::deserialize_settings(MPlexServer::StateReader& in) {
+    chan_name_ = in.str();
+    creation_time_ = static_cast<std::time_t>(in.u64());
+    key_ = in.str();
+    topic_ = in.str();
+    topic_setter_ = in.str();
+    topic_set_time_ = static_cast<std::time_t>(in.u64());
+    member_limit_ = static_cast<int>(in.u32());
+    topic_protected_ = in.u8();
+    needs_invite_ = in.u8();
+    chan_ops_.clear();
+    saved_ops_.clear();
+    for (uint32_t n = in.u32(); n > 0; --n) {
+        saved_ops_.insert(in.str());
+    }
+    chan_nicks_.clear();
+    invites_.clear();
+    member_count_ = 0;
+    deserialize_masks(in);
+}
+
+void Channel::serialize_masks(MPlexServer::StateWriter& out) const {
+    for (const auto& masks : masks_) {
+        out.u32(static_cast<uint32_t>(masks.size()));
+        for (const MaskEntry& entry : masks) {
+            out.str(entry.mask);
+            out.str(entry.setter);
+            out.u64(static_cast<uint64_t>(entry.set_time));
+        }
+    }
+}
+
+void Channel::deserialize_masks(MPlexServer::StateReader& in) {
+    for (auto& masks : masks_) {
+        masks.clear();
+        for (uint32_t n = in.u32(); n > 0; --n) {
+            MaskEntry   entry;
+            entry.mask = in.str();
+            entry.setter = in.str();
+            entry.set_time = static_cast<std::time_t>(in.u64());
+            masks.push_back(entry);
+        }
+    }
+    masks_changed();
+}
+
+bool Channel::has_operators() const {
+    return !chan_ops_.empty();
+}
+
+bool Channel::has_saved_ops() const {
+    return !saved_ops_.empty();
+}
+
+bool Channel::is_saved_op(const std::string& signature) const {
+    return saved_ops_.find(signature) != saved_ops_.end();
+}
+
+void Channel::clear_saved_ops() {
+    saved_ops_.clear();
+}
@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include "ChannelHistory.h"
+
+HistoryArena::~HistoryArena() {
+    if (tail_ != nullptr) MPlexServer::Segment::release(tail_);
+}
+
+MPlexServer::Slice HistoryArena::store(const std::string_view bytes) {
+    if (bytes.empty() || bytes.size() > MPlexServer::Segment::CAPACITY) {
+        return MPlexServer::Slice{nullptr, 0, 0};
+    }
+    if (tail_ == nullptr || tail_->used + bytes.size() > MPlexServer::Segment::CAPACITY) {
+        if (tail_ != nullptr) MPlexServer::Segment::release(tail_);
+        tail_ = MPlexServer::Segment::create();
+    }
+    const MPlexServer::Slice slice{tail_, tail_->used, static_cast<uint32_t>(bytes.size())};
+    std::memcpy(tail_->data + tail_->used, bytes.data(), bytes.size());
+    tail_->used += static_cast<uint32_t>(bytes.size());
+    MPlexServer::Segment::retain(tail_);
+    return slice;
+}
+
+uint32_t HistoryArena::intern(const std::string_view prefix) {
+    auto it = index_.find(prefix);
+    if (it != index_.end()) {
+        prefixes_[it->second].refs++;
+        return it->second;
+    }
+    const MPlexServer::Slice slice = store(prefix);
+    uint32_t id;
+    if (free_ids_.empty()) {
+        id = static_cast<uint32_t>(prefixes_.size());
+        prefixes_.push_back(Prefix{slice, 1});
+    } else {
+        id = free_ids_.back();
+        free_ids_.pop_back();
+        prefixes_[id] = Prefix{slice, 1};
+    }
+    if (slice.seg != nullptr) {
+        index_.emplace(std::string_view(slice.seg->data + slice.off, slice.len), id);
+    }
+    return id;
+}
+
+void HistoryArena::release(const uint32_t prefix_id) {
+    Prefix& prefix = prefixes_[prefix_id];
+    if (--prefix.refs > 0) return;
+    if (prefix.slice.seg != nullptr) {
+        index_.erase(std::string_view(prefix.slice.seg->data + prefix.slice.off, prefix.slice.len));
+        MPlexServer::Segment::release(prefix.slice.seg);
+    }
+    prefix.slice = MPlexServer::Slice{nullptr, 0, 0};
+    free_ids_.push_back(prefix_id);
+}
+
+MPlexServer::Slice HistoryArena::prefix(const uint32_t prefix_id) const {
+    return prefixes_[prefix_id].slice;
+}
+
+ChannelHistory::ChannelHistory(HistoryArena& arena, const HistoryLimits& limits) : arena_(arena), limits_(limits) {
+}
+
+ChannelHistory::~ChannelHistory() {
+    while (!entries_.empty()) {
+        evict_oldest();
+    }
+}
+
+void ChannelHistory::add(const int64_t time_ms, const std::string_view tags, const std::string_view prefix,
+                         const std::string_view body) {
+    std::string bytes;
+    bytes.reserve(tags.size() + body.size());
+    bytes.append(tags).append(body);
+    const MPlexServer::Slice stored = arena_.store(bytes);
+    if (stored.seg == nullptr) return;
+    entries_.push_back(Entry{time_ms, arena_.intern(prefix), static_cast<uint32_t>(tags.size()), stored});
+    bytes_ += prefix.size() + bytes.size();
+    trim(time_ms);
+}
+
+void ChannelHistory::trim(const int64_t now_ms) {
+    while (!entries_.empty() && (entries_.size() > limits_.lines || bytes_ > limits_.bytes
+                                 || now_ms - entries_.front().time_ms > limits_.max_age_ms)) {
+        evict_oldest();
+    }
+}
+
+void ChannelHistory::evict_oldest() {
+    const Entry& oldest = entries_.front();
+    bytes_ -= arena_.prefix(oldest.prefix).len + oldest.stored.len;
+    arena_.release(oldest.prefix);
+    MPlexServer::Segment::release(oldest.stored.seg);
+    entries_.pop_front();
+}
+
+std::vector<HistoryLine> ChannelHistory::lines(size_t first, const size_t last) const {
+    std::vector<HistoryLine> out;
+    out.reserve(last - first);
+    for (; first < last; ++first) {
+        const Entry&    entry = entries_[first];
+        const char*     stored = entry.stored.seg->data + entry.stored.off;
+        out.push_back(HistoryLine{entry.time_ms, std::string_view(stored, entry.tags_len), arena_.prefix(entry.prefix),
+                                  MPlexServer::Slice{entry.stored.seg, entry.stored.off + entry.tags_len,
+                                                     entry.stored.len - entry.tags_len}});
+    }
+    return out;
+}
+
+std::vector<HistoryLine> ChannelHistory::latest(const int64_t now_ms, const size_t limit, const int64_t after_ms) {
+    trim(now_ms);
+    size_t first = entries_.size() - std::min(limit, entries_.size());
+    while (first < entries_.size() && entries_[first].time_ms <= after_ms) ++first;
+    return lines(first, entries_.size());
+}
+
+std::vector<HistoryLine> ChannelHistory::before(const int64_t now_ms, const int64_t before_ms, const size_t limit) {
+    trim(now_ms);
+    const auto end = std::lower_bound(entries_.begin(), entries_.end(), before_ms,
+                                      [](const Entry& e, const int64_t t) { return e.time_ms < t; });
+    const size_t last = end - entries_.begin();
+    return lines(last - std::min(limit, last), last);
+}
+
+std::vector<HistoryLine> ChannelHistory::after(const int64_t now_ms, const int64_t after_ms, const size_t limit) {
+    trim(now_ms);
+    const auto begin = std::upper_bound(entries_.begin(), entries_.end(), after_ms,
+                                        [](const int64_t t, const Entry& e) { return t < e.time_ms; });
+    const size_t first = begin - entries_.begin();
+    return lines(first, first + std::min(limit, entries_.size() - first));
+}
+
+size_t ChannelHistory::size() const {
+    return entries_.size();
+}
+
+int64_t ChannelHistory::oldest_ms() const {
+    return entries_.front().time_ms;
+}
+
+bool ChannelHistory::parse_timestamp(const std::string& reference, int64_t& ms) {
+    if (reference.compare(0, 10, "timestamp=") != 0) return false;
+    std::tm tm{};
+    int     millis = 0;
+    const int fields = std::sscanf(reference.c_str() + 10, "%4d-%2d-%2dT%2d:%2d:%2d.%3d",
+                                   &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &millis);
+    if (fields < 6) return false;
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    ms = static_cast<int64_t>(timegm(&tm)) * 1000 + millis;
+    return true;
+}
+
+int64_t ChannelHistory::now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
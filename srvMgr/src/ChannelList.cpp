@@ -0,0 +1,72 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include "ChannelList.h"
+#include "IRC_macros.h"
+#include "utils.h"
+
+bool ListFilter::matches(const std::string& chan_name, const Channel& channel) const {
+    const int   users = channel.get_member_count();
+    if (min_users >= 0 && users <= min_users) return false;
+    if (max_users >= 0 && users >= max_users) return false;
+    if (masks.empty()) return true;
+    return std::any_of(masks.begin(), masks.end(), [&](const std::string& mask) { return mask_match(mask, chan_name); });
+}
+
+ListFilter ListFilter::parse(std::string args) {
+    ListFilter  filter;
+    args = split_off_before_del(args, ' ');     // a trailing <server> argument is ignored
+    while (!args.empty()) {
+        std::string condition = split_off_before_del(args, ',');
+        if (condition.empty()) continue;
+        if (condition[0] == '>') {
+            filter.min_users = std::atoi(condition.c_str() + 1);
+        } else if (condition[0] == '<') {
+            filter.max_users = std::atoi(condition.c_str() + 1);
+        } else {
+            filter.masks.push_back(condition);
+        }
+    }
+    return filter;
+}
+
+ChannelList::ChannelList(std::unordered_map<std::string, Channel>& channels, const std::string& server_name, const std::string& nick, ListFilter filter)
+    : channels_(channels), server_name_(server_name), nick_(nick), filter_(std::move(filter)) {
+    literal_ = !filter_.masks.empty() && std::none_of(filter_.masks.begin(), filter_.masks.end(), [](const std::string& mask) {
+        return mask.find_first_of("*?") != std::string::npos;
+    });
+}
+
+void ChannelList::append_entry(std::string& out, const std::string& chan_name, Channel& channel) const {
+    std::string topic = channel.get_channel_topic();
+    if (!topic.empty() && topic[0] == ':') topic.erase(0, 1);
+    out += ":" + server_name_ + " " + RPL_LIST + " " + nick_ + " " + chan_name + " "
+        + std::to_string(channel.get_member_count()) + " :" + topic + "\r\n";
+}
+
+bool ChannelList::generate(std::string& out, const size_t budget) {
+    bool    finished;
+    if (literal_) {
+        while (cursor_ < filter_.masks.size() && out.size() < budget) {
+            auto    it = channels_.find(filter_.masks[cursor_++]);
+            if (it != channels_.end() && filter_.matches(it->first, it->second)) {
+                append_entry(out, it->first, it->second);
+            }
+        }
+        finished = cursor_ >= filter_.masks.size();
+    } else {
+        // bounded scan, so a filter matching nothing does not walk the whole table in one go
+        const size_t    end = std::min(channels_.bucket_count(), cursor_ + LIST_SCAN_STEP);
+        for (; cursor_ < end && out.size() < budget; ++cursor_) {
+            for (auto it = channels_.begin(cursor_); it != channels_.end(cursor_); ++it) {
+                if (filter_.matches(it->first, it->second)) {
+                    append_entry(out, it->first, it->second);
+                }
+            }
+        }
+        finished = cursor_ >= channels_.bucket_count();
+    }
+    if (!finished) return true;
+    out += ":" + server_name_ + " " + RPL_LISTEND + " " + nick_ + " :End of /LIST\r\n";
+    return false;
+}
@@ -0,0 +1,263 @@
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "ChannelLog.h"
+
+#define CHANLOG_WAL_MAGIC "IRCWAL03"
+#define CHANLOG_SNAP_MAGIC "IRCSNP03"
+#define CHANLOG_MAGIC_LEN 8
+#define CHANLOG_RECORD_HEADER 8
+
+namespace {
+    uint32_t crc32(const char* data, size_t len) {
+        static uint32_t table[256];
+        static bool     table_ready = false;
+        if (!table_ready) {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k) {
+                    c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                }
+                table[i] = c;
+            }
+            table_ready = true;
+        }
+        uint32_t crc = 0xffffffffu;
+        for (size_t i = 0; i < len; ++i) {
+            crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xff] ^ (crc >> 8);
+        }
+        return crc ^ 0xffffffffu;
+    }
+
+    uint32_t load_u32(const char* p) {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    void store_u32(char* p, uint32_t v) {
+        std::memcpy(p, &v, sizeof(v));
+    }
+}
+
+ChannelLog::~ChannelLog() {
+    close();
+}
+
+void ChannelLog::close() {
+    if (map_ != nullptr) munmap(map_, map_size_);
+    if (fd_ != -1) ::close(fd_);
+    map_ = nullptr;
+    map_size_ = 0;
+    fd_ = -1;
+    end_ = 0;
+    pending_.clear();
+}
+
+bool ChannelLog::is_open() const {
+    return map_ != nullptr;
+}
+
+bool ChannelLog::open(const std::string& path_prefix, std::unordered_map<std::string, Channel>& recovered) {
+    path_prefix_ = path_prefix;
+    fd_ = ::open((path_prefix_ + ".wal").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ == -1) {
+        std::cerr << "[CHANLOG] cannot open " << path_prefix_ << ".wal: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    // two servers appending to one mapped log would overwrite each other's records
+    if (flock(fd_, LOCK_EX | LOCK_NB) == -1) {
+        std::cerr << "[CHANLOG] " << path_prefix_ << ".wal is locked, another ircserv is using it" << std::endl;
+        close();
+        return false;
+    }
+    replay_snapshot(recovered);
+
+    struct stat st{};
+    fstat(fd_, &st);
+    if (!map_file(std::max<size_t>(st.st_size, CHANLOG_INITIAL_SIZE))) {
+        std::cerr << "[CHANLOG] cannot map " << path_prefix_ << ".wal: " << std::strerror(errno) << std::endl;
+        close();
+        return false;
+    }
+    if (std::memcmp(map_, CHANLOG_WAL_MAGIC, CHANLOG_MAGIC_LEN) != 0) {
+        reset_log();
+    } else {
+        replay_log(recovered);
+    }
+    return true;
+}
+
+bool ChannelLog::map_file(const size_t size) {
+    if (map_ != nullptr) {
+        munmap(map_, map_size_);
+        map_ = nullptr;
+    }
+    if (ftruncate(fd_, static_cast<off_t>(size)) == -1) return false;
+    void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (mapped == MAP_FAILED) return false;
+    map_ = static_cast<char*>(mapped);
+    map_size_ = size;
+    return true;
+}
+
+void ChannelLog::replay_snapshot(std::unordered_map<std::string, Channel>& recovered) const {
+    FILE* f = std::fopen((path_prefix_ + ".snap").c_str(), "rb");
+    if (f == nullptr) return;
+    std::string raw;
+    char        buf[4096];
+    size_t      n;
+    while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0) raw.append(buf, n);
+    std::fclose(f);
+
+    if (raw.size() < CHANLOG_MAGIC_LEN + 8 || raw.compare(0, CHANLOG_MAGIC_LEN, CHANLOG_SNAP_MAGIC) != 0) {
+        std::cerr << "[CHANLOG] ignoring snapshot with unknown format" << std::endl;
+        return;
+    }
+    const uint32_t  count = load_u32(raw.data() + CHANLOG_MAGIC_LEN);
+    const uint32_t  crc = load_u32(raw.data() + CHANLOG_MAGIC_LEN + 4);
+    const char*     body = raw.data() + CHANLOG_MAGIC_LEN + 8;
+    const size_t    body_len = raw.size() - CHANLOG_MAGIC_LEN - 8;
+    if (crc32(body, body_len) != crc) {
+        std::cerr << "[CHANLOG] ignoring snapshot with bad checksum" << std::endl;
+        return;
+    }
+    try {
+        MPlexServer::StateReader in(std::string_view(body, body_len));
+        for (uint32_t i = 0; i < count; ++i) {
+            Channel channel;
+            channel.deserialize_settings(in);
+            recovered[channel.get_channel_name()] = channel;
+        }
+    } catch (const MPlexServer::SerialError& e) {
+        std::cerr << "[CHANLOG] snapshot: " << e.what() << std::endl;
+    }
+}
+
+void ChannelLog::replay_log(std::unordered_map<std::string, Channel>& recovered) {
+    size_t pos = CHANLOG_MAGIC_LEN;
+    size_t records = 0;
+    while (pos + CHANLOG_RECORD_HEADER <= map_size_) {
+        const uint32_t len = load_u32(map_ + pos);
+        const uint32_t crc = load_u32(map_ + pos + 4);
+        if (len == 0 || pos + CHANLOG_RECORD_HEADER + len > map_size_) break;
+        const char* body = map_ + pos + CHANLOG_RECORD_HEADER;
+        if (crc32(body, len) != crc) {
+            std::cerr << "[CHANLOG] torn record at offset " << pos << ", truncating log" << std::endl;
+            break;
+        }
+        try {
+            MPlexServer::StateReader in(std::string_view(body + 1, len - 1));
+            if (body[0] == SETTINGS) {
+                Channel channel;
+                channel.deserialize_settings(in);
+                recovered[channel.get_channel_name()] = channel;
+            } else if (body[0] == REMOVAL) {
+                recovered.erase(in.str());
+            }
+        } catch (const MPlexServer::SerialError& e) {
+            std::cerr << "[CHANLOG] bad record at offset " << pos << ": " << e.what() << std::endl;
+            break;
+        }
+        pos += CHANLOG_RECORD_HEADER + len;
+        records++;
+    }
+    // whatever follows the last valid record is garbage from an interrupted write
+    std::memset(map_ + pos, 0, map_size_ - pos);
+    end_ = pos;
+    std::cout << "[CHANLOG] Replayed " << records << " log records" << std::endl;
+}
+
+void ChannelLog::reset_log() {
+    if (map_size_ > CHANLOG_INITIAL_SIZE && !map_file(CHANLOG_INITIAL_SIZE)) {
+        std::cerr << "[CHANLOG] failed to shrink log" << std::endl;
+    }
+    std::memset(map_, 0, map_size_);
+    std::memcpy(map_, CHANLOG_WAL_MAGIC, CHANLOG_MAGIC_LEN);
+    end_ = CHANLOG_MAGIC_LEN;
+}
+
+void ChannelLog::append_record(const RecordType type, const std::string& payload) {
+    const size_t len = payload.size() + 1;
+    char header[CHANLOG_RECORD_HEADER];
+    std::string body;
+    body.reserve(len);
+    body.push_back(static_cast<char>(type));
+    body += payload;
+    store_u32(header, static_cast<uint32_t>(len));
+    store_u32(header + 4, crc32(body.data(), body.size()));
+    pending_.append(header, sizeof(header));
+    pending_ += body;
+}
+
+void ChannelLog::record_settings(const Channel& channel, const Channel::SignatureOf& signature_of) {
+    if (!is_open()) return;
+    MPlexServer::StateWriter out;
+    channel.serialize_settings(out, signature_of);
+    append_record(SETTINGS, out.data());
+}
+
+void ChannelLog::record_removal(const std::string& chan_name) {
+    if (!is_open()) return;
+    MPlexServer::StateWriter out;
+    out.str(chan_name);
+    append_record(REMOVAL, out.data());
+}
+
+bool ChannelLog::commit() {
+    if (!is_open() || pending_.empty()) return false;
+    if (end_ + pending_.size() > map_size_) {
+        size_t size = map_size_;
+        while (end_ + pending_.size() > size) size *= 2;
+        if (!map_file(size)) {
+            std::cerr << "[CHANLOG] failed to grow log, dropping " << pending_.size() << " bytes" << std::endl;
+            pending_.clear();
+            return false;
+        }
+    }
+    std::memcpy(map_ + end_, pending_.data(), pending_.size());
+    end_ += pending_.size();
+    pending_.clear();
+    // the page cache already survives a crash of the process; this only starts writeback
+    msync(map_, map_size_, MS_ASYNC);
+    return end_ > CHANLOG_SNAPSHOT_BYTES;
+}
+
+void ChannelLog::snapshot(const std::vector<const Channel*>& channels, const Channel::SignatureOf& signature_of) {
+    if (!is_open()) return;
+    MPlexServer::StateWriter body;
+    for (const Channel* channel : channels) {
+        channel->serialize_settings(body, signature_of);
+    }
+    std::string raw(CHANLOG_SNAP_MAGIC);
+    char        header[8];
+    store_u32(header, static_cast<uint32_t>(channels.size()));
+    store_u32(header + 4, crc32(body.data().data(), body.data().size()));
+    raw.append(header, sizeof(header));
+    raw += body.data();
+
+    const std::string tmp_path = path_prefix_ + ".snap.tmp";
+    FILE* f = std::fopen(tmp_path.c_str(), "wb");
+    if (f == nullptr || std::fwrite(raw.data(), 1, raw.size(), f) != raw.size()) {
+        std::cerr << "[CHANLOG] failed to write snapshot" << std::endl;
+        if (f != nullptr) std::fclose(f);
+        return;
+    }
+    std::fclose(f);
+    if (std::rename(tmp_path.c_str(), (path_prefix_ + ".snap").c_str()) != 0) {
+        std::cerr << "[CHANLOG] failed to install snapshot" << std::endl;
+        return;
+    }
+    // records still in the log are all older than the snapshot; replaying them
+    // after it (crash right here) ends in the same state, so order is safe
+    reset_log();
+    std::cout << "[CHANLOG] Snapshot of " << channels.size() << " channels written" << std::endl;
+}
@@ -0,0 +1,144 @@
+#include <charconv>
+#include <fstream>
+#include <stdexcept>
+
+#include "Config.h"
+
+using std::string;
+
+namespace {
+    string  trim(const string& s) {
+        const size_t begin = s.find_first_not_of(" \t\r");
+        if (begin == string::npos) return "";
+        return s.substr(begin, s.find_last_not_of(" \t\r") - begin + 1);
+    }
+
+    // whole value, within [min, max]; throws the message shown after "<path>:<line>: "
+    template <class T>
+    T   number(const string& key, const string& value, const T min, const T max) {
+        T       out{};
+        const auto  result = std::from_chars(value.data(), value.data() + value.size(), out);
+        if (value.empty() || result.ec != std::errc() || result.ptr != value.data() + value.size() || out < min || out > max) {
+            throw std::invalid_argument(key + " must be a number from " + std::to_string(min) + " to " + std::to_string(max)
+                                        + ", not '" + value + "'");
+        }
+        return out;
+    }
+
+    std::vector<string> list(const string& value) {
+        std::vector<string> out;
+        size_t  begin = 0;
+        while (begin <= value.size()) {
+            const size_t comma = std::min(value.find(',', begin), value.size());
+            const string item = trim(value.substr(begin, comma - begin));
+            if (!item.empty()) out.push_back(item);
+            begin = comma + 1;
+        }
+        return out;
+    }
+}
+
+bool    Config::load(const string& path, string& error) {
+    std::ifstream   file(path);
+    if (!file) {
+        error = path + ": cannot open";
+        return false;
+    }
+    Config  config;
+    string  line;
+    int     line_number = 0;
+    try {
+        while (std::getline(file, line)) {
+            ++line_number;
+            line = trim(line.substr(0, line.find('#')));
+            if (line.empty()) continue;
+            const size_t equals = line.find('=');
+            if (equals == string::npos) throw std::invalid_argument("expected key = value");
+            const string key = trim(line.substr(0, equals));
+            const string value = trim(line.substr(equals + 1));
+
+            if (key == "server_name") {
+                if (value.empty() || value.find_first_of(" :!@") != string::npos) throw std::invalid_argument("invalid server_name");
+                config.server_name = value;
+            } else if (key == "listen") {
+                for (const string& spec : list(value)) {
+                    MPlexServer::ListenerConfig::parse(spec);      // throws ServerSettingsError
+                    config.listen.push_back(spec);
+                }
+            } else if (key == "tls_cert") {
+                config.tls_cert = value;
+            } else if (key == "tls_key") {
+                config.tls_key = value;
+            } else if (key == "plugins") {
+                const std::vector<string> paths = list(value);
+                config.plugins.insert(config.plugins.end(), paths.begin(), paths.end());
+            } else if (key == "channel_log") {
+                if (value.empty()) throw std::invalid_argument("channel_log needs a path prefix");
+                config.channel_log = value;
+            } else if (key == "log_level") {
+                config.log_level = number(key, value, 0, VERBOSITY_MAX);
+            } else if (key == "read_size") {
+                config.read_size = number<size_t>(key, value, 64, 1 << 20);
+            } else if (key == "epoll_events") {
+                config.epoll_events = number<size_t>(key, value, 1, 65536);
+            } else if (key == "flood_rate") {
+                config.flood_rate = number(key, value, 0.01, 1e6);
+            } else if (key == "flood_burst") {
+                config.flood_burst = number(key, value, 1.0, 1e6);
+            } else if (key == "recvq_max") {
+                config.recvq_max = number<size_t>(key, value, 512, 1 << 30);
+            } else if (key == "sendq_max") {
+                config.sendq_max = number<size_t>(key, value, 4096, size_t(1) << 32);
+            } else if (key.starts_with("penalty.") && key.size() > 8) {
+                config.penalties[key.substr(8)] = number(key, value, 0.0, 1e6);
+            } else if (key == "ident_timeout_ms") {
+                config.ident_timeout_ms = number(key, value, 1, 60000);
+            } else if (key == "dns_timeout_ms") {
+                config.dns_timeout_ms = number(key, value, 1, 60000);
+            } else if (key == "worker_threads") {
+                config.worker_threads = number<size_t>(key, value, 1, 256);
+            } else if (key == "profile") {
+                MPlexServer::LatencyProfile::named(value);          // throws ServerSettingsError
+                config.profile = value;
+            } else if (key == "loop_cpu") {
+                config.loop_cpu = number(key, value, -1, static_cast<int>(sysconf(_SC_NPROCESSORS_CONF)) - 1);
+            } else if (key == "spin_us") {
+                config.spin_us = number(key, value, 0, 1000000);
+            } else {
+                throw std::invalid_argument("unknown key '" + key + "'");
+            }
+        }
+    } catch (std::exception& e) {
+        error = path + ":" + std::to_string(line_number) + ": " + e.what();
+        return false;
+    }
+    *this = std::move(config);
+    return true;
+}
+
+void    Config::apply(IrcServer& srv, SrvMgr& srv_mgr) const {
+    srv.setVerbose(log_level);
+    srv_mgr.set_log_level(log_level);
+    srv.setReadSize(read_size);
+    srv.setEventBatch(epoll_events);
+    srv.setFloodControl(flood_rate, flood_burst, recvq_max);
+    srv.setSendQLimit(sendq_max);
+    srv_mgr.set_command_penalties(penalties);
+    srv_mgr.set_lookup_timeouts(ident_timeout_ms, dns_timeout_ms);
+    srv.setWorkerThreads(worker_threads);
+    MPlexServer::LatencyProfile latency = MPlexServer::LatencyProfile::named(profile);
+    latency.cpu = loop_cpu;
+    if (spin_us >= 0) latency.spin_us = spin_us;
+    srv.setLatencyProfile(latency);
+}
+
+std::vector<string> Config::startup_changes(const Config& running) const {
+    std::vector<string> keys;
+    if (server_name != running.server_name) keys.emplace_back("server_name");
+    if (listen != running.listen) keys.emplace_back("listen");
+    if (tls_cert != running.tls_cert) keys.emplace_back("tls_cert");
+    if (tls_key != running.tls_key) keys.emplace_back("tls_key");
+    if (plugins != running.plugins) keys.emplace_back("plugins");
+    if (channel_log != running.channel_log) keys.emplace_back("channel_log");
+    return keys;
+}
@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <cctype>
+
+#include "MaskMatcher.h"
+
+MaskMatcher::MaskMatcher(const std::vector<std::string>& masks) {
+    // one input class per character used literally, case folded
+    for (const std::string& mask : masks) {
+        for (const char ch : mask) {
+            if (ch == '*' || ch == '?') continue;
+            const int lower = std::tolower(static_cast<unsigned char>(ch));
+            if (classes_[lower] != 0) continue;
+            classes_[lower] = class_count_;
+            classes_[std::toupper(lower)] = class_count_;
+            class_count_++;
+        }
+    }
+    nodes_.emplace_back();
+    for (const std::string& mask : masks) {
+        add_mask(mask);
+    }
+    reset_dfa();
+}
+
+void MaskMatcher::add_mask(const std::string& mask) {
+    int32_t cur = 0;
+    for (const char ch : mask) {
+        int32_t next;
+        if (ch == '*') {
+            if (nodes_[cur].is_star) continue;     // "**" is "*"
+            next = nodes_[cur].star;
+        } else if (ch == '?') {
+            next = nodes_[cur].any;
+        } else {
+            auto it = nodes_[cur].literal.find(classes_[static_cast<unsigned char>(ch)]);
+            next = it == nodes_[cur].literal.end() ? -1 : it->second;
+        }
+        if (next == -1) {
+            next = static_cast<int32_t>(nodes_.size());
+            nodes_.emplace_back();
+            if (ch == '*') {
+                nodes_[next].is_star = true;
+                nodes_[cur].star = next;
+            } else if (ch == '?') {
+                nodes_[cur].any = next;
+            } else {
+                nodes_[cur].literal[classes_[static_cast<unsigned char>(ch)]] = next;
+            }
+        }
+        cur = next;
+    }
+    nodes_[cur].accept = true;
+}
+
+void MaskMatcher::close_over(std::vector<int32_t>& set) const {
+    // a '*' also matches nothing, so entering a node enters its star child too
+    for (size_t i = 0; i < set.size(); ++i) {
+        const int32_t star = nodes_[set[i]].star;
+        if (star != -1) set.push_back(star);
+    }
+    std::sort(set.begin(), set.end());
+    set.erase(std::unique(set.begin(), set.end()), set.end());
+}
+
+int32_t MaskMatcher::intern(std::vector<int32_t> set) {
+    auto it = dfa_index_.find(set);
+    if (it != dfa_index_.end()) return it->second;
+    DfaState    state;
+    for (const int32_t node : set) {
+        state.accept = state.accept || nodes_[node].accept;
+    }
+    state.next.assign(class_count_, -1);
+    state.nodes = set;
+    const int32_t id = static_cast<int32_t>(dfa_.size());
+    dfa_.push_back(std::move(state));
+    dfa_index_.emplace(std::move(set), id);
+    return id;
+}
+
+int32_t MaskMatcher::build(const int32_t from, const uint8_t input_class) {
+    std::vector<int32_t>    set;
+    for (const int32_t id : dfa_[from].nodes) {
+        const Node& node = nodes_[id];
+        if (input_class != 0) {
+            auto it = node.literal.find(input_class);
+            if (it != node.literal.end()) set.push_back(it->second);
+        }
+        if (node.any != -1) set.push_back(node.any);
+        if (node.is_star) set.push_back(id);
+    }
+    close_over(set);
+    if (dfa_.size() >= MASK_DFA_MAX_STATES && dfa_index_.find(set) == dfa_index_.end()) {
+        // too many distinct subjects seen: start the cache over, `from` does not survive that
+        reset_dfa();
+        return intern(std::move(set));
+    }
+    const int32_t to = intern(std::move(set));
+    dfa_[from].next[input_class] = to;
+    return to;
+}
+
+void MaskMatcher::reset_dfa() {
+    dfa_.clear();
+    dfa_index_.clear();
+    std::vector<int32_t> start{0};
+    close_over(start);
+    intern(std::move(start));   // always state 0
+    dead_ = intern({});
+}
+
+bool MaskMatcher::matches(const std::string_view subject) {
+    int32_t state = 0;
+    for (const char ch : subject) {
+        const uint8_t   input_class = classes_[static_cast<unsigned char>(ch)];
+        int32_t         next = dfa_[state].next[input_class];
+        if (next < 0) next = build(state, input_class);
+        if (next == dead_) return false;
+        state = next;
+    }
+    return dfa_[state].accept;
+}
+
+size_t MaskMatcher::dfa_states() const {
+    return dfa_.size();
+}
+
+std::string MaskMatcher::normalize(const std::string& mask) {
+    const bool  has_bang = mask.find('!') != std::string::npos;
+    const bool  has_at = mask.find('@') != std::string::npos;
+    if (!has_bang && !has_at) return mask + "!*@*";
+    if (!has_bang) return "*!" + mask;
+    if (!has_at) return mask + "@*";
+    return mask;
+}
@@ -0,0 +1,161 @@
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <random>
+
+#include "MessageTags.h"
+
+namespace {
+    bool    valid_key(const std::string_view key) {
+        const std::string_view  name = !key.empty() && key[0] == '+' ? key.substr(1) : key;
+        if (name.empty()) return false;
+        for (const char ch : name) {
+            if (!std::isalnum(static_cast<unsigned char>(ch)) && ch != '-' && ch != '.' && ch != '/') return false;
+        }
+        return true;
+    }
+
+    std::string unescape(const std::string_view value) {
+        std::string out;
+        out.reserve(value.size());
+        for (size_t i = 0; i < value.size(); ++i) {
+            if (value[i] != '\\') {
+                out += value[i];
+                continue;
+            }
+            if (++i == value.size()) break;     // a trailing lone backslash is dropped
+            switch (value[i]) {
+                case ':': out += ';'; break;
+                case 's': out += ' '; break;
+                case 'r': out += '\r'; break;
+                case 'n': out += '\n'; break;
+                default: out += value[i];       // "\\" and unknown escapes: the character itself
+            }
+        }
+        return out;
+    }
+}
+
+bool    parse_tags(const std::string_view section, std::vector<MessageTag>& out) {
+    out.clear();
+    size_t  start = 0;
+    while (start <= section.size()) {
+        size_t  end = section.find(';', start);
+        if (end == std::string_view::npos) end = section.size();
+        const std::string_view  tag = section.substr(start, end - start);
+        start = end + 1;
+        if (tag.empty()) continue;
+        const size_t            equals = tag.find('=');
+        const std::string_view  key = tag.substr(0, equals);
+        if (!valid_key(key)) return false;
+        const std::string       value = equals == std::string_view::npos ? "" : unescape(tag.substr(equals + 1));
+        // a repeated key: the last one wins
+        bool    replaced = false;
+        for (MessageTag& existing : out) {
+            if (existing.key == key) {
+                existing.value = value;
+                replaced = true;
+            }
+        }
+        if (!replaced) out.push_back(MessageTag{std::string(key), value});
+    }
+    return true;
+}
+
+std::string escape_tag_value(const std::string_view value) {
+    std::string out;
+    out.reserve(value.size());
+    for (const char ch : value) {
+        switch (ch) {
+            case ';': out += "\\:"; break;
+            case ' ': out += "\\s"; break;
+            case '\\': out += "\\\\"; break;
+            case '\r': out += "\\r"; break;
+            case '\n': out += "\\n"; break;
+            default: out += ch;
+        }
+    }
+    return out;
+}
+
+std::string relayed_client_tags(const std::vector<MessageTag>& tags) {
+    std::string out;
+    for (const MessageTag& tag : tags) {
+        if (tag.key[0] != '+') continue;
+        if (!out.empty()) out += ';';
+        out += tag.key;
+        if (!tag.value.empty()) out += "=" + escape_tag_value(tag.value);
+    }
+    return out.size() > CLIENT_TAGS_MAX_LEN ? "" : out;
+}
+
+const std::string& ServerTime::now() {
+    if (!fresh_) {
+        fresh_ = true;
+        const int64_t   ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        if (ms != ms_) {
+            ms_ = ms;
+            iso_ = format(ms);
+        }
+    }
+    return iso_;
+}
+
+int64_t ServerTime::now_ms() {
+    now();
+    return ms_;
+}
+
+void ServerTime::next_iteration() {
+    fresh_ = false;
+}
+
+std::string ServerTime::format(const int64_t ms) {
+    const std::time_t   seconds = static_cast<std::time_t>(ms / 1000);
+    std::tm             tm{};
+    gmtime_r(&seconds, &tm);
+    char    buffer[64];     // room for any int year, so snprintf cannot truncate
+    std::snprintf(buffer, sizeof(buffer), "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ", tm.tm_year + 1900, tm.tm_mon + 1,
+                  tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, static_cast<int>(ms % 1000));
+    return buffer;
+}
+
+MsgIdGenerator::MsgIdGenerator() {
+    // random per process, so ids stay unique across restarts and upgrades
+    std::random_device  random;
+    char                buffer[16];
+    std::snprintf(buffer, sizeof(buffer), "%08x", random());
+    prefix_ = buffer;
+}
+
+std::string MsgIdGenerator::next() {
+    char    buffer[24];
+    std::snprintf(buffer, sizeof(buffer), "%llx", static_cast<unsigned long long>(counter_.fetch_add(1, std::memory_order_relaxed)));
+    return prefix_ + buffer;
+}
+
+OutboundTags::OutboundTags(ServerTime& time, MsgIdGenerator& ids, std::string client_tags)
+    : time_(time), ids_(ids), client_tags_(std::move(client_tags)) {
+}
+
+const std::string& OutboundTags::prefix(uint32_t caps) {
+    caps &= CAP_TAG_MASK;
+    if (rendered_[caps]) return variants_[caps];
+    rendered_[caps] = true;
+    std::string&    out = variants_[caps];
+    if (caps & CAP_SERVER_TIME) {
+        out += "time=" + time_.now();
+    }
+    if (caps & CAP_MESSAGE_TAGS) {
+        out += (out.empty() ? "" : ";") + message_tags();
+    }
+    if (!out.empty()) out = "@" + out + " ";
+    return out;
+}
+
+std::string OutboundTags::message_tags() {
+    if (msgid_.empty()) msgid_ = ids_.next();
+    return client_tags_.empty() ? "msgid=" + msgid_ : "msgid=" + msgid_ + ";" + client_tags_;
+}
@@ -0,0 +1,129 @@
+#include <dlfcn.h>
+
+#include <iostream>
+
+#include "mplexserver_impl.h"
+#include "PluginManager.h"
+#include "SrvMgr.h"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+
+PluginManager::PluginManager(SrvMgr& srv_mgr) : srv_mgr_(srv_mgr) {}
+
+PluginManager::~PluginManager() {
+    // the hooks' code lives in the plugins, so they go first
+    register_hooks_.clear();
+    command_hooks_.clear();
+    channel_message_hooks_.clear();
+    disconnect_hooks_.clear();
+    for (auto it = handles_.rbegin(); it != handles_.rend(); ++it) {
+        dlclose(*it);
+    }
+}
+
+bool    PluginManager::load(const string& path) {
+    // RTLD_LOCAL: plugins see the server's symbols (linked with -rdynamic), not each other's
+    void*   handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (handle == nullptr) {
+        cerr << "[PLUGIN] cannot load " << path << ": " << dlerror() << endl;
+        return false;
+    }
+    const auto  init = reinterpret_cast<PluginInit>(dlsym(handle, PLUGIN_INIT_SYMBOL));
+    if (init == nullptr) {
+        cerr << "[PLUGIN] " << path << " has no " << PLUGIN_INIT_SYMBOL << "()" << endl;
+        dlclose(handle);
+        return false;
+    }
+    // kept before init runs: hooks it registered stay even if it fails, and their code must stay mapped
+    handles_.push_back(handle);
+    if (const int result = init(*this, PLUGIN_API_VERSION); result != 0) {
+        cerr << "[PLUGIN] " << path << " failed to start (" << result << ")" << endl;
+        return false;
+    }
+    cout << "[PLUGIN] Loaded " << path << endl;
+    return true;
+}
+
+size_t  PluginManager::loaded() const {
+    return handles_.size();
+}
+
+void    PluginManager::flush_disconnects() {
+    for (const auto& [client, reason] : pending_disconnects_) {
+        srv_mgr_.srv_instance_.sendLine(client, "ERROR :Closing Link: " + string(client.getPeer()) + " (" + reason + ")");
+        srv_mgr_.srv_instance_.disconnectClient(client);
+    }
+    pending_disconnects_.clear();
+}
+
+const string&   PluginManager::server_name() const {
+    return srv_mgr_.server_name_;
+}
+
+const User*     PluginManager::find_user(const string& nick) const {
+    const auto  nick_it = srv_mgr_.server_nicks_.find(nick);
+    return nick_it == srv_mgr_.server_nicks_.end() ? nullptr : srv_mgr_.find_user(nick_it->second);
+}
+
+const Channel*  PluginManager::find_channel(const string& chan_name) const {
+    const auto  chan_it = srv_mgr_.server_channels_.find(chan_name);
+    return chan_it == srv_mgr_.server_channels_.end() ? nullptr : &chan_it->second;
+}
+
+void    PluginManager::send_to_user(const User& user, const string& line) {
+    srv_mgr_.srv_instance_.sendLine(user.get_client(), line);
+}
+
+void    PluginManager::notice(const User& user, const string& text) {
+    const string    nick = user.get_nickname().empty() ? "*" : user.get_nickname();
+    srv_mgr_.srv_instance_.sendLine(user.get_client(), ":" + srv_mgr_.server_name_ + " NOTICE " + nick + " :" + text);
+}
+
+// deferred: disconnecting runs SrvMgr::onDisconnect() right away, which may erase the
+// channel or user the calling hook is looking at
+void    PluginManager::disconnect_user(const User& user, const string& reason) {
+    pending_disconnects_.emplace_back(user.get_client(), reason);
+}
+
+void    PluginManager::on_register(std::function<void(const User&)> hook) {
+    register_hooks_.push_back(std::move(hook));
+}
+void    PluginManager::on_command(std::function<Verdict(const User&, const string&, const string&)> hook) {
+    command_hooks_.push_back(std::move(hook));
+}
+void    PluginManager::on_channel_message(std::function<Verdict(const User&, const Channel&, std::string_view)> hook) {
+    channel_message_hooks_.push_back(std::move(hook));
+}
+void    PluginManager::on_disconnect(std::function<void(const User&)> hook) {
+    disconnect_hooks_.push_back(std::move(hook));
+}
+
+void    PluginManager::run_register(const User& user) const {
+    for (const auto& hook : register_hooks_) {
+        hook(user);
+    }
+}
+
+// the first plugin to drop a message ends it, later ones never see it
+Verdict PluginManager::run_command(const User& user, const string& command, const string& args) const {
+    for (const auto& hook : command_hooks_) {
+        if (hook(user, command, args) == Verdict::DROP) return Verdict::DROP;
+    }
+    return Verdict::PASS;
+}
+
+Verdict PluginManager::run_channel_message(const User& user, const Channel& channel, const std::string_view text) const {
+    for (const auto& hook : channel_message_hooks_) {
+        if (hook(user, channel, text) == Verdict::DROP) return Verdict::DROP;
+    }
+    return Verdict::PASS;
+}
+
+void    PluginManager::run_disconnect(const User& user) const {
+    for (const auto& hook : disconnect_hooks_) {
+        hook(user);
+    }
+}
@@ -0,0 +1,256 @@
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "Resolver.h"
+
+namespace {
+    uint16_t    get16(const std::string& msg, const size_t at) {
+        return static_cast<uint16_t>((static_cast<uint8_t>(msg[at]) << 8) | static_cast<uint8_t>(msg[at + 1]));
+    }
+
+    uint32_t    get32(const std::string& msg, const size_t at) {
+        return (static_cast<uint32_t>(get16(msg, at)) << 16) | get16(msg, at + 2);
+    }
+
+    void        put16(std::string& out, const uint16_t value) {
+        out += static_cast<char>(value >> 8);
+        out += static_cast<char>(value & 0xff);
+    }
+
+    // reads a possibly compressed name; at ends up behind it in the record it started in
+    bool        read_name(const std::string& msg, size_t& at, std::string& name) {
+        name.clear();
+        size_t  pos = at;
+        int     jumps = 0;
+        while (pos < msg.size()) {
+            const uint8_t len = static_cast<uint8_t>(msg[pos]);
+            if ((len & 0xc0) == 0xc0) {
+                if (pos + 1 >= msg.size() || ++jumps > 16) return false;   // pointer loops
+                if (jumps == 1) at = pos + 2;
+                pos = (static_cast<size_t>(len & 0x3f) << 8) | static_cast<uint8_t>(msg[pos + 1]);
+                continue;
+            }
+            if ((len & 0xc0) != 0) return false;
+            if (len == 0) {
+                if (jumps == 0) at = pos + 1;
+                return true;
+            }
+            if (pos + 1 + len > msg.size() || name.size() + len + 1 > 255) return false;
+            if (!name.empty()) name += '.';
+            name.append(msg, pos + 1, len);
+            pos += 1 + len;
+        }
+        return false;
+    }
+
+    bool        same_name(const std::string& a, const std::string& b) {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const char x, const char y) {
+            return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+        });
+    }
+}
+
+Resolver::Join::~Join() {
+    if (!waiting_) return;
+    auto it = resolver_.flights_.find(addr_);
+    if (it == resolver_.flights_.end()) return;
+    std::vector<Join*>& joined = it->second;
+    joined.erase(std::remove(joined.begin(), joined.end(), this), joined.end());
+}
+
+bool Resolver::Join::await_suspend(const std::coroutine_handle<> handle) {
+    auto it = resolver_.flights_.find(addr_);
+    if (it == resolver_.flights_.end()) return false;
+    handle_ = handle;
+    waiting_ = true;
+    it->second.push_back(this);
+    return true;
+}
+
+Resolver::Flight::~Flight() {
+    // only when the coroutine was destroyed mid-lookup (server shutdown), which destroys the joined ones too
+    if (resolver_ != nullptr) resolver_->flights_.erase(addr_);
+}
+
+void Resolver::Flight::finish(const std::string& host, const uint32_t ttl) {
+    Resolver& resolver = *resolver_;
+    resolver_ = nullptr;
+    resolver.store(addr_, host, ttl);
+    auto it = resolver.flights_.find(addr_);
+    if (it == resolver.flights_.end()) return;
+    const std::vector<Join*> joined = std::move(it->second);
+    resolver.flights_.erase(it);
+    for (Join* join : joined) {
+        join->host_ = host;
+        join->waiting_ = false;
+    }
+    for (Join* join : joined) {
+        join->handle_.resume();
+    }
+}
+
+void Resolver::set_nameserver(const sockaddr_in& nameserver) {
+    nameserver_ = nameserver;
+}
+
+const sockaddr_in& Resolver::get_nameserver() const {
+    return nameserver_;
+}
+
+const std::string* Resolver::cached(const uint32_t addr) {
+    auto it = cache_.find(addr);
+    if (it == cache_.end()) return nullptr;
+    if (it->second.expiry->first <= Clock::now()) {
+        erase(addr);
+        return nullptr;
+    }
+    return &it->second.host;
+}
+
+bool Resolver::in_flight(const uint32_t addr) const {
+    return flights_.find(addr) != flights_.end();
+}
+
+Resolver::Flight Resolver::begin(const uint32_t addr) {
+    flights_[addr];
+    return Flight(*this, addr);
+}
+
+Resolver::Join Resolver::join(const uint32_t addr) {
+    return Join(*this, addr);
+}
+
+uint16_t Resolver::next_id() {
+    return static_cast<uint16_t>(ids_());
+}
+
+void Resolver::store(const uint32_t addr, const std::string& host, const uint32_t ttl) {
+    erase(addr);
+    while (cache_.size() >= DNS_CACHE_MAX) {
+        erase(expiries_.begin()->second);
+    }
+    const auto expiry = expiries_.emplace(Clock::now() + std::chrono::seconds(std::min<uint32_t>(ttl, DNS_MAX_TTL)), addr);
+    cache_.emplace(addr, CacheEntry{host, expiry});
+}
+
+void Resolver::erase(const uint32_t addr) {
+    auto it = cache_.find(addr);
+    if (it == cache_.end()) return;
+    expiries_.erase(it->second.expiry);
+    cache_.erase(it);
+}
+
+std::string Resolver::ptr_name(const uint32_t addr) {
+    const uint8_t*  bytes = reinterpret_cast<const uint8_t*>(&addr);
+    return std::to_string(bytes[3]) + "." + std::to_string(bytes[2]) + "." + std::to_string(bytes[1]) + "."
+           + std::to_string(bytes[0]) + ".in-addr.arpa";
+}
+
+std::string Resolver::build_query(const uint16_t id, const std::string& name, const Type type) {
+    std::string query;
+    put16(query, id);
+    put16(query, 0x0100);       // standard query, recursion desired
+    put16(query, 1);            // one question
+    put16(query, 0);
+    put16(query, 0);
+    put16(query, 0);
+    std::stringstream   labels(name);
+    std::string         label;
+    while (std::getline(labels, label, '.')) {
+        if (label.empty() || label.size() > 63) continue;
+        query += static_cast<char>(label.size());
+        query += label;
+    }
+    query += '\0';
+    put16(query, static_cast<uint16_t>(type));
+    put16(query, 1);            // class IN
+    return query;
+}
+
+bool Resolver::parse_reply(const std::string& reply, const uint16_t id, const std::string& name, const Type type, Answer& answer) {
+    answer = Answer();
+    if (reply.size() < 12 || get16(reply, 0) != id) return false;
+    const uint16_t  flags = get16(reply, 2);
+    if ((flags & 0x8000) == 0 || (flags & 0x7800) != 0 || get16(reply, 4) != 1) return false;
+    size_t          at = 12;
+    std::string     owner;
+    if (!read_name(reply, at, owner) || !same_name(owner, name) || at + 4 > reply.size()) return false;
+    if (get16(reply, at) != static_cast<uint16_t>(type) || get16(reply, at + 2) != 1) return false;
+    at += 4;
+    if ((flags & 0x000f) != 0) return true;     // NXDOMAIN, SERVFAIL...: answered, nothing found
+
+    // follow CNAMEs from the question name (classless in-addr.arpa delegation uses them)
+    std::string     current = name;
+    std::string     target;
+    for (uint16_t n = get16(reply, 6); n > 0; --n) {
+        if (!read_name(reply, at, owner) || at + 10 > reply.size()) return false;
+        const uint16_t  rtype = get16(reply, at);
+        const uint16_t  rclass = get16(reply, at + 2);
+        const uint32_t  ttl = get32(reply, at + 4);
+        const uint16_t  length = get16(reply, at + 8);
+        at += 10;
+        if (at + length > reply.size()) return false;
+        if (rclass == 1 && same_name(owner, current)) {
+            size_t  data = at;
+            if (rtype == static_cast<uint16_t>(Type::CNAME)) {
+                if (!read_name(reply, data, target)) return false;
+                current = target;
+                answer.ttl = std::min(answer.ttl, ttl);
+            } else if (rtype == static_cast<uint16_t>(type)) {
+                if (type == Type::A && length == 4) {
+                    uint32_t address;
+                    std::memcpy(&address, reply.data() + at, 4);
+                    answer.addresses.push_back(address);
+                } else if (type == Type::PTR) {
+                    if (!read_name(reply, data, target)) return false;
+                    answer.names.push_back(target);
+                }
+                answer.ttl = std::min(answer.ttl, ttl);
+            }
+        }
+        at += length;
+    }
+    return true;
+}
+
+bool Resolver::valid_hostname(const std::string& host) {
+    // the name ends up in nick!user@host prefixes, so nothing that could break a line or a mask
+    if (host.empty() || host.size() > HOST_MAX_LEN || host.front() == '.' || host.front() == '-') return false;
+    return std::all_of(host.begin(), host.end(), [](const char ch) {
+        return std::isalnum(static_cast<unsigned char>(ch)) || ch == '-' || ch == '.';
+    });
+}
+
+bool Resolver::parse_address(const std::string& spec, sockaddr_in& out) {
+    const size_t    colon = spec.find(':');
+    const std::string   ip = spec.substr(0, colon);
+    int             port = DNS_PORT;
+    if (colon != std::string::npos) {
+        port = std::atoi(spec.c_str() + colon + 1);
+        if (port <= 0 || port > 65535) return false;
+    }
+    out = sockaddr_in();
+    out.sin_family = AF_INET;
+    out.sin_port = htons(static_cast<uint16_t>(port));
+    return inet_pton(AF_INET, ip.c_str(), &out.sin_addr) == 1;
+}
+
+bool Resolver::system_nameserver(sockaddr_in& out) {
+    std::ifstream   conf("/etc/resolv.conf");
+    std::string     line;
+    while (std::getline(conf, line)) {
+        std::stringstream   words(line);
+        std::string         keyword;
+        std::string         address;
+        if (words >> keyword >> address && keyword == "nameserver" && parse_address(address, out)) {
+            return true;
+        }
+    }
+    return false;
+}
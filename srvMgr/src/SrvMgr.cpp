@@ -1,6 +1,7 @@
+#include <chrono>
 #include <vector>
 
-#include "mplexserver.h"
+#include "mplexserver_impl.h"
 #include "Channel.h"
 #include "IRC_macros.h"
 #include "SrvMgr.h"
@@ -11,21 +12,81 @@ using std::cout;
 using std::endl;
 using std::string;
 
-SrvMgr::SrvMgr(MPlexServer::Server& srv, const string& server_password, const string& server_name) : srv_instance_(srv), server_password_(server_password), server_name_(server_name) {
+SrvMgr::SrvMgr(IrcServer& srv, const string& server_password, const string& server_name) : srv_instance_(srv), server_password_(server_password), server_name_(server_name), plugins_(*this) {
+    set_command_penalties({});
+
+    // users live in the server's connection slots and are freed together with them
+    srv_instance_.setUserDataDeleter([](void* user) { delete static_cast<User*>(user); });
+}
+
+void    SrvMgr::set_command_penalties(const std::unordered_map<string, double>& overrides) {
+    // flood control penalties, weighted by the work a command causes (fan-out, channel state changes);
+    // the cheap ones still cost a little, so that a stream of them is paced like any other
+    srv_instance_.clearCommandPenalties();
+    srv_instance_.setCommandPenalty("PASS", 0.1);
+    srv_instance_.setCommandPenalty("CAP", 0.1);
+    srv_instance_.setCommandPenalty("PING", 0.1);
+    srv_instance_.setCommandPenalty("PRIVMSG", 1);
+    srv_instance_.setCommandPenalty("JOIN", 2);
+    srv_instance_.setCommandPenalty("PART", 2);
+    srv_instance_.setCommandPenalty("TOPIC", 2);
+    srv_instance_.setCommandPenalty("INVITE", 2);
+    srv_instance_.setCommandPenalty("KICK", 2);
+    srv_instance_.setCommandPenalty("MODE", 2);
+    srv_instance_.setCommandPenalty("NICK", 3);
+    srv_instance_.setCommandPenalty("CHATHISTORY", 3);
+    srv_instance_.setCommandPenalty("LIST", 3);
+    for (const auto& [command, penalty] : overrides) {
+        srv_instance_.setCommandPenalty(command, penalty);
+    }
+}
+
+void    SrvMgr::set_log_level(const int level) {
+    log_level_ = level;
 }
 
 void    SrvMgr::onConnect(MPlexServer::Client client) {
-    cout << "[CONNECT] New client: " << client.getIpv4() << ":" << client.getPort() << endl;
-    server_users_.emplace(client.getFd(), User(client));
+    const MPlexServer::ListenerConfig*  listener = srv_instance_.getListener(client);
+    cout << "[CONNECT] New client: " << client.getPeer() << ":" << client.getPort();
+    if (listener != nullptr) cout << " on " << listener->describe();
+    if (listener != nullptr && !listener->client_class.empty()) cout << " (class " << listener->client_class << ")";
+    cout << endl;
+    User*   user = new User(client);
+    // until a lookup confirms a name, never what the client claims; "::1" would end the prefix at the colon
+    const string    peer = client.getPeer();
+    user->set_hostname(peer[0] == ':' ? "0" + peer : peer);
+    srv_instance_.setUserData(client, user);
+    start_link(client, *user);
+    if (user->get_link_state() != LinkState::NONE) return;
+    // nothing to look up for unix-domain clients, and the resolver only knows in-addr.arpa
+    if (ident_enabled_ && client.getAddress().family() != AF_UNIX) {
+        user->begin_lookup();
+        srv_instance_.spawn(ident_lookup(client));
+    }
+    if (resolver_enabled_ && client.getAddress().family() == AF_INET) {
+        user->begin_lookup();
+        srv_instance_.spawn(host_lookup(client));
+    }
 }
 
 void    SrvMgr::onDisconnect(MPlexServer::Client client) {
-    User&       user = server_users_[client.getFd()];
+    for (LinkTarget& target : link_targets_) {
+        if (target.client.getFd() == client.getFd() && target.client.getGeneration() == client.getGeneration()) {
+            target.client = MPlexServer::Client();
+        }
+    }
+    User*       user_ptr = find_user(client.getFd());
+    if (user_ptr == nullptr) return;
+    User&       user = *user_ptr;
+    if (user.get_link_state() == LinkState::ESTABLISHED) {
+        link_closed(client, user);
+        return ;
+    }
     std::string nick = user.get_nickname();
     std::string signature = ":" + user.get_signature();
 
-    cout << "[DISCONNECT] " << nick << " (" << client.getIpv4() << ":" << client.getPort() << ") left" << endl;
-
+    cout << "[DISCONNECT] " << nick << " (" << client.getPeer() << ":" << client.getPort() << ") left" << endl;
+    plugins_.disconnected(user);
 
     if (user.is_logged_in()) {
         std::vector<string> keys;
@@ -38,28 +99,93 @@ void    SrvMgr::onDisconnect(MPlexServer::Client client) {
             Channel& channel = it->second;
 
             if (channel.has_chan_member(nick)) {
-                remove_user_from_channel(channel, nick);
+                // before the removal, which erases the channel when it was the last member
                 string  msg = ":" + user.get_signature() + " QUIT :Quit: User disconnected";
                 send_to_chan_all_but_one(channel, msg, nick);
+                remove_user_from_channel(channel, nick);
             }
         }
+        propagate(signature + " QUIT :Quit: User disconnected");
     }
     server_nicks_.erase(nick);
-    server_users_.erase(client.getFd());
+}
+
+void    SrvMgr::onPollEnd() {
+    server_time_.next_iteration();
+    plugins_.flush_disconnects();
+    maintain_links();
+    expire_history();
+    flush_channel_log();
+}
+
+void    SrvMgr::flush_channel_log() {
+    if (dirty_channels_.empty()) return;
+    const Channel::SignatureOf  signature_of = [this](const string& nick) { return this->signature_of(nick); };
+    for (const string& chan_name : dirty_channels_) {
+        auto chan_it = server_channels_.find(chan_name);
+        if (chan_it != server_channels_.end()) {
+            channel_log_.record_settings(chan_it->second, signature_of);
+        } else if (recovered_channels_.find(chan_name) == recovered_channels_.end()) {
+            channel_log_.record_removal(chan_name);
+        }
+    }
+    dirty_channels_.clear();
+    if (channel_log_.commit()) {
+        std::vector<const Channel*> channels;
+        for (const auto& [chan_name, channel] : server_channels_) {
+            channels.push_back(&channel);
+        }
+        for (const auto& [chan_name, channel] : recovered_channels_) {
+            channels.push_back(&channel);
+        }
+        channel_log_.snapshot(channels, signature_of);
+    }
 }
 
 void    SrvMgr::onMessage(const MPlexServer::Message msg) {
     const MPlexServer::Client&  client = msg.getClient();
-    User&                       user = server_users_[client.getFd()];
-    
-    cout << "[MSG] Received: '" << msg.getMessage() << "'" << endl;
-    
-    std::vector<string>         msg_parts = process_message(msg.getMessage());
+    User*                       user_ptr = static_cast<User*>(srv_instance_.getUserData(client));
+    if (user_ptr == nullptr) return;
+    User&                       user = *user_ptr;
+
+    if (log_level_ >= 2) {
+        cout << "[MSG] Received: '" << msg.getMessage() << "'" << endl;
+    }
+
+    current_tags_.clear();
+    if (user.get_link_state() == LinkState::ESTABLISHED) {
+        process_link_message(msg.getMessage(), client, user);
+        return ;
+    }
+    if (msg.tagsTooLong()) {
+        string  nick = user.get_nickname().empty() ? "*" : user.get_nickname();
+        send_to_one(user, ":" + server_name_ + " " + ERR_INPUTTOOLONG + " " + nick + " :Input line was too long");
+        return ;
+    }
+    if (!parse_tags(msg.getTags(), current_tags_)) {
+        current_tags_.clear();      // malformed tags are ignored, the command still runs
+    }
+    std::vector<string>         msg_parts = process_message(string(msg.getBody()));
     const int                   command = get_msg_type(msg_parts[0]);
 
-    cout << "[MSG] Command: " << msg_parts[0] << " (type: " << command << ")" << endl;
-    if (msg_parts.size() > 1 && !msg_parts[1].empty()) {
-        cout << "[MSG] Args: '" << msg_parts[1] << "'" << endl;
+    if (msg_parts[0] == "SERVER") {
+        process_server(msg_parts[1], client, user);
+        return ;
+    }
+    if (user.get_link_state() == LinkState::HANDSHAKE_SENT) {
+        cout << "[LINK] Ignoring '" << msg_parts[0] << "' before the SERVER reply" << endl;
+        return ;
+    }
+
+    if (log_level_ >= 2) {
+        cout << "[MSG] Command: " << msg_parts[0] << " (type: " << command << ")" << endl;
+        if (msg_parts.size() > 1 && !msg_parts[1].empty()) {
+            cout << "[MSG] Args: '" << msg_parts[1] << "'" << endl;
+        }
+    }
+
+    if (plugins_.command(user, msg_parts[0], msg_parts[1]) == Verdict::DROP) {
+        return ;
     }
 
     // some commands are only allowed after the user registered successfully
@@ -109,6 +235,15 @@ void    SrvMgr::onMessage(const MPlexServer::Message msg) {
         case cmdType::PING:
             pong(msg_parts[1], client, user);
             break;
+        case cmdType::CHATHISTORY:
+            process_chathistory(msg_parts[1], client, user);
+            break;
+        case cmdType::LIST:
+            process_list(msg_parts[1], client, user);
+            break;
+        case cmdType::TAGMSG:
+            process_tagmsg(msg_parts[1], client, user);
+            break;
         default:
             cout << "no cmd_type found.\n";
             string  nick = user.get_nickname().empty()? "*" : user.get_nickname();
@@ -130,7 +265,7 @@ void    SrvMgr::process_password(const std::string& provided_password, const MPl
     else {
         srv_instance_.sendTo(client, ":" + server_name_ + " " + ERR_PASSWDMISMATCH + " * " + ":Password incorrect\r\n");
         srv_instance_.sendTo(client, ":" + server_name_ + " " + ERR_NOTREGISTERED + " * " + ":You have not registered\r\n");
-        srv_instance_.sendTo(client, "ERROR :Closing Link: " + client.getIpv4() + " (Password incorrect)\r\n");
+        srv_instance_.sendTo(client, "ERROR :Closing Link: " + string(client.getPeer()) + " (Password incorrect)\r\n");
         srv_instance_.disconnectClient(client);
         return ;
     }
@@ -139,13 +274,37 @@ void    SrvMgr::process_password(const std::string& provided_password, const MPl
     }
 }
 
+// CAP LS [302] | LIST | REQ :<caps> | END
+// REQ is all or nothing: one unknown capability NAKs the whole request
 void    SrvMgr::process_cap(const string& s, const MPlexServer::Client& client, User& user) const {
+    string  args = s;
+    string  subcommand = split_off_before_del(args, ' ');
+    string  nick = user.get_nickname().empty() ? "*" : user.get_nickname();
+
     user.set_cap_negotiation_started(true);
-    if (s == "END") {
+    if (subcommand == "END") {
         user.set_cap_negotiation_ended(true);
-    }
-    else {
-        srv_instance_.sendTo(client, "CAP * LS :\r\n");
+    } else if (subcommand == "LS") {
+        srv_instance_.sendTo(client, "CAP " + nick + " LS :" + capability_names(CAP_ALL_MASK) + "\r\n");
+    } else if (subcommand == "LIST") {
+        srv_instance_.sendTo(client, "CAP " + nick + " LIST :" + capability_names(user.get_caps()) + "\r\n");
+    } else if (subcommand == "REQ") {
+        if (!args.empty() && args[0] == ':') args = args.substr(1);
+        uint32_t    caps = user.get_caps();
+        bool        known = !args.empty();
+        string      requested = args;
+        while (known && !requested.empty()) {
+            string          name = split_off_before_del(requested, ' ');
+            if (name.empty()) continue;
+            const bool      remove = name[0] == '-';
+            const uint32_t  bit = capability_bit(remove ? name.substr(1) : name);
+            known = bit != 0;
+            caps = remove ? caps & ~bit : caps | bit;
+        }
+        if (known) user.set_caps(caps);
+        srv_instance_.sendTo(client, "CAP " + nick + (known ? " ACK :" : " NAK :") + args + "\r\n");
+    } else {
+        srv_instance_.sendTo(client, ":" + server_name_ + " " + ERR_INVALIDCAPCMD + " " + nick + " " + subcommand + " :Invalid CAP command\r\n");
     }
     if (!user.is_logged_in()) {
         try_to_log_in(user ,client);
@@ -170,7 +329,7 @@ void    SrvMgr::process_nick(const string& s, const MPlexServer::Client& client,
 	} else {
 		new_nick = s;
  }
-    if (server_nicks_.find(new_nick) != server_nicks_.end()) {
+    if (nick_exists(new_nick)) {
         srv_instance_.sendTo(client, ":" + server_name_ + " " + ERR_NICKNAMEINUSE + " " + old_nick + " " + new_nick + " :Nickname is already in use\r\n");
     } else {
         change_nick(new_nick, old_nick, user);
@@ -178,6 +337,7 @@ void    SrvMgr::process_nick(const string& s, const MPlexServer::Client& client,
             string msg = ":" + old_signature + " NICK :" + new_nick;
             cout << msg << endl;
             srv_instance_.sendTo(client, msg + "\r\n");
+            propagate(msg);
         }
     }
     if (!user.is_logged_in()) {
@@ -194,19 +354,21 @@ void    SrvMgr::process_user(string s, const MPlexServer::Client& client, User&
     }
 
     string username = split_off_before_del(s, ' ');
-    string hostname = split_off_before_del(s, ' ');
+    string mode = split_off_before_del(s, ' ');     // the host comes from the connection, see onConnect
+    split_off_before_del(s, ' ');                   // unused
+    string realname = !s.empty() && s[0] == ':' ? s.substr(1) : s;
 
-    if (username.empty() || hostname.empty()) {
+    if (username.empty() || mode.empty()) {
         srv_instance_.sendTo(client, ":" + server_name_ + " " + ERR_NEEDMOREPARAMS + " * " + ":Not enough parameters for user registration\r\n");
         srv_instance_.sendTo(client, ":" + server_name_ + " " + ERR_NOTREGISTERED + " * " + ":You have not registered\r\n");
         return ;
     }
 
     user.set_username(username);
-    user.set_hostname(hostname);
+    user.set_realname(realname);
 
     cout << "process_user: username: " << username
-        << ", hostname: " << hostname << endl;
+        << ", hostname: " << user.get_hostname() << endl;
     if (!user.is_logged_in()) {
         try_to_log_in(user ,client);
     }
@@ -215,7 +377,7 @@ void    SrvMgr::process_user(string s, const MPlexServer::Client& client, User&
     if (!user.password_provided()) {
         srv_instance_.sendTo(client, ":" + server_name_ + " " + ERR_PASSWDMISMATCH + " * " + ":Password incorrect\r\n");
         srv_instance_.sendTo(client, ":" + server_name_ + " " + ERR_NOTREGISTERED + " * " + ":You have not registered\r\n");
-        srv_instance_.sendTo(client, "ERROR :Closing Link: " + client.getIpv4() + " (Password incorrect)\r\n");
+        srv_instance_.sendTo(client, "ERROR :Closing Link: " + string(client.getPeer()) + " (Password incorrect)\r\n");
         srv_instance_.disconnectClient(client);
     }
 }
@@ -266,9 +428,13 @@ void    SrvMgr::process_kick(std::string s, const MPlexServer::Client& client, U
         return;
     }
 
-    // Compose KICK message
-    string kick_msg = ":" + user.get_signature() + " KICK " + chan_name + " " + target_nick + " :" + (message.empty() ? user.get_nickname() : message) + "\r\n";
-    send_to_chan_all(channel, kick_msg);
+    // Compose KICK message. The kicked user gets it as a reply, ahead of the channel traffic
+    // still queued for it; the other members keep their order and get it behind that traffic.
+    string kick_msg = ":" + user.get_signature() + " KICK " + chan_name + " " + target_nick + " :" + (message.empty() ? user.get_nickname() : message);
+    OutboundTags    tags(server_time_, msgids_);
+    send_tagged(channel.get_chan_nicks(), target_nick, kick_msg, tags);
+    send_to_one(target_nick, kick_msg, tags);
+    propagate(kick_msg);
 
     // Remove user from channel
     remove_user_from_channel(channel, target_nick);
@@ -300,7 +466,7 @@ void    SrvMgr::process_part(string s, const MPlexServer::Client& client, User&
     }
 
     string  message = ":" + user.get_signature() + " PART " + chan_name + " " + reason;
-    send_to_chan_all(channel, message);
+    send_to_chan_and_links(channel, message);
     remove_user_from_channel(channel, nick);
 }
 
@@ -316,32 +482,92 @@ void    SrvMgr::process_privmsg(std::string s, const MPlexServer::Client& client
         return ;
     }
 
+    // client-only tags go to message-tags clients here; links do not carry tags
+    OutboundTags    tags(server_time_, msgids_, relayed_client_tags(current_tags_));
     if (target[0] != '#' && target[0] != '&') {
-        if (server_nicks_.find(target) == server_nicks_.end()) {
+        if (!nick_exists(target)) {
             string err_msg = ":" + server_name_ + " " + ERR_NOSUCHNICK + " " + nick + " " + target + " :No such nick";
             send_to_one(user, err_msg);
             return ;
         } else {
+            // the target is either ours or behind one of the links
             message = ":" + user.get_signature() + " PRIVMSG " + target + " " + message;
-            send_to_one(target, message);
+            send_to_one(target, message, tags);
+            send_to_remote(target, message);
         }
     } else {
-        auto    chan_it = server_channels_.find(target);
-        if (chan_it == server_channels_.end()) {
-            string err_msg = ":" + server_name_ + " " + ERR_NOSUCHCHANNEL + " " + nick + " " + target + " :No such channel";
+        Channel*    channel = channel_to_speak_in(target, user);
+        if (channel == nullptr) {
+            return ;
+        }
+        if (plugins_.channel_message(user, *channel, std::string_view(message).substr(message[0] == ':')) == Verdict::DROP) {
+            return ;
+        }
+        message = ":" + user.get_signature() + " PRIVMSG " + target + " " + message;
+        send_tagged(channel->get_chan_nicks(), nick, message, tags);
+        route_to_channel(*channel, message);
+        record_history(target, message, tags);
+    }
+    // same tags as the recipients got, so the client can match its message by msgid
+    if (user.get_caps() & CAP_ECHO_MESSAGE) {
+        send_to_one(user, tags.prefix(user.get_caps()) + message);
+    }
+}
+
+// TAGMSG <target>
+// Carries only tags (typing notifications, reactions), so it goes to local clients with message-tags only.
+void    SrvMgr::process_tagmsg(std::string s, const MPlexServer::Client& client, User& user) {
+    (void)  client;
+    string  target = split_off_before_del(s, ' ');
+    string  nick = user.get_nickname();
+
+    if (target.empty()) {
+        string err_msg = ":" + server_name_ + " " + ERR_NEEDMOREPARAMS + " " + nick + " TAGMSG :Not enough parameters";
+        send_to_one(user, err_msg);
+        return ;
+    }
+    OutboundTags    tags(server_time_, msgids_, relayed_client_tags(current_tags_));
+    string          message = ":" + user.get_signature() + " TAGMSG " + target;
+    if (target[0] != '#' && target[0] != '&') {
+        if (!nick_exists(target)) {
+            string err_msg = ":" + server_name_ + " " + ERR_NOSUCHNICK + " " + nick + " " + target + " :No such nick";
             send_to_one(user, err_msg);
             return ;
-        } else {
-            Channel& channel = chan_it->second;
-            if (channel.get_chan_nicks().find(nick) == channel.get_chan_nicks().end()) {
-                string err_msg = ":" + server_name_ + " " + ERR_NOTONCHANNEL + " " + nick + " " + target + " :You're not on that channel";
-                send_to_one(user, err_msg);
-                return ;
-            }
-            message = ":" + user.get_signature() + " PRIVMSG " + target + " " + message;
-            send_to_chan_all_but_one(channel, message, nick);
         }
+        send_to_one(target, message, tags, true);
+    } else {
+        Channel*    channel = channel_to_speak_in(target, user);
+        if (channel == nullptr) {
+            return ;
+        }
+        send_tagged(channel->get_chan_nicks(), nick, message, tags, true);
+    }
+    if ((user.get_caps() & CAP_ECHO_MESSAGE) && (user.get_caps() & CAP_MESSAGE_TAGS)) {
+        send_to_one(user, tags.prefix(user.get_caps()) + message);
+    }
+}
+
+Channel*    SrvMgr::channel_to_speak_in(const std::string& target, User& user) {
+    string  nick = user.get_nickname();
+    auto    chan_it = server_channels_.find(target);
+    if (chan_it == server_channels_.end()) {
+        string err_msg = ":" + server_name_ + " " + ERR_NOSUCHCHANNEL + " " + nick + " " + target + " :No such channel";
+        send_to_one(user, err_msg);
+        return nullptr;
     }
+    Channel& channel = chan_it->second;
+    if (channel.get_chan_nicks().find(nick) == channel.get_chan_nicks().end()) {
+        string err_msg = ":" + server_name_ + " " + ERR_NOTONCHANNEL + " " + nick + " " + target + " :You're not on that channel";
+        send_to_one(user, err_msg);
+        return nullptr;
+    }
+    // banned members may stay but not speak; users behind a link are checked by their own server
+    if (user.get_client().getFd() != -1 && !channel.has_chan_op(nick) && check_masks(target, channel, user).banned) {
+        string err_msg = ":" + server_name_ + " " + ERR_CANNOTSENDTOCHAN + " " + nick + " " + target + " :Cannot send to channel (+b)";
+        send_to_one(user, err_msg);
+        return nullptr;
+    }
+    return &channel;
 }
 // TOPIC <channel> [<topic>]
 // If topic is not given, return current topic. 
@@ -396,8 +622,10 @@ void    SrvMgr::process_topic(std::string s, const MPlexServer::Client& client,
     // Set new topic and notify all users in the channel
     channel.set_channel_topic(new_topic);
     channel.set_topic_setter(user.get_username());
+    channel.set_topic_set_time();
+    mark_channel_dirty(chan_name);
     string topic_set_msg = ":" + user.get_signature() + " TOPIC " + chan_name + " :" + new_topic;
-    send_to_chan_all(channel, topic_set_msg);
+    send_to_chan_and_links(channel, topic_set_msg);
 }
 
 void    SrvMgr::process_mode(std::string s, const MPlexServer::Client& client, User& user) {
@@ -406,8 +634,8 @@ void    SrvMgr::process_mode(std::string s, const MPlexServer::Client& client, U
 
     string  target = split_off_before_del(s, ' ');          // must be a channel (as per the subject file)
     string  modestring = split_off_before_del(s, ' ');      // +-itkol
-    string  mode_arguments = s;                                 // only for +kol-o
-    char    plusminus;
+    string  mode_arguments = s;                                 // only for +kolbeI-obeI
+    char    plusminus = '+';
 
     auto it = server_channels_.find(target);
     if (it == server_channels_.end()) {
@@ -425,17 +653,20 @@ void    SrvMgr::process_mode(std::string s, const MPlexServer::Client& client, U
         return ;
     }
 
-    if (!channel.has_chan_op(user.get_nickname())) {
+    // "MODE #chan b" lists the bans, which anyone may do
+    const bool  list_query = mode_arguments.empty() && modestring.find_first_not_of("+-beI") == string::npos;
+    if (!list_query && !channel.has_chan_op(user.get_nickname())) {
         string  err_msg = ":" + server_name_ + " " + ERR_CHANOPRIVSNEEDED + " " + user.get_nickname() + " " + target + " :You're not a channel operator";
         send_to_one(user.get_nickname(), err_msg);
         return ;
     }
 
-    if (modestring[0] != '-' && modestring[0] != '+') {
+    if (!list_query && modestring[0] != '-' && modestring[0] != '+') {
         string  err_msg = ":" + server_name_ + " " + ERR_NEEDMOREPARAMS + " " + user.get_nickname() + " MODE :Not enough parameters";
         send_to_one(user.get_nickname(), err_msg);
         return ;
     }
+    if (!list_query) mark_channel_dirty(target);
     for (char m : modestring) {
         if (m == '-') plusminus = m;
         else if (m == '+') plusminus = m;
@@ -444,6 +675,7 @@ void    SrvMgr::process_mode(std::string s, const MPlexServer::Client& client, U
         else if (m == 'k') mode_k(plusminus, mode_arguments, channel, user);
         else if (m == 'o') mode_o(plusminus, mode_arguments, channel, user);
         else if (m == 'l') mode_l(plusminus, mode_arguments, channel, user);
+        else if (m == 'b' || m == 'e' || m == 'I') mode_list(m, plusminus, mode_arguments, channel, user);
         else {
             string  err_msg = ":" + server_name_ + " " + ERR_UMODEUNKNOWNFLAG + " " + user.get_nickname() + " :Unknown MODE flag";
             send_to_one(user.get_nickname(), err_msg);
@@ -484,12 +716,16 @@ void    SrvMgr::process_invite(std::string s, const MPlexServer::Client &client,
         send_to_one(user.get_nickname(), err_msg);
         return ;
     }
-    User& target_user = server_users_.find(server_nicks_.find(target_nick)->second)->second;
-    target_user.add_invitation(target_chan);
+    auto    target_it = server_nicks_.find(target_nick);
+    if (target_it != server_nicks_.end()) {
+        find_user(target_it->second)->add_invitation(target_chan);
+    }
     string  msg = ":" + server_name_ + " " + RPL_INVITING + " " + user.get_nickname() + " " + target_nick + " " + target_chan;
     send_to_one(user.get_nickname(), msg);
     msg = ":" + user.get_signature() + " INVITE " + target_nick + " " + target_chan;
     send_to_one(target_nick, msg);
+    // a remote target's server records the invitation when this arrives
+    send_to_remote(target_nick, msg);
 }
 
 void    SrvMgr::process_quit(string s, const MPlexServer::Client &client, User& user) {
@@ -503,7 +739,179 @@ void    SrvMgr::pong(const string &s, const MPlexServer::Client &client, const U
         send_to_one(user.get_nickname(), err_msg);
         return ;
     }
-    string nick = server_users_[client.getFd()].get_nickname();
     srv_instance_.sendTo(client, ":" + server_name_ + " PONG " + server_name_ + " " + s + "\r\n");
     cout << ":" + server_name_ + " PONG " + server_name_ + " :" + s << endl;
-}
\ No newline at end of file
+}
+// CHATHISTORY LATEST <target> <* | timestamp=...> <limit>
+// CHATHISTORY BEFORE|AFTER <target> <timestamp=...> <limit>
+void    SrvMgr::process_chathistory(std::string s, const MPlexServer::Client& client, User& user) {
+    (void)  client;
+    string  subcommand = split_off_before_del(s, ' ');
+    string  target = split_off_before_del(s, ' ');
+    string  reference = split_off_before_del(s, ' ');
+    string  limit_str = split_off_before_del(s, ' ');
+
+    if (!history_enabled_) {
+        send_to_one(user, "FAIL CHATHISTORY MESSAGE_ERROR " + subcommand + " " + target + " :History is not enabled on this server");
+        return ;
+    }
+    if (subcommand != "LATEST" && subcommand != "BEFORE" && subcommand != "AFTER") {
+        send_to_one(user, "FAIL CHATHISTORY INVALID_PARAMS " + subcommand + " :Supported: LATEST, BEFORE, AFTER");
+        return ;
+    }
+    int64_t reference_ms = -1;
+    const bool  any = subcommand == "LATEST" && reference == "*";
+    if (!any && !ChannelHistory::parse_timestamp(reference, reference_ms)) {
+        send_to_one(user, "FAIL CHATHISTORY INVALID_MSGREFTYPE " + subcommand + " " + reference + " :Use * or timestamp=");
+        return ;
+    }
+    const int   limit = atoi(limit_str.c_str());
+    if (limit <= 0) {
+        send_to_one(user, "FAIL CHATHISTORY INVALID_PARAMS " + subcommand + " " + limit_str + " :Invalid limit");
+        return ;
+    }
+    auto    chan_it = server_channels_.find(target);
+    if (chan_it == server_channels_.end() || !chan_it->second.has_chan_member(user.get_nickname())) {
+        send_to_one(user, "FAIL CHATHISTORY INVALID_TARGET " + subcommand + " " + target + " :You're not on that channel");
+        return ;
+    }
+    auto    history_it = channel_history_.find(target);
+    std::vector<HistoryLine>    lines;
+    if (history_it != channel_history_.end()) {
+        const int64_t   now_ms = ChannelHistory::now_ms();
+        const size_t    max_lines = std::min(limit, CHATHISTORY_MAX_LIMIT);
+        ChannelHistory& history = history_it->second;
+        if (subcommand == "LATEST") {
+            lines = history.latest(now_ms, max_lines, reference_ms);
+        } else if (subcommand == "BEFORE") {
+            lines = history.before(now_ms, reference_ms, max_lines);
+        } else {
+            lines = history.after(now_ms, reference_ms, max_lines);
+        }
+    }
+    // a batch client learns that there is nothing from the empty batch
+    send_history(user, target, lines, true);
+}
+
+// LIST [<mask>|>n|<n>[,...]]; the reply is generated while the client's socket drains
+void    SrvMgr::process_list(std::string s, const MPlexServer::Client& client, User& user) {
+    srv_instance_.attachGenerator(client, std::make_unique<ChannelList>(server_channels_, server_name_, user.get_nickname(), ListFilter::parse(s)));
+}
+
+std::string SrvMgr::export_state() const {
+    MPlexServer::StateWriter    out;
+    std::vector<MPlexServer::Client>    clients = srv_instance_.getClients();
+
+    out.u32(static_cast<uint32_t>(clients.size()));
+    for (const MPlexServer::Client& client : clients) {
+        const User* user = find_user(client.getFd());
+        // server links are re-established after the upgrade, the network state behind them is gone
+        if (user != nullptr && user->get_link_state() != LinkState::NONE) user = nullptr;
+        out.u32(static_cast<uint32_t>(client.getFd()));
+        out.u8(user != nullptr);
+        if (user != nullptr) {
+            user->serialize(out);
+        }
+    }
+    out.u32(static_cast<uint32_t>(server_channels_.size()));
+    for (const auto& [chan_name, channel] : server_channels_) {
+        channel.serialize(out);
+    }
+    return out.data();
+}
+
+void SrvMgr::import_state(const std::string& state) {
+    MPlexServer::StateReader    in(state);
+
+    for (uint32_t n = in.u32(); n > 0; --n) {
+        const int   old_fd = static_cast<int>(in.u32());
+        if (!in.u8()) {
+            srv_instance_.disconnectClient(srv_instance_.importedClient(old_fd));
+            continue;
+        }
+        MPlexServer::Client client = srv_instance_.importedClient(old_fd);
+        User*       user = new User(client);
+        user->deserialize(in);
+        if (client.getFd() == -1) {
+            delete user;
+            continue;
+        }
+        srv_instance_.setUserData(client, user);
+        if (!user->get_nickname().empty()) {
+            server_nicks_[user->get_nickname()] = client.getFd();
+        }
+        // lookups still running in the old process are not carried over, so they no longer hold registration
+        if (!user->is_logged_in()) {
+            try_to_log_in(*user, client);
+        }
+    }
+    for (uint32_t n = in.u32(); n > 0; --n) {
+        Channel channel;
+        channel.deserialize(in);
+        string  chan_name = channel.get_channel_name();
+        server_channels_[chan_name] = channel;
+        recovered_channels_.erase(chan_name);
+    }
+    // members whose connection did not survive the upgrade (TLS sessions are not carried over)
+    std::vector<string> keys;
+    for (const auto& pair : server_channels_) {
+        keys.push_back(pair.first);
+    }
+    for (const auto& key : keys) {
+        Channel& channel = server_channels_[key];
+        for (string nick : channel.get_chan_nicks()) {
+            if (server_nicks_.find(nick) == server_nicks_.end()) {
+                remove_user_from_channel(channel, nick);
+                if (server_channels_.find(key) == server_channels_.end()) break;
+            }
+        }
+    }
+    cout << "[UPGRADE] Restored " << server_nicks_.size() << " users and " << server_channels_.size() << " channels" << endl;
+}
+
+size_t SrvMgr::users_footprint() const {
+    size_t  bytes = server_nicks_.bucket_count() * sizeof(void*);
+    for (const auto& [nick, fd] : server_nicks_) {
+        // node: next pointer, key, value, cached hash
+        bytes += sizeof(void*) + sizeof(nick) + sizeof(fd) + sizeof(size_t);
+        if (nick.capacity() > std::string().capacity()) bytes += nick.capacity() + 1;
+    }
+    for (const MPlexServer::Client& client : srv_instance_.getClients()) {
+        if (const User* user = find_user(client.getFd())) bytes += user->footprint();
+    }
+    return bytes;
+}
+
+void SrvMgr::enable_history(const HistoryLimits& limits) {
+    history_enabled_ = true;
+    history_limits_ = limits;
+    cout << "[HISTORY] Keeping up to " << limits.lines << " lines / " << limits.bytes << " bytes / "
+         << limits.max_age_ms / 1000 << "s per channel, " << limits.join_replay << " replayed on join" << endl;
+}
+
+bool SrvMgr::enable_channel_log(const std::string& path_prefix) {
+    const auto  start = std::chrono::steady_clock::now();
+    if (!channel_log_.open(path_prefix, recovered_channels_)) {
+        return false;
+    }
+    // reopened after a failed upgrade: the live channels are newer than their records
+    for (const auto& [chan_name, channel] : server_channels_) {
+        recovered_channels_.erase(chan_name);
+    }
+    const auto  elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    cout << "[CHANLOG] Recovered " << recovered_channels_.size() << " channels in " << elapsed.count() << "us" << endl;
+    return true;
+}
+
+void SrvMgr::release_channel_log() {
+    if (!channel_log_.is_open()) return;
+    flush_channel_log();
+    channel_log_.close();
+}
+
+bool SrvMgr::load_plugin(const std::string& path) {
+    return plugins_.load(path);
+}
+
+// the event loop is compiled here, next to the handlers it calls
+template class MPlexServer::BasicServer<SrvMgr>;
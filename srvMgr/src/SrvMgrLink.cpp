@@ -0,0 +1,557 @@
+// Server-to-server links: several ircserv instances form one network.
+//
+// Links are regular connections on the client port that open with
+// "SERVER <name> <password>"; the side that connected out (IRC_LINKS) sends it
+// first, the other side answers with its own SERVER line and both send a burst
+// of everything they know. Links form a spanning tree: a line is never sent
+// back to the link it came from and a server name that is already known
+// closes the link that introduced it.
+//
+// Lines on a link always carry a prefix. Client commands keep the client form
+// (":nick!user@host PRIVMSG #chan :text") and run through the usual process_*
+// handlers on behalf of the remote user; network state uses server lines:
+//   :<uplink> SERVER <name>
+//   :<server> UNICK <nick> <user> <host>
+//   :<server> SJOIN <chan> <ts> <+modes> <key|*> <limit> :[@]nick ...
+//   :<server> STOPIC <chan> <setter> <ts> :<topic>
+//   :<server> SMASK <chan> <b|e|I> <mask> <setter> <ts>
+//   :<server> SQUIT <name> :<reason>
+//   :<server> KILL <nick> :<reason>
+// State changes go to every link, channel messages only to links with members.
+
+#include <algorithm>
+
+#include "mplexserver.h"
+#include "Channel.h"
+#include "IRC_macros.h"
+#include "SrvMgr.h"
+#include "User.h"
+#include "utils.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+
+namespace {
+    bool    same_client(const MPlexServer::Client& a, const MPlexServer::Client& b) {
+        return a.getFd() == b.getFd() && a.getGeneration() == b.getGeneration();
+    }
+
+    string  strip_colon(const string& s) {
+        return !s.empty() && s[0] == ':' ? s.substr(1) : s;
+    }
+}
+
+void    SrvMgr::enable_links(const std::string& link_password, const std::vector<LinkTarget>& targets) {
+    link_password_ = link_password;
+    link_targets_ = targets;
+    cout << "[LINK] Linking enabled as " << server_name_ << ", " << link_targets_.size() << " autoconnect targets" << endl;
+}
+
+void    SrvMgr::maintain_links() {
+    const auto  now = std::chrono::steady_clock::now();
+    for (LinkTarget& target : link_targets_) {
+        if (target.client.getFd() != -1 || now < target.next_attempt) continue;
+        target.next_attempt = now + std::chrono::seconds(LINK_RETRY_INTERVAL);
+        try {
+            target.client = srv_instance_.connectTo(target.ipv4, target.port);
+        } catch (std::exception &e) {
+            std::cerr << "[LINK] " << target.ipv4 << ":" << target.port << ": " << e.what() << endl;
+        }
+    }
+}
+
+bool    SrvMgr::start_link(const MPlexServer::Client& client, User& user) {
+    for (const LinkTarget& target : link_targets_) {
+        if (!same_client(target.client, client)) continue;
+        cout << "[LINK] Connected to " << target.ipv4 << ":" << target.port << ", sending SERVER" << endl;
+        srv_instance_.setFloodExempt(client, true);
+        srv_instance_.setSendQLimit(client, LINK_SENDQ_MAX);
+        user.set_link_state(LinkState::HANDSHAKE_SENT);
+        srv_instance_.sendLine(client, "SERVER " + server_name_ + " " + link_password_);
+        return true;
+    }
+    return false;
+}
+
+// SERVER <name> <password>
+void    SrvMgr::process_server(std::string s, const MPlexServer::Client& client, User& user) {
+    string  name = split_off_before_del(s, ' ');
+    string  password = s;
+
+    string  error;
+    if (link_password_.empty() || user.is_logged_in()) {
+        error = "Server linking is not enabled";
+    } else if (password != link_password_) {
+        error = "Bad link password";
+    } else if (name.empty() || name == server_name_ || servers_.find(name) != servers_.end()) {
+        error = "Server " + name + " already linked";
+    }
+    if (!error.empty()) {
+        cout << "[LINK] Refused " << name << ": " << error << endl;
+        srv_instance_.sendLine(client, "ERROR :Closing Link: " + string(client.getPeer()) + " (" + error + ")");
+        srv_instance_.disconnectClient(client);
+        return ;
+    }
+    if (user.get_link_state() == LinkState::NONE) {
+        srv_instance_.setFloodExempt(client, true);
+        srv_instance_.setSendQLimit(client, LINK_SENDQ_MAX);
+        srv_instance_.sendLine(client, "SERVER " + server_name_ + " " + link_password_);
+    }
+    user.set_link_state(LinkState::ESTABLISHED);
+    user.set_link_name(name);
+    servers_[name] = LinkedServer{server_name_, client};
+    cout << "[LINK] Linked with " << name << endl;
+
+    link_origin_ = client;
+    propagate(":" + server_name_ + " SERVER " + name);
+    link_origin_ = MPlexServer::Client();
+    send_burst(client);
+}
+
+void    SrvMgr::send_burst(const MPlexServer::Client& link) {
+    // servers in tree order, so every uplink is known before the servers behind it
+    std::unordered_set<string>  introduced{server_name_};
+    for (const auto& [name, server] : servers_) {
+        if (same_client(server.link, link)) introduced.insert(name);
+    }
+    for (bool progress = true; progress; ) {
+        progress = false;
+        for (const auto& [name, server] : servers_) {
+            if (introduced.count(name) || !introduced.count(server.uplink)) continue;
+            srv_instance_.sendLine(link, ":" + server.uplink + " SERVER " + name);
+            introduced.insert(name);
+            progress = true;
+        }
+    }
+    for (const auto& [nick, fd] : server_nicks_) {
+        User* user = find_user(fd);
+        if (user == nullptr || !user->is_logged_in()) continue;
+        srv_instance_.sendLine(link, ":" + server_name_ + " UNICK " + nick + " " + user->get_username() + " " + user->get_hostname());
+    }
+    for (const auto& [nick, remote] : remote_users_) {
+        srv_instance_.sendLine(link, ":" + remote.server + " UNICK " + nick + " " + remote.username + " " + remote.hostname);
+    }
+    for (auto& [chan_name, channel] : server_channels_) {
+        for (const string& line : sjoin_lines(channel)) {
+            srv_instance_.sendLine(link, line);
+        }
+        if (channel.get_channel_topic() != ":") {
+            srv_instance_.sendLine(link, ":" + server_name_ + " STOPIC " + chan_name + " " + channel.get_topic_setter() + " "
+                + channel.get_topic_set_time() + " :" + channel.get_channel_topic());
+        }
+        for (const string& line : smask_lines(chan_name, channel)) {
+            srv_instance_.sendLine(link, line);
+        }
+    }
+    cout << "[LINK] Burst sent: " << introduced.size() - 1 << " servers, " << server_nicks_.size() + remote_users_.size()
+         << " users, " << server_channels_.size() << " channels" << endl;
+}
+
+std::vector<std::string>    SrvMgr::sjoin_lines(Channel& channel) const {
+    string  modes = "+";
+    if (channel.needs_invite()) modes += "i";
+    if (channel.topic_protected()) modes += "t";
+    const string key = channel.get_key().empty() ? "*" : channel.get_key();
+    const string head = ":" + server_name_ + " SJOIN " + channel.get_channel_name() + " " + std::to_string(channel.get_creation_ts()) + " "
+        + modes + " " + key + " " + std::to_string(channel.get_member_limit()) + " :";
+
+    std::vector<string> lines;
+    string  members;
+    int     count = 0;
+    for (const string& nick : channel.get_chan_nicks()) {
+        members += (channel.has_chan_op(nick) ? "@" : "") + nick + " ";
+        if (++count == LINK_SJOIN_CHUNK) {
+            lines.push_back(head + members);
+            members.clear();
+            count = 0;
+        }
+    }
+    if (!members.empty()) {
+        lines.push_back(head + members);
+    }
+    return lines;
+}
+
+std::vector<std::string>    SrvMgr::smask_lines(const std::string& chan_name, const Channel& channel) const {
+    std::vector<string> lines;
+    for (const char list : {'b', 'e', 'I'}) {
+        for (const MaskEntry& entry : channel.get_masks(list)) {
+            lines.push_back(":" + server_name_ + " SMASK " + chan_name + " " + list + " " + entry.mask + " "
+                + entry.setter + " " + std::to_string(entry.set_time));
+        }
+    }
+    return lines;
+}
+
+void    SrvMgr::process_link_message(const std::string& line, const MPlexServer::Client& client, User& user) {
+    string  rest = line;
+    strip_trailing_rn(rest);
+    if (rest.empty() || rest[0] != ':') {
+        cout << "[LINK] " << user.get_link_name() << ": " << rest << endl;
+        return ;
+    }
+    const string    prefix = split_off_before_del(rest, ' ').substr(1);
+    const string    command = split_off_before_del(rest, ' ');
+    const string    full_line = ":" + prefix + " " + command + " " + rest;
+
+    link_origin_ = client;
+    if (prefix.find('!') != string::npos) {
+        process_remote_command(prefix, command, rest, full_line);
+    } else if (command == "SERVER") {
+        remote_server(prefix, rest, full_line);
+    } else if (command == "UNICK") {
+        remote_unick(prefix, rest, full_line);
+    } else if (command == "SJOIN") {
+        remote_sjoin(rest, full_line);
+    } else if (command == "STOPIC") {
+        remote_stopic(prefix, rest, full_line);
+    } else if (command == "SMASK") {
+        remote_smask(prefix, rest, full_line);
+    } else if (command == "SQUIT") {
+        remote_squit(rest, full_line);
+    } else if (command == "KILL") {
+        remote_kill(rest, full_line);
+    } else {
+        cout << "[LINK] Unknown server command from " << user.get_link_name() << ": " << command << endl;
+    }
+    link_origin_ = MPlexServer::Client();
+}
+
+void    SrvMgr::process_remote_command(const std::string& prefix, std::string command, std::string args, const std::string& line) {
+    const string    nick = prefix.substr(0, prefix.find('!'));
+    auto            remote_it = remote_users_.find(nick);
+    if (remote_it == remote_users_.end()) {
+        cout << "[LINK] Dropping " << command << " from unknown user " << nick << endl;
+        return ;
+    }
+    // the usual handlers act on behalf of the remote user; their error replies go nowhere
+    MPlexServer::Client none;
+    User    user(none);
+    user.set_nickname(nick);
+    user.set_username(remote_it->second.username);
+    user.set_hostname(remote_it->second.hostname);
+    user.set_as_logged_in(true);
+
+    const int   type = get_msg_type(command);
+    switch (type) {
+        case cmdType::JOIN:
+            remote_join(nick, prefix, args);
+            break;
+        case cmdType::PART:
+            process_part(args, none, user);
+            break;
+        case cmdType::PRIVMSG:
+            process_privmsg(args, none, user);
+            break;
+        case cmdType::TOPIC:
+            process_topic(args, none, user);
+            break;
+        case cmdType::MODE:
+            process_mode(args, none, user);
+            break;
+        case cmdType::INVITE:
+            process_invite(args, none, user);
+            break;
+        case cmdType::KICK:
+            process_kick(args, none, user);
+            break;
+        case cmdType::NICK:
+            remote_nick(nick, prefix, args, line);
+            break;
+        case cmdType::QUIT:
+            remove_remote_user(nick, strip_colon(args));
+            propagate(line);
+            break;
+        default:
+            cout << "[LINK] Unknown command from " << nick << ": " << command << endl;
+    }
+}
+
+// :<uplink> SERVER <name>
+void    SrvMgr::remote_server(const std::string& uplink, const std::string& args, const std::string& line) {
+    const string name = args;
+    if (name == server_name_ || servers_.find(name) != servers_.end()) {
+        // a second path to a known server would close a cycle
+        cout << "[LINK] Loop detected, " << name << " is already known; closing link" << endl;
+        srv_instance_.sendLine(link_origin_, "ERROR :Closing Link: " + server_name_ + " (Server " + name + " already exists)");
+        srv_instance_.disconnectClient(link_origin_);
+        return ;
+    }
+    servers_[name] = LinkedServer{uplink, link_origin_};
+    cout << "[LINK] " << name << " joined the network behind " << uplink << endl;
+    propagate(line);
+}
+
+// :<server> UNICK <nick> <user> <host>
+void    SrvMgr::remote_unick(const std::string& server, std::string args, const std::string& line) {
+    string  nick = split_off_before_del(args, ' ');
+    string  username = split_off_before_del(args, ' ');
+    string  hostname = args;
+
+    if (nick_exists(nick)) {
+        // both registered the nick while apart: neither of them keeps it
+        cout << "[LINK] Nick collision on " << nick << endl;
+        kill_nick(nick, "Nick collision");
+        propagate(":" + server_name_ + " KILL " + nick + " :Nick collision", true);
+        return ;
+    }
+    remote_users_[nick] = RemoteUser{username, hostname, server, link_origin_};
+    propagate(line);
+}
+
+// :<server> SJOIN <chan> <ts> <+modes> <key|*> <limit> :[@]nick ...
+// The older channel wins: a lower timestamp replaces our settings and operators,
+// a higher one keeps ours and joins its members without operator status.
+void    SrvMgr::remote_sjoin(std::string args, const std::string& line) {
+    string  chan_name = split_off_before_del(args, ' ');
+    const std::time_t ts = std::atol(split_off_before_del(args, ' ').c_str());
+    string  modes = split_off_before_del(args, ' ');
+    string  key = split_off_before_del(args, ' ');
+    const int limit = std::atoi(split_off_before_del(args, ' ').c_str());
+    string  members = strip_colon(args);
+
+    auto    chan_it = server_channels_.find(chan_name);
+    bool    adopt = false;
+    bool    accept_ops = true;
+    if (chan_it == server_channels_.end()) {
+        recovered_channels_.erase(chan_name);
+        chan_it = server_channels_.emplace(chan_name, Channel(chan_name, ts)).first;
+        adopt = true;
+    } else if (ts < chan_it->second.get_creation_ts()) {
+        adopt = true;
+        for (const string& op : chan_it->second.get_chan_ops()) {
+            chan_it->second.remove_operator(op);
+            send_to_chan_all(chan_it->second, ":" + server_name_ + " MODE " + chan_name + " -o " + op);
+        }
+    } else if (ts > chan_it->second.get_creation_ts()) {
+        accept_ops = false;
+    }
+    Channel&    channel = chan_it->second;
+    if (adopt) {
+        channel.set_creation_ts(ts);
+        channel.set_needs_invite(modes.find('i') != string::npos);
+        channel.set_topic_protected(modes.find('t') != string::npos);
+        channel.set_key(key == "*" ? "" : key);
+        channel.set_member_limit(limit);
+        mark_channel_dirty(chan_name);
+    }
+    while (!members.empty()) {
+        string  nick = split_off_before_del(members, ' ');
+        const bool op = !nick.empty() && nick[0] == '@';
+        if (op) nick = nick.substr(1);
+        auto    remote_it = remote_users_.find(nick);
+        if (remote_it == remote_users_.end()) continue;
+        if (!channel.has_chan_member(nick)) {
+            channel.add_nick(nick);
+            const RemoteUser& remote = remote_it->second;
+            send_join(channel, nick, nick + "!" + remote.username + "@" + remote.hostname, "");
+        }
+        if (op && accept_ops && !channel.has_chan_op(nick)) {
+            channel.add_operator(nick);
+            send_to_chan_all(channel, ":" + server_name_ + " MODE " + chan_name + " +o " + nick);
+            mark_channel_dirty(chan_name);
+        }
+    }
+    propagate(line);
+}
+
+// :<server> STOPIC <chan> <setter> <ts> :<topic>
+void    SrvMgr::remote_stopic(const std::string& server, std::string args, const std::string& line) {
+    string  chan_name = split_off_before_del(args, ' ');
+    string  setter = split_off_before_del(args, ' ');
+    const std::time_t ts = std::atol(split_off_before_del(args, ' ').c_str());
+    string  topic = strip_colon(args);
+
+    auto    chan_it = server_channels_.find(chan_name);
+    if (chan_it != server_channels_.end()) {
+        Channel& channel = chan_it->second;
+        if (channel.get_channel_topic() == ":" || ts > channel.get_topic_set_ts()) {
+            channel.set_channel_topic(topic);
+            channel.set_topic_setter(setter);
+            channel.set_topic_set_time(ts);
+            mark_channel_dirty(chan_name);
+            send_to_chan_all(channel, ":" + server + " TOPIC " + chan_name + " :" + topic);
+        }
+    }
+    propagate(line);
+}
+
+// :<server> SMASK <chan> <b|e|I> <mask> <setter> <ts>, lists are merged on link
+void    SrvMgr::remote_smask(const std::string& server, std::string args, const std::string& line) {
+    string  chan_name = split_off_before_del(args, ' ');
+    string  list = split_off_before_del(args, ' ');
+    string  mask = split_off_before_del(args, ' ');
+    string  setter = split_off_before_del(args, ' ');
+    const std::time_t ts = std::atol(split_off_before_del(args, ' ').c_str());
+
+    auto    chan_it = server_channels_.find(chan_name);
+    if (chan_it == server_channels_.end() || (list != "b" && list != "e" && list != "I") || mask.empty()) return;
+    Channel& channel = chan_it->second;
+    if (channel.add_mask(list[0], MaskEntry{mask, setter, ts})) {
+        mark_channel_dirty(chan_name);
+        send_to_chan_all(channel, ":" + server + " MODE " + chan_name + " +" + list + " " + mask);
+    }
+    propagate(line);
+}
+
+// :<server> SQUIT <name> :<reason>
+void    SrvMgr::remote_squit(std::string args, const std::string& line) {
+    string  name = split_off_before_del(args, ' ');
+    if (servers_.find(name) == servers_.end()) return;
+
+    std::unordered_set<string>  lost{name};
+    for (bool progress = true; progress; ) {
+        progress = false;
+        for (const auto& [server_name, server] : servers_) {
+            if (!lost.count(server_name) && lost.count(server.uplink)) {
+                lost.insert(server_name);
+                progress = true;
+            }
+        }
+    }
+    drop_servers(lost, servers_[name].uplink + " " + name);
+    propagate(line);
+}
+
+// :<server> KILL <nick> :<reason>
+void    SrvMgr::remote_kill(std::string args, const std::string& line) {
+    string  nick = split_off_before_del(args, ' ');
+    kill_nick(nick, strip_colon(args));
+    propagate(line);
+}
+
+void    SrvMgr::remote_join(const std::string& nick, const std::string& signature, std::string chan_name) {
+    chan_name = strip_colon(chan_name);
+    auto    chan_it = server_channels_.find(chan_name);
+    if (chan_it == server_channels_.end()) {
+        // only SJOIN creates channels; a plain JOIN raced with the channel's end here
+        auto    recovered_it = recovered_channels_.find(chan_name);
+        if (recovered_it != recovered_channels_.end()) {
+            chan_it = server_channels_.emplace(chan_name, recovered_it->second).first;
+            chan_it->second.clear_saved_ops();
+            recovered_channels_.erase(recovered_it);
+        } else {
+            chan_it = server_channels_.emplace(chan_name, Channel(chan_name, std::time(nullptr))).first;
+        }
+        mark_channel_dirty(chan_name);
+    }
+    Channel&    channel = chan_it->second;
+    channel.add_nick(nick);
+    send_join(channel, nick, signature, "");
+    propagate(":" + signature + " JOIN " + chan_name);
+}
+
+void    SrvMgr::remote_nick(const std::string& old_nick, const std::string& old_signature, std::string new_nick, const std::string& line) {
+    new_nick = strip_colon(new_nick);
+    if (nick_exists(new_nick)) {
+        cout << "[LINK] Nick collision on " << new_nick << endl;
+        remove_remote_user(old_nick, "Nick collision");
+        propagate(":" + old_signature + " QUIT :Nick collision");
+        kill_nick(new_nick, "Nick collision");
+        propagate(":" + server_name_ + " KILL " + new_nick + " :Nick collision", true);
+        return ;
+    }
+    for (auto& [chan_name, channel] : server_channels_) {
+        if (channel.has_chan_member(old_nick)) {
+            change_nick_in_channel(new_nick, old_nick, old_signature, channel);
+        }
+    }
+    auto    remote_it = remote_users_.find(old_nick);
+    RemoteUser  remote = remote_it->second;
+    remote_users_.erase(remote_it);
+    remote_users_[new_nick] = remote;
+    propagate(line);
+}
+
+void    SrvMgr::link_closed(const MPlexServer::Client& client, const User& user) {
+    const string    name = user.get_link_name();
+    cout << "[LINK] Lost link to " << name << endl;
+
+    std::unordered_set<string>  lost;
+    for (const auto& [server_name, server] : servers_) {
+        if (same_client(server.link, client)) lost.insert(server_name);
+    }
+    link_origin_ = client;
+    drop_servers(lost, server_name_ + " " + name);
+    propagate(":" + server_name_ + " SQUIT " + name + " :Link closed");
+    link_origin_ = MPlexServer::Client();
+}
+
+void    SrvMgr::drop_servers(const std::unordered_set<std::string>& names, const std::string& reason) {
+    std::vector<string> lost_nicks;
+    for (const auto& [nick, remote] : remote_users_) {
+        if (names.count(remote.server)) lost_nicks.push_back(nick);
+    }
+    for (const string& nick : lost_nicks) {
+        remove_remote_user(nick, reason);
+    }
+    for (const string& name : names) {
+        servers_.erase(name);
+    }
+    cout << "[LINK] Netsplit: lost " << names.size() << " servers and " << lost_nicks.size() << " users" << endl;
+}
+
+void    SrvMgr::remove_remote_user(const std::string& nick, const std::string& reason) {
+    auto    remote_it = remote_users_.find(nick);
+    if (remote_it == remote_users_.end()) return;
+    const string    quit_msg = ":" + nick + "!" + remote_it->second.username + "@" + remote_it->second.hostname + " QUIT :" + reason;
+    remote_users_.erase(remote_it);
+
+    std::vector<string> keys;
+    for (const auto& pair : server_channels_) {
+        keys.push_back(pair.first);
+    }
+    for (const auto& key : keys) {
+        Channel& channel = server_channels_[key];
+        if (!channel.has_chan_member(nick)) continue;
+        send_to_chan_all_but_one(channel, quit_msg, nick);
+        string  member = nick;
+        remove_user_from_channel(channel, member);
+    }
+}
+
+void    SrvMgr::kill_nick(const std::string& nick, const std::string& reason) {
+    auto    nick_it = server_nicks_.find(nick);
+    if (nick_it != server_nicks_.end()) {
+        User*   user = find_user(nick_it->second);
+        if (user != nullptr) {
+            srv_instance_.sendLine(user->get_client(), "ERROR :Closing Link: " + string(user->get_client().getPeer()) + " (Killed: " + reason + ")");
+            srv_instance_.disconnectClient(user->get_client());
+        }
+        return ;
+    }
+    remove_remote_user(nick, "Killed: " + reason);
+}
+
+void    SrvMgr::propagate(const std::string& line, const bool include_origin) const {
+    for (const auto& [name, server] : servers_) {
+        if (server.uplink != server_name_) continue;
+        if (!include_origin && same_client(server.link, link_origin_)) continue;
+        srv_instance_.sendLine(server.link, line);
+    }
+}
+
+void    SrvMgr::route_to_channel(const Channel& channel, const std::string& line) const {
+    if (remote_users_.empty()) return;
+    std::vector<int>    links;
+    for (const string& nick : channel.get_chan_nicks()) {
+        auto    remote_it = remote_users_.find(nick);
+        if (remote_it == remote_users_.end()) continue;
+        const MPlexServer::Client& link = remote_it->second.link;
+        if (same_client(link, link_origin_) || std::find(links.begin(), links.end(), link.getFd()) != links.end()) continue;
+        links.push_back(link.getFd());
+        srv_instance_.sendLine(link, line);
+    }
+}
+
+void    SrvMgr::send_to_remote(const std::string& nick, const std::string& line) const {
+    auto    remote_it = remote_users_.find(nick);
+    if (remote_it == remote_users_.end() || same_client(remote_it->second.link, link_origin_)) return;
+    srv_instance_.sendLine(remote_it->second.link, line);
+}
+
+void    SrvMgr::send_to_chan_and_links(const Channel& channel, const std::string& msg) const {
+    send_to_chan_all(channel, msg);
+    propagate(msg);
+}
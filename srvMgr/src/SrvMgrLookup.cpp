@@ -0,0 +1,228 @@
+// Lookups about a client that run while it registers.
+//
+// Each one is a coroutine spawned on the server loop from onConnect: it waits
+// for its own socket without blocking anybody else, and registration is held
+// (User::lookups_pending) until it finished or gave up. A lookup never keeps
+// a User pointer across a suspension, the client may have left meanwhile.
+//
+// Ident (RFC 1413): connect to port 113 of the client and ask which user owns
+// our connection; "<client port> , <our port>" is answered with
+// "<ports> : USERID : <os> : <user name>". A confirmed name replaces the one
+// from USER, an unconfirmed one gets a '~' in front at login.
+//
+// Reverse DNS: a PTR query for the client address, then an A query for the
+// name it returned. Only a name that resolves back to the address replaces the
+// IP as host, anyone can publish any PTR record for their own addresses.
+// Queries go over UDP to one nameserver, each from a fresh socket (random
+// source port) with a random id; results are cached per address (Resolver).
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+
+#include "mplexserver.h"
+#include "SrvMgr.h"
+#include "User.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+
+namespace {
+    // closes the query socket on every way out, also when the frame is destroyed while suspended
+    struct ScopedFd {
+        int fd;
+        ~ScopedFd() { close(fd); }
+    };
+
+    string  trim(const string& s) {
+        const size_t begin = s.find_first_not_of(" \t\r\n");
+        if (begin == string::npos) return "";
+        return s.substr(begin, s.find_last_not_of(" \t\r\n") - begin + 1);
+    }
+
+    // "<ports> : USERID : <os> : <user name>", anything else (ERROR replies too) yields ""
+    string  parse_ident_reply(const string& reply) {
+        const string    line = reply.substr(0, reply.find('\n'));
+        const size_t    first = line.find(':');
+        const size_t    second = first == string::npos ? string::npos : line.find(':', first + 1);
+        const size_t    third = second == string::npos ? string::npos : line.find(':', second + 1);
+        if (third == string::npos || trim(line.substr(first + 1, second - first - 1)) != "USERID") return "";
+        string  ident;
+        for (const char ch : trim(line.substr(third + 1))) {
+            if (ident.size() == IDENT_MAX_LEN) break;
+            if (std::isalnum(static_cast<unsigned char>(ch)) || ch == '-' || ch == '_' || ch == '.') ident += ch;
+        }
+        return ident;
+    }
+}
+
+void    SrvMgr::set_lookup_timeouts(const int ident_timeout_ms, const int dns_timeout_ms) {
+    ident_timeout_ms_ = ident_timeout_ms;
+    dns_timeout_ms_ = dns_timeout_ms;
+}
+
+void    SrvMgr::enable_ident() {
+    ident_enabled_ = true;
+    cout << "[IDENT] Looking up new clients, registration waits up to " << ident_timeout_ms_ << " ms" << endl;
+}
+
+void    SrvMgr::enable_resolver(const sockaddr_in& nameserver) {
+    resolver_enabled_ = true;
+    resolver_.set_nameserver(nameserver);
+    char    ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &nameserver.sin_addr, ip, sizeof(ip));
+    cout << "[DNS] Resolving new clients with " << ip << ":" << ntohs(nameserver.sin_port)
+         << ", registration waits up to " << dns_timeout_ms_ << " ms" << endl;
+}
+
+void    SrvMgr::lookup_done(const MPlexServer::Client& client, User& user) {
+    user.end_lookup();
+    // a connection that turned out to be a server link does not register
+    if (!user.lookups_pending() && !user.is_logged_in() && user.get_link_state() == LinkState::NONE) {
+        try_to_log_in(user, client);
+    }
+}
+
+MPlexServer::Task<>   SrvMgr::ident_lookup(const MPlexServer::Client client) {
+    srv_instance_.sendTo(client, ":" + server_name_ + " NOTICE * :*** Checking Ident\r\n");
+    string  ident;
+    try {
+        ident = co_await query_ident(client);
+    } catch (std::exception& e) {
+        cout << "[IDENT] Lookup of " << client.getPeer() << " failed: " << e.what() << endl;
+    }
+    cout << "[IDENT] " << client.getPeer() << ":" << client.getPort() << " is "
+         << (ident.empty() ? "not confirmed" : "'" + ident + "'") << endl;
+    User*   user = static_cast<User*>(srv_instance_.getUserData(client));
+    if (user == nullptr) co_return;     // left while we were asking
+    user->set_ident(ident);
+    srv_instance_.sendTo(client, ":" + server_name_ + " NOTICE * :*** "
+                                 + (ident.empty() ? "No Ident response" : "Got Ident response") + "\r\n");
+    lookup_done(client, *user);
+}
+
+MPlexServer::Task<string>  SrvMgr::query_ident(const MPlexServer::Client client) {
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(ident_timeout_ms_);
+    const auto  remaining_ms = [&deadline] {
+        const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+        return static_cast<int>(left > 0 ? left : 0);
+    };
+
+    // ask from the address the client connected to, identd matches the connection by both ends
+    MPlexServer::SocketAddress  local{};
+    socklen_t                   local_len = sizeof(local);
+    if (getsockname(client.getFd(), &local.any, &local_len) == -1) co_return "";
+    const bool      v6 = local.family() == AF_INET6;
+    const ScopedFd  sock{socket(local.family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)};
+    if (sock.fd == -1) co_return "";
+    MPlexServer::SocketAddress  bind_addr = local;
+    (v6 ? bind_addr.v6.sin6_port : bind_addr.v4.sin_port) = 0;
+    if (bind(sock.fd, &bind_addr.any, bind_addr.length()) == -1) co_return "";
+
+    MPlexServer::SocketAddress  remote = client.getAddress();
+    (v6 ? remote.v6.sin6_port : remote.v4.sin_port) = htons(IDENT_PORT);
+    if (connect(sock.fd, &remote.any, remote.length()) == -1 && errno != EINPROGRESS) co_return "";
+    if (co_await srv_instance_.writable(sock.fd, remaining_ms()) == 0) co_return "";
+    int         error = 0;
+    socklen_t   error_len = sizeof(error);
+    if (getsockopt(sock.fd, SOL_SOCKET, SO_ERROR, &error, &error_len) == -1 || error != 0) co_return "";
+
+    const string    query = std::to_string(client.getPort()) + " , " + std::to_string(ntohs(v6 ? local.v6.sin6_port : local.v4.sin_port)) + "\r\n";
+    if (write(sock.fd, query.data(), query.size()) != static_cast<ssize_t>(query.size())) co_return "";
+
+    string  reply;
+    while (reply.find('\n') == string::npos && reply.size() < 512) {
+        if (co_await srv_instance_.readable(sock.fd, remaining_ms()) == 0) co_return "";
+        char            buf[512];
+        const ssize_t   n = read(sock.fd, buf, sizeof(buf));
+        if (n == -1 && errno == EAGAIN) continue;
+        if (n <= 0) break;
+        reply.append(buf, n);
+    }
+    co_return parse_ident_reply(reply);
+}
+
+MPlexServer::Task<>   SrvMgr::host_lookup(const MPlexServer::Client client) {
+    srv_instance_.sendTo(client, ":" + server_name_ + " NOTICE * :*** Looking up your hostname...\r\n");
+    const string    host = co_await resolve_host(client.getAddress().v4.sin_addr.s_addr);
+    User*   user = static_cast<User*>(srv_instance_.getUserData(client));
+    if (user == nullptr) co_return;
+    if (!host.empty()) user->set_hostname(host);
+    srv_instance_.sendTo(client, ":" + server_name_ + " NOTICE * :*** "
+                                 + (host.empty() ? "Couldn't look up your hostname" : "Found your hostname") + "\r\n");
+    lookup_done(client, *user);
+}
+
+MPlexServer::Task<string>  SrvMgr::resolve_host(const uint32_t addr) {
+    char    ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+    if (const string* host = resolver_.cached(addr)) {
+        cout << "[DNS] " << ip << " is " << (host->empty() ? "unconfirmed" : *host) << " (cached)" << endl;
+        co_return *host;
+    }
+    if (resolver_.in_flight(addr)) {
+        co_return co_await resolver_.join(addr);
+    }
+    Resolver::Flight    flight = resolver_.begin(addr);
+    const Resolver::Clock::time_point deadline = Resolver::Clock::now() + std::chrono::milliseconds(dns_timeout_ms_);
+    string      host;
+    uint32_t    ttl = DNS_NEGATIVE_TTL;
+    try {
+        Resolver::Answer    ptr;
+        Resolver::Answer    forward;
+        if (co_await query_dns(Resolver::ptr_name(addr), Resolver::Type::PTR, deadline, ptr) && !ptr.names.empty()
+            && Resolver::valid_hostname(ptr.names.front())
+            && co_await query_dns(ptr.names.front(), Resolver::Type::A, deadline, forward)) {
+            for (const uint32_t address : forward.addresses) {
+                if (address != addr) continue;
+                host = ptr.names.front();
+                ttl = std::min(ptr.ttl, forward.ttl);
+            }
+        }
+    } catch (std::exception& e) {
+        cout << "[DNS] Lookup of " << ip << " failed: " << e.what() << endl;
+    }
+    cout << "[DNS] " << ip << " is " << (host.empty() ? "unconfirmed" : host) << ", cached for " << ttl << " s" << endl;
+    flight.finish(host, ttl);
+    co_return host;
+}
+
+MPlexServer::Task<bool>    SrvMgr::query_dns(const string name, const Resolver::Type type, const Resolver::Clock::time_point deadline,
+                                              Resolver::Answer& answer) {
+    using Clock = Resolver::Clock;
+    const auto  ms_until = [](const Clock::time_point when) {
+        const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(when - Clock::now()).count();
+        return static_cast<int>(left > 0 ? left : 0);
+    };
+
+    // connected, so only datagrams from the nameserver arrive; a fresh socket means a fresh source port
+    const ScopedFd  sock{socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)};
+    if (sock.fd == -1) co_return false;
+    const sockaddr_in&  nameserver = resolver_.get_nameserver();
+    if (connect(sock.fd, reinterpret_cast<const sockaddr*>(&nameserver), sizeof(nameserver)) == -1) co_return false;
+    const uint16_t  id = resolver_.next_id();
+    const string    query = Resolver::build_query(id, name, type);
+
+    while (Clock::now() < deadline) {
+        if (send(sock.fd, query.data(), query.size(), 0) == -1) co_return false;
+        const Clock::time_point resend = std::min(deadline, Clock::now() + std::chrono::milliseconds(DNS_RETRY_MS));
+        while (true) {
+            if (co_await srv_instance_.readable(sock.fd, ms_until(resend)) == 0) break;
+            char            buf[DNS_MAX_PACKET];
+            const ssize_t   n = recv(sock.fd, buf, sizeof(buf), 0);
+            if (n == -1 && errno == EAGAIN) continue;
+            if (n == -1) co_return false;           // ECONNREFUSED: nothing listens there
+            // answers to other queries or forged ones are dropped, the right one may still come
+            if (Resolver::parse_reply(string(buf, n), id, name, type, answer)) co_return true;
+        }
+    }
+    co_return false;
+}
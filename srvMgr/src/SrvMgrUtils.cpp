@@ -17,18 +17,24 @@ void    SrvMgr::try_to_log_in(User &user, const MPlexServer::Client &client) con
          << ", cap_ended=" << user.cap_negotiation_ended() << endl;
     
     if (user.get_nickname().empty() || user.get_username().empty() ||
-        !user.password_provided() || 
+        !user.password_provided() || user.lookups_pending() ||
         (user.cap_negotiation_started() && !user.cap_negotiation_ended())) {
         cout << "[LOGIN] Requirements not met, login blocked" << endl;
         return ;
         }
     cout << "[LOGIN] ✓ All requirements met, logging in user '" << user.get_nickname() << "'" << endl;
+    if (ident_enabled_) {
+        // as on most networks, user names the client's identd did not confirm start with '~'
+        user.set_username(user.get_ident().empty() ? "~" + user.get_username() : user.get_ident());
+    }
     user.set_as_logged_in(true);
     const string nick = user.get_nickname();
     srv_instance_.sendTo(client, ":" + server_name_ + " " + RPL_WELCOME + " " + nick + " :Welcome to our single-server IRC network, " + user.get_signature() + "\r\n");
     srv_instance_.sendTo(client, ":" + server_name_ + " " + RPL_YOURHOST + " " + nick + " :Your host is " + server_name_ + ", running version 1.0.\r\n");
     srv_instance_.sendTo(client, ":" + server_name_ + " " + RPL_CREATED + " " + nick + " :This server was created today.\r\n");
     srv_instance_.sendTo(client, ":" + server_name_ + " " + RPL_MYINFO + " " + nick + " :server 1.0 o o\r\n");
+    propagate(":" + server_name_ + " UNICK " + nick + " " + user.get_username() + " " + user.get_hostname());
+    plugins_.registered(user);
 }
 
 void SrvMgr::mode_i(char plusminus, std::string &mode_arguments, Channel &channel, User &user) {
@@ -36,11 +42,11 @@ void SrvMgr::mode_i(char plusminus, std::string &mode_arguments, Channel &channe
     if (plusminus == '-') {
         channel.set_needs_invite(false);
         std::string msg = ":" + user.get_signature() + " MODE " + channel.get_channel_name() + " -i";
-        send_to_chan_all(channel, msg);
+        send_to_chan_and_links(channel, msg);
     } else if (plusminus == '+') {
         channel.set_needs_invite(true);
         std::string msg = ":" + user.get_signature() + " MODE " + channel.get_channel_name() + " +i";
-        send_to_chan_all(channel, msg);
+        send_to_chan_and_links(channel, msg);
     }
 }
 void SrvMgr::mode_t(char plusminus, std::string &mode_arguments, Channel &channel, User &user) {
@@ -48,11 +54,11 @@ void SrvMgr::mode_t(char plusminus, std::string &mode_arguments, Channel &channe
     if (plusminus == '-') {
         channel.set_topic_protected(false);
         std::string msg = ":" + user.get_signature() + " MODE " + channel.get_channel_name() + " -t";
-        send_to_chan_all(channel, msg);
+        send_to_chan_and_links(channel, msg);
     } else if (plusminus == '+') {
         channel.set_topic_protected(true);
         std::string msg = ":" + user.get_signature() + " MODE " + channel.get_channel_name() + " +t";
-        send_to_chan_all(channel, msg);
+        send_to_chan_and_links(channel, msg);
     }
 }
 void SrvMgr::mode_k(char plusminus, std::string &mode_arguments, Channel &channel, User &user) {
@@ -65,11 +71,11 @@ void SrvMgr::mode_k(char plusminus, std::string &mode_arguments, Channel &channe
     if (plusminus == '-') {
         channel.set_key("");
         std::string msg = ":" + user.get_signature() + " MODE " + channel.get_channel_name() + " -k *";
-        send_to_chan_all(channel, msg);
+        send_to_chan_and_links(channel, msg);
     } else if (plusminus == '+') {
         channel.set_key(key);
         std::string msg = ":" + user.get_signature() + " MODE " + channel.get_channel_name() + " +k " + key;
-        send_to_chan_all(channel, msg);
+        send_to_chan_and_links(channel, msg);
     }
 }
 void SrvMgr::mode_o(char plusminus, std::string &mode_arguments, Channel &channel, User &user) {
@@ -87,18 +93,18 @@ void SrvMgr::mode_o(char plusminus, std::string &mode_arguments, Channel &channe
     if (plusminus == '-') {
         channel.remove_operator(target_nick);
         std::string msg = ":" + user.get_signature() + " MODE " + channel.get_channel_name() + " -o " + target_nick;
-        send_to_chan_all(channel, msg);
+        send_to_chan_and_links(channel, msg);
     } else if (plusminus == '+') {
         channel.add_operator(target_nick);
         std::string msg = ":" + user.get_signature() + " MODE " + channel.get_channel_name() + " +o " + target_nick;
-        send_to_chan_all(channel, msg);
+        send_to_chan_and_links(channel, msg);
     }
 }
 void SrvMgr::mode_l(char plusminus, std::string &mode_arguments, Channel &channel, User &user) {
     if (plusminus == '-') {
         channel.set_member_limit(0);
         std::string msg = ":" + user.get_signature() + " MODE " + channel.get_channel_name() + " -l ";
-        send_to_chan_all(channel, msg);
+        send_to_chan_and_links(channel, msg);
     } else if (plusminus == '+') {
         std::string limit_str = split_off_before_del(mode_arguments,' ');
         if (limit_str.empty()) {
@@ -109,10 +115,50 @@ void SrvMgr::mode_l(char plusminus, std::string &mode_arguments, Channel &channe
         int         limit = atoi(limit_str.c_str());
         channel.set_member_limit(limit);
         std::string msg = ":" + user.get_signature() + " MODE " + channel.get_channel_name() + " +l " + limit_str;
-        send_to_chan_all(channel, msg);
+        send_to_chan_and_links(channel, msg);
     }
 }
 
+void SrvMgr::mode_list(char list, char plusminus, std::string &mode_arguments, Channel &channel, User &user) {
+    std::string mask = split_off_before_del(mode_arguments,' ');
+    const std::string   chan_name = channel.get_channel_name();
+    const std::string   nick = user.get_nickname();
+    if (mask.empty()) {
+        const string    item = list == 'b' ? RPL_BANLIST : list == 'e' ? RPL_EXCEPTLIST : RPL_INVITELIST;
+        const string    end = list == 'b' ? RPL_ENDOFBANLIST : list == 'e' ? RPL_ENDOFEXCEPTLIST : RPL_ENDOFINVITELIST;
+        const string    name = list == 'b' ? "ban" : list == 'e' ? "exception" : "invite exception";
+        for (const MaskEntry& entry : channel.get_masks(list)) {
+            send_to_one(user, ":" + server_name_ + " " + item + " " + nick + " " + chan_name + " " + entry.mask + " " + entry.setter + " " + std::to_string(entry.set_time));
+        }
+        send_to_one(user, ":" + server_name_ + " " + end + " " + nick + " " + chan_name + " :End of channel " + name + " list");
+        return ;
+    }
+    mask = MaskMatcher::normalize(mask);
+    if (plusminus == '+') {
+        if (channel.get_masks(list).size() >= CHANNEL_MAX_MASKS) {
+            string  err_msg = ":" + server_name_ + " " + ERR_BANLISTFULL + " " + nick + " " + chan_name + " " + list + " :Channel list is full";
+            send_to_one(user, err_msg);
+            return ;
+        }
+        if (!channel.add_mask(list, MaskEntry{mask, user.get_signature(), std::time(nullptr)})) return ;
+    } else if (!channel.remove_mask(list, mask)) {
+        return ;
+    }
+    std::string msg = ":" + user.get_signature() + " MODE " + chan_name + " " + plusminus + list + " " + mask;
+    send_to_chan_and_links(channel, msg);
+}
+
+BanCheck    SrvMgr::check_masks(const std::string& chan_name, Channel& channel, User& user) {
+    const uint64_t  version = channel.get_masks_version();
+    if (!channel.has_masks()) return BanCheck{version, false, false};
+    if (const BanCheck* cached = user.cached_ban_check(chan_name, version)) return *cached;
+    const string    signature = user.get_signature();
+    const BanCheck  check{version, channel.masks_match('b', signature) && !channel.masks_match('e', signature),
+                          channel.masks_match('I', signature)};
+    user.cache_ban_check(chan_name, check);
+    return check;
+}
+
 void    SrvMgr::join_channel(string& chan_name, string& key, User& user) {
     // Channel name must start with # or &
     if (chan_name.empty() || (chan_name[0] != '#' && chan_name[0] != '&')) {
@@ -120,21 +166,38 @@ void    SrvMgr::join_channel(string& chan_name, string& key, User& user) {
         send_to_one(user, err_msg);
         return ;
     }
-    if (server_channels_.find(chan_name) == server_channels_.end()) {
-        server_channels_.emplace(chan_name, Channel(chan_name, user.get_nickname()));
+    // a channel restored from the log only comes back to life once somebody manages to join it
+    auto    chan_it = server_channels_.find(chan_name);
+    auto    recovered_it = recovered_channels_.end();
+    const bool  created = chan_it == server_channels_.end();
+    if (chan_it == server_channels_.end()) {
+        recovered_it = recovered_channels_.find(chan_name);
+        if (recovered_it == recovered_channels_.end()) {
+            chan_it = server_channels_.emplace(chan_name, Channel(chan_name, user.get_nickname())).first;
+            mark_channel_dirty(chan_name);
+        }
     }
-    Channel& channel = server_channels_[chan_name];
-    if (!channel.does_key_fit(key)) {
+    Channel& channel = chan_it != server_channels_.end() ? chan_it->second : recovered_it->second;
+    // its operators must be able to get back into a restored +i/+k/+l channel nobody can invite to yet,
+    // recognised by their full saved mask: the nick alone is free for anybody to take after a restart
+    const bool  restored_op = recovered_it != recovered_channels_.end() && channel.is_saved_op(user.get_signature());
+    if (!restored_op && !channel.does_key_fit(key)) {
         string  err_msg = ":" + server_name_ + " " + ERR_BADCHANNELKEY + " " + user.get_nickname() + " " + chan_name + " :Cannot join channel (+k)";
         send_to_one(user, err_msg);
         return ;
     }
-    if (channel.get_member_count() >= channel.get_member_limit() && !channel.get_member_limit() == 0) {
+    if (!restored_op && channel.get_member_count() >= channel.get_member_limit() && !channel.get_member_limit() == 0) {
         string  err_msg = ":" + server_name_ + " " + ERR_CHANNELISFULL + " " + user.get_nickname() + " " + chan_name + " :Cannot join channel (+l)";
         send_to_one(user, err_msg);
         return ;
     }
-    if (channel.needs_invite()) {
+    const BanCheck  masks = check_masks(chan_name, channel, user);
+    if (!restored_op && masks.banned && !user.has_invitation(chan_name)) {
+        string  err_msg = ":" + server_name_ + " " + ERR_BANNEDFROMCHAN + " " + user.get_nickname() + " " + chan_name + " :Cannot join channel (+b)";
+        send_to_one(user, err_msg);
+        return ;
+    }
+    if (!restored_op && channel.needs_invite() && !masks.invite_exempt) {
         if (!user.has_invitation(chan_name)){
             string  err_msg = ":" + server_name_ + " " + ERR_INVITEONLYCHAN + " " + user.get_nickname() + " " + chan_name + " :Cannot join channel (+i)";
             send_to_one(user, err_msg);
@@ -143,35 +206,187 @@ void    SrvMgr::join_channel(string& chan_name, string& key, User& user) {
             user.remove_invitation(chan_name);
         }
     }
-    channel.add_nick(user.get_nickname());
-    send_channel_command_ack(channel, user);
-    send_channel_greetings(channel, user);
+    if (recovered_it != recovered_channels_.end()) {
+        Channel restored = recovered_it->second;
+        recovered_channels_.erase(recovered_it);
+        // like a new channel when nobody held ops; otherwise only a returning operator gets them
+        if (restored_op || !restored.has_saved_ops()) {
+            restored.add_operator(user.get_nickname());
+        }
+        restored.clear_saved_ops();
+        mark_channel_dirty(chan_name);
+        chan_it = server_channels_.emplace(chan_name, restored).first;
+        cout << "[CHANLOG] Restored " << chan_name << endl;
+    }
+    Channel& joined = chan_it->second;
+    joined.add_nick(user.get_nickname());
+    send_channel_command_ack(joined, user);
+    send_channel_greetings(joined, user);
+    if (history_limits_.join_replay > 0) {
+        auto    history_it = channel_history_.find(chan_name);
+        if (history_it != channel_history_.end()) {
+            send_history(user, chan_name, history_it->second.latest(ChannelHistory::now_ms(), history_limits_.join_replay), false);
+        }
+    }
+    // a channel that is new to us is new to the network, unless a link raced us to it
+    if (created) {
+        for (const string& line : sjoin_lines(joined)) {
+            propagate(line);
+        }
+        if (joined.get_channel_topic() != ":") {
+            propagate(":" + server_name_ + " STOPIC " + chan_name + " " + joined.get_topic_setter() + " "
+                + joined.get_topic_set_time() + " :" + joined.get_channel_topic());
+        }
+        for (const string& line : smask_lines(chan_name, joined)) {
+            propagate(line);
+        }
+    } else {
+        propagate(":" + user.get_signature() + " JOIN " + chan_name);
+    }
+}
+
+void    SrvMgr::mark_channel_dirty(const std::string& chan_name) {
+    dirty_channels_.insert(chan_name);
+}
+
+void    SrvMgr::record_history(const std::string& chan_name, const std::string& line, OutboundTags& tags) {
+    if (!history_enabled_) return;
+    // stored as interned ":nick!user@host " prefix + the rest of the wire line, with the time and msgid
+    // the channel got it with
+    const size_t    prefix_len = line.find(' ') + 1;
+    const string    body = line.substr(prefix_len) + "\r\n";
+    auto    history_it = channel_history_.try_emplace(chan_name, history_arena_, history_limits_).first;
+    ChannelHistory& history = history_it->second;
+    const bool      was_empty = history.size() == 0;
+    history.add(server_time_.now_ms(), tags.message_tags(), std::string_view(line).substr(0, prefix_len), body);
+    if (was_empty && history.size() > 0) {
+        history_expiry_.emplace(history.oldest_ms() + history_limits_.max_age_ms, chan_name);
+    }
+}
+
+void    SrvMgr::expire_history() {
+    if (history_expiry_.empty()) return;
+    const int64_t   now_ms = ChannelHistory::now_ms();
+    while (!history_expiry_.empty() && history_expiry_.top().first < now_ms) {
+        const string    chan_name = history_expiry_.top().second;
+        history_expiry_.pop();
+        auto    history_it = channel_history_.find(chan_name);
+        if (history_it == channel_history_.end()) continue;
+        ChannelHistory& history = history_it->second;
+        history.trim(now_ms);
+        if (history.size() == 0) {
+            // gives the segments of its last lines back
+            channel_history_.erase(history_it);
+            if (log_level_ >= 2) {
+                cout << "[HISTORY] " << chan_name << " expired" << endl;
+            }
+            continue;
+        }
+        history_expiry_.emplace(history.oldest_ms() + history_limits_.max_age_ms, chan_name);
+    }
+}
+
+void    SrvMgr::send_history(const User& user, const std::string& chan_name, const std::vector<HistoryLine>& lines,
+                             const bool empty_batch) {
+    const uint32_t  caps = user.get_caps();
+    const bool      batch = (caps & CAP_BATCH) && (empty_batch || !lines.empty());
+    if (!batch && !(caps & CAP_TAG_MASK)) {
+        // nothing to add: the stored bytes go out as they are
+        std::vector<MPlexServer::Slice> slices;
+        slices.reserve(2 * lines.size());
+        for (const HistoryLine& line : lines) {
+            slices.push_back(line.prefix);
+            slices.push_back(line.body);
+        }
+        srv_instance_.sendSlices(user.get_client(), slices);
+        return ;
+    }
+    const auto  bytes = [](const MPlexServer::Slice& slice) {
+        return slice.seg == nullptr ? std::string_view() : std::string_view(slice.seg->data + slice.off, slice.len);
+    };
+    const string    ref = batch ? msgids_.next() : "";
+    string          out;
+    if (batch) out += ":" + server_name_ + " BATCH +" + ref + " chathistory " + chan_name + "\r\n";
+    for (const HistoryLine& line : lines) {
+        string  tags = batch ? "batch=" + ref : "";
+        if (caps & CAP_SERVER_TIME) {
+            tags += (tags.empty() ? "time=" : ";time=") + ServerTime::format(line.time_ms);
+        }
+        if (caps & CAP_MESSAGE_TAGS) {
+            tags += (tags.empty() ? "" : ";") + string(line.tags);
+        }
+        if (!tags.empty()) out += "@" + tags + " ";
+        out += bytes(line.prefix);
+        out += bytes(line.body);
+    }
+    if (batch) out += ":" + server_name_ + " BATCH -" + ref + "\r\n";
+    srv_instance_.sendTo(user.get_client(), out);
 }
 
 void    SrvMgr::send_to_one(const User& user, const std::string& msg) {
-    srv_instance_.sendTo(user.get_client(), msg + "\r\n");
+    srv_instance_.sendLine(user.get_client(), msg);
 }
 void    SrvMgr::send_to_one(const string& nick, const std::string& msg) {
     auto    nick_it = server_nicks_.find(nick);
     if (nick_it == server_nicks_.end()) {
         return ;
     }
-    auto    user_it = server_users_.find(nick_it->second);
-    if (user_it == server_users_.end()) {
+    User*   user = find_user(nick_it->second);
+    if (user == nullptr) {
         return ;
     }
-    send_to_one(user_it->second, msg);
+    send_to_one(*user, msg);
+}
+void    SrvMgr::send_to_one(const string& nick, const std::string& msg, OutboundTags& tags, const bool tag_clients_only) {
+    auto    nick_it = server_nicks_.find(nick);
+    if (nick_it == server_nicks_.end()) {
+        return ;
+    }
+    User*   user = find_user(nick_it->second);
+    if (user == nullptr || (tag_clients_only && !(user->get_caps() & CAP_MESSAGE_TAGS))) {
+        return ;
+    }
+    send_to_one(*user, tags.prefix(user->get_caps()) + msg);
 }
 void    SrvMgr::send_to_chan_all(const Channel& channel, const std::string& msg) const {
-    auto set_of_nicks = channel.get_chan_nicks();
-    std::vector<MPlexServer::Client> clients = create_client_vector(set_of_nicks);
-    srv_instance_.multisend(clients, msg + "\r\n");
+    OutboundTags    tags(server_time_, msgids_);
+    send_tagged(channel.get_chan_nicks(), "", msg, tags);
 }
 void    SrvMgr::send_to_chan_all_but_one(const Channel& channel, const std::string& msg, const std::string& origin_nick) const {
-    auto set_of_nicks = channel.get_chan_nicks();
-    set_of_nicks.erase(origin_nick);
-    std::vector<MPlexServer::Client> clients = create_client_vector(set_of_nicks);
-    srv_instance_.multisend(clients, msg + "\r\n");
+    OutboundTags    tags(server_time_, msgids_);
+    send_tagged(channel.get_chan_nicks(), origin_nick, msg, tags);
+}
+void    SrvMgr::send_tagged(const std::unordered_set<std::string>& nicks, const std::string& origin_nick, const std::string& msg,
+                            OutboundTags& tags, const bool tag_clients_only) const {
+    send_grouped(nicks, origin_nick, CAP_TAG_MASK, [&](const uint32_t caps) {
+        return tag_clients_only && !(caps & CAP_MESSAGE_TAGS) ? std::string() : tags.prefix(caps) + msg;
+    });
+}
+// one group per combination of the capabilities that matter to this event, so
+// the work per event grows with the variants present, not with the recipients
+void    SrvMgr::send_grouped(const std::unordered_set<std::string>& nicks, const std::string& origin_nick, const uint32_t variant_caps,
+                             const std::function<std::string(uint32_t caps)>& render) const {
+    std::vector<MPlexServer::Client>    groups[CAP_ALL_MASK + 1];
+    for (const string& nick : nicks) {
+        if (nick == origin_nick) continue;
+        auto nick_it = server_nicks_.find(nick);
+        if (nick_it == server_nicks_.end()) continue;
+        const User* user = find_user(nick_it->second);
+        if (user == nullptr) continue;
+        groups[user->get_caps() & variant_caps].push_back(user->get_client());
+    }
+    for (uint32_t caps = 0; caps <= CAP_ALL_MASK; ++caps) {
+        if (groups[caps].empty()) continue;
+        const string    line = render(caps);
+        if (!line.empty()) srv_instance_.multisend(groups[caps], line + "\r\n");
+    }
+}
+void    SrvMgr::send_join(const Channel& channel, const std::string& nick, const std::string& signature, const std::string& realname) const {
+    const string    chan_name = channel.get_channel_name();
+    OutboundTags    tags(server_time_, msgids_);
+    send_grouped(channel.get_chan_nicks(), nick, CAP_TAG_MASK | CAP_EXTENDED_JOIN, [&](const uint32_t caps) {
+        return tags.prefix(caps) + ":" + signature + " JOIN " + (caps & CAP_EXTENDED_JOIN ? chan_name + " * :" + realname : ":" + chan_name);
+    });
 }
 void    SrvMgr::send_to_chan_all_but_one(const std::string& chan_name, const std::string& msg, const std::string& origin_nick) const {
     auto    chan_it = server_channels_.find(chan_name);
@@ -186,7 +401,7 @@ void    SrvMgr::change_nick(const string &new_nick, const std::string& old_nick,
     for (auto& channel_it : server_channels_) {
         Channel& channel = channel_it.second;
         if (channel.has_chan_member(old_nick)) {
-            change_nick_in_channel(new_nick, old_nick, channel);
+            change_nick_in_channel(new_nick, old_nick, user.get_signature(), channel);
         }
     }
     if (!old_nick.empty()) {
@@ -195,11 +410,11 @@ void    SrvMgr::change_nick(const string &new_nick, const std::string& old_nick,
     server_nicks_.emplace(new_nick, user.get_client().getFd());
     user.set_nickname(new_nick);
 }
-void    SrvMgr::change_nick_in_channel(const std::string &new_nick, const std::string &old_nick, Channel &channel) {
-    string old_signature = server_users_[server_nicks_[old_nick]].get_signature();
+void    SrvMgr::change_nick_in_channel(const std::string &new_nick, const std::string &old_nick, const std::string& old_signature, Channel &channel) {
     if (channel.has_chan_op(old_nick)) {
         channel.remove_operator(old_nick);
         channel.add_operator(new_nick);
+        mark_channel_dirty(channel.get_channel_name());
     }
     if (channel.has_chan_member(old_nick)) {
         channel.remove_nick(old_nick);
@@ -216,17 +431,22 @@ void    SrvMgr::remove_op_from_channel(Channel& channel, std::string &op) {
 void    SrvMgr::remove_nick_from_channel(Channel& channel, std::string &nick) {
     channel.remove_nick(nick);
     if (channel.get_chan_nicks().empty()) {
+        channel_history_.erase(channel.get_channel_name());
         server_channels_.erase(channel.get_channel_name());
     }
 }
 void    SrvMgr::remove_user_from_channel(Channel &channel, std::string &nick) {
+    // only operator changes and the end of the channel are persistent
+    if (channel.has_chan_op(nick) || channel.get_member_count() <= 1) {
+        mark_channel_dirty(channel.get_channel_name());
+    }
     remove_op_from_channel(channel, nick);
     remove_nick_from_channel(channel, nick);
 }
 
 void    SrvMgr::send_channel_command_ack(Channel& channel, const User& user) {
-    string  ack = ":" + user.get_nickname() + " JOIN :" + channel.get_channel_name();
-    send_to_chan_all(channel, ack);
+    // the joining user is in the channel already and gets the line too
+    send_join(channel, "", user.get_nickname(), user.get_realname());
 }
 void    SrvMgr::send_channel_greetings(Channel& channel, const User& user) {
     if (channel.get_channel_topic() != ":") {
@@ -241,8 +461,25 @@ void    SrvMgr::send_channel_greetings(Channel& channel, const User& user) {
     send_to_one(user, end_of_names);
 }
 
+User*   SrvMgr::find_user(int fd) const {
+    return static_cast<User*>(srv_instance_.getUserData(fd));
+}
+
+std::string SrvMgr::signature_of(const std::string& nick) const {
+    auto    nick_it = server_nicks_.find(nick);
+    if (nick_it != server_nicks_.end()) {
+        const User* user = find_user(nick_it->second);
+        return user != nullptr ? user->get_signature() : "";
+    }
+    auto    remote_it = remote_users_.find(nick);
+    if (remote_it != remote_users_.end()) {
+        return nick + "!" + remote_it->second.username + "@" + remote_it->second.hostname;
+    }
+    return "";
+}
+
 bool    SrvMgr::nick_exists(std::string &nick) {
-     if (server_nicks_.find(nick) == server_nicks_.end()) {
+     if (server_nicks_.find(nick) == server_nicks_.end() && remote_users_.find(nick) == remote_users_.end()) {
          return false;
      }
     return true;
@@ -253,25 +490,3 @@ bool    SrvMgr::chan_exists(std::string &chan_name) {
     }
     return true;
 }
-
-std::vector<MPlexServer::Client>    SrvMgr::create_client_vector(const std::unordered_set<std::string>& set_of_nicks) const {
-    std::vector<MPlexServer::Client> clients;
-    for (const string& nick : set_of_nicks) {
-        auto nick_it = server_nicks_.find(nick);
-        if (nick_it == server_nicks_.end()) {
-            continue ;
-        }
-
-        int user_id = nick_it->second;
-
-        auto user_it = server_users_.find(user_id);
-        if (user_it == server_users_.end()) {
-            continue ;
-        }
-
-        const User& user = user_it->second;
-        MPlexServer::Client client = user.get_client();
-        clients.push_back(client);
-    }
-    return clients;
-}
\ No newline at end of file
@@ -2,17 +2,22 @@
 #include "SrvMgr.h"
 
 std::string User::get_farewell_message() const {
-    return farewell_message_;
+    return extras_ ? extras_->farewell_message : std::string();
 }
 
 void User::set_farewell_message(const std::string& farewell_message) {
-    farewell_message_ = farewell_message;
+    extras().farewell_message = farewell_message;
 }
 
 User::User(MPlexServer::Client& client) : client_(client)
 {
 }
 
+User::Extras& User::extras() {
+    if (!extras_) extras_ = std::make_unique<Extras>();
+    return *extras_;
+}
+
 [[nodiscard]] bool User::is_logged_in() const {
     return is_logged_in_;
 }
@@ -45,44 +50,170 @@ void User::set_cap_negotiation_started(bool cap_negotiation_started) {
     cap_negotiation_started_ = cap_negotiation_started;
 }
 
+uint32_t User::get_caps() const {
+    return caps_;
+}
+
+void User::set_caps(uint32_t caps) {
+    caps_ = caps;
+}
+
 MPlexServer::Client User::get_client() const {
     return client_;
 }
 
 void        User::set_nickname(std::string nickname) {
     nickname_ = nickname;
+    if (extras_) extras_->ban_checks.clear();
 }
 std::string User::get_nickname() const {
     return nickname_;
 }
 void        User::set_username(std::string username) {
     username_ = username;
+    if (extras_) extras_->ban_checks.clear();
 }
-std::string User::get_username() {
+std::string User::get_username() const {
     return username_;
 }
 void        User::set_hostname(std::string hostname) {
     hostname_ = hostname;
+    if (extras_) extras_->ban_checks.clear();
 }
-std::string User::get_hostname() {
+std::string User::get_hostname() const {
     return hostname_;
 }
 
+void        User::set_realname(const std::string& realname) {
+    realname_ = realname;
+}
+
+const std::string& User::get_realname() const {
+    return realname_;
+}
+
+const BanCheck*     User::cached_ban_check(const std::string& chan_name, const uint64_t masks_version) const {
+    if (!extras_) return nullptr;
+    auto    it = extras_->ban_checks.find(chan_name);
+    if (it == extras_->ban_checks.end() || it->second.masks_version != masks_version) return nullptr;
+    return &it->second;
+}
+
+void        User::cache_ban_check(const std::string& chan_name, const BanCheck& check) {
+    std::unordered_map<std::string, BanCheck>&  ban_checks = extras().ban_checks;
+    if (ban_checks.size() >= BAN_CACHE_MAX && ban_checks.find(chan_name) == ban_checks.end()) {
+        ban_checks.clear();
+    }
+    ban_checks[chan_name] = check;
+}
+
 std::string User::get_signature() const {
     return nickname_ + "!" + username_ + "@" + hostname_;
 }
 
 void    User::add_invitation(std::string &chan_name) {
-    channel_invites_.insert(chan_name);
+    extras().channel_invites.insert(chan_name);
 }
 
 void User::remove_invitation(std::string &chan_name) {
-    channel_invites_.erase(chan_name);
+    if (extras_) extras_->channel_invites.erase(chan_name);
 }
 
 bool User::has_invitation(std::string &chan_name) {
-    if (channel_invites_.find(chan_name) == channel_invites_.end()) {
+    if (!extras_ || extras_->channel_invites.find(chan_name) == extras_->channel_invites.end()) {
         return false;
     }
     return true;
 }
+
+LinkState User::get_link_state() const {
+    return link_state_;
+}
+
+void User::set_link_state(LinkState link_state) {
+    link_state_ = link_state;
+}
+
+std::string User::get_link_name() const {
+    return extras_ ? extras_->link_name : std::string();
+}
+
+void User::set_link_name(const std::string& link_name) {
+    extras().link_name = link_name;
+}
+
+void User::begin_lookup() {
+    pending_lookups_++;
+}
+void User::end_lookup() {
+    pending_lookups_--;
+}
+bool User::lookups_pending() const {
+    return pending_lookups_ > 0;
+}
+std::string User::get_ident() const {
+    return extras_ ? extras_->ident : std::string();
+}
+void User::set_ident(const std::string& ident) {
+    extras().ident = ident;
+}
+
+void User::serialize(MPlexServer::StateWriter& out) const {
+    out.u8(is_logged_in_);
+    out.u8(password_provided_);
+    out.u8(cap_negotiation_started_);
+    out.u8(cap_negotiation_ended_);
+    out.u32(caps_);
+    out.str(nickname_);
+    out.str(username_);
+    out.str(hostname_);
+    out.str(realname_);
+    out.str(get_farewell_message());
+    out.u32(extras_ ? static_cast<uint32_t>(extras_->channel_invites.size()) : 0);
+    if (extras_) {
+        for (const std::string& chan_name : extras_->channel_invites) {
+            out.str(chan_name);
+        }
+    }
+}
+
+void User::deserialize(MPlexServer::StateReader& in) {
+    is_logged_in_ = in.u8();
+    password_provided_ = in.u8();
+    cap_negotiation_started_ = in.u8();
+    cap_negotiation_ended_ = in.u8();
+    caps_ = in.u32();
+    nickname_ = in.str();
+    username_ = in.str();
+    hostname_ = in.str();
+    realname_ = in.str();
+    const std::string farewell_message = in.str();
+    if (!farewell_message.empty()) set_farewell_message(farewell_message);
+    if (extras_) extras_->channel_invites.clear();
+    for (uint32_t n = in.u32(); n > 0; --n) {
+        extras().channel_invites.insert(in.str());
+    }
+}
+
+namespace {
+    size_t  heap_bytes(const std::string& s) {
+        return s.capacity() > std::string().capacity() ? s.capacity() + 1 : 0;
+    }
+
+    // node-based containers: one node per element plus the bucket array
+    template <class Container>
+    size_t  table_bytes(const Container& table, const size_t node_size) {
+        return table.bucket_count() * sizeof(void*) + table.size() * node_size;
+    }
+}
+
+size_t User::footprint() const {
+    size_t  bytes = sizeof(User) + heap_bytes(nickname_) + heap_bytes(username_) + heap_bytes(hostname_) + heap_bytes(realname_);
+    if (!extras_) return bytes;
+    bytes += sizeof(Extras) + heap_bytes(extras_->farewell_message) + heap_bytes(extras_->link_name) + heap_bytes(extras_->ident);
+    bytes += table_bytes(extras_->channel_invites, sizeof(void*) + sizeof(std::string) + sizeof(size_t));
+    for (const std::string& chan_name : extras_->channel_invites) bytes += heap_bytes(chan_name);
+    bytes += table_bytes(extras_->ban_checks, sizeof(void*) + sizeof(std::string) + sizeof(BanCheck) + sizeof(size_t));
+    for (const auto& entry : extras_->ban_checks) bytes += heap_bytes(entry.first);
+    return bytes;
+}
@@ -1,3 +1,4 @@
+#include <cctype>
 #include <string>
 #include <vector>
 
@@ -29,11 +30,36 @@ std::vector<std::string>    process_message(std::string s) {
 
     idx = s.find_first_of(' ');
     msg_parts.push_back(s.substr(0, idx));
-    msg_parts.push_back(s.substr(idx + 1, s.length() - idx));
+    // a command without parameters ("LIST") gets an empty argument string
+    msg_parts.push_back(idx == std::string::npos ? "" : s.substr(idx + 1, s.length() - idx));
 
     return msg_parts;
 }
 
+bool    mask_match(std::string_view mask, std::string_view s) {
+    size_t  m = 0;
+    size_t  i = 0;
+    size_t  star = std::string_view::npos;  // last '*' seen, retried with one more character on a mismatch
+    size_t  star_i = 0;
+
+    while (i < s.size()) {
+        if (m < mask.size() && (mask[m] == '?' || std::tolower(static_cast<unsigned char>(mask[m])) == std::tolower(static_cast<unsigned char>(s[i])))) {
+            m++;
+            i++;
+        } else if (m < mask.size() && mask[m] == '*') {
+            star = m++;
+            star_i = i;
+        } else if (star != std::string_view::npos) {
+            m = star + 1;
+            i = ++star_i;
+        } else {
+            return false;
+        }
+    }
+    while (m < mask.size() && mask[m] == '*') m++;
+    return m == mask.size();
+}
+
 int     get_msg_type(std::string& s) {
     if (s == "PASS") {
         return cmdType::PASS;
@@ -61,6 +87,12 @@ int     get_msg_type(std::string& s) {
         return cmdType::QUIT;
     } else if (s == "PING") {
         return cmdType::PING;
+    } else if (s == "CHATHISTORY") {
+        return cmdType::CHATHISTORY;
+    } else if (s == "LIST") {
+        return cmdType::LIST;
+    } else if (s == "TAGMSG") {
+        return cmdType::TAGMSG;
     }
     else {
         return cmdType::NO_TYPE_FOUND;
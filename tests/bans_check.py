@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+"""
+Channel +b/+e/+I lists end to end.
+
+An operator bans a nick (in other case than the one it is set in) and a
+whole host, excepts one nick from the host ban with +e, and lets a nick
+pattern past +i with +I. Then each kind of client must get exactly the
+answer its nick!user@host deserves: 474 or a JOIN, 473 or a JOIN. A member
+that took a banned nick after its check was cached must lose its voice
+(404), and get it back with the old nick or once the ban is lifted; the
+lists themselves must be listed with their setter and reject duplicates.
+tests/mask_check.cpp covers the matcher itself.
+
+    make && python3 tests/bans_check.py [--binary ./ircserv]
+"""
+
+import argparse
+import os
+import re
+import socket
+import subprocess
+import tempfile
+import time
+
+PASSWORD = "pw"
+
+failed = False
+
+
+def check(cond, what):
+    global failed
+    print(("PASS " if cond else "FAIL ") + what)
+    failed = failed or not cond
+
+
+def read(s, timeout=0.5):
+    s.settimeout(timeout)
+    data = b""
+    try:
+        while True:
+            chunk = s.recv(65536)
+            if not chunk:
+                break
+            data += chunk
+    except socket.timeout:
+        pass
+    return data.decode(errors="replace")
+
+
+def read_until(s, needle, timeout):
+    data = ""
+    deadline = time.time() + timeout
+    while needle not in data and time.time() < deadline:
+        data += read(s, 0.2)
+    return data
+
+
+def register(port, nick, user=None):
+    s = socket.create_connection(("127.0.0.1", port))
+    user = user or nick
+    s.sendall(("PASS %s\r\nNICK %s\r\nUSER %s 0 * :%s\r\n" % (PASSWORD, nick, user, nick)).encode())
+    read_until(s, " 004 ", 3)
+    return s
+
+
+def join(port, nick, channel, user=None):
+    """Registers nick and tries to join channel; returns the socket and the numeric or 'JOIN'."""
+    s = register(port, nick, user)
+    s.sendall(("JOIN %s\r\n" % channel).encode())
+    reply = read_until(s, "\r\n", 3)
+    data = reply + read(s, 0.3)
+    m = re.search(r" (47[34]|JOIN) ", data)
+    return s, m.group(1) if m else data
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--binary", default="./ircserv")
+    parser.add_argument("--port", type=int, default=6704)
+    args = parser.parse_args()
+
+    workdir = tempfile.mkdtemp()
+    config = os.path.join(workdir, "ircserv.conf")
+    with open(config, "w") as f:
+        f.write("log_level = 1\nflood_rate = 1000000\nflood_burst = 1000000\n")
+    log = open(os.path.join(workdir, "out.log"), "w+")
+    server = subprocess.Popen([os.path.abspath(args.binary), str(args.port), PASSWORD, config], cwd=workdir,
+                              stdout=log, stderr=subprocess.STDOUT)
+    clients = []
+    try:
+        time.sleep(0.5)
+        op = register(args.port, "chanop")
+        op.sendall(b"JOIN #b\r\nJOIN #i\r\nMODE #i +i\r\n"
+                   b"MODE #b +b Troll\r\nMODE #b +b *!*@127.0.0.1\r\nMODE #b +e friend*!*@*\r\n"
+                   b"MODE #i +I inv?ted!*@*\r\n")
+        listed = read_until(op, "+I inv?ted!*@*", 3)
+        check(" MODE #b +b Troll!*@*" in listed, "a short mask is completed to nick!user@host")
+
+        op.sendall(b"MODE #b +b *!*@127.0.0.1\r\nMODE #b b\r\nMODE #b e\r\nMODE #i I\r\n")
+        lists = read_until(op, " 347 ", 3)
+        check(lists.count(" MODE #b +b *!*@127.0.0.1") == 0, "a duplicate mask is not added again")
+        check(re.search(r" 367 chanop #b \*!\*@127\.0\.0\.1 chanop!chanop@\S+ \d+", lists) is not None
+              and " 368 chanop #b " in lists, "+b lists mask, setter and time")
+        check(" 348 chanop #b friend*!*@* " in lists and " 349 " in lists, "+e is listed")
+        check(" 346 chanop #i inv?ted!*@* " in lists and " 347 " in lists, "+I is listed")
+
+        s, got = join(args.port, "TROLL", "#b")
+        clients.append(s)
+        check(got == "474", "a banned nick in other case is kept out (%s)" % got)
+        s, got = join(args.port, "stranger", "#b")
+        clients.append(s)
+        check(got == "474", "a host ban keeps out anybody from it (%s)" % got)
+        s, got = join(args.port, "friendly", "#b")
+        clients.append(s)
+        check(got == "JOIN", "+e lets an excepted nick past the host ban (%s)" % got)
+
+        s, got = join(args.port, "invited", "#i")
+        clients.append(s)
+        check(got == "JOIN", "+I lets a matching nick into a +i channel (%s)" % got)
+        s, got = join(args.port, "INVOTED", "#i")
+        clients.append(s)
+        check(got == "JOIN", "+I folds case and '?' takes any character (%s)" % got)
+        s, got = join(args.port, "invite", "#i")
+        clients.append(s)
+        check(got == "473", "anybody else needs an invite (%s)" % got)
+
+        # the host ban goes, a nick ban comes: a member's cached check must follow its nick
+        op.sendall(b"MODE #b -b *!*@127.0.0.1\r\nMODE #b +b evil*!*@*\r\n")
+        read_until(op, "+b evil*!*@*", 3)
+        member, got = join(args.port, "member", "#b")
+        clients.append(member)
+        check(got == "JOIN", "the lifted host ban no longer applies (%s)" % got)
+        read(op, 0.3)
+        member.sendall(b"PRIVMSG #b :before\r\n")
+        check(":before" in read_until(op, ":before", 3), "a member not banned speaks")
+        member.sendall(b"NICK evilone\r\nPRIVMSG #b :banned now\r\n")
+        check(" 404 evilone #b " in read_until(member, " 404 ", 3), "after taking a banned nick it cannot")
+        member.sendall(b"NICK member\r\nPRIVMSG #b :back\r\n")
+        check(":back" in read_until(op, ":back", 3), "with the old nick it speaks again")
+        member.sendall(b"NICK evilone\r\n")
+        read_until(member, " NICK ", 3)
+        op.sendall(b"MODE #b -b evil*!*@*\r\n")
+        read_until(op, "-b evil", 3)
+        member.sendall(b"PRIVMSG #b :lifted\r\n")
+        check(":lifted" in read_until(op, ":lifted", 3), "lifting the ban gives it back under the banned nick")
+        op.sendall(b"MODE #b +b evilone\r\n")
+        read_until(op, "+b evilone", 3)
+        member.sendall(b"PRIVMSG #b :again\r\n")
+        check(" 404 evilone #b " in read_until(member, " 404 ", 3), "a new ban applies to a member with a cached check")
+    finally:
+        for s in clients:
+            s.close()
+        server.terminate()
+        server.wait()
+    print("ALL OK" if not failed else "SOME FAILED")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,155 @@
+// Per-message cost of the server core for different BasicServer policies.
+//
+// A client thread streams short PRIVMSG lines over loopback into one
+// connection; the server dispatches them to a handler that only counts.
+// Reported is the CPU time of the server thread per message, so waiting
+// for the client does not count.
+// Each policy is measured at both read sizes, so its effect is not mixed up
+// with that of the read size: a virtual EventHandler with the runtime
+// verbosity check (what Server is), a final handler with that check, and a
+// final handler with logging compiled out. Variants take turns round by
+// round, and the best round of each is kept.
+//
+//     make bench && ./bench_dispatch [messages] [base port]
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "mplexserver_impl.h"
+
+using namespace MPlexServer;
+
+namespace {
+    const std::string LINE = "PRIVMSG #bench :the quick brown fox jumps\r\n";
+    constexpr int ROUNDS = 5;
+
+    struct NoBase {};
+
+    template <class ServerT, class Base>
+    struct Counter : Base {
+        ServerT*    server = nullptr;
+        size_t      messages = 0;
+
+        void onConnect(Client client) { server->setFloodExempt(client, true); }
+        void onDisconnect(Client) {}
+        void onMessage(Message) { messages++; }
+        void onPollEnd() {}
+    };
+
+    struct LargeReads {
+        static constexpr size_t read_size = 64 * 1024;
+    };
+
+    // every event is a virtual call through EventHandler*, like in Server
+    template <class Log, class Buffers>
+    struct Virtual {
+        using ServerT = BasicServer<EventHandler, Log, Buffers>;
+        struct HandlerT final : Counter<ServerT, EventHandler> {};
+    };
+
+    template <class Log, class Buffers>
+    struct Inline {
+        struct HandlerT;
+        using ServerT = BasicServer<HandlerT, Log, Buffers>;
+        struct HandlerT final : Counter<ServerT, NoBase> {};
+    };
+
+    void send_lines(const uint16_t port, const size_t messages) {
+        const int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
+            std::perror("connect");
+            std::exit(1);
+        }
+        std::string block;
+        while (block.size() + LINE.size() <= 64 * 1024) block += LINE;
+        const size_t per_block = block.size() / LINE.size();
+        for (size_t sent = 0; sent < messages; sent += per_block) {
+            const size_t len = std::min(per_block, messages - sent) * LINE.size();
+            for (size_t off = 0; off < len;) {
+                const ssize_t n = write(fd, block.data() + off, len - off);
+                if (n <= 0) {
+                    std::perror("write");
+                    std::exit(1);
+                }
+                off += n;
+            }
+        }
+        // the server drops unread input once it sees the hangup, so wait for it to close first
+        char byte;
+        while (read(fd, &byte, 1) > 0) {}
+        close(fd);
+    }
+
+    double thread_cpu_ns() {
+        timespec ts{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return ts.tv_sec * 1e9 + ts.tv_nsec;
+    }
+
+    // server CPU nanoseconds per message of one round
+    template <class Variant>
+    double measure(const uint16_t port, const size_t messages) {
+        typename Variant::ServerT server(port, "127.0.0.1");
+        typename Variant::HandlerT handler;
+        handler.server = &server;
+        server.setEventHandler(&handler);
+        server.activate();
+        const double start = thread_cpu_ns();
+        std::thread client(send_lines, port, messages);
+        while (handler.messages < messages) {
+            server.poll();
+        }
+        const double elapsed = thread_cpu_ns() - start;
+        server.deactivate();
+        client.join();
+        return elapsed / messages;
+    }
+
+    struct Row {
+        const char* name;
+        double      (*small)(uint16_t, size_t);
+        double      (*large)(uint16_t, size_t);
+        double      best[2];
+    };
+}
+
+int main(int argc, char* argv[]) {
+    const size_t messages = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    uint16_t port = argc > 2 ? static_cast<uint16_t>(std::atoi(argv[2])) : 6790;
+
+    Row rows[] = {
+        {"virtual handler, RuntimeLog (Server)", measure<Virtual<RuntimeLog, DefaultBuffers>>,
+                                                 measure<Virtual<RuntimeLog, LargeReads>>, {}},
+        {"final handler, RuntimeLog", measure<Inline<RuntimeLog, DefaultBuffers>>, measure<Inline<RuntimeLog, LargeReads>>, {}},
+        {"final handler, NoLog", measure<Inline<NoLog, DefaultBuffers>>, measure<Inline<NoLog, LargeReads>>, {}},
+    };
+    for (int round = 0; round < ROUNDS; ++round) {
+        for (Row& row : rows) {
+            const double small = row.small(port++, messages);
+            const double large = row.large(port++, messages);
+            if (round == 0 || small < row.best[0]) row.best[0] = small;
+            if (round == 0 || large < row.best[1]) row.best[1] = large;
+        }
+    }
+
+    std::printf("%zu messages of %zu bytes, best of %d, ns/message (difference to the first row)\n",
+                messages, LINE.size(), ROUNDS);
+    std::printf("  %-38s %20s %20s\n", "", "reads of MAX_MSG_LEN", "64 KiB reads");
+    for (const Row& row : rows) {
+        std::printf("  %-38s %10.1f (%+6.1f)  %10.1f (%+6.1f)\n", row.name,
+                    row.best[0], row.best[0] - rows[0].best[0], row.best[1], row.best[1] - rows[0].best[1]);
+    }
+    return 0;
+}
@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+"""
+Memory footprint of idle registered clients.
+
+Starts ircserv, opens <clients> connections (spread over several 127.0.x.y
+source addresses so loopback does not run out of ports), registers them all
+and reads everything the server sends. Then reports how much the server's
+resident memory grew per connection, next to the kernel's TCP buffer memory,
+which is not part of the process.
+
+Both this script and the server need an fd limit above <clients>: the hard
+limit (ulimit -Hn) is raised to as far as allowed, fewer clients are used if it
+is too low.
+
+    make && python3 tests/bench_idle.py --clients 100000
+"""
+
+import argparse
+import os
+import resource
+import selectors
+import socket
+import subprocess
+import tempfile
+import time
+
+PASSWORD = "pw"
+PER_SOURCE = 20000      # clients per source address, below the ephemeral port range
+
+
+def rss_kib(pid):
+    with open("/proc/%d/status" % pid) as status:
+        for line in status:
+            if line.startswith("VmRSS:"):
+                return int(line.split()[1])
+    return 0
+
+
+def tcp_mem_kib():
+    with open("/proc/net/sockstat") as sockstat:
+        for line in sockstat:
+            if line.startswith("TCP:"):
+                words = line.split()
+                return int(words[words.index("mem") + 1]) * os.sysconf("SC_PAGE_SIZE") // 1024
+    return 0
+
+
+def raise_fd_limit(wanted):
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    limit = hard if hard == resource.RLIM_INFINITY else min(max(wanted, soft), hard)
+    resource.setrlimit(resource.RLIMIT_NOFILE, (limit, hard))
+    return limit
+
+
+def register_all(clients, port):
+    sel = selectors.DefaultSelector()
+    pending = 0
+    for i in range(clients):
+        s = socket.socket()
+        s.bind(("127.0.%d.%d" % (1 + i // PER_SOURCE // 250, 1 + i // PER_SOURCE % 250), 0))
+        s.connect(("127.0.0.1", port))
+        s.setblocking(False)
+        nick = "i%d" % i
+        s.sendall(("PASS %s\r\nNICK %s\r\nUSER %s 0 * :idle\r\n" % (PASSWORD, nick, nick)).encode())
+        sel.register(s, selectors.EVENT_READ, [b""])
+        pending += 1
+        # keep the accept backlog short and the received replies flowing
+        if i % 500 == 499:
+            pending -= drain(sel, 0)
+    end = time.time() + 60
+    while pending > 0 and time.time() < end:
+        pending -= drain(sel, 0.2)
+    return sel, pending
+
+
+def drain(sel, timeout):
+    done = 0
+    for key, _ in sel.select(timeout):
+        try:
+            data = key.fileobj.recv(1 << 16)
+        except BlockingIOError:
+            continue
+        seen = key.data
+        if seen[0] is None:
+            continue
+        seen[0] = (seen[0] + data)[-64:]
+        if b" 004 " in seen[0] or b" 004 " in data:
+            seen[0] = None
+            done += 1
+    return done
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--binary", default="./ircserv")
+    parser.add_argument("--clients", type=int, default=100000)
+    parser.add_argument("--port", type=int, default=6696)
+    args = parser.parse_args()
+
+    limit = raise_fd_limit(args.clients + 64)
+    clients = min(args.clients, limit - 64)
+    if clients < args.clients:
+        print("fd limit %d: measuring %d clients instead of %d" % (limit, clients, args.clients))
+
+    workdir = tempfile.mkdtemp()
+    server = subprocess.Popen([os.path.abspath(args.binary), str(args.port), PASSWORD], cwd=workdir,
+                              stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        time.sleep(0.5)
+        rss_before = rss_kib(server.pid)
+        tcp_before = tcp_mem_kib()
+        start = time.time()
+        sel, missing = register_all(clients, args.port)
+        took = time.time() - start
+        time.sleep(1)
+        drain(sel, 0)
+        rss_after = rss_kib(server.pid)
+        tcp_after = tcp_mem_kib()
+
+        registered = clients - missing
+        print("%d clients registered in %.1f s (%d missing)" % (registered, took, missing))
+        print("server RSS: %d KiB -> %d KiB, %.0f bytes per connection"
+              % (rss_before, rss_after, (rss_after - rss_before) * 1024.0 / max(registered, 1)))
+        print("kernel TCP buffers (both ends): %d KiB, %.0f bytes per connection"
+              % (tcp_after - tcp_before, (tcp_after - tcp_before) * 1024.0 / max(registered, 1)))
+        for key in list(sel.get_map().values()):
+            key.fileobj.close()
+    finally:
+        server.terminate()
+        server.wait()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+"""
+PRIVMSG round-trip time per latency profile.
+
+For every profile, starts ircserv with a config file selecting it (flood
+control opened up, logging off), registers two clients and sends <messages>
+PRIVMSGs from one to the other, one at a time: each is timed from the send
+until the other client has read it back through the server. Reports p50, p99
+and the CPU time the server used, since busy-polling trades CPU for latency.
+
+    make && python3 tests/bench_latency.py --messages 20000
+    python3 tests/bench_latency.py --profiles latency --loop-cpu 2
+"""
+
+import argparse
+import os
+import socket
+import subprocess
+import tempfile
+import time
+
+PASSWORD = "pw"
+
+
+def register(port, nick):
+    s = socket.create_connection(("127.0.0.1", port))
+    s.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    s.sendall(("PASS %s\r\nNICK %s\r\nUSER %s 0 * :%s\r\n" % (PASSWORD, nick, nick, nick)).encode())
+    data = b""
+    while b" 004 " not in data:
+        chunk = s.recv(65536)
+        if not chunk:
+            raise RuntimeError("%s was disconnected while registering" % nick)
+        data += chunk
+    return s
+
+
+def cpu_seconds(pid):
+    with open("/proc/%d/stat" % pid) as stat:
+        fields = stat.read().rsplit(")", 1)[1].split()
+    return (int(fields[11]) + int(fields[12])) / os.sysconf("SC_CLK_TCK")
+
+
+def percentile(sorted_values, p):
+    return sorted_values[min(len(sorted_values) - 1, int(len(sorted_values) * p / 100))]
+
+
+def run(binary, port, profile, messages, loop_cpu):
+    workdir = tempfile.mkdtemp()
+    path = os.path.join(workdir, "ircserv.conf")
+    with open(path, "w") as f:
+        f.write("profile = %s\nlog_level = 0\nflood_rate = 1000000\nflood_burst = 1000000\n" % profile)
+        if loop_cpu >= 0:
+            f.write("loop_cpu = %d\n" % loop_cpu)
+    server = subprocess.Popen([binary, str(port), PASSWORD, path], cwd=workdir,
+                              stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        time.sleep(0.5)
+        sender = register(port, "ping")
+        receiver = register(port, "pong")
+        rtts = []
+        cpu_before = cpu_seconds(server.pid)
+        for i in range(messages):
+            line = b"PRIVMSG pong :%d\r\n" % i
+            start = time.perf_counter()
+            sender.sendall(line)
+            data = b""
+            while not data.endswith(b"\r\n"):
+                data += receiver.recv(4096)
+            rtts.append(time.perf_counter() - start)
+        cpu = cpu_seconds(server.pid) - cpu_before
+    finally:
+        server.terminate()
+        server.wait()
+    rtts.sort()
+    print("%-8s p50 %6.1f us   p99 %6.1f us   server CPU %.2f s for %d messages"
+          % (profile, percentile(rtts, 50) * 1e6, percentile(rtts, 99) * 1e6, cpu, messages))
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--binary", default="./ircserv")
+    parser.add_argument("--port", type=int, default=6695)
+    parser.add_argument("--messages", type=int, default=5000)
+    parser.add_argument("--profiles", default="default,latency")
+    parser.add_argument("--loop-cpu", type=int, default=-1)
+    args = parser.parse_args()
+
+    for profile in args.profiles.split(","):
+        run(os.path.abspath(args.binary), args.port, profile, args.messages, args.loop_cpu)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,133 @@
+// Cost of BasicServer::post() from other threads, and how well the loop batches.
+//
+// One client connects over loopback; <producers> threads each post <messages>
+// Posted::send tasks for it as fast as they can (retrying while the queue is
+// full) while the loop polls. The client checks that every line arrives and
+// that each producer's lines keep their order. Reported are the producers'
+// wall time per post until delivered, how often the queue was full, and the
+// tasks run per loop iteration: many per iteration means few eventfd wakeups.
+//
+//     make bench && ./bench_post [producers] [messages per producer] [port]
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mplexserver_impl.h"
+
+using namespace MPlexServer;
+
+namespace {
+    struct Recorder;
+    using PostServer = BasicServer<Recorder, NoLog>;
+
+    struct Recorder final {
+        PostServer* server = nullptr;
+        Client      client;
+        bool        connected = false;
+
+        void onConnect(Client c) { client = c; connected = true; }
+        void onDisconnect(Client) { connected = false; }
+        void onMessage(Message) {}
+        void onPollEnd() {}
+    };
+
+    int connect_to(const uint16_t port) {
+        const int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
+            std::perror("connect");
+            std::exit(1);
+        }
+        return fd;
+    }
+
+    // reads "<producer> <seq>\r\n" lines until every one arrived; false if one is missing or out of order
+    bool read_lines(const int fd, const size_t producers, const size_t messages) {
+        std::vector<size_t> next(producers, 0);
+        size_t      left = producers * messages;
+        std::string buffer;
+        char        chunk[65536];
+        while (left > 0) {
+            const ssize_t n = read(fd, chunk, sizeof(chunk));
+            if (n <= 0) return false;
+            buffer.append(chunk, n);
+            size_t start = 0;
+            for (size_t end; (end = buffer.find("\r\n", start)) != std::string::npos; start = end + 2) {
+                const size_t producer = std::strtoul(buffer.c_str() + start, nullptr, 10);
+                const size_t seq = std::strtoul(buffer.c_str() + buffer.find(' ', start), nullptr, 10);
+                if (producer >= producers || seq != next[producer]++) return false;
+                --left;
+            }
+            buffer.erase(0, start);
+        }
+        return true;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const size_t producers = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 4;
+    const size_t messages = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 250000;
+    const uint16_t port = argc > 3 ? static_cast<uint16_t>(std::atoi(argv[3])) : 6795;
+
+    PostServer server(port, "127.0.0.1");
+    Recorder recorder;
+    recorder.server = &server;
+    server.setEventHandler(&recorder);
+    server.activate();
+
+    bool intact = false;
+    std::atomic<bool> reading{true};
+    std::thread client([&] {
+        const int fd = connect_to(port);
+        intact = read_lines(fd, producers, messages);
+        close(fd);
+        reading = false;
+    });
+    while (!recorder.connected) server.poll();
+
+    std::atomic<size_t> full{0};
+    std::vector<std::thread> threads;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p] {
+            for (size_t i = 0; i < messages; ++i) {
+                Posted task = Posted::send(recorder.client, std::to_string(p) + " " + std::to_string(i) + "\r\n");
+                while (!server.post(std::move(task))) {     // only moved from once queued
+                    full.fetch_add(1, std::memory_order_relaxed);
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    // until every line arrived, or the client gave up on a missing one
+    size_t iterations = 0;
+    while (reading) {
+        server.poll();
+        ++iterations;
+    }
+    const double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    for (std::thread& t : threads) t.join();
+    client.join();
+    server.deactivate();
+
+    const size_t total = producers * messages;
+    std::printf("%zu producers x %zu posts, queue of %d\n", producers, messages, POST_QUEUE_CAPACITY);
+    std::printf("  %-28s %7.1f ns/post (wall, until delivered)\n", "throughput", elapsed / total);
+    std::printf("  %-28s %zu\n", "posts that found it full", full.load());
+    std::printf("  %-28s %7.1f\n", "tasks per loop iteration", static_cast<double>(total) / iterations);
+    std::printf("  %-28s %s\n", "every line, in order", intact ? "yes" : "NO");
+    return intact ? 0 : 1;
+}
@@ -0,0 +1,221 @@
+#!/usr/bin/env python3
+"""
+Channel settings surviving a crash through the write-ahead log.
+
+An operator sets up a +k/+i/+l channel with a topic and a ban, and enough
+other channels to make the log roll over into a snapshot; later changes
+stay in the log. A second server on the same channel_log must refuse to
+start, and after an upgrade (SIGUSR2) the new process must hold the lock
+and keep logging. The server is then killed with SIGKILL and started again
+twice: once with the CRC of the last record broken, which must be dropped
+while everything before it (snapshot and log) is restored, and once with a
+torn record at the tail, behind the removal of the channel that ended.
+
+A client that only took the operator's nick must still be kept out by the
+key and the invite, and get no ops; the operator coming back with the same
+nick!user@host must get in without key or invite and get ops back.
+
+    make && python3 tests/chanlog_check.py [--binary ./ircserv]
+"""
+
+import argparse
+import os
+import re
+import signal
+import socket
+import struct
+import subprocess
+import tempfile
+import time
+
+PASSWORD = "pw"
+CHANNELS = 600
+TOPIC = "t" * 400
+
+failed = False
+
+
+def check(cond, what):
+    global failed
+    print(("PASS " if cond else "FAIL ") + what)
+    failed = failed or not cond
+
+
+def read(s, timeout=0.5):
+    s.settimeout(timeout)
+    data = b""
+    try:
+        while True:
+            chunk = s.recv(65536)
+            if not chunk:
+                break
+            data += chunk
+    except (socket.timeout, ConnectionResetError):
+        pass
+    return data.decode(errors="replace")
+
+
+def read_until(s, needle, timeout):
+    data = ""
+    deadline = time.time() + timeout
+    while needle not in data and time.time() < deadline:
+        data += read(s, 0.2)
+    return data
+
+
+def register(port, nick, user):
+    s = socket.create_connection(("127.0.0.1", port))
+    s.sendall(("PASS %s\r\nNICK %s\r\nUSER %s 0 * :%s\r\n" % (PASSWORD, nick, user, nick)).encode())
+    read_until(s, " 004 ", 5)
+    return s
+
+
+def start(binary, port, workdir, config, log):
+    server = subprocess.Popen([binary, str(port), PASSWORD, config], cwd=workdir, stdout=log, stderr=subprocess.STDOUT)
+    time.sleep(0.5)
+    return server
+
+
+def log_text(log):
+    log.flush()
+    return open(log.name).read()
+
+
+def wait_log(log, needle, timeout):
+    deadline = time.time() + timeout
+    while needle not in log_text(log) and time.time() < deadline:
+        time.sleep(0.1)
+    return needle in log_text(log)
+
+
+def records(wal):
+    """Offsets of the records in the log: u32 length | u32 crc32 | body, after the 8 byte magic."""
+    offsets = []
+    pos = 8
+    while pos + 8 <= len(wal):
+        length = struct.unpack_from("<I", wal, pos)[0]
+        if length == 0:
+            break
+        offsets.append(pos)
+        pos += 8 + length
+    return offsets, pos
+
+
+def restored(port):
+    """Joins #vault as its operator; returns the socket, the JOIN replies, its modes and the replies to
+    the ban list query and to joining #c7."""
+    s = register(port, "keeper", "keeper")
+    s.sendall(b"JOIN #vault\r\n")
+    joined = read_until(s, " 366 ", 3)
+    s.sendall(b"MODE #vault\r\nMODE #vault b\r\nJOIN #c7\r\n")
+    replies = read_until(s, " 366 keeper #c7", 3)
+    modes = re.search(r" 324 keeper #vault (\S+)", replies)
+    return s, joined, modes.group(1) if modes else "", replies
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--binary", default="./ircserv")
+    parser.add_argument("--port", type=int, default=6702)
+    args = parser.parse_args()
+
+    binary = os.path.abspath(args.binary)
+    workdir = tempfile.mkdtemp()
+    os.mkdir(os.path.join(workdir, "state"))
+    wal_path = os.path.join(workdir, "state", "irc.wal")
+    config = os.path.join(workdir, "ircserv.conf")
+    with open(config, "w") as f:
+        f.write("log_level = 1\nflood_rate = 1000000\nflood_burst = 1000000\nchannel_log = state/irc\n")
+    log = open(os.path.join(workdir, "out.log"), "w+")
+    server = start(binary, args.port, workdir, config, log)
+    upgraded = None
+    try:
+        op = register(args.port, "keeper", "keeper")
+        op.sendall(b"JOIN #vault\r\nMODE #vault +k secret\r\nMODE #vault +i\r\nMODE #vault +l 5\r\n"
+                   b"MODE #vault +b bad!*@*\r\nTOPIC #vault :before\r\n")
+        check(" TOPIC " in read_until(op, " TOPIC ", 3), "operator sets up the channel")
+        for i in range(CHANNELS):
+            op.sendall(("JOIN #c%d\r\nTOPIC #c%d :%s\r\n" % (i, i, TOPIC)).encode())
+            if i % 50 == 49:
+                read_until(op, "TOPIC #c%d " % i, 3)
+        check(wait_log(log, "[CHANLOG] Snapshot of", 5), "the log rolls over into a snapshot")
+        op.sendall(b"TOPIC #vault :after\r\n")
+        read_until(op, ":after", 3)
+        time.sleep(0.2)
+        check(os.path.exists(os.path.join(workdir, "state", "irc.snap")), "channel_log sets the files' prefix")
+
+        second = subprocess.run([binary, str(args.port + 1), PASSWORD, config], cwd=workdir,
+                                capture_output=True, text=True, timeout=5)
+        check(second.returncode == 1 and "locked" in second.stdout + second.stderr,
+              "a second server on the same log refuses to start")
+
+        server.send_signal(signal.SIGUSR2)
+        check(wait_log(log, "Upgrade complete", 5), "upgrade hands the log over")
+        server.wait()
+        pid = re.search(r"handed \d+ clients over to pid (\d+)", log_text(log))
+        upgraded = int(pid.group(1)) if pid else None
+        op.sendall(b"MODE #vault +t\r\n")
+        check("+t" in read_until(op, "+t", 3), "the new process takes changes")
+        time.sleep(0.2)
+        os.kill(upgraded, signal.SIGKILL)
+        upgraded = None
+        op.close()
+
+        with open(wal_path, "rb") as f:
+            wal = bytearray(f.read())
+        offsets, _ = records(wal)
+        check(len(offsets) >= 2, "the new process appended to the log (%d records)" % len(offsets))
+        wal[offsets[-1] + 4] ^= 0xff
+        with open(wal_path, "wb") as f:
+            f.write(wal)
+
+        server = start(binary, args.port, workdir, config, log)
+        check("torn record at offset %d" % offsets[-1] in log_text(log), "a record with a bad CRC is dropped")
+        impostor = register(args.port, "keeper", "other")
+        impostor.sendall(b"JOIN #vault\r\n")
+        check(" 475 " in read_until(impostor, " 475 ", 3), "the operator's nick alone does not bypass +k")
+        impostor.sendall(b"JOIN #vault secret\r\n")
+        check(" 473 " in read_until(impostor, " 473 ", 3), "nor +i")
+        impostor.close()
+        time.sleep(0.2)
+
+        back, joined, modes, replies = restored(args.port)
+        check(" JOIN :#vault" in joined, "the operator with its saved mask gets back in")
+        check("@keeper" in joined, "and gets ops back")
+        check(re.search(r" 332 keeper #vault :?after\r\n", joined) is not None, "the topic set after the snapshot is restored from the log")
+        check(modes == "+ikl", "modes before the broken record are restored (%s)" % modes)
+        check(" 367 keeper #vault bad!*@* " in replies, "the ban list is restored")
+        check(TOPIC in replies, "channels only in the snapshot are restored")
+        back.close()
+        time.sleep(0.2)
+        server.send_signal(signal.SIGKILL)
+        server.wait()
+
+        with open(wal_path, "rb") as f:
+            wal = bytearray(f.read())
+        offsets, end = records(wal)
+        # a header whose body never made it to the disk
+        struct.pack_into("<II", wal, end, 1 << 20, 0)
+        wal[end + 8:end + 16] = b"\x01partial"
+        with open(wal_path, "wb") as f:
+            f.write(wal)
+        server = start(binary, args.port, workdir, config, log)
+        check("Replayed %d log records" % len(offsets) in log_text(log), "a torn record at the tail is ignored")
+        # #vault ended when its last member left, #c8 was never touched since the snapshot
+        back = register(args.port, "keeper", "keeper")
+        back.sendall(b"JOIN #vault\r\nMODE #vault\r\nJOIN #c8\r\n")
+        replies = read_until(back, " 366 keeper #c8", 3)
+        check(" 324 keeper #vault + " in replies or " 324 keeper #vault +\r\n" in replies,
+              "a channel removed in the log before the torn record stays removed")
+        check(TOPIC in replies, "and the snapshot before it is restored")
+        back.close()
+    finally:
+        if upgraded is not None:
+            os.kill(upgraded, signal.SIGKILL)
+        server.terminate()
+        server.wait()
+    print("ALL OK" if not failed else "SOME FAILED")
+
+
+if __name__ == "__main__":
+    main()
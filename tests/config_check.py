@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""
+The configuration file and its live reload.
+
+Starts ircserv with a config file (server name, log level 1, an extra
+listener), checks the name and listener, then tightens flood control and
+raises the log level through SIGHUP while a client stays connected. A reload
+with a mistake must keep the running settings, and a broken file must stop
+the startup with the line number.
+
+    make && python3 tests/config_check.py [--binary ./ircserv]
+"""
+
+import argparse
+import os
+import signal
+import socket
+import subprocess
+import tempfile
+import time
+
+PASSWORD = "pw"
+
+failed = False
+
+
+def check(cond, what):
+    global failed
+    print(("PASS " if cond else "FAIL ") + what)
+    failed = failed or not cond
+
+
+def register(port, nick):
+    s = socket.create_connection(("127.0.0.1", port))
+    s.sendall(("PASS %s\r\nNICK %s\r\nUSER %s 0 * :%s\r\n" % (PASSWORD, nick, nick, nick)).encode())
+    return s, read(s)
+
+
+def read(s, timeout=0.5):
+    s.settimeout(timeout)
+    data = b""
+    try:
+        while True:
+            chunk = s.recv(65536)
+            if not chunk:
+                break
+            data += chunk
+    except socket.timeout:
+        pass
+    return data.decode(errors="replace")
+
+
+def burst(sender, receiver, count):
+    """messages of a quick burst the receiver gets within a second"""
+    sender.sendall(b"".join(b"PRIVMSG #cfg :n%d\r\n" % i for i in range(count)))
+    return read(receiver, 1.0).count("PRIVMSG #cfg")
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--binary", default="./ircserv")
+    parser.add_argument("--port", type=int, default=6698)
+    args = parser.parse_args()
+
+    workdir = tempfile.mkdtemp()
+    path = os.path.join(workdir, "ircserv.conf")
+    with open(path, "w") as f:
+        f.write("server_name = irc.config.test\nlog_level = 1   # quiet\nlisten = 127.0.0.1:%d\n" % (args.port + 1))
+
+    log = open(os.path.join(workdir, "out.log"), "w+")
+    server = subprocess.Popen([os.path.abspath(args.binary), str(args.port), PASSWORD, path], cwd=workdir,
+                              stdout=log, stderr=subprocess.STDOUT)
+    try:
+        time.sleep(0.5)
+        alice, welcome = register(args.port, "alice")
+        check(":irc.config.test 001 alice" in welcome, "server name from the file")
+        bob, welcome = register(args.port + 1, "bob")
+        check(" 001 bob" in welcome, "listener from the file")
+        for s in (alice, bob):
+            s.sendall(b"JOIN #cfg\r\n")
+        read(alice)
+        read(bob)
+        check(burst(alice, bob, 8) == 8, "default burst lets 8 messages through")
+        log.flush()
+        check("[MSG] Received" not in open(log.name).read(), "log level 1 does not log lines")
+
+        time.sleep(8)   # tokens back
+        with open(path, "w") as f:
+            f.write("server_name = irc.config.test\nlog_level = 2\nlisten = 127.0.0.1:%d\n"
+                    "flood_burst = 2\nflood_rate = 0.5\n" % (args.port + 1))
+        os.kill(server.pid, signal.SIGHUP)
+        time.sleep(0.5)
+        check(burst(alice, bob, 8) <= 3, "reloaded burst throttles")
+        time.sleep(0.5)
+        output = open(log.name).read()
+        check("[CONFIG] Reloaded" in output and "[MSG] Received" in output, "log level raised live")
+
+        with open(path, "w") as f:
+            f.write("log_level = 1\nflood_burst = lots\n")
+        os.kill(server.pid, signal.SIGHUP)
+        time.sleep(0.5)
+        output = open(log.name).read()
+        check("Reload failed" in output and "ircserv.conf:2:" in output, "bad reload rejected with its line")
+        bob.sendall(b"PING :still\r\n")
+        check("PONG" in read(bob), "connections kept across reloads")
+    finally:
+        server.terminate()
+        server.wait()
+
+    with open(path, "w") as f:
+        f.write("log_level = 1\n\nnot a setting\n")
+    result = subprocess.run([os.path.abspath(args.binary), str(args.port), PASSWORD, path], cwd=workdir,
+                            capture_output=True, text=True, timeout=10)
+    check(result.returncode != 0 and "ircserv.conf:3:" in result.stderr, "broken file stops the startup")
+    print("ALL OK" if not failed else "SOME FAILED")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+"""
+Reverse DNS at registration, against a local stub nameserver.
+
+Starts ircserv with IRC_RESOLVE and IRC_DNS_SERVER pointing at a stub that
+answers from a fixed table, then registers clients from different loopback
+addresses (127.0.0.x) and checks the host they end up with: forward-confirmed
+names only, spoofed/invalid/missing ones fall back to the IP, a silent
+nameserver holds registration only for a bounded time, concurrent lookups of
+one address are merged and results are cached.
+
+    make && python3 tests/dns_stub.py [--binary ./ircserv]
+"""
+
+import argparse
+import os
+import socket
+import struct
+import subprocess
+import tempfile
+import threading
+import time
+
+PASSWORD = "pw"
+PORT = 6695
+DNS_PORT = 5399
+A, CNAME, PTR = 1, 5, 12
+
+# reverse name -> behaviour of the stub
+PTR_TABLE = {
+    "2.0.0.127.in-addr.arpa": ("ptr", "good.example"),
+    "3.0.0.127.in-addr.arpa": ("ptr", "spoofed.example"),       # A points elsewhere
+    "4.0.0.127.in-addr.arpa": ("nxdomain", None),
+    "5.0.0.127.in-addr.arpa": ("silent", None),
+    "6.0.0.127.in-addr.arpa": ("ptr", "bad host!x"),
+    "7.0.0.127.in-addr.arpa": ("forged-first", "forged.example"),
+    "8.0.0.127.in-addr.arpa": ("cname", "8.0/25.0.0.127.in-addr.arpa"),
+    "8.0/25.0.0.127.in-addr.arpa": ("ptr", "delegated.example"),
+    "9.0.0.127.in-addr.arpa": ("slow", "shared.example"),
+    "10.0.0.127.in-addr.arpa": ("drop-first", "retry.example"),
+}
+A_TABLE = {
+    "good.example": "127.0.0.2",
+    "spoofed.example": "10.1.2.3",
+    "forged.example": "127.0.0.7",
+    "delegated.example": "127.0.0.8",
+    "shared.example": "127.0.0.9",
+    "retry.example": "127.0.0.10",
+}
+
+
+def encode_name(name):
+    out = b""
+    for label in name.split("."):
+        out += bytes([len(label)]) + label.encode()
+    return out + b"\0"
+
+
+def decode_question(packet):
+    at, labels = 12, []
+    while packet[at]:
+        labels.append(packet[at + 1:at + 1 + packet[at]].decode())
+        at += 1 + packet[at]
+    qtype, = struct.unpack("!H", packet[at + 1:at + 3])
+    return ".".join(labels), qtype, packet[12:at + 5]
+
+
+def record(owner, rtype, rdata, ttl=300):
+    return encode_name(owner) + struct.pack("!HHIH", rtype, 1, ttl, len(rdata)) + rdata
+
+
+class StubDns:
+    def __init__(self, port):
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.bind(("127.0.0.1", port))
+        self.queries = []
+        self.seen = set()
+        threading.Thread(target=self.serve, daemon=True).start()
+
+    def count(self, name):
+        return sum(1 for q in self.queries if q == name)
+
+    def serve(self):
+        while True:
+            packet, peer = self.sock.recvfrom(512)
+            qid, = struct.unpack("!H", packet[:2])
+            name, qtype, question = decode_question(packet)
+            self.queries.append(name)
+            answers, rcode = [], 0
+            if qtype == PTR:
+                kind, target = PTR_TABLE.get(name, ("nxdomain", None))
+                if kind == "silent":
+                    continue
+                if kind == "drop-first" and name not in self.seen:
+                    self.seen.add(name)
+                    continue
+                if kind == "slow":
+                    time.sleep(0.5)
+                if kind == "nxdomain":
+                    rcode = 3
+                elif kind == "cname":
+                    answers.append(record(name, CNAME, encode_name(target)))
+                    answers.append(record(target, PTR, encode_name(PTR_TABLE[target][1])))
+                else:
+                    answers.append(record(name, PTR, encode_name(target)))
+                if kind == "forged-first":
+                    forged = record(name, PTR, encode_name("evil.example"))
+                    self.send(peer, (qid + 1) & 0xffff, question, [forged], 0)
+            elif qtype == A and name in A_TABLE:
+                answers.append(record(name, A, socket.inet_aton(A_TABLE[name])))
+            else:
+                rcode = 3
+            self.send(peer, qid, question, answers, rcode)
+
+    def send(self, peer, qid, question, answers, rcode):
+        header = struct.pack("!HHHHHH", qid, 0x8180 | rcode, 1, len(answers), 0, 0)
+        self.sock.sendto(header + question + b"".join(answers), peer)
+
+
+def register(source, nick):
+    s = socket.socket()
+    s.bind((source, 0))
+    s.connect(("127.0.0.1", PORT))
+    s.sendall(("PASS %s\r\nNICK %s\r\nUSER %s 0 * :x\r\n" % (PASSWORD, nick, nick)).encode())
+    return s
+
+
+def wait_for(s, text, timeout):
+    s.settimeout(0.1)
+    data, end = "", time.time() + timeout
+    while text not in data and time.time() < end:
+        try:
+            chunk = s.recv(4096)
+            if not chunk:
+                break
+            data += chunk.decode(errors="replace")
+        except socket.timeout:
+            pass
+    return data
+
+
+def host_of(s, nick):
+    # the host others see: message ourselves and read the prefix
+    s.sendall(("PRIVMSG %s :ping\r\n" % nick).encode())
+    line = wait_for(s, "PRIVMSG %s :ping" % nick, 2)
+    prefix = [l for l in line.split("\r\n") if "PRIVMSG %s :ping" % nick in l]
+    return prefix[0].split("@", 1)[1].split(" ", 1)[0] if prefix else None
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--binary", default="./ircserv")
+    args = parser.parse_args()
+
+    dns = StubDns(DNS_PORT)
+    workdir = tempfile.mkdtemp()
+    env = dict(os.environ, IRC_RESOLVE="1", IRC_DNS_SERVER="127.0.0.1:%d" % DNS_PORT)
+    server = subprocess.Popen([os.path.abspath(args.binary), str(PORT), PASSWORD], cwd=workdir, env=env,
+                              stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    time.sleep(0.5)
+    failures = 0
+
+    def check(ok, what):
+        nonlocal failures
+        print(("PASS " if ok else "FAIL ") + what)
+        failures += 0 if ok else 1
+
+    try:
+        cases = [("127.0.0.2", "good", "good.example"),
+                 ("127.0.0.3", "spoofed", "127.0.0.3"),
+                 ("127.0.0.4", "nxdomain", "127.0.0.4"),
+                 ("127.0.0.6", "invalid", "127.0.0.6"),
+                 ("127.0.0.7", "forged", "forged.example"),
+                 ("127.0.0.8", "cname", "delegated.example"),
+                 ("127.0.0.10", "retry", "retry.example")]
+        for source, nick, expected in cases:
+            s = register(source, nick)
+            wait_for(s, " 001 ", 3)
+            host = host_of(s, nick)
+            check(host == expected, "%-9s host %s (want %s)" % (nick, host, expected))
+            s.close()
+
+        start = time.time()
+        silent = register("127.0.0.5", "silent")
+        other = register("127.0.0.4", "other")
+        check(" 001 " in wait_for(other, " 001 ", 1), "others register while a lookup hangs")
+        registered = " 001 " in wait_for(silent, " 001 ", 8)
+        elapsed = time.time() - start
+        check(registered and elapsed < 6, "silent nameserver holds registration %.1f s" % elapsed)
+        check(host_of(silent, "silent") == "127.0.0.5", "silent: IP as host")
+
+        before = dns.count("9.0.0.127.in-addr.arpa")
+        clients = [register("127.0.0.9", "shared%d" % i) for i in range(3)]
+        hosts = []
+        for i, s in enumerate(clients):
+            wait_for(s, " 001 ", 3)
+            hosts.append(host_of(s, "shared%d" % i))
+        check(hosts == ["shared.example"] * 3, "concurrent clients share the lookup: %s" % hosts)
+        check(dns.count("9.0.0.127.in-addr.arpa") - before == 1, "one PTR query for them")
+
+        before = len(dns.queries)
+        s = register("127.0.0.2", "again")
+        wait_for(s, " 001 ", 3)
+        check(host_of(s, "again") == "good.example" and len(dns.queries) == before, "second visit answered from cache")
+    finally:
+        server.terminate()
+        server.wait()
+    print("ALL OK" if failures == 0 else "%d FAILED" % failures)
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+"""
+Inbound flood control: token bucket throttling and the RecvQ limit.
+
+Runs ircserv with a small bucket (2 tokens, 5 per second) and checks that a
+burst of PRIVMSGs is answered at the refill rate, in order and without loss;
+that a NICK costing more than the whole burst still goes through, also
+behind a tag section; that even PINGs, the cheapest command, are paced;
+and that a
+client streaming bytes without ever ending a line, or piling up lines while
+throttled, is disconnected with Excess Flood once past recvq_max.
+
+    make && python3 tests/flood_check.py [--binary ./ircserv]
+"""
+
+import argparse
+import os
+import socket
+import subprocess
+import tempfile
+import time
+
+PASSWORD = "pw"
+RATE = 5
+BURST = 2
+RECVQ = 8192
+
+failed = False
+
+
+def check(cond, what):
+    global failed
+    print(("PASS " if cond else "FAIL ") + what)
+    failed = failed or not cond
+
+
+def read(s, timeout=0.5):
+    s.settimeout(timeout)
+    data = b""
+    try:
+        while True:
+            chunk = s.recv(65536)
+            if not chunk:
+                break
+            data += chunk
+    except (socket.timeout, ConnectionResetError):
+        pass
+    return data.decode(errors="replace")
+
+
+def read_until(s, needle, timeout):
+    data = ""
+    deadline = time.time() + timeout
+    while needle not in data and time.time() < deadline:
+        data += read(s, 0.2)
+    return data
+
+
+def read_for(s, seconds):
+    data = ""
+    deadline = time.time() + seconds
+    while time.time() < deadline:
+        data += read(s, max(0.01, deadline - time.time()))
+    return data
+
+
+def register(port, nick):
+    s = socket.create_connection(("127.0.0.1", port))
+    s.sendall(("PASS %s\r\nNICK %s\r\nUSER %s 0 * :%s\r\n" % (PASSWORD, nick, nick, nick)).encode())
+    # registration itself is throttled: NICK takes the whole burst
+    welcome = read_until(s, " 004 ", 5)
+    time.sleep(BURST / RATE)
+    return s, welcome
+
+
+def closed(s, timeout=3):
+    s.settimeout(timeout)
+    try:
+        while True:
+            if not s.recv(65536):
+                return True
+    except socket.timeout:
+        return False
+    except OSError:
+        return True
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--binary", default="./ircserv")
+    parser.add_argument("--port", type=int, default=6699)
+    args = parser.parse_args()
+
+    workdir = tempfile.mkdtemp()
+    path = os.path.join(workdir, "ircserv.conf")
+    with open(path, "w") as f:
+        # NICK keeps its built-in penalty of 3, above the burst
+        f.write("log_level = 1\nflood_rate = %d\nflood_burst = %d\nrecvq_max = %d\n" % (RATE, BURST, RECVQ))
+    log = open(os.path.join(workdir, "out.log"), "w+")
+    server = subprocess.Popen([os.path.abspath(args.binary), str(args.port), PASSWORD, path], cwd=workdir,
+                              stdout=log, stderr=subprocess.STDOUT)
+    try:
+        time.sleep(0.5)
+        client, welcome = register(args.port, "paced")
+        check(" 004 " in welcome, "registration completes although NICK costs more than the burst")
+
+        # a PRIVMSG costs 1; each to a missing nick is answered by its 401
+        client.sendall(b"".join(b"PRIVMSG gone%d :x\r\n" % i for i in range(10)))
+        replies = read_for(client, 0.1)
+        early = replies.count(" 401 ")
+        check(early <= BURST + 1, "a burst is answered at the refill rate (%d of 10 at once)" % early)
+        replies += read_until(client, "gone9", 5)
+        nicks = [line.split()[3] for line in replies.split("\r\n") if " 401 " in line]
+        check(nicks == ["gone%d" % i for i in range(10)], "the rest follows, in order and complete")
+
+        client.sendall(b"NICK renamed\r\n")
+        check(" NICK " in read_until(client, " NICK ", 3), "a NICK above the burst goes through once the bucket is full")
+
+        # a tag section in front does not hide the command: each JOIN takes the whole bucket
+        time.sleep(2 * BURST / RATE)
+        client.sendall(b"".join(b"@a=b JOIN #t%d\r\n" % i for i in range(3)))
+        joined = read_for(client, 0.15).count(" JOIN :#t")
+        check(joined == 1, "tagged lines pay their command's penalty (%d of 3 JOINs at once)" % joined)
+        read_until(client, " JOIN :#t2", 3)
+
+        endless, _ = register(args.port, "endless")
+        try:
+            for _ in range(RECVQ // 1024 + 2):
+                endless.sendall(b"x" * 1024)
+                time.sleep(0.01)
+        except OSError:
+            pass
+        check(closed(endless), "a line without CRLF past recvq_max disconnects")
+
+        piled, _ = register(args.port, "piled")
+        try:
+            piled.sendall(b"".join(b"PRIVMSG paced :%s\r\n" % (b"y" * 400) for _ in range(60)))
+        except OSError:
+            pass
+        check(closed(piled), "lines piling up behind the throttle past recvq_max disconnect")
+
+        client.sendall(b"PING :alive\r\n")
+        check("alive" in read_until(client, "alive", 2), "the paced client is still served")
+
+        # PING costs a tenth of a token: a burst of them is paced too, at ten times the rate
+        time.sleep(2 * BURST / RATE)
+        client.sendall(b"".join(b"PING :p%d\r\n" % i for i in range(100)))
+        time.sleep(0.1)
+        # only what is there by now: the PONGs keep trickling in faster than read()'s timeout
+        client.setblocking(False)
+        early = ""
+        try:
+            while True:
+                early += client.recv(65536).decode(errors="replace")
+        except BlockingIOError:
+            pass
+        client.setblocking(True)
+        early = early.count(" PONG ")
+        check(early < 100, "a burst of PINGs is throttled (%d of 100 at once)" % early)
+        log.flush()
+        check(open(log.name).read().count("Excess Flood") == 2, "Excess Flood logged for both")
+    finally:
+        server.terminate()
+        server.wait()
+    print("ALL OK" if not failed else "SOME FAILED")
+
+
+if __name__ == "__main__":
+    main()
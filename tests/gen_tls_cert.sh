@@ -0,0 +1,14 @@
+#!/bin/bash
+# Creates a self-signed certificate for local TLS tests
+# Usage: ./gen_tls_cert.sh [cert] [key]
+# Then: IRC_TLS_PORT=6697 IRC_TLS_CERT=ircserv.crt IRC_TLS_KEY=ircserv.key ./ircserv <port> <password>
+# Connect: openssl s_client -connect localhost:6697 -crlf
+
+CERT=${1:-ircserv.crt}
+KEY=${2:-ircserv.key}
+
+openssl req -x509 -newkey rsa:2048 -nodes -days 365 \
+    -subj "/CN=localhost" \
+    -keyout "$KEY" -out "$CERT"
+
+echo "Wrote $CERT and $KEY"
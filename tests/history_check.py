@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+"""
+Channel history replay with the tags each client asked for.
+
+A message-tags/server-time member records the @time and msgid every
+channel line went out with. Replayed on join and by CHATHISTORY, the same
+lines must carry exactly those tags for a client with both capabilities,
+only the time for a server-time client and none for a plain one; with
+batch they come in a chathistory BATCH, which is sent empty if there is
+no history. Lines past IRC_HISTORY_AGE are dropped even from a channel
+nobody talks in any more.
+
+    make && python3 tests/history_check.py [--binary ./ircserv]
+"""
+
+import argparse
+import os
+import re
+import socket
+import subprocess
+import tempfile
+import time
+
+PASSWORD = "pw"
+LINES = 4
+AGE = 3
+
+failed = False
+
+
+def check(cond, what):
+    global failed
+    print(("PASS " if cond else "FAIL ") + what)
+    failed = failed or not cond
+
+
+def read(s, timeout=0.5):
+    s.settimeout(timeout)
+    data = b""
+    try:
+        while True:
+            chunk = s.recv(65536)
+            if not chunk:
+                break
+            data += chunk
+    except socket.timeout:
+        pass
+    return data.decode(errors="replace")
+
+
+def read_until(s, needle, timeout):
+    data = ""
+    deadline = time.time() + timeout
+    while needle not in data and time.time() < deadline:
+        data += read(s, 0.2)
+    return data
+
+
+def register(port, nick, caps=""):
+    s = socket.create_connection(("127.0.0.1", port))
+    request = "CAP REQ :%s\r\n" % caps if caps else ""
+    s.sendall(("CAP LS 302\r\n%sPASS %s\r\nNICK %s\r\nUSER %s 0 * :%s\r\nCAP END\r\n"
+               % (request, PASSWORD, nick, nick, nick)).encode())
+    read_until(s, " 004 ", 3)
+    return s
+
+
+def history(data):
+    """(tags, line) of every channel PRIVMSG in data, tags without '@' or None."""
+    out = []
+    for line in data.split("\r\n"):
+        m = re.match(r"(?:@(\S+) )?(:\S+ PRIVMSG #h :.*)$", line)
+        if m:
+            out.append((m.group(1), m.group(2)))
+    return out
+
+
+def without_batch(tags):
+    return ";".join(t for t in tags.split(";") if not t.startswith("batch=")) if tags else tags
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--binary", default="./ircserv")
+    parser.add_argument("--port", type=int, default=6703)
+    args = parser.parse_args()
+
+    workdir = tempfile.mkdtemp()
+    env = dict(os.environ, IRC_HISTORY_LINES="10", IRC_HISTORY_JOIN="10", IRC_HISTORY_AGE=str(AGE))
+    log = open(os.path.join(workdir, "out.log"), "w+")
+    server = subprocess.Popen([os.path.abspath(args.binary), str(args.port), PASSWORD], cwd=workdir, env=env,
+                              stdout=log, stderr=subprocess.STDOUT)
+    try:
+        time.sleep(0.5)
+        speaker = register(args.port, "speaker")
+        watcher = register(args.port, "watcher", "message-tags server-time")
+        for s in (speaker, watcher):
+            s.sendall(b"JOIN #h\r\n")
+            read_until(s, " 366 ", 2)
+        for i in range(LINES):
+            speaker.sendall(b"@+draft/label=x%d PRIVMSG #h :line %d\r\n" % (i, i))
+            time.sleep(0.02)
+        live = history(read_until(watcher, "line %d" % (LINES - 1), 3))
+        check(len(live) == LINES and all("msgid=" in t and "time=" in t for t, _ in live), "live lines are tagged")
+
+        full = register(args.port, "full", "batch message-tags server-time")
+        full.sendall(b"JOIN #h\r\n")
+        replay = read_until(full, "BATCH -", 3)
+        batch = re.search(r" BATCH \+(\S+) chathistory #h\r\n", replay)
+        check(batch is not None, "join replay comes in a chathistory batch")
+        lines = history(replay)
+        check(all(t and "batch=%s" % batch.group(1) in t.split(";") for t, _ in lines) if batch else False,
+              "every replayed line carries the batch reference")
+        check([(without_batch(t), line) for t, line in lines] == live, "replay has the time, msgid and client tags they went out with")
+
+        full.sendall(b"CHATHISTORY LATEST #h * 2\r\n")
+        lines = history(read_until(full, "BATCH -", 3))
+        check([(without_batch(t), line) for t, line in lines] == live[-2:], "CHATHISTORY has them too")
+
+        timed = register(args.port, "timed", "server-time")
+        timed.sendall(b"JOIN #h\r\n")
+        lines = history(read_until(timed, "line %d" % (LINES - 1), 3))
+        check([(t, line) for t, line in lines] == [(t.split(";")[0], line) for t, line in live],
+              "a server-time client gets only the time")
+
+        plain = register(args.port, "plain")
+        plain.sendall(b"JOIN #h\r\n")
+        lines = history(read_until(plain, "line %d" % (LINES - 1), 3))
+        check(lines == [(None, line) for _, line in live], "a plain client gets the bare lines")
+
+        # throttled by now, CHATHISTORY is expensive
+        full.sendall(b"JOIN #empty\r\n")
+        read_until(full, " 366 ", 5)
+        full.sendall(b"CHATHISTORY LATEST #empty * 10\r\n")
+        reply = read_until(full, "BATCH -", 5)
+        check(re.search(r"BATCH \+(\S+) chathistory #empty\r\n:\S+ BATCH -\1\r\n", reply) is not None,
+              "no history is an empty batch")
+
+        # #h was last written to more than AGE seconds ago by now, with nothing said since
+        deadline = time.time() + AGE + 3
+        while "[HISTORY] #h expired" not in open(log.name).read() and time.time() < deadline:
+            time.sleep(0.2)
+        check("[HISTORY] #h expired" in open(log.name).read(), "an idle channel's history expires by age")
+    finally:
+        server.terminate()
+        server.wait()
+    print("ALL OK" if not failed else "SOME FAILED")
+
+
+if __name__ == "__main__":
+    main()
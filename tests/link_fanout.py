@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+"""
+Cross-node fan-out benchmark for server links.
+
+Starts <nodes> ircserv instances on loopback, linked in a chain
+(node i connects to node i-1), puts <clients> users on every node into one
+channel and lets every user send <messages> lines (kept below the flood
+burst). Reports how long it takes until every member received every line.
+
+    python3 tests/link_fanout.py --nodes 3 --clients 50
+    python3 tests/link_fanout.py --nodes 1 --clients 150     # single server baseline
+"""
+
+import argparse
+import os
+import selectors
+import socket
+import subprocess
+import tempfile
+import time
+
+PASSWORD = "pw"
+LINK_PASSWORD = "linkpw"
+
+
+def start_nodes(binary, nodes, base_port, workdir):
+    procs = []
+    for i in range(nodes):
+        node_dir = os.path.join(workdir, "node%d" % i)
+        os.makedirs(node_dir)
+        env = dict(os.environ, IRC_SERVER_NAME="node%d.bench" % i, IRC_LINK_PASSWORD=LINK_PASSWORD)
+        if i > 0:
+            env["IRC_LINKS"] = "127.0.0.1:%d" % (base_port + i - 1)
+        procs.append(subprocess.Popen([binary, str(base_port + i), PASSWORD], cwd=node_dir, env=env,
+                                      stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL))
+        time.sleep(0.2)
+    return procs
+
+
+def connect_clients(nodes, clients, base_port):
+    socks = []
+    for i in range(nodes):
+        for j in range(clients):
+            nick = "n%du%d" % (i, j)
+            s = socket.create_connection(("127.0.0.1", base_port + i))
+            s.sendall(("PASS %s\r\nNICK %s\r\nUSER %s h\r\nJOIN #bench\r\n" % (PASSWORD, nick, nick)).encode())
+            socks.append(s)
+    return socks
+
+
+def drain(socks, seconds):
+    for s in socks:
+        s.setblocking(False)
+    end = time.time() + seconds
+    while time.time() < end:
+        for s in socks:
+            try:
+                while s.recv(1 << 16):
+                    pass
+            except BlockingIOError:
+                pass
+        time.sleep(0.05)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--binary", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "ircserv"))
+    parser.add_argument("--nodes", type=int, default=3)
+    parser.add_argument("--clients", type=int, default=50, help="users per node")
+    parser.add_argument("--messages", type=int, default=8, help="lines per user, below the flood burst of 10")
+    parser.add_argument("--port", type=int, default=6760)
+    parser.add_argument("--timeout", type=float, default=60.0)
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as workdir:
+        procs = start_nodes(os.path.abspath(args.binary), args.nodes, args.port, workdir)
+        try:
+            # links retry every few seconds; give the chain time to form before users join
+            time.sleep(1.0 + 0.2 * args.nodes)
+            socks = connect_clients(args.nodes, args.clients, args.port)
+            drain(socks, 2.0)
+
+            total_users = len(socks)
+            expected = args.messages * (total_users - 1)
+            payload = b"".join(b"PRIVMSG #bench :fanout %d\r\n" % k for k in range(args.messages))
+            received = {s: 0 for s in socks}
+            partial = {s: b"" for s in socks}
+            sel = selectors.DefaultSelector()
+            for s in socks:
+                sel.register(s, selectors.EVENT_READ)
+
+            start = time.time()
+            for s in socks:
+                s.setblocking(True)
+                s.sendall(payload)
+                s.setblocking(False)
+            done = 0
+            deadline = start + args.timeout
+            while done < total_users and time.time() < deadline:
+                for key, _ in sel.select(timeout=0.5):
+                    s = key.fileobj
+                    try:
+                        data = s.recv(1 << 16)
+                    except BlockingIOError:
+                        continue
+                    if not data:
+                        sel.unregister(s)
+                        continue
+                    lines = (partial[s] + data).split(b"\r\n")
+                    partial[s] = lines.pop()
+                    before = received[s]
+                    received[s] += sum(1 for line in lines if b" PRIVMSG #bench :fanout " in line)
+                    if before < expected <= received[s]:
+                        done += 1
+            elapsed = time.time() - start
+
+            deliveries = sum(min(n, expected) for n in received.values())
+            print("nodes: %d, users: %d, lines sent: %d" % (args.nodes, total_users, args.messages * total_users))
+            print("deliveries: %d of %d in %.3fs" % (deliveries, expected * total_users, elapsed))
+            print("throughput: %.0f deliveries/s" % (deliveries / elapsed if elapsed > 0 else 0))
+            if done < total_users:
+                print("INCOMPLETE: %d users missed lines" % (total_users - done))
+            for s in socks:
+                s.close()
+        finally:
+            for p in procs:
+                p.kill()
+                p.wait()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""
+Extra listeners from IRC_LISTEN: IPv6 and a unix-domain socket next to IPv4.
+
+Starts ircserv with "[::1]:<port>" and a unix socket whose file is left over
+from a dead server, registers one client on each, checks the hosts they get
+("0::1", "localhost"), that they talk to each other, and that all of them
+and both listeners survive a binary upgrade (SIGUSR2).
+
+    make && python3 tests/listeners_check.py [--binary ./ircserv]
+"""
+
+import argparse
+import os
+import signal
+import socket
+import subprocess
+import tempfile
+import time
+
+PASSWORD = "pw"
+
+failed = False
+
+
+def check(cond, what):
+    global failed
+    print(("PASS " if cond else "FAIL ") + what)
+    failed = failed or not cond
+
+
+def connect(family, address):
+    s = socket.socket(family, socket.SOCK_STREAM)
+    s.connect(address)
+    return s
+
+
+def register(s, nick):
+    s.sendall(("PASS %s\r\nNICK %s\r\nUSER %s 0 * :%s\r\n" % (PASSWORD, nick, nick, nick)).encode())
+    return read(s)
+
+
+def read(s, timeout=0.5):
+    s.settimeout(timeout)
+    data = b""
+    try:
+        while True:
+            chunk = s.recv(65536)
+            if not chunk:
+                break
+            data += chunk
+    except socket.timeout:
+        pass
+    return data.decode(errors="replace")
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--binary", default="./ircserv")
+    parser.add_argument("--port", type=int, default=6696)
+    args = parser.parse_args()
+
+    workdir = tempfile.mkdtemp()
+    path = os.path.join(workdir, "ircserv.sock")
+    stale = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    stale.bind(path)        # bound but closed: a socket file nobody accepts on
+    stale.close()
+
+    env = dict(os.environ, IRC_LISTEN="[::1]:%d,%s?class=bots&backlog=16" % (args.port, path))
+    server = subprocess.Popen([os.path.abspath(args.binary), str(args.port), PASSWORD], cwd=workdir, env=env,
+                              stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+    try:
+        time.sleep(0.5)
+        v4 = connect(socket.AF_INET, ("127.0.0.1", args.port))
+        v6 = connect(socket.AF_INET6, ("::1", args.port))
+        local = connect(socket.AF_UNIX, path)
+        check(" 001 " in register(v4, "four"), "registered over IPv4")
+        welcome = register(v6, "six")
+        check(" 001 " in welcome and "six!six@0::1" in welcome, "registered over IPv6, host 0::1")
+        welcome = register(local, "bot")
+        check(" 001 " in welcome and "bot!bot@localhost" in welcome, "registered over the unix socket, host localhost")
+
+        for s in (v4, v6, local):
+            s.sendall(b"JOIN #l\r\n")
+        read(v4)
+        read(v6)
+        read(local)
+
+        os.kill(server.pid, signal.SIGUSR2)
+        time.sleep(2)
+        v6.sendall(b"PRIVMSG #l :after upgrade\r\n")
+        check("PRIVMSG #l :after upgrade" in read(local), "clients kept across the upgrade")
+        late = connect(socket.AF_UNIX, path)
+        check(" 001 " in register(late, "late"), "unix listener taken over")
+        late6 = connect(socket.AF_INET6, ("::1", args.port))
+        check(" 001 " in register(late6, "late6"), "IPv6 listener taken over")
+    finally:
+        subprocess.run(["pkill", "-f", "%s %d %s" % (os.path.abspath(args.binary), args.port, PASSWORD)])
+        server.wait()
+    print("ALL OK" if not failed else "SOME FAILED")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,191 @@
+// Checks MaskMatcher against a plain recursive wildcard match, and the
+// per-user cache of ban checks in front of it.
+//
+// Random mask sets (sharing prefixes, with '?', '*' and runs of '*') are
+// compiled into one matcher each and every random subject must get the same
+// answer as matching each mask on its own, also with the case flipped. A set
+// of a thousand masks then has to keep its DFA at MASK_DFA_MAX_STATES while
+// answering correctly across several cache restarts. Finally a User's cached
+// check must be dropped on a new masks version and on every nick, user or
+// host change, since the signature it was computed for is gone.
+//
+//     make mask_check && ./mask_check
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Channel.h"
+#include "MaskMatcher.h"
+#include "User.h"
+
+namespace {
+    bool failed = false;
+
+    void check(const bool cond, const std::string& what) {
+        std::printf("%s %s\n", cond ? "PASS" : "FAIL", what.c_str());
+        failed = failed || !cond;
+    }
+
+    bool glob(const std::string_view mask, const std::string_view subject) {
+        if (mask.empty()) return subject.empty();
+        if (mask[0] == '*') {
+            for (size_t skip = 0; skip <= subject.size(); ++skip) {
+                if (glob(mask.substr(1), subject.substr(skip))) return true;
+            }
+            return false;
+        }
+        if (subject.empty()) return false;
+        if (mask[0] != '?' && std::tolower(static_cast<unsigned char>(mask[0])) != std::tolower(static_cast<unsigned char>(subject[0]))) {
+            return false;
+        }
+        return glob(mask.substr(1), subject.substr(1));
+    }
+
+    bool any_glob(const std::vector<std::string>& masks, const std::string_view subject) {
+        for (const std::string& mask : masks) {
+            if (glob(mask, subject)) return true;
+        }
+        return false;
+    }
+
+    std::string flip_case(std::string s) {
+        for (char& ch : s) {
+            const unsigned char c = static_cast<unsigned char>(ch);
+            ch = static_cast<char>(std::islower(c) ? std::toupper(c) : std::tolower(c));
+        }
+        return s;
+    }
+
+    // few letters, so that masks share prefixes and subjects hit them
+    std::string random_word(std::mt19937& rng, const std::string& alphabet, const size_t max_len) {
+        std::string word(rng() % (max_len + 1), ' ');
+        for (char& ch : word) {
+            ch = alphabet[rng() % alphabet.size()];
+        }
+        return word;
+    }
+
+    void differential(std::mt19937& rng) {
+        size_t  mismatches = 0;
+        size_t  matched = 0;
+        size_t  total = 0;
+        for (int round = 0; round < 200; ++round) {
+            std::vector<std::string>    masks;
+            const size_t                count = 1 + rng() % 8;
+            for (size_t i = 0; i < count; ++i) {
+                masks.push_back(random_word(rng, "abAB!@*?", 8));
+            }
+            MaskMatcher matcher(masks);
+            for (int i = 0; i < 200; ++i) {
+                const std::string   subject = random_word(rng, "abcAB!@", 10);
+                const bool          expected = any_glob(masks, subject);
+                matched += expected;
+                ++total;
+                mismatches += matcher.matches(subject) != expected;
+                mismatches += matcher.matches(flip_case(subject)) != expected;
+            }
+        }
+        check(mismatches == 0, "random mask sets agree with matching each mask alone (" + std::to_string(matched)
+                               + " of " + std::to_string(total) + " subjects match, " + std::to_string(mismatches) + " differ)");
+    }
+
+    void cases() {
+        MaskMatcher shared({"nick!*@*", "nickel!*@*", "ni?k!user@*", "*!*@*.example"});
+        check(shared.matches("nick!u@h") && shared.matches("nickel!u@h") && shared.matches("nirk!user@h")
+              && shared.matches("x!y@host.example"), "masks with a common prefix all match");
+        check(!shared.matches("nic!u@h") && !shared.matches("nickels!u@h") && !shared.matches("nirk!other@h")
+              && !shared.matches("x!y@example"), "and only their own subjects");
+
+        MaskMatcher collapsed({"a**b!*@*"});
+        MaskMatcher single({"a*b!*@*"});
+        bool        same = true;
+        for (const char* subject : {"ab!x@y", "axb!x@y", "axxb!x@y", "a!x@y", "b!x@y", "abx!x@y"}) {
+            same = same && collapsed.matches(subject) == single.matches(subject);
+        }
+        check(same, "\"**\" matches like \"*\"");
+        MaskMatcher stars({"***"});
+        check(stars.matches("") && stars.matches("anything!at@all"), "a mask of only stars matches everything");
+
+        MaskMatcher folded({"BaD!*@*.Example"});
+        check(folded.matches("bad!u@host.EXAMPLE") && folded.matches("BAD!U@HOST.example"), "matching folds ASCII case");
+        check(!folded.matches("bac!u@host.example"), "folding does not merge other letters");
+        MaskMatcher symbols({"a[b!*@*"});
+        check(symbols.matches("A[B!x@y") && !symbols.matches("a{b!x@y"), "symbols match only themselves");
+
+        MaskMatcher none({});
+        check(!none.matches("") && !none.matches("a!b@c"), "an empty list matches nothing");
+
+        check(MaskMatcher::normalize("nick") == "nick!*@*" && MaskMatcher::normalize("u@h") == "*!u@h"
+              && MaskMatcher::normalize("n!u") == "n!u@*" && MaskMatcher::normalize("n!u@h") == "n!u@h",
+              "short masks are completed to nick!user@host");
+    }
+
+    void dfa_limit(std::mt19937& rng) {
+        std::vector<std::string>    masks;
+        for (int i = 0; i < 1000; ++i) {
+            masks.push_back("n" + std::to_string(i * 7919 % 100000) + "*!*@*");
+        }
+        MaskMatcher matcher(masks);
+        size_t      peak = 0;
+        size_t      restarts = 0;
+        size_t      previous = matcher.dfa_states();
+        size_t      mismatches = 0;
+        for (int i = 0; i < 20000; ++i) {
+            const std::string   subject = "n" + std::to_string(rng() % 1000000) + "!u@h";
+            mismatches += matcher.matches(subject) != any_glob(masks, subject);
+            const size_t        states = matcher.dfa_states();
+            peak = std::max(peak, states);
+            restarts += states < previous;
+            previous = states;
+        }
+        check(peak == MASK_DFA_MAX_STATES, "the DFA grows up to MASK_DFA_MAX_STATES (" + std::to_string(peak) + ")");
+        check(restarts > 0, "and is started over past it (" + std::to_string(restarts) + " times)");
+        check(mismatches == 0, "answers stay right across restarts");
+    }
+
+    void ban_cache() {
+        Channel channel("#c", "op");
+        channel.add_mask('b', MaskEntry{"bad!*@*", "op", 0});
+        const uint64_t  version = channel.get_masks_version();
+        channel.add_mask('e', MaskEntry{"*!*@trusted", "op", 0});
+        check(channel.get_masks_version() != version, "a list change gives a new masks version");
+        check(channel.masks_match('b', "BAD!u@h") && channel.masks_match('e', "x!y@trusted")
+              && !channel.masks_match('I', "x!y@trusted"), "each list matches on its own");
+        channel.remove_mask('b', "bad!*@*");
+        check(!channel.masks_match('b', "bad!u@h"), "a removed mask no longer matches");
+
+        User    user;
+        user.set_nickname("bad");
+        user.set_username("u");
+        user.set_hostname("h");
+        const uint64_t  current = channel.get_masks_version();
+        user.cache_ban_check("#c", BanCheck{current, true, false});
+        const BanCheck* cached = user.cached_ban_check("#c", current);
+        check(cached != nullptr && cached->banned, "a check is cached per channel and version");
+        check(user.cached_ban_check("#c", current + 1) == nullptr, "a new masks version misses");
+        check(user.cached_ban_check("#d", current) == nullptr, "another channel misses");
+        user.set_nickname("good");
+        check(user.cached_ban_check("#c", current) == nullptr, "a nick change drops the cache");
+        user.cache_ban_check("#c", BanCheck{current, true, false});
+        user.set_hostname("elsewhere");
+        check(user.cached_ban_check("#c", current) == nullptr, "a host change drops the cache");
+        user.cache_ban_check("#c", BanCheck{current, true, false});
+        user.set_username("other");
+        check(user.cached_ban_check("#c", current) == nullptr, "a user change drops the cache");
+    }
+}
+
+int main() {
+    std::mt19937    rng(42);
+    cases();
+    differential(rng);
+    dfa_limit(rng);
+    ban_cache();
+    std::printf("%s\n", failed ? "SOME FAILED" : "ALL OK");
+    return failed ? 1 : 0;
+}
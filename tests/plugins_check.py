@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""
+The plugin API with the example channel guard, plugins/badwords.so.
+
+Starts ircserv with IRC_PLUGINS and two filtered words, checks the notice
+sent on registration, that clean channel messages go through while filtered
+ones are dropped with a warning, that the third strike disconnects the
+sender, and that a plugin which cannot be loaded stops the startup.
+
+    make && make plugins && python3 tests/plugins_check.py [--binary ./ircserv]
+"""
+
+import argparse
+import os
+import socket
+import subprocess
+import tempfile
+import time
+
+PASSWORD = "pw"
+
+failed = False
+
+
+def check(cond, what):
+    global failed
+    print(("PASS " if cond else "FAIL ") + what)
+    failed = failed or not cond
+
+
+def register(port, nick):
+    s = socket.create_connection(("127.0.0.1", port))
+    s.sendall(("PASS %s\r\nNICK %s\r\nUSER %s 0 * :%s\r\n" % (PASSWORD, nick, nick, nick)).encode())
+    return s, read(s)
+
+
+def read(s, timeout=0.5):
+    s.settimeout(timeout)
+    data = b""
+    try:
+        while True:
+            chunk = s.recv(65536)
+            if not chunk:
+                break
+            data += chunk
+    except socket.timeout:
+        pass
+    return data.decode(errors="replace")
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--binary", default="./ircserv")
+    parser.add_argument("--plugin", default="plugins/badwords.so")
+    parser.add_argument("--port", type=int, default=6697)
+    args = parser.parse_args()
+
+    binary = os.path.abspath(args.binary)
+    env = dict(os.environ, IRC_PLUGINS=os.path.abspath(args.plugin), IRC_BADWORDS="Spam,scam")
+    server = subprocess.Popen([binary, str(args.port), PASSWORD], cwd=tempfile.mkdtemp(), env=env,
+                              stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        time.sleep(0.5)
+        alice, welcome = register(args.port, "alice")
+        check(" 001 " in welcome and "NOTICE alice :This server filters 2 words" in welcome, "notice on registration")
+        bob, _ = register(args.port, "bob")
+        for s in (alice, bob):
+            s.sendall(b"JOIN #guard\r\n")
+        read(alice)
+        read(bob)
+
+        alice.sendall(b"PRIVMSG #guard :hello there\r\n")
+        check("PRIVMSG #guard :hello there" in read(bob), "clean message delivered")
+        alice.sendall(b"PRIVMSG #guard :buy SPAM now\r\n")
+        check("SPAM" not in read(bob), "filtered message dropped")
+        check("Message to #guard blocked (1/3)" in read(alice), "sender warned")
+        alice.sendall(b"PRIVMSG bob :spam is fine in private\r\n")
+        check("spam is fine in private" in read(bob), "private messages not filtered")
+
+        alice.sendall(b"PRIVMSG #guard :scam\r\nPRIVMSG #guard :spam\r\n")
+        reply = read(alice)
+        check("(3/3)" in reply and "ERROR :Closing Link" in reply, "third strike disconnects")
+        check("QUIT" in read(bob), "channel sees the quit")
+    finally:
+        server.terminate()
+        server.wait()
+
+    env["IRC_PLUGINS"] = "/nonexistent/plugin.so"
+    result = subprocess.run([binary, str(args.port), PASSWORD], cwd=tempfile.mkdtemp(), env=env,
+                            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL, timeout=10)
+    check(result.returncode != 0, "missing plugin stops the startup")
+    print("ALL OK" if not failed else "SOME FAILED")
+
+
+if __name__ == "__main__":
+    main()
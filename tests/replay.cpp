@@ -0,0 +1,227 @@
+// Replays a traffic capture (IRC_CAPTURE=<file> ./ircserv ...) into SrvMgr in-process.
+//
+// The server runs without sockets: every captured connection gets a
+// placeholder connection slot, captured lines go straight to the handler and
+// all output ends up in this program. Poll iterations end where they ended
+// when the capture was taken, so output is produced at the same points.
+// Reported are throughput and the handler cost per command; SrvMgr's console
+// output is discarded so it does not dominate the numbers.
+//
+// --out writes every outbound line as "<conn> <line>", with Unix and ISO
+// timestamps and msgid prefixes masked, and --compare checks the output
+// against such a file from an earlier build: identical input, so any
+// difference is a behaviour change.
+//
+//     make replay && ./replay <capture> <password> [--paced] [--out file] [--compare file]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "mplexserver.h"
+#include "SrvMgr.h"
+
+using namespace MPlexServer;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+    constexpr auto SERVER_NAME = "irc.LeMaDa.hn";
+
+    // swallows SrvMgr's logging
+    class NullBuffer : public std::streambuf {
+    protected:
+        int overflow(const int ch) override { return ch; }
+        std::streamsize xsputn(const char*, const std::streamsize n) override { return n; }
+    };
+
+    class Transcript : public OutputSink {
+    public:
+        std::unordered_map<int, uint32_t>   ids;        // fd -> capture connection id
+        size_t                              bytes = 0;
+        std::vector<std::string>            lines;
+        bool                                keep_lines = false;
+
+        void write(const Client& client, const std::string_view data) override {
+            bytes += data.size();
+            if (!keep_lines) return;
+            const uint32_t  id = ids[client.getFd()];
+            std::string&    partial = partials[id];
+            partial.append(data);
+            size_t start = 0;
+            size_t end;
+            while ((end = partial.find("\r\n", start)) != std::string::npos) {
+                lines.push_back(std::to_string(id) + " " + mask_volatile(partial.substr(start, end - start)));
+                start = end + 2;
+            }
+            partial.erase(0, start);
+        }
+
+    private:
+        std::unordered_map<uint32_t, std::string> partials;
+
+        // timestamps and the random per-process prefix of msgids (MsgIdGenerator); the counter
+        // behind it stays, so ids handed out in another order still show up as a difference
+        static std::string mask_volatile(const std::string& line) {
+            static const std::regex iso("\\d{4}-\\d\\d-\\d\\dT\\d\\d:\\d\\d:\\d\\d(\\.\\d+)?Z");
+            static const std::regex unix_time("\\b\\d{10}\\b");
+            static const std::regex msgid("msgid=[0-9a-f]{8}");
+            std::string masked = std::regex_replace(std::regex_replace(line, iso, "<time>"), unix_time, "<time>");
+            return std::regex_replace(masked, msgid, "msgid=<id>");
+        }
+    };
+
+    struct Cost {
+        size_t          calls = 0;
+        Clock::duration total{};
+    };
+
+    std::string command_of(const std::string& line) {
+        std::stringstream   words(line);
+        std::string         word;
+        words >> word;
+        if (!word.empty() && word[0] == ':') words >> word;
+        std::transform(word.begin(), word.end(), word.begin(), ::toupper);
+        return word.empty() ? "(empty)" : word;
+    }
+
+    bool read_transcript(const std::string& path, std::vector<std::string>& lines) {
+        std::ifstream   file(path);
+        std::string     line;
+        if (!file) return false;
+        while (std::getline(file, line)) lines.push_back(line);
+        return true;
+    }
+
+    int compare(const std::vector<std::string>& ours, const std::string& path) {
+        std::vector<std::string> theirs;
+        if (!read_transcript(path, theirs)) {
+            std::cerr << "cannot read " << path << std::endl;
+            return 2;
+        }
+        size_t first = 0;
+        size_t differing = 0;
+        for (size_t i = 0; i < std::max(ours.size(), theirs.size()); ++i) {
+            if (i < ours.size() && i < theirs.size() && ours[i] == theirs[i]) continue;
+            if (differing++ == 0) first = i;
+        }
+        if (differing == 0) {
+            std::printf("output identical to %s (%zu lines)\n", path.c_str(), ours.size());
+            return 0;
+        }
+        std::printf("output differs from %s: %zu of %zu/%zu lines, first at line %zu\n",
+                    path.c_str(), differing, ours.size(), theirs.size(), first + 1);
+        std::printf("  this build: %s\n", first < ours.size() ? ours[first].c_str() : "(end)");
+        std::printf("  %s: %s\n", path.c_str(), first < theirs.size() ? theirs[first].c_str() : "(end)");
+        return 1;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " <capture> <password> [--paced] [--out file] [--compare file]" << std::endl;
+        return 2;
+    }
+    bool        paced = false;
+    std::string out_path;
+    std::string compare_path;
+    for (int i = 3; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--paced") == 0) paced = true;
+        else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc) out_path = argv[++i];
+        else if (std::strcmp(argv[i], "--compare") == 0 && i + 1 < argc) compare_path = argv[++i];
+        else {
+            std::cerr << "unknown option " << argv[i] << std::endl;
+            return 2;
+        }
+    }
+
+    Transcript  transcript;
+    transcript.keep_lines = !out_path.empty() || !compare_path.empty();
+    NullBuffer  null_buffer;
+    std::streambuf* console = std::cout.rdbuf(&null_buffer);
+
+    std::map<std::string, Cost>     costs;
+    size_t                          lines = 0;
+    size_t                          connections = 0;
+    Clock::duration                 busy{};
+    try {
+        CaptureReader   reader(argv[1]);
+        IrcServer       srv(0);
+        SrvMgr          sm(srv, argv[2], SERVER_NAME);
+        srv.setEventHandler(&sm);
+        srv.setVerbose(0);
+        srv.activateReplay(transcript);
+
+        std::unordered_map<uint32_t, Client>    clients;
+        CaptureRecord                           record;
+        const Clock::time_point                 start = Clock::now();
+        while (reader.next(record)) {
+            if (paced) std::this_thread::sleep_until(start + std::chrono::microseconds(record.at_us));
+            const Clock::time_point before = Clock::now();
+            switch (record.event) {
+                case CaptureEvent::CONNECT: {
+                    // the slot must be known before onConnect produces output
+                    Client client = srv.replayConnect(record.addr);
+                    clients[record.conn] = client;
+                    transcript.ids[client.getFd()] = record.conn;
+                    ++connections;
+                    break;
+                }
+                case CaptureEvent::LINE: {
+                    auto it = clients.find(record.conn);
+                    if (it == clients.end()) break;
+                    Cost& cost = costs[command_of(record.line)];
+                    srv.replayLine(it->second, std::move(record.line));
+                    cost.calls++;
+                    cost.total += Clock::now() - before;
+                    ++lines;
+                    break;
+                }
+                case CaptureEvent::DISCONNECT: {
+                    auto it = clients.find(record.conn);
+                    if (it == clients.end()) break;
+                    srv.replayDisconnect(it->second);
+                    clients.erase(it);
+                    break;
+                }
+                case CaptureEvent::POLL_END:
+                    srv.replayPollEnd();
+                    break;
+            }
+            busy += Clock::now() - before;
+        }
+        srv.replayPollEnd();
+    } catch (std::exception& e) {
+        std::cout.rdbuf(console);
+        std::cerr << "replay failed: " << e.what() << std::endl;
+        return 2;
+    }
+    std::cout.rdbuf(console);
+
+    const double seconds = std::chrono::duration<double>(busy).count();
+    std::printf("%zu connections, %zu lines in %.3f s busy: %.0f lines/s, %zu bytes out\n",
+                connections, lines, seconds, seconds > 0 ? lines / seconds : 0.0, transcript.bytes);
+    std::printf("%-12s %10s %12s %10s\n", "command", "calls", "total ms", "ns/call");
+    std::vector<std::pair<std::string, Cost>> sorted(costs.begin(), costs.end());
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.second.total > b.second.total; });
+    for (const auto& [command, cost] : sorted) {
+        const double ns = std::chrono::duration<double, std::nano>(cost.total).count();
+        std::printf("%-12s %10zu %12.3f %10.0f\n", command.c_str(), cost.calls, ns / 1e6, ns / cost.calls);
+    }
+
+    if (!out_path.empty()) {
+        std::ofstream out(out_path);
+        for (const std::string& line : transcript.lines) out << line << '\n';
+        std::printf("transcript written to %s\n", out_path.c_str());
+    }
+    return compare_path.empty() ? 0 : compare(transcript.lines, compare_path);
+}
@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+"""
+Priority classes of the send queue and bulk shedding at the SendQ limit.
+
+A reader joins a channel through a listener with a tiny socket send buffer
+and stops reading while another member floods the channel far past its
+SendQ. Its PING must still be answered ahead of the queued channel traffic,
+the channel lines it gets must be whole and in order, the excess must have
+been dropped for it alone, and a KICK must reach it ahead of the backlog too.
+Its own JOIN, though sent to the whole channel, must precede the names reply.
+A slow bystander must get a KICK behind the lines the kicked user sent
+before it, and a slow reader flooded with private messages, which are not
+dropped, must be disconnected once past twice the SendQ. A server linking
+in must get a burst far beyond that, since links have their own limit.
+
+    make && python3 tests/sendq_check.py [--binary ./ircserv]
+"""
+
+import argparse
+import os
+import re
+import socket
+import subprocess
+import tempfile
+import time
+
+PASSWORD = "pw"
+LINES = 3000
+PAYLOAD = "x" * 300
+LINK_PASSWORD = "linkpw"
+BURST_CHANNELS = 400
+
+failed = False
+
+
+def check(cond, what):
+    global failed
+    print(("PASS " if cond else "FAIL ") + what)
+    failed = failed or not cond
+
+
+def register(port, nick, rcvbuf=0):
+    s = socket.socket()
+    if rcvbuf:
+        s.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, rcvbuf)
+    s.connect(("127.0.0.1", port))
+    s.sendall(("PASS %s\r\nNICK %s\r\nUSER %s 0 * :%s\r\n" % (PASSWORD, nick, nick, nick)).encode())
+    return s, read(s)
+
+
+def read(s, timeout=0.5):
+    s.settimeout(timeout)
+    data = b""
+    try:
+        while True:
+            chunk = s.recv(65536)
+            if not chunk:
+                break
+            data += chunk
+    except socket.timeout:
+        pass
+    return data.decode(errors="replace")
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--binary", default="./ircserv")
+    parser.add_argument("--port", type=int, default=6693)
+    args = parser.parse_args()
+
+    workdir = tempfile.mkdtemp()
+    path = os.path.join(workdir, "ircserv.conf")
+    with open(path, "w") as f:
+        f.write("log_level = 1\nflood_rate = 100000\nflood_burst = 100000\nrecvq_max = 4194304\nsendq_max = 65536\n"
+                "listen = 127.0.0.1:%d?sndbuf=4096\n" % (args.port + 1))
+    log = open(os.path.join(workdir, "out.log"), "w+")
+    env = dict(os.environ, IRC_SERVER_NAME="a.test", IRC_LINK_PASSWORD=LINK_PASSWORD)
+    server = subprocess.Popen([os.path.abspath(args.binary), str(args.port), PASSWORD, path], cwd=workdir, env=env,
+                              stdout=log, stderr=subprocess.STDOUT)
+    linked = None
+    try:
+        time.sleep(0.5)
+        op, _ = register(args.port, "op")
+        fast, _ = register(args.port, "fast")
+        slow, _ = register(args.port + 1, "slow", rcvbuf=4096)
+        for s in (op, fast, slow):
+            s.sendall(b"JOIN #big\r\n")
+            time.sleep(0.1)
+        joined = read(slow)
+        for s in (op, fast):
+            read(s)
+        # the joiner's own JOIN goes out with the channel, but is a reply to it all the same
+        check(-1 < joined.find(" JOIN ") < joined.find(" 353 "), "own JOIN ahead of the names reply")
+
+        # the slow reader does not read while the channel is flooded
+        op.sendall(b"".join(b"PRIVMSG #big :n%d %s\r\n" % (i, PAYLOAD.encode()) for i in range(LINES)))
+        fast_lines = 0
+        deadline = time.time() + 10
+        while fast_lines < LINES and time.time() < deadline:
+            fast_lines += read(fast, 0.3).count("PRIVMSG #big")
+        check(fast_lines == LINES, "a member that keeps up gets every line (%d)" % fast_lines)
+
+        slow.sendall(b"PING :prio\r\n")
+        time.sleep(0.3)
+        op.sendall(b"KICK #big slow :bye\r\n")
+        time.sleep(0.3)
+        received = read(slow, 1.5)
+        lines = received.split("\r\n")[:-1]
+        pong = next((i for i, line in enumerate(lines) if " PONG " in line), None)
+        kick = next((i for i, line in enumerate(lines) if " KICK #big slow" in line), None)
+        chat = [line for line in lines if " PRIVMSG #big " in line]
+        check(pong is not None and pong < len(lines) // 2, "PONG ahead of the backlog (line %s of %d)" % (pong, len(lines)))
+        check(kick is not None and kick < len(lines) // 2, "KICK ahead of the backlog (line %s of %d)" % (kick, len(lines)))
+        numbers = [int(m.group(1)) for m in (re.search(r"PRIVMSG #big :n(\d+) x+$", line) for line in chat) if m]
+        check(len(numbers) == len(chat) and numbers == sorted(numbers), "channel lines whole and in order")
+        check(0 < len(chat) < LINES, "excess channel traffic shed (%d of %d kept)" % (len(chat), LINES))
+        log.flush()
+        check("dropping bulk messages" in open(log.name).read(), "shedding logged")
+
+        # a bystander with a backlog keeps the channel's order
+        watch, _ = register(args.port + 1, "watch", rcvbuf=4096)
+        victim, _ = register(args.port, "victim")
+        for s in (op, watch, victim):
+            s.sendall(b"JOIN #small\r\n")
+            time.sleep(0.1)
+        for s in (op, watch, victim):
+            read(s)
+        victim.sendall(b"".join(b"PRIVMSG #small :v%d %s\r\n" % (i, PAYLOAD.encode()) for i in range(150)))
+        time.sleep(0.5)
+        op.sendall(b"KICK #small victim :bye\r\n")
+        time.sleep(0.3)
+        lines = read(watch, 1.5).split("\r\n")
+        said = [i for i, line in enumerate(lines) if " PRIVMSG #small " in line]
+        kick = next((i for i, line in enumerate(lines) if " KICK #small victim" in line), None)
+        check(len(said) == 150 and kick is not None and kick > said[-1],
+              "bystander gets the KICK behind the kicked user's lines (%d lines, KICK at %s)" % (len(said), kick))
+
+        # private messages are replies to nobody, but still bounded
+        deaf, _ = register(args.port + 1, "deaf", rcvbuf=4096)
+        op.sendall(b"".join(b"PRIVMSG deaf :d%d %s\r\n" % (i, PAYLOAD.encode()) for i in range(1000)))
+        time.sleep(1)
+        deaf.settimeout(0.5)
+        gone = False
+        try:
+            while deaf.recv(65536):
+                pass
+            gone = True
+        except socket.timeout:
+            pass
+        except OSError:
+            gone = True
+        log.flush()
+        check(gone and "SendQ exceeded" in open(log.name).read(), "private flood past twice the SendQ disconnects")
+        op.sendall(b"PING :still\r\n")
+        check("still" in read(op), "the sender stays connected")
+
+        # the burst to a new link is queued in one go, many times the SendQ
+        for i in range(BURST_CHANNELS):
+            op.sendall(b"JOIN #l%d\r\nTOPIC #l%d :%s\r\n" % (i, i, PAYLOAD.encode()))
+        read(op, 1)
+        link_dir = tempfile.mkdtemp()
+        link_log = open(os.path.join(link_dir, "out.log"), "w+")
+        link_path = os.path.join(link_dir, "ircserv.conf")
+        with open(link_path, "w") as f:
+            f.write("log_level = 1\nsendq_max = 65536\n")
+        env = dict(os.environ, IRC_SERVER_NAME="b.test", IRC_LINK_PASSWORD=LINK_PASSWORD,
+                   IRC_LINKS="127.0.0.1:%d" % args.port)
+        linked = subprocess.Popen([os.path.abspath(args.binary), str(args.port + 2), PASSWORD, link_path], cwd=link_dir,
+                                  env=env, stdout=link_log, stderr=subprocess.STDOUT)
+        time.sleep(2)
+        remote, _ = register(args.port + 2, "remote")
+        remote.sendall(b"JOIN #l%d\r\n" % (BURST_CHANNELS - 1))
+        check(" 332 remote #l%d " % (BURST_CHANNELS - 1) in read(remote, 1),
+              "a link takes a burst of %d KiB with a SendQ of 64 KiB" % (BURST_CHANNELS * 2 * len(PAYLOAD) // 1024))
+        log.flush()
+        check(open(log.name).read().count("SendQ exceeded") == 1, "and is not disconnected")
+    finally:
+        if linked is not None:
+            linked.terminate()
+            linked.wait()
+        server.terminate()
+        server.wait()
+    print("ALL OK" if not failed else "SOME FAILED")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,215 @@
+#!/usr/bin/env python3
+"""
+Binary upgrade (SIGUSR2) with half-done I/O, a client leaving during the
+handoff and channels restored from the channel log.
+
+The server is killed once so that two +k channels come back from the log;
+one is rejoined (live again), the other stays dormant. Then, before the
+upgrade, a client has half a line in its receive buffer, a reader with a
+tiny socket buffer has megabytes of channel traffic queued, and a third
+client closes its socket while the server is stopped, so that the handoff
+carries a dead connection. After the upgrade the line must complete, the
+reader get every line in order, the dead client's QUIT reach its channel
+and its nick and sole channel be free. The dormant channel must keep its
+key and its operator from the log, while the live one, once everybody
+left, must start over as a new channel, also after a crash of the new
+process.
+
+    make && python3 tests/upgrade_check.py [--binary ./ircserv]
+"""
+
+import argparse
+import os
+import re
+import signal
+import socket
+import subprocess
+import tempfile
+import time
+
+PASSWORD = "pw"
+LINES = 20000
+FILL = "x" * 400
+
+failed = False
+
+
+def check(cond, what):
+    global failed
+    print(("PASS " if cond else "FAIL ") + what)
+    failed = failed or not cond
+
+
+def read(s, timeout=0.5):
+    s.settimeout(timeout)
+    data = b""
+    try:
+        while True:
+            chunk = s.recv(65536)
+            if not chunk:
+                break
+            data += chunk
+    except (socket.timeout, ConnectionResetError):
+        pass
+    return data.decode(errors="replace")
+
+
+def read_until(s, needle, timeout):
+    data = ""
+    deadline = time.time() + timeout
+    while needle not in data and time.time() < deadline:
+        data += read(s, 0.2)
+    return data
+
+
+def register(port, nick, rcvbuf=0):
+    s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    if rcvbuf:
+        s.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, rcvbuf)
+    s.connect(("127.0.0.1", port))
+    s.sendall(("PASS %s\r\nNICK %s\r\nUSER %s 0 * :%s\r\n" % (PASSWORD, nick, nick, nick)).encode())
+    welcome = read_until(s, " 004 ", 5)
+    return s, welcome
+
+
+def join(s, channel, key=""):
+    s.sendall(("JOIN %s %s\r\n" % (channel, key)).encode())
+    reply = read_until(s, "\r\n", 3) + read(s, 0.3)
+    m = re.search(r" (47[1345]|JOIN) ", reply)
+    return m.group(1) if m else reply, reply
+
+
+def start(binary, port, workdir, config, log):
+    server = subprocess.Popen([binary, str(port), PASSWORD, config], cwd=workdir, stdout=log, stderr=subprocess.STDOUT)
+    time.sleep(0.5)
+    return server
+
+
+def log_text(log):
+    log.flush()
+    return open(log.name).read()
+
+
+def wait_log(log, needle, timeout):
+    deadline = time.time() + timeout
+    while needle not in log_text(log) and time.time() < deadline:
+        time.sleep(0.1)
+    return needle in log_text(log)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--binary", default="./ircserv")
+    parser.add_argument("--port", type=int, default=6705)
+    args = parser.parse_args()
+
+    binary = os.path.abspath(args.binary)
+    workdir = tempfile.mkdtemp()
+    config = os.path.join(workdir, "ircserv.conf")
+    with open(config, "w") as f:
+        # room for the reader's backlog, which would otherwise be shed
+        f.write("log_level = 1\nflood_rate = 1000000\nflood_burst = 1000000\nsendq_max = %d\n" % (64 << 20))
+    log = open(os.path.join(workdir, "out.log"), "w+")
+    server = start(binary, args.port, workdir, config, log)
+    upgraded = None
+    try:
+        keeper, _ = register(args.port, "keeper")
+        keeper.sendall(b"JOIN #dormant\r\nMODE #dormant +k k1\r\nTOPIC #dormant :dormant\r\n"
+                       b"JOIN #live\r\nMODE #live +k k2\r\nTOPIC #live :live\r\n")
+        read_until(keeper, "TOPIC #live", 3)
+        time.sleep(0.3)
+        server.send_signal(signal.SIGKILL)
+        server.wait()
+        keeper.close()
+
+        server = start(binary, args.port, workdir, config, log)
+        check("[CHANLOG] Recovered 2 channels" in log_text(log), "both channels come back from the log")
+        keeper, _ = register(args.port, "keeper")
+        got, reply = join(keeper, "#live")
+        check(got == "JOIN" and "@keeper" in reply, "the operator brings #live back to life")
+        watcher, _ = register(args.port, "watcher")
+        half, _ = register(args.port, "half")
+        leaver, _ = register(args.port, "leaver")
+        for s in (watcher, half, leaver):
+            join(s, "#live", "k2")
+        join(leaver, "#gone")
+        slow, _ = register(args.port, "slow", rcvbuf=4096)
+        speaker, _ = register(args.port, "speaker")
+        join(slow, "#flood")
+        join(speaker, "#flood")
+        read(watcher, 0.3)
+
+        speaker.sendall("".join("PRIVMSG #flood :%06d %s\r\n" % (i, FILL) for i in range(LINES)).encode())
+        speaker.sendall(b"PING :sent\r\n")
+        check("sent" in read_until(speaker, "sent", 20), "the speaker's %d lines are all taken" % LINES)
+        half.sendall(b"PRIVMSG #live :hal")
+        # the reader's socket buffers fill up and the server goes idle in epoll_wait()
+        time.sleep(1)
+
+        # stopped there, it sees the close only after the SIGUSR2 that interrupts the wait: the handoff
+        # carries the closed connection
+        server.send_signal(signal.SIGSTOP)
+        time.sleep(0.2)
+        leaver.close()
+        time.sleep(0.2)
+        server.send_signal(signal.SIGUSR2)
+        time.sleep(0.1)
+        server.send_signal(signal.SIGCONT)
+        check(wait_log(log, "Upgrade complete", 10), "the upgrade completes")
+        server.wait()
+        pid = re.search(r"handed (\d+) clients over to pid (\d+)", log_text(log))
+        upgraded = int(pid.group(2)) if pid else None
+        check(pid is not None and pid.group(1) == "6", "the closed client is handed over too (%s)"
+              % (pid.group(1) if pid else "none"))
+
+        half.sendall(b"lo\r\n")
+        seen = read_until(watcher, "hallo", 3)
+        seen += read_until(watcher, " QUIT ", 3) if " QUIT " not in seen else ""
+        check("PRIVMSG #live :hallo\r\n" in seen, "a line split by the upgrade arrives whole")
+        check(re.search(r":leaver!\S+ QUIT ", seen) is not None, "the dropped client's QUIT reaches its channel")
+
+        backlog = read_until(slow, "PRIVMSG #flood :%06d " % (LINES - 1), 30)
+        backlog += read_until(slow, "\r\n", 1) if not backlog.endswith("\r\n") else ""
+        numbers = [int(m.group(1)) for m in re.finditer(r"PRIVMSG #flood :(\d{6}) %s\r\n" % FILL, backlog)]
+        check(numbers == list(range(LINES)), "queued output survives in order and complete (%d of %d lines)"
+              % (len(numbers), LINES))
+
+        newcomer, welcome = register(args.port, "leaver")
+        check(" 004 " in welcome, "the dropped client's nick is free")
+        got, reply = join(newcomer, "#gone")
+        check(got == "JOIN" and "@leaver" in reply, "and its channel ended with it")
+
+        stranger, _ = register(args.port, "stranger")
+        got, _ = join(stranger, "#dormant")
+        check(got == "475", "the dormant channel keeps its key from the log (%s)" % got)
+        got, reply = join(keeper, "#dormant")
+        check(got == "JOIN" and "@keeper" in reply and re.search(r" 332 keeper #dormant :?dormant\r\n", reply) is not None,
+              "and its operator and topic")
+
+        for s in (keeper, watcher, half):
+            s.sendall(b"PART #live\r\n")
+            read_until(s, " PART ", 3)
+        got, reply = join(stranger, "#live")
+        check(got == "JOIN" and "@stranger" in reply, "a channel live at the upgrade starts over once it ended (%s)" % got)
+        stranger.sendall(b"PART #live\r\n")
+        read_until(stranger, " PART ", 3)
+        time.sleep(0.3)
+
+        os.kill(upgraded, signal.SIGKILL)
+        upgraded = None
+        server = start(binary, args.port, workdir, config, log)
+        other, _ = register(args.port, "other")
+        got, reply = join(other, "#live")
+        check(got == "JOIN" and "@other" in reply, "the new process logged its end (%s)" % got)
+        got, _ = join(other, "#dormant")
+        check(got == "475", "and kept the dormant channel (%s)" % got)
+    finally:
+        if upgraded is not None:
+            os.kill(upgraded, signal.SIGKILL)
+        server.terminate()
+        server.wait()
+    print("ALL OK" if not failed else "SOME FAILED")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+"""
+Checks the WebSocket listener against a plain TCP client.
+
+Starts ircserv with IRC_WS_PORT, upgrades a raw socket to a WebSocket
+(RFC 6455, masked client frames) and talks IRC over it: registration, a
+channel shared with a TCP client in both directions, fragmented messages,
+ping/pong, the binary subprotocol, a rejected upgrade, an unmasked frame
+and the close handshake.
+
+    make && python3 tests/websocket_check.py
+"""
+
+import argparse
+import base64
+import hashlib
+import os
+import socket
+import struct
+import subprocess
+import tempfile
+import time
+
+PASSWORD = "pw"
+GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+failed = False
+
+
+def check(cond, what):
+    global failed
+    print(("PASS " if cond else "FAIL ") + what)
+    failed = failed or not cond
+
+
+class WsClient:
+    def __init__(self, port, protocols=None):
+        self.sock = socket.create_connection(("127.0.0.1", port))
+        self.sock.settimeout(1)
+        self.buf = b""
+        key = base64.b64encode(os.urandom(16)).decode()
+        request = ("GET / HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: keep-alive, Upgrade\r\n"
+                   "Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n" % key)
+        if protocols:
+            request += "Sec-WebSocket-Protocol: %s\r\n" % protocols
+        self.sock.sendall((request + "\r\n").encode())
+        while b"\r\n\r\n" not in self.buf:
+            self.buf += self.sock.recv(4096)
+        head, self.buf = self.buf.split(b"\r\n\r\n", 1)
+        self.response = head.decode()
+        expected = base64.b64encode(hashlib.sha1((key + GUID).encode()).digest()).decode()
+        self.accepted = " 101 " in self.response and ("Sec-WebSocket-Accept: " + expected) in self.response
+
+    def send_frame(self, opcode, payload, fin=True):
+        mask = os.urandom(4)
+        header = bytes([(0x80 if fin else 0) | opcode])
+        if len(payload) < 126:
+            header += bytes([0x80 | len(payload)])
+        else:
+            header += bytes([0x80 | 126]) + struct.pack("!H", len(payload))
+        self.sock.sendall(header + mask + bytes(b ^ mask[i % 4] for i, b in enumerate(payload)))
+
+    def send(self, line):
+        self.send_frame(0x1, line.encode())
+
+    def frames(self, timeout=0.5):
+        """(opcode, payload) of everything that arrives within timeout"""
+        end = time.time() + timeout
+        while time.time() < end:
+            try:
+                data = self.sock.recv(65536)
+            except socket.timeout:
+                break
+            if not data:
+                break
+            self.buf += data
+        out = []
+        while len(self.buf) >= 2:
+            length = self.buf[1] & 0x7f
+            offset = 2
+            if length == 126:
+                length, = struct.unpack("!H", self.buf[2:4])
+                offset = 4
+            elif length == 127:
+                length, = struct.unpack("!Q", self.buf[2:10])
+                offset = 10
+            if len(self.buf) < offset + length:
+                break
+            out.append((self.buf[0] & 0x0f, self.buf[offset:offset + length]))
+            self.buf = self.buf[offset + length:]
+        return out
+
+    def lines(self, timeout=0.5):
+        return [payload.decode(errors="replace") for opcode, payload in self.frames(timeout) if opcode in (1, 2)]
+
+
+def tcp_client(port, nick):
+    s = socket.create_connection(("127.0.0.1", port))
+    s.sendall(("PASS %s\r\nNICK %s\r\nUSER %s 0 * :tcp\r\n" % (PASSWORD, nick, nick)).encode())
+    return s
+
+
+def tcp_read(s, timeout=0.5):
+    s.settimeout(timeout)
+    data = b""
+    try:
+        while True:
+            chunk = s.recv(65536)
+            if not chunk:
+                break
+            data += chunk
+    except socket.timeout:
+        pass
+    return data.decode(errors="replace")
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--binary", default="./ircserv")
+    parser.add_argument("--port", type=int, default=6694)
+    parser.add_argument("--ws-port", type=int, default=8094)
+    args = parser.parse_args()
+
+    env = dict(os.environ, IRC_WS_PORT=str(args.ws_port))
+    server = subprocess.Popen([os.path.abspath(args.binary), str(args.port), PASSWORD], cwd=tempfile.mkdtemp(),
+                              env=env, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        time.sleep(0.5)
+        ws = WsClient(args.ws_port, "text.ircv3.net")
+        check(ws.accepted and "Sec-WebSocket-Protocol: text.ircv3.net" in ws.response, "upgrade accepted")
+        for line in ("PASS " + PASSWORD, "NICK web", "USER web 0 * :browser"):
+            ws.send(line)
+        lines = ws.lines()
+        check(any(" 001 web " in line for line in lines), "registered over WebSocket")
+        check(all(not line.endswith("\r\n") for line in lines), "one line per frame, without CRLF")
+
+        tcp = tcp_client(args.port, "tcp")
+        tcp_read(tcp)
+        tcp.sendall(b"JOIN #w\r\n")
+        tcp_read(tcp)
+        ws.send("JOIN #w")
+        ws.lines()
+        tcp_read(tcp)
+        tcp.sendall(b"PRIVMSG #w :from tcp\r\n")
+        check(any(line.endswith("PRIVMSG #w :from tcp") for line in ws.lines()), "channel message reaches the WebSocket client")
+
+        ws.send_frame(0x1, b"PRIVMSG #w :from", fin=False)
+        ws.send_frame(0x0, b" web\r\n")
+        check("PRIVMSG #w :from web\r\n" in tcp_read(tcp), "fragmented message reaches the TCP client")
+
+        ws.send_frame(0x9, b"ka")
+        check((0xa, b"ka") in ws.frames(), "ping answered with pong")
+
+        binary = WsClient(args.ws_port, "binary.ircv3.net")
+        for line in ("PASS " + PASSWORD, "NICK bin", "USER bin 0 * :browser"):
+            binary.send_frame(0x2, line.encode())
+        frames = binary.frames()
+        check(binary.accepted and frames and all(opcode == 2 for opcode, _ in frames), "binary subprotocol uses binary frames")
+
+        s = socket.create_connection(("127.0.0.1", args.ws_port))
+        s.sendall(b"GET / HTTP/1.1\r\nHost: localhost\r\n\r\n")
+        check(tcp_read(s).startswith("HTTP/1.1 400"), "plain HTTP request rejected")
+
+        unmasked = WsClient(args.ws_port)
+        unmasked.sock.sendall(b"\x81\x04PING")
+        check((0x8, struct.pack("!H", 1002)) in unmasked.frames(), "unmasked frame closes with 1002")
+
+        ws.send_frame(0x8, struct.pack("!H", 1000))
+        check((0x8, struct.pack("!H", 1000)) in ws.frames(), "close handshake")
+        check("QUIT" in tcp_read(tcp), "closed client quits")
+    finally:
+        server.terminate()
+        server.wait()
+    print("ALL OK" if not failed else "SOME FAILED")
+
+
+if __name__ == "__main__":
+    main()